@@ -39,6 +39,7 @@ testScripts=(
     'txn_doublespend.py'
     'txn_doublespend.py --mineblock'
     'getchaintips.py'
+    'compactblocks.py'
     'rawtransactions.py'
     'rest.py'
     'mempool_spendcoinbase.py'
@@ -47,6 +48,8 @@ testScripts=(
     'mempool_nu_activation.py'
     'mempool_tx_expiry.py'
     'httpbasics.py'
+    'rpcqueue.py'
+    'rpcstats.py'
     'zapwallettxes.py'
     'proxy_test.py'
     'merkle_blocks.py'
@@ -0,0 +1,67 @@
+#!/usr/bin/env python2
+# Copyright (c) 2016 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test compact block relay: nodes 0 and 1 negotiate it through the
+# NODE_COMPACT_BLOCKS service bit, node 2 runs with -compactblocks=0 and
+# must keep receiving full blocks. Blocks carrying mempool transactions,
+# and ones the receivers have only partly seen, must propagate to all.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, start_node, connect_nodes_bi, \
+    sync_blocks, sync_mempools
+
+NODE_COMPACT_BLOCKS = (1 << 25)
+
+class CompactBlocksTest(BitcoinTestFramework):
+
+    def setup_network(self):
+        self.nodes = []
+        self.nodes.append(start_node(0, self.options.tmpdir, ["-debug=net", "-debug=cmpctblock"]))
+        self.nodes.append(start_node(1, self.options.tmpdir, ["-debug=net", "-debug=cmpctblock"]))
+        self.nodes.append(start_node(2, self.options.tmpdir, ["-debug=net", "-compactblocks=0"]))
+        connect_nodes_bi(self.nodes, 0, 1)
+        connect_nodes_bi(self.nodes, 0, 2)
+        self.is_network_split = False
+        self.sync_all()
+
+    def check_services(self):
+        for i in range(2):
+            assert(int(self.nodes[i].getnetworkinfo()['localservices'], 16) & NODE_COMPACT_BLOCKS)
+        assert_equal(int(self.nodes[2].getnetworkinfo()['localservices'], 16) & NODE_COMPACT_BLOCKS, 0)
+
+    def run_test(self):
+        self.check_services()
+
+        # Blocks made of mempool transactions known to every node
+        for i in range(3):
+            for j in range(5):
+                self.nodes[0].sendtoaddress(self.nodes[1 + j % 2].getnewaddress(), 1)
+            sync_mempools(self.nodes)
+            blockhash = self.nodes[0].generate(1)[0]
+            sync_blocks(self.nodes)
+            for node in self.nodes:
+                assert_equal(node.getbestblockhash(), blockhash)
+                assert_equal(len(node.getrawmempool()), 0)
+
+        # Transactions mined straight away have usually not been relayed yet,
+        # so the receivers fetch them with getblocktxn
+        txids = [ self.nodes[0].sendtoaddress(self.nodes[0].getnewaddress(), 1) for j in range(3) ]
+        blockhash = self.nodes[0].generate(1)[0]
+        sync_blocks(self.nodes)
+        for node in self.nodes:
+            assert_equal(node.getbestblockhash(), blockhash)
+            assert_equal(len(node.getblock(blockhash)['tx']), 1 + len(txids))
+
+        # Blocks mined by node 1 and node 2 reach everyone as well
+        self.nodes[1].generate(1)
+        sync_blocks(self.nodes)
+        self.nodes[2].generate(1)
+        sync_blocks(self.nodes)
+        assert_equal(self.nodes[0].getblockcount(), self.nodes[2].getblockcount())
+
+if __name__ == '__main__':
+    CompactBlocksTest().main()
@@ -0,0 +1,76 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 SuperNET developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the prioritized RPC work queue: -rpcpriority and -rpcmethodlimit
+# are reflected by getrpcqueueinfo, whose counters follow the single calls
+# made. A JSON-RPC batch is scheduled and counted once, as "(batch)",
+# whatever methods it contains.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, start_node
+
+import base64
+import json
+
+try:
+    import http.client as httplib
+except ImportError:
+    import httplib
+try:
+    import urllib.parse as urlparse
+except ImportError:
+    import urlparse
+
+class RPCQueueTest(BitcoinTestFramework):
+
+    def setup_network(self):
+        self.nodes = [ start_node(0, self.options.tmpdir, [
+            "-rpcpriority=getblockhash:low",
+            "-rpcpriority=getdifficulty:high",
+            "-rpcmethodlimit=getdifficulty:1",
+        ]) ]
+        self.is_network_split = False
+
+    def queue_info(self):
+        return dict((s['method'], s) for s in self.nodes[0].getrpcqueueinfo())
+
+    def run_test(self):
+        node = self.nodes[0]
+        for i in range(3):
+            node.getblockhash(0)
+            node.getdifficulty()
+        node.getblockcount()
+
+        info = self.queue_info()
+        assert_equal(info['getblockhash']['priority'], 'low')
+        assert_equal(info['getblockhash']['completed'], 3)
+        assert_equal(info['getdifficulty']['priority'], 'high')
+        assert_equal(info['getdifficulty']['limit'], 1)
+        assert_equal(info['getdifficulty']['completed'], 3)
+        assert_equal(info['getblockcount']['priority'], 'high')
+        assert_equal(info['getblockcount']['rejected'], 0)
+        # The getrpcqueueinfo call itself is being run
+        assert_equal(info['getrpcqueueinfo']['running'], 1)
+
+        # A batch is scheduled as one request, its calls don't count for their methods
+        before = self.queue_info()
+        assert('(batch)' not in before)
+        url = urlparse.urlparse(node.url)
+        headers = {"Authorization": "Basic " + base64.b64encode(url.username + ':' + url.password)}
+        conn = httplib.HTTPConnection(url.hostname, url.port)
+        conn.request('POST', '/', json.dumps([{"method": "getblockcount", "id": 1}, {"method": "getdifficulty", "id": 2}]), headers)
+        assert_equal(len(json.loads(conn.getresponse().read())), 2)
+        conn.close()
+        info = self.queue_info()
+        assert_equal(info['(batch)']['priority'], 'normal')
+        assert_equal(info['(batch)']['completed'], 1)
+        assert_equal(info['(batch)']['rejected'], 0)
+        for method in ['getblockcount', 'getdifficulty']:
+            assert_equal(info[method]['completed'], before[method]['completed'])
+
+if __name__ == '__main__':
+    RPCQueueTest().main()
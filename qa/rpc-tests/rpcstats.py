@@ -0,0 +1,73 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 SuperNET developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the per-command RPC statistics of getrpcstats, and their
+# Prometheus export at /metrics with -rpcprometheus.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.authproxy import JSONRPCException
+from test_framework.util import assert_equal, start_node
+
+import base64
+
+try:
+    import http.client as httplib
+except ImportError:
+    import httplib
+try:
+    import urllib.parse as urlparse
+except ImportError:
+    import urlparse
+
+class RPCStatsTest(BitcoinTestFramework):
+
+    def setup_network(self):
+        self.nodes = [ start_node(0, self.options.tmpdir, ["-rpcprometheus"]) ]
+        self.is_network_split = False
+
+    def get_metrics(self, auth=True):
+        url = urlparse.urlparse(self.nodes[0].url)
+        headers = {}
+        if auth:
+            headers["Authorization"] = "Basic " + base64.b64encode(url.username + ':' + url.password)
+        conn = httplib.HTTPConnection(url.hostname, url.port)
+        conn.request('GET', '/metrics', '', headers)
+        resp = conn.getresponse()
+        body = resp.read()
+        conn.close()
+        return resp.status, body
+
+    def run_test(self):
+        node = self.nodes[0]
+        for i in range(5):
+            node.getblockhash(0)
+        try:
+            node.getblockhash(100000)
+            raise AssertionError("getblockhash out of range succeeded")
+        except JSONRPCException:
+            pass
+
+        stats = node.getrpcstats("getblockhash")
+        assert_equal(stats.keys(), ["getblockhash"])
+        s = stats["getblockhash"]
+        assert_equal(s["calls"], 6)
+        assert_equal(s["errors"], 1)
+        assert(s["bytes_in"] > 0 and s["bytes_out"] > 0)
+        assert(s["p50_ms"] <= s["p99_ms"] <= s["max_ms"])
+        assert(s["cs_main_wait_ms"] >= 0)
+        assert("getblockhash" not in node.getrpcstats("getblockcount"))
+
+        status, body = self.get_metrics(auth=False)
+        assert_equal(status, 401)
+        status, body = self.get_metrics()
+        assert_equal(status, 200)
+        assert('rpc_calls_total{method="getblockhash"} 6' in body)
+        assert('rpc_errors_total{method="getblockhash"} 1' in body)
+        assert('rpc_duration_seconds_bucket{method="getblockhash",le="+Inf"} 6' in body)
+
+if __name__ == '__main__':
+    RPCStatsTest().main()
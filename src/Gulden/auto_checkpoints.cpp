@@ -161,7 +161,8 @@ namespace Checkpoints
 					return error("%s: ReadBlockFromDisk failed for sync checkpoint %s",  __func__, pendingCheckpoint.ToString());
 				}
 				CValidationState state;
-				if (!ActivateBestChain(true, state, &block))
+				// AcceptPendingSyncCheckpoint is called with cs_main held, so don't wait for the notification queue
+				if (!ActivateBestChain(true, state, &block, false))
 				{
 					invalidCheckpoint = pendingCheckpoint;
 					return error("%s: SetBestChain failed for sync checkpoint %s",  __func__, pendingCheckpoint.ToString());
@@ -285,7 +286,8 @@ namespace Checkpoints
 				return error("ResetSyncCheckpoint: ReadBlockFromDisk failed for hardened checkpoint %s", hash.ToString());
 			}
 			CValidationState state;
-			if (!ActivateBestChain(true, state, &block))
+			// callers may hold cs_main
+			if (!ActivateBestChain(true, state, &block, false))
 			{
 				return error("ResetSyncCheckpoint: ActivateBestChain failed for hardened checkpoint %s", hash.ToString());
 			}
@@ -666,7 +668,8 @@ bool CSyncChkptMessage::ProcessSyncCheckpoint(CNode* pfrom, const std::string &s
 		}
 
 		CValidationState state;
-		if (!ActivateBestChain(true, state, &block))
+		// ProcessMessage holds cs_main
+		if (!ActivateBestChain(true, state, &block, false))
 		{
 			Checkpoints::invalidCheckpoint = checkpoint;
 			sReasonOut = "could not activate best chain";
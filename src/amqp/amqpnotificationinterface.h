@@ -24,7 +24,7 @@ protected:
     void Shutdown();
 
     // CValidationInterface
-    void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
+    void SyncTransaction(const CTransaction &tx, const CBlock *pblock, const CBlockIndex *pindex);
     void UpdatedBlockTip(const CBlockIndex *pindex);
 
 private:
@@ -21,6 +21,7 @@
 #include "CCinclude.h"
 
 int32_t komodo_priceget(int64_t *buf64,int32_t ind,int32_t height,int32_t numblocks);
+int32_t komodo_pricesmoothed(int64_t *smoothed,int32_t ind,int32_t height,int32_t numblocks);
 extern void GetKomodoEarlytxidScriptPub();
 extern CScript KOMODO_EARLYTXID_SCRIPTPUB;
 
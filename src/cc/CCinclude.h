@@ -309,7 +309,7 @@ extern CWallet* pwalletMain;  //!< global wallet object pointer to access wallet
 //extern CCoinsViewCache *pcoinsTip;
 
 /// @private seems old-style
-bool GetAddressUnspent(uint160 addressHash, int type,std::vector<std::pair<CAddressUnspentKey,CAddressUnspentValue> > &unspentOutputs);
+bool GetAddressUnspent(uint160 addressHash, int type,std::vector<std::pair<CAddressUnspentKey,CAddressUnspentValue> > &unspentOutputs,const CAddressUnspentKey *pAfterKey,size_t nMaxResults);
 //CBlockIndex *komodo_getblockindex(uint256 hash);  //moved to komodo_def.h
 //int32_t komodo_nextheight();  //moved to komodo_def.h
 
@@ -376,7 +376,7 @@ bool myIsutxo_spentinmempool(uint256 &spenttxid,int32_t &spentvini,uint256 txid,
 bool myAddtomempool(CTransaction &tx, CValidationState *pstate = NULL, bool fSkipExpiry = false);
 bool mytxid_inmempool(uint256 txid);
 int32_t myIsutxo_spent(uint256 &spenttxid,uint256 txid,int32_t vout);
-int32_t myGet_mempool_txs(std::vector<CTransaction> &txs,uint8_t evalcode,uint8_t funcid);
+int32_t myGet_mempool_txs(std::vector<CTransaction> &txs,uint8_t evalcode,uint8_t funcid,const uint256 &reftxid = zeroid);
 /// \endcond
 
 /// \cond INTERNAL
@@ -737,10 +737,31 @@ static int64_t CheckTokensvout(bool goDeeper, bool checkPubkeys /*<--not used, a
 // If goDeeper param is true the func also validates input and output token amounts of the passed transaction: 
 // it should be either sum(cc vins) == sum(cc vouts) or the transaction is the 'tokenbase' ('c' or 'C') tx
 // checkPubkeys is true: validates if the vout is token vout1 or token vout1of2. Should always be true!
+// looks up a confirmed token vout in the token ownership index
+// the index is built with the tokens cp so it is used only for EVAL_TOKENS cp
+// a miss does not mean the vout is not a token vout, the caller should fall back to CheckTokensvout
+static bool GetIndexedTokensvout(struct CCcontract_info *cp, uint256 txid, int32_t v, uint256 &tokenid, CAmount &amount)
+{
+    CTokenIndexValue value;
+
+    if (!fTokenIndex || cp == NULL || cp->evalcode != EVAL_TOKENS || v < 0)
+        return false;
+    if (!GetTokenIndex(CTokenIndexKey(txid, v), value) || value.IsNull())
+        return false;
+    tokenid = value.tokenid;
+    amount = value.satoshis;
+    return true;
+}
+
 int64_t IsTokensvout(bool goDeeper, bool checkPubkeys /*<--not used, always true*/, struct CCcontract_info *cp, Eval* eval, const CTransaction& tx, int32_t v, uint256 reftokenid)
 {
     uint256 tokenIdInOpret;
     std::string errorStr;
+    CAmount indexedAmount;
+
+    if (GetIndexedTokensvout(cp, tx.GetHash(), v, tokenIdInOpret, indexedAmount))
+        return (reftokenid == tokenIdInOpret) ? indexedAmount : 0;
+
     CAmount retAmount = CheckTokensvout(goDeeper, checkPubkeys, cp, eval, tx, v, tokenIdInOpret, errorStr);
     if (!errorStr.empty())
         LOGSTREAMFN(cctokens_log, CCLOG_DEBUG1, stream << "error=" << errorStr << std::endl);
@@ -757,6 +778,54 @@ bool IsTokenMarkerVout(CTxOut vout) {
     return vout == MakeCC1vout(EVAL_TOKENS, vout.nValue, GetUnspendable(cpTokens, NULL));
 }
 
+// get owner pubkeys of a token vout from its opreturn: vout pubkeys for transfers, the originator pubkey for tokenbase
+static void GetTokensvoutOwners(const CTransaction &tx, int32_t v, std::vector<CPubKey> &owners)
+{
+    CScript opret;
+    uint256 tokenid;
+    std::vector<CPubKey> voutPubkeys;
+    std::vector<vscript_t> oprets;
+
+    if (!MyGetCCopretV2(tx.vout[v].scriptPubKey, opret))
+        opret = tx.vout.back().scriptPubKey;
+
+    uint8_t funcid = DecodeTokenOpRetV1(opret, tokenid, voutPubkeys, oprets);
+    if (IsTokenTransferFuncid(funcid))
+        FilterOutTokensUnspendablePk(voutPubkeys, owners);
+    else if (IsTokenCreateFuncid(funcid))
+    {
+        vscript_t vorigPubkey;
+        std::string dummyName, dummyDescription;
+
+        if (DecodeTokenCreateOpRetV1(opret, vorigPubkey, dummyName, dummyDescription, oprets) != 0)
+            owners.push_back(pubkey2pk(vorigPubkey));
+    }
+}
+
+void TokensIndexTransaction(const CTransaction &tx, int32_t height, std::vector<std::pair<CTokenIndexKey, CTokenIndexValue> > &tokenIndex)
+{
+    struct CCcontract_info *cp = NULL, C;
+    uint256 txid = tx.GetHash();
+
+    for (int32_t v = 0; v < tx.vout.size(); v ++)
+    {
+        if (!tx.vout[v].scriptPubKey.IsPayToCryptoCondition() || IsTokenMarkerVout(tx.vout[v]))
+            continue;
+        if (cp == NULL)
+            cp = CCinit(&C, EVAL_TOKENS);
+
+        uint256 tokenid;
+        std::string errorStr;
+        CAmount amount = CheckTokensvout(false, true, cp, NULL, tx, v, tokenid, errorStr);
+        if (amount <= 0 || tokenid.IsNull())
+            continue;
+
+        std::vector<CPubKey> owners;
+        GetTokensvoutOwners(tx, v, owners);
+        tokenIndex.push_back(std::make_pair(CTokenIndexKey(txid, v), CTokenIndexValue(tokenid, amount, owners, height)));
+    }
+}
+
 // compares cc inputs vs cc outputs (to prevent feeding vouts from normal inputs)
 bool TokensExactAmounts(bool goDeeper, struct CCcontract_info *cp, Eval* eval, const CTransaction &tx, std::string &errorStr)
 {
@@ -782,6 +851,16 @@ bool TokensExactAmounts(bool goDeeper, struct CCcontract_info *cp, Eval* eval, c
 	{												  // check for additional contracts which may send tokens to the Tokens contract
 		if ((*cp->ismyvin)(tx.vin[i].scriptSig) /*|| IsVinAllowed(tx.vin[i].scriptSig) != 0*/)
 		{
+            uint256 indexedTokenid;
+            CAmount indexedAmount;
+
+            // confirmed token vouts are already proven by the token index, no need to load and re-decode vintx
+            if (GetIndexedTokensvout(cp, tx.vin[i].prevout.hash, tx.vin[i].prevout.n, indexedTokenid, indexedAmount))
+            {
+                LOGSTREAM(cctokens_log, CCLOG_DEBUG1, stream << indentStr << "TokensExactAmounts() adding indexed vintx.vout for tx.vin[" << i << "] tokenoshis=" << indexedAmount << std::endl);
+                mapinputs[indexedTokenid] += indexedAmount;
+                continue;
+            }
 			//std::cerr << indentStr << "TokensExactAmounts() eval is true=" << (eval != NULL) << " ismyvin=ok for_i=" << i << std::endl;
 			// we are not inside the validation code -- dimxy
 			if ((eval && eval->GetTxUnconfirmed(tx.vin[i].prevout.hash, vinTx, hashBlock) == 0) || (!eval && !myGetTransaction(tx.vin[i].prevout.hash, vinTx, hashBlock)))
@@ -1035,6 +1114,30 @@ int64_t AddTokenCCInputs(struct CCcontract_info *cp, CMutableTransaction &mtx, c
 		if (ivin != mtx.vin.size()) // that is, the tx.vout is already added to mtx.vin (in some previous calls)
 			continue;
 
+        uint256 indexedTokenid;
+        CAmount indexedAmount;
+        if (GetIndexedTokensvout(cp, vintxid, vout, indexedTokenid, indexedAmount))
+        {
+            // confirmed token vout found in the token index, no need to load vintx
+            char destaddr[KOMODO_ADDRESS_BUFSIZE];
+            if (indexedTokenid != tokenid || !Getscriptaddress(destaddr, it->second.script) || strcmp(destaddr, tokenaddr) != 0)
+                continue;
+            if (myIsutxo_spentinmempool(ignoretxid, ignorevin, vintxid, vout) != 0)
+                continue;
+
+            if (total != 0 && maxinputs != 0)  // if it is not just to calc amount...
+                mtx.vin.push_back(CTxIn(vintxid, vout, CScript()));
+
+            nValue = it->second.satoshis;
+            totalinputs += nValue;
+            LOGSTREAM(cctokens_log, CCLOG_DEBUG1, stream << "AddTokenCCInputs() adding indexed input nValue=" << nValue  << std::endl);
+            n++;
+
+            if ((total > 0 && totalinputs >= total) || (maxinputs > 0 && n >= maxinputs))
+                break;
+            continue;
+        }
+
 		if (myGetTransaction(vintxid, vintx, hashBlock) != 0)
 		{
             char destaddr[64];
@@ -173,6 +173,13 @@ bool IsEqualVouts(const CTxOut &v1, const CTxOut &v2);
 
 bool TokensIsVer1Active(const Eval *eval);
 
+/// Collects token ownership index entries (tokenid, token amount and owner pubkeys) for the token vouts of a confirmed transaction
+/// Markers and vouts that are not valid token vouts are not indexed
+/// @param tx transaction being connected
+/// @param height height of the block that contains tx
+/// @param tokenIndex vector the entries are appended to
+void TokensIndexTransaction(const CTransaction &tx, int32_t height, std::vector<std::pair<CTokenIndexKey, CTokenIndexValue> > &tokenIndex);
+
 const char cctokens_log[] = "cctokens";
 
 #endif
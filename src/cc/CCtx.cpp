@@ -427,56 +427,71 @@ void NSPV_CCunspents(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentVa
 void NSPV_CCtxids(std::vector<std::pair<CAddressIndexKey, CAmount> > &txids,char *coinaddr,bool ccflag);
 void NSPV_CCtxids(std::vector<uint256> &txids,char *coinaddr,bool ccflag, uint8_t evalcode,uint256 filtertxid, uint8_t func);
 
-// set cc or normal unspents from mempool
-static void AddCCunspentsInMempool(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs, char *destaddr, bool isCC)
+// add cc or normal unspent outputs of memtx paying to destaddr
+static void AddCCunspentsFromTx(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs, char *destaddr, bool isCC, const CTransaction& memtx)
 {
-    // lock mempool
-    //ENTER_CRITICAL_SECTION(cs_main);
-    ENTER_CRITICAL_SECTION(mempool.cs);
-
-    for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
-        mi != mempool.mapTx.end(); ++mi)
+    for (int32_t i = 0; i < memtx.vout.size(); i++)
     {
-        const CTransaction& memtx = mi->GetTx();
-        for (int32_t i = 0; i < memtx.vout.size(); i++)
+        if (isCC && memtx.vout[i].scriptPubKey.IsPayToCryptoCondition() || !isCC && !memtx.vout[i].scriptPubKey.IsPayToCryptoCondition())
         {
-            if (isCC && memtx.vout[i].scriptPubKey.IsPayToCryptoCondition() || !isCC && !memtx.vout[i].scriptPubKey.IsPayToCryptoCondition())
+            uint256 dummytxid;
+            int32_t dummyvout;
+            if (!myIsutxo_spentinmempool(dummytxid, dummyvout, memtx.GetHash(), i))
             {
-                uint256 dummytxid;
-                int32_t dummyvout;
-                if (!myIsutxo_spentinmempool(dummytxid, dummyvout, memtx.GetHash(), i))
+                char voutaddr[64];
+                Getscriptaddress(voutaddr, memtx.vout[i].scriptPubKey);
+                if (strcmp(voutaddr, destaddr) == 0)
                 {
-                    char voutaddr[64];
-                    Getscriptaddress(voutaddr, memtx.vout[i].scriptPubKey);
-                    if (strcmp(voutaddr, destaddr) == 0)
-                    {
-                        uint160 hashBytes;
-                        std::string addrstr(destaddr);
-                        CBitcoinAddress address(addrstr);
-                        int type;
+                    uint160 hashBytes;
+                    std::string addrstr(destaddr);
+                    CBitcoinAddress address(addrstr);
+                    int type;
 
-                        if (address.GetIndexKey(hashBytes, type, isCC) == 0)
-                            continue;
+                    if (address.GetIndexKey(hashBytes, type, isCC) == 0)
+                        continue;
 
-                        // create unspent output key value pair
-                        CAddressUnspentKey key;
-                        CAddressUnspentValue value;
+                    // create unspent output key value pair
+                    CAddressUnspentKey key;
+                    CAddressUnspentValue value;
 
-                        key.type = type;
-                        key.hashBytes = hashBytes;
-                        key.txhash = memtx.GetHash();
-                        key.index = i;
+                    key.type = type;
+                    key.hashBytes = hashBytes;
+                    key.txhash = memtx.GetHash();
+                    key.index = i;
 
-                        value.satoshis = memtx.vout[i].nValue;
-                        value.blockHeight = 0;
-                        value.script = memtx.vout[i].scriptPubKey;
+                    value.satoshis = memtx.vout[i].nValue;
+                    value.blockHeight = 0;
+                    value.script = memtx.vout[i].scriptPubKey;
 
-                        unspentOutputs.push_back(std::make_pair(key, value));
-                    }
+                    unspentOutputs.push_back(std::make_pair(key, value));
                 }
             }
         }
     }
+}
+
+// set cc or normal unspents from mempool and from the block under validation
+static void AddCCunspentsInMempool(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs, char *destaddr, bool isCC)
+{
+    std::shared_ptr<const CBlockTxOverlay> overlay = GetBlockTxOverlay();
+    if (overlay)
+    {
+        BOOST_FOREACH(const CTransaction& blocktx, overlay->GetTransactions())
+            AddCCunspentsFromTx(unspentOutputs, destaddr, isCC, blocktx);
+    }
+
+    // lock mempool
+    //ENTER_CRITICAL_SECTION(cs_main);
+    ENTER_CRITICAL_SECTION(mempool.cs);
+
+    for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
+        mi != mempool.mapTx.end(); ++mi)
+    {
+        const CTransaction& memtx = mi->GetTx();
+        if (overlay && overlay->HaveTransaction(memtx.GetHash()))
+            continue;
+        AddCCunspentsFromTx(unspentOutputs, destaddr, isCC, memtx);
+    }
     LEAVE_CRITICAL_SECTION(mempool.cs);
     //LEAVE_CRITICAL_SECTION(cs_main);
 }
@@ -598,6 +613,15 @@ int64_t CCgettxout(uint256 txid,int32_t vout,int32_t mempoolflag,int32_t lockfla
     //fprintf(stderr,"CCgettxoud %s/v%d\n",txid.GetHex().c_str(),vout);
     if ( mempoolflag != 0 )
     {
+        CTransaction overlaytx;
+        std::shared_ptr<const CBlockTxOverlay> overlay = GetBlockTxOverlay();
+        if ( overlay && overlay->GetTransaction(txid, overlaytx) )
+        {
+            // output of a tx in the block under validation
+            if ( vout < 0 || vout >= overlaytx.vout.size() || myIsutxo_spentinmempool(ignoretxid,ignorevin,txid,vout) != 0 )
+                return(-1);
+            return(overlaytx.vout[vout].nValue);
+        }
         if ( lockflag != 0 )
         {
             LOCK(mempool.cs);
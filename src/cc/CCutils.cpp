@@ -659,37 +659,93 @@ int64_t CCOraclesGetDepositBalance(char const *logcategory,uint256 reforacletxid
 
 int32_t NSPV_coinaddr_inmempool(char const *logcategory,char *coinaddr,uint8_t CCflag);
 
+static bool mytx_hascoinaddrvout(const CTransaction &tx,char *coinaddr)
+{
+    char destaddr[64];
+    for (int32_t i=0; i<tx.vout.size(); i++)
+    {
+        Getscriptaddress(destaddr,tx.vout[i].scriptPubKey);
+        if ( strcmp(destaddr,coinaddr) == 0 )
+            return(true);
+    }
+    return(false);
+}
+
 int32_t myIs_coinaddr_inmempoolvout(char const *logcategory,uint256 txid,char *coinaddr)
 {
-    int32_t i,n; char destaddr[64];
     if ( KOMODO_NSPV_SUPERLITE )
         return(NSPV_coinaddr_inmempool(logcategory,coinaddr,0));
-    BOOST_FOREACH(const CTxMemPoolEntry &e,mempool.mapTx)
+    std::shared_ptr<const CBlockTxOverlay> overlay = GetBlockTxOverlay();
+    if ( overlay )
     {
-        const CTransaction &tx = e.GetTx();
-        if ( (n= tx.vout.size()) > 0 )
+        BOOST_FOREACH(const CTransaction &tx,overlay->GetTransactions())
         {
-            if (txid == tx.GetHash()) continue;
-            for (i=0; i<n; i++)
+            if ( txid != tx.GetHash() && mytx_hascoinaddrvout(tx,coinaddr) )
             {
-                Getscriptaddress(destaddr,tx.vout[i].scriptPubKey);
-                if ( strcmp(destaddr,coinaddr) == 0 )
-                {
-                    LogPrint(logcategory,"found (%s) vout in mempool\n",coinaddr);
-                    return(1);
-                }
+                LogPrint(logcategory,"found (%s) vout in block\n",coinaddr);
+                return(1);
             }
         }
     }
+    BOOST_FOREACH(const CTxMemPoolEntry &e,mempool.mapTx)
+    {
+        const CTransaction &tx = e.GetTx();
+        if ( txid != tx.GetHash() && mytx_hascoinaddrvout(tx,coinaddr) )
+        {
+            LogPrint(logcategory,"found (%s) vout in mempool\n",coinaddr);
+            return(1);
+        }
+    }
     return(0);
 }
 
 extern struct NSPV_mempoolresp NSPV_mempoolresult;
 extern bool NSPV_evalcode_inmempool(uint8_t evalcode,uint8_t funcid);
 
-int32_t myGet_mempool_txs(std::vector<CTransaction> &txs,uint8_t evalcode,uint8_t funcid)
+static CMempoolCCKey MempoolCCKey(const vscript_t &vopret)
 {
-    int i=0;
+    uint256 reftxid;
+    if ( vopret.size() >= 34 )
+        reftxid = uint256(std::vector<uint8_t>(vopret.begin()+2,vopret.begin()+34));
+    return(CMempoolCCKey(vopret[0],vopret[1],reftxid));
+}
+
+void GetMempoolCCKeys(const CTransaction &tx,std::vector<CMempoolCCKey> &keys)
+{
+    vscript_t vopret,vblob; std::vector<vscript_t> oprets; std::vector<CPubKey> pubkeys; uint256 tokenid; uint8_t funcid;
+    if ( tx.vout.size() == 0 || GetOpReturnData(tx.vout.back().scriptPubKey,vopret) == 0 || vopret.size() < 2 )
+        return;
+    if ( vopret[0] != EVAL_TOKENS )
+    {
+        keys.push_back(MempoolCCKey(vopret));
+        return;
+    }
+    // token oprets are found by tokenid, and by the opret of the module that wrapped its data in them
+    if ( (funcid= DecodeTokenOpRetV1(tx.vout.back().scriptPubKey,tokenid,pubkeys,oprets)) == 0 )
+    {
+        keys.push_back(MempoolCCKey(vopret));
+        return;
+    }
+    keys.push_back(CMempoolCCKey(EVAL_TOKENS,funcid,tokenid));
+    if ( GetOpReturnCCBlob(oprets,vblob) && vblob.size() >= 2 && vblob[0] != EVAL_TOKENS )
+        keys.push_back(MempoolCCKey(vblob));
+}
+
+static bool MempoolCCKeysMatch(const CTransaction &tx,uint8_t evalcode,uint8_t funcid,const uint256 &reftxid)
+{
+    std::vector<CMempoolCCKey> keys;
+    GetMempoolCCKeys(tx,keys);
+    for (std::vector<CMempoolCCKey>::const_iterator it=keys.begin(); it!=keys.end(); it++)
+    {
+        if ( it->evalcode == evalcode && (funcid == 0 || it->funcid == funcid) && (reftxid.IsNull() || it->reftxid == reftxid) )
+            return(true);
+    }
+    return(false);
+}
+
+int32_t myGet_mempool_txs(std::vector<CTransaction> &txs,uint8_t evalcode,uint8_t funcid,const uint256 &reftxid)
+{
+    int i=0; std::vector<uint256> txids; CTransaction tx;
 
     if ( KOMODO_NSPV_SUPERLITE )
     {
@@ -702,10 +758,27 @@ int32_t myGet_mempool_txs(std::vector<CTransaction> &txs,uint8_t evalcode,uint8_
         }
         return (NSPV_mempoolresult.numtxids);
     }
-    BOOST_FOREACH(const CTxMemPoolEntry &e,mempool.mapTx)
+    std::shared_ptr<const CBlockTxOverlay> overlay = GetBlockTxOverlay();
+    if ( overlay )
     {
-        txs.push_back(e.GetTx());
-        i++;
+        BOOST_FOREACH(const CTransaction &tx,overlay->GetTransactions())
+        {
+            if ( !MempoolCCKeysMatch(tx,evalcode,funcid,reftxid) )
+                continue;
+            txs.push_back(tx);
+            i++;
+        }
+    }
+    mempool.getCCIndex(evalcode,funcid,reftxid,txids);
+    BOOST_FOREACH(const uint256 &txid,txids)
+    {
+        if ( overlay && overlay->HaveTransaction(txid) )
+            continue;
+        if ( mempool.lookup(txid,tx) )
+        {
+            txs.push_back(tx);
+            i++;
+        }
     }
     return(i);
 }
@@ -961,14 +1034,17 @@ bool ProcessCC(struct CCcontract_info *cp,Eval* eval, std::vector<uint8_t> param
         return eval->Invalid("Cannot have params");
     //else if ( ctx.vout.size() == 0 )      // spend can go to z-addresses
     //    return eval->Invalid("no-vouts");
-    else if ( (*cp->validate)(cp,eval,ctx,nIn) != 0 )
-    {
-        //fprintf(stderr,"done CC %02x\n",cp->evalcode);
-        //cp->prevtxid = txid;
-        return(true);
-    }
-    //fprintf(stderr,"invalid CC %02x\n",cp->evalcode);
-    return(false);
+    // validators check the whole tx, so reuse the result for other cc vins of the same eval code
+    bool result;
+    std::shared_ptr<CCValidationMemo> memo = GetCCValidationMemo();
+    if ( memo && memo->Lookup(ctx.GetHash(),cp->evalcode,result,eval->state) )
+        return(result);
+    result = (*cp->validate)(cp,eval,ctx,nIn) != 0;
+    if ( memo )
+        memo->Store(ctx.GetHash(),cp->evalcode,result,eval->state);
+    //if ( result != 0 ) fprintf(stderr,"done CC %02x\n",cp->evalcode);
+    //else fprintf(stderr,"invalid CC %02x\n",cp->evalcode);
+    return(result);
 }
 
 extern struct CCcontract_info CCinfos[0x100];
@@ -34,12 +34,84 @@ Eval* EVAL_TEST = 0;
 struct CCcontract_info CCinfos[0x100];
 extern pthread_mutex_t KOMODO_CC_mutex;
 
+// cc modules audited to be safe for concurrent validation: their validators only read the
+// block tx overlay, the mempool (under its own lock), the leveldb indexes, block files and the
+// block index, and keep no state in globals or in the shared CCinfos entry.
+// Validators calling CCgettxout() on pcoinsTip (whose cache is filled on read) are not safe.
+static const uint8_t CCParallelEvalCodes[] = { EVAL_FAUCET };
+
+bool CCIsParallelEvalSafe(uint8_t evalcode)
+{
+    static const bool fEnabled = GetBoolArg("-ccparalleleval", true);
+    if ( !fEnabled || EVAL_TEST != 0 )
+        return false;
+    for (int32_t i=0; i<sizeof(CCParallelEvalCodes)/sizeof(*CCParallelEvalCodes); i++)
+        if ( CCParallelEvalCodes[i] == evalcode )
+            return true;
+    return false;
+}
+
+// per thread, so mempool acceptance and block connection never share results
+static thread_local std::shared_ptr<CCValidationMemo> pccvalidationmemo;
+
+bool CCValidationMemo::Lookup(const uint256 &txid, uint8_t evalcode, bool &result, CValidationState &state) const
+{
+    LOCK(cs);
+    std::map<Key, std::pair<bool, CValidationState> >::const_iterator it = mapResults.find(std::make_pair(txid, evalcode));
+    if ( it == mapResults.end() )
+        return false;
+    result = it->second.first;
+    state = it->second.second;
+    return true;
+}
+
+void CCValidationMemo::Store(const uint256 &txid, uint8_t evalcode, bool result, const CValidationState &state)
+{
+    LOCK(cs);
+    mapResults[std::make_pair(txid, evalcode)] = std::make_pair(result, state);
+}
+
+std::shared_ptr<CCValidationMemo> GetCCValidationMemo()
+{
+    return pccvalidationmemo;
+}
+
+CCValidationMemoScope::CCValidationMemoScope(bool fEnable, int32_t context) : fInstalled(false)
+{
+    if ( !fEnable || EVAL_TEST != 0 || (pccvalidationmemo && pccvalidationmemo->GetContext() == context) )
+        return;
+    prevmemo = pccvalidationmemo;
+    pccvalidationmemo = std::make_shared<CCValidationMemo>(context);
+    fInstalled = true;
+}
+
+CCValidationMemoScope::CCValidationMemoScope(const std::shared_ptr<CCValidationMemo> &memo) : fInstalled(false)
+{
+    if ( !memo || pccvalidationmemo == memo )
+        return;
+    prevmemo = pccvalidationmemo;
+    pccvalidationmemo = memo;
+    fInstalled = true;
+}
+
+CCValidationMemoScope::~CCValidationMemoScope()
+{
+    if ( fInstalled )
+        pccvalidationmemo = prevmemo;
+}
+
 bool RunCCEval(const CC *cond, const CTransaction &tx, unsigned int nIn, CValidationState *pstateCC)
 {
     EvalRef eval;
-    pthread_mutex_lock(&KOMODO_CC_mutex);
-    bool out = eval->Dispatch(cond, tx, nIn);
-    pthread_mutex_unlock(&KOMODO_CC_mutex);
+    bool out;
+    if ( cond->codeLength > 0 && CCIsParallelEvalSafe(cond->code[0]) )
+        out = eval->Dispatch(cond, tx, nIn);
+    else
+    {
+        pthread_mutex_lock(&KOMODO_CC_mutex);
+        out = eval->Dispatch(cond, tx, nIn);
+        pthread_mutex_unlock(&KOMODO_CC_mutex);
+    }
 
     if (pstateCC)   {
         *pstateCC = eval->state; // return cc validation state
@@ -75,7 +147,7 @@ bool RunCCEval(const CC *cond, const CTransaction &tx, unsigned int nIn, CValida
  */
 bool Eval::Dispatch(const CC *cond, const CTransaction &txTo, unsigned int nIn)
 {
-    struct CCcontract_info *cp;
+    struct CCcontract_info *cp,C;
     if (cond->codeLength == 0)
         return Invalid("empty-eval");
 
@@ -97,11 +169,19 @@ bool Eval::Dispatch(const CC *cond, const CTransaction &txTo, unsigned int nIn)
             return CClib_Dispatch(cond,this,vparams,txTo,nIn);
         else return Invalid("mismatched -ac_cclib vs CClib_name");
     }
-    cp = &CCinfos[(int32_t)ecode];
-    if ( cp->didinit == 0 )
+    if ( CCIsParallelEvalSafe(ecode) )
     {
-        CCinit(cp,ecode);
-        cp->didinit = 1;
+        // validators may change cp (CCaddr2set etc), so concurrent ones get their own copy
+        cp = CCinit(&C,ecode);
+    }
+    else
+    {
+        cp = &CCinfos[(int32_t)ecode];
+        if ( cp->didinit == 0 )
+        {
+            CCinit(cp,ecode);
+            cp->didinit = 1;
+        }
     }
 
     switch ( ecode )
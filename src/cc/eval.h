@@ -24,6 +24,10 @@
 #include "version.h"
 #include "consensus/validation.h"
 #include "primitives/transaction.h"
+#include "sync.h"
+
+#include <map>
+#include <memory>
 
 #define KOMODO_FIRSTFUNGIBLEID 100
 
@@ -142,6 +146,59 @@ public:
  */ 
 bool RunCCEval(const CC *cond, const CTransaction &tx, unsigned int nIn, CValidationState *pstateCC = nullptr);
 
+/**
+ * check if the validator for an evalcode is audited to run concurrently with other validators
+ * (on the script check threads) without holding KOMODO_CC_mutex
+ * @param evalcode eval code of the cc module
+ */
+bool CCIsParallelEvalSafe(uint8_t evalcode);
+
+
+/*
+ * Results of cc validators within one validation context (a block being connected or a tx
+ * being accepted to the mempool). The validators check the whole tx whatever cc vin they are
+ * called for, so a tx spending many cc vins of the same eval code is validated once.
+ * The context is the KOMODO_CONNECTING value the validation runs with: the block height, or
+ * (1<<30) + the next height for the mempool. A memo belongs to one context only.
+ */
+class CCValidationMemo
+{
+public:
+    CCValidationMemo(int32_t contextIn) : context(contextIn) {}
+
+    int32_t GetContext() const { return context; }
+    bool Lookup(const uint256 &txid, uint8_t evalcode, bool &result, CValidationState &state) const;
+    void Store(const uint256 &txid, uint8_t evalcode, bool result, const CValidationState &state);
+
+private:
+    typedef std::pair<uint256, uint8_t> Key;
+    const int32_t context;
+    mutable CCriticalSection cs; // shared by the script check threads of one block
+    std::map<Key, std::pair<bool, CValidationState> > mapResults;
+};
+
+/*
+ * Get the memo of the validation context open on the calling thread, empty if none is open
+ */
+std::shared_ptr<CCValidationMemo> GetCCValidationMemo();
+
+/*
+ * Opens a validation context memo on the calling thread while in scope. A nested scope with
+ * the same context shares the outer memo, one with another context gets its own. The second
+ * form hands a memo to a script check thread validating inputs for the thread that opened it.
+ */
+class CCValidationMemoScope
+{
+public:
+    CCValidationMemoScope(bool fEnable, int32_t context);
+    CCValidationMemoScope(const std::shared_ptr<CCValidationMemo> &memo);
+    ~CCValidationMemoScope();
+
+private:
+    bool fInstalled;
+    std::shared_ptr<CCValidationMemo> prevmemo;
+};
+
 
 /*
  * Virtual machine to use in the case of on-chain app evaluation
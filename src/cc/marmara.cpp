@@ -6016,7 +6016,7 @@ UniValue MarmaraAmountStatSnapshot(int32_t beginHeight, int32_t endHeight)
     CAmount activated = 0LL;
     CAmount ccunk = 0LL;
 
-    if (!pblocktree->ReadAllUnspentIndex(unspentOutputs))  {
+    if (paddressindexdb == NULL || !SyncIndexes() || !paddressindexdb->ReadAllUnspentIndex(unspentOutputs))  {
         result.push_back(Pair("result", "error"));
         result.push_back(Pair("error", "could not get snapshot"));
         return result;
@@ -1087,7 +1087,7 @@ UniValue OracleDataSamples(uint256 reforacletxid,char* batonaddr,int32_t num)
         if ( DecodeOraclesCreateOpRet(oracletx.vout[numvouts-1].scriptPubKey,name,description,format) == 'C' )
         {
             std::vector<CTransaction> tmp_txs;
-            myGet_mempool_txs(tmp_txs,EVAL_ORACLES,'D');
+            myGet_mempool_txs(tmp_txs,EVAL_ORACLES,'D',reforacletxid);
             for (std::vector<CTransaction>::const_iterator it=tmp_txs.begin(); it!=tmp_txs.end(); it++)
             {
                 const CTransaction &txmempool = *it;
@@ -111,6 +111,10 @@ static std::map<int32_t, std::string> parse_errors{
 #define PRICESCC_ERR_MEMORY (-15)
 #define PRICESCC_ERR_CANT_GET_PRICES (-16)
 
+// heights of synthetic prices evaluated at once by prices_scanchain, the chunk grows while the scan goes on
+#define PRICES_SCANCHAIN_MINCHUNK 16
+#define PRICES_SCANCHAIN_MAXCHUNK 1024
+
 static std::map<int32_t, std::string> calc_errors{
     { PRICESCC_ERR_CANT_GET_PRICES, "could not get prices (end of the chain is possible)" },
     { PRICESCC_BAD_EXPR_WEIGHT, "bad operands for weight opcode" },
@@ -1045,23 +1049,61 @@ int32_t prices_syntheticvec(std::vector<uint16_t> &vec, std::vector<std::string>
     return(0);
 }
 
-// calculates price for synthetic expression
-int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t minmax, int16_t leverage)
+// reports the outcome of a synthetic price evaluation, shared by the int64 and the bignum evaluation
+static int64_t prices_syntheticpriceresult(int32_t errcode, int64_t den, int32_t depth, int64_t priceIndex, bool fLog)
 {
-    int32_t i, int32value, errcode, depth, retval = PRICESCC_ERR_CANT_GET_PRICES;
+    if (errcode != 0 && fLog) 
+        LOGSTREAMFN("prices", CCLOG_ERROR, stream << "errcode in switch=" << errcode << std::endl);
+    
+    if( errcode == PRICESCC_ERR_CANT_GET_PRICES )  {
+        if (fLog)
+            LOGSTREAMFN("prices", CCLOG_INFO, stream << "error getting price (could be end of chain)" << std::endl);
+        return errcode;
+    }
+
+    if (errcode == PRICESCC_OVERFLOW) {
+        if (fLog)
+            LOGSTREAMFN("prices", CCLOG_ERROR, stream << "overflow in price" << std::endl);
+        return errcode;
+    }
+    if (errcode == PRICESCC_PRICE_IS_NULL) {
+        if (fLog)
+            LOGSTREAMFN("prices", CCLOG_INFO, stream << "price is zero, not enough historical data yet or end of chain reached" << std::endl);
+        return errcode;
+    }
+    if (den == 0) {
+        if (fLog)
+            LOGSTREAMFN("prices", CCLOG_ERROR, stream << "den==0 in expr" << std::endl);
+        return PRICESCC_EMPTY_TOTAL_WEIGHT;
+    }
+    else if (depth != 0) {
+        if (fLog)
+            LOGSTREAMFN("prices", CCLOG_ERROR, stream << "depth!=0 in expr" << std::endl);
+        return PRICESCC_EXTRA_DATA_IN_STACK;
+    }
+    else if (errcode != 0) {
+        if (fLog)
+            LOGSTREAMFN("prices", CCLOG_ERROR, stream << "unknown err=" << errcode << std::endl);
+        return(errcode);
+    }
+    if (fLog)
+        LOGSTREAMFN("prices", CCLOG_DEBUG1, stream << "priceIndex=totalprice/den=" << priceIndex << " den=" << den << std::endl);
+
+    return priceIndex;
+}
+
+// calculates price for synthetic expression at one height with bignum arithmetic
+// used by prices_syntheticprices() for the heights where int64 arithmetic would overflow
+static int64_t prices_syntheticprice_mpz(const std::vector<uint16_t> &vec, int32_t height, bool fLog)
+{
+    int32_t i, int32value, errcode, depth;
     uint16_t opcode;
 
     // TODO: maybe to do this variables as mpz too?
-    int64_t *pricedata, pricestack[4], a, b, c;
+    int64_t pricedata = 0, pricestack[4], a, b, c;
 
     mpz_t mpzTotalPrice, mpzPriceValue, mpzDen, mpzA, mpzB, mpzC, mpzResult, mpzMAXINT64;
 
-    pricedata = (int64_t *)calloc(sizeof(*pricedata) * 3, 1 + PRICES_DAYWINDOW * 2 + PRICES_SMOOTHWIDTH);
-    if (pricedata == NULL) {
-        LOGSTREAMFN("prices", CCLOG_INFO, stream << "could not alloc memory" << std::endl);
-        return PRICESCC_ERR_MEMORY;
-    }
-
     mpz_init(mpzTotalPrice);
     mpz_init(mpzPriceValue);
     mpz_init(mpzDen);
@@ -1084,27 +1126,13 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
 
         mpz_set_ui64(mpzResult, 0);  // clear result to test overflow (see below)
 
-        //LOGSTREAMFN("prices", CCLOG_DEBUG1, stream << "i=" << i << " mpzTotalPrice=" << mpz_get_si64(mpzTotalPrice) << " value=" << value << " depth=" << depth <<  " opcode&KOMODO_PRICEMASK=" << (opcode & KOMODO_PRICEMASK) <<std::endl);
         switch (opcode & KOMODO_PRICEMASK)
         {
         case 0: // indices 
             pricestack[depth] = 0;
-            if (komodo_priceget(pricedata, int32value, height, 1) >= 0)
-            {
-                // LOGSTREAMFN("prices", CCLOG_DEBUG1, stream << "pricedata[0]=" << pricedata[0] << " pricedata[1]=" << pricedata[1] << " pricedata[2]=" << pricedata[2] << std::endl);
-                // push price to the prices stack
-                /*if (!minmax)
-                    pricestack[depth] = pricedata[2];   // use smoothed value if we are over 24h
-                else
-                {
-                    // if we are within 24h use min or max price
-                    if (leverage > 0)
-                        pricestack[depth] = (pricedata[1] > pricedata[2]) ? pricedata[1] : pricedata[2]; // MAX
-                    else
-                        pricestack[depth] = (pricedata[1] < pricedata[2]) ? pricedata[1] : pricedata[2]; // MIN
-                }*/
-                pricestack[depth] = pricedata[2];
-            }
+            // if there is no prices file for the index the previous price is reused
+            if (komodo_pricesmoothed(&pricedata, int32value, height, 1) != 0)
+                pricestack[depth] = pricedata;  // smoothed value
             else
                 errcode = PRICESCC_ERR_CANT_GET_PRICES;
 
@@ -1255,7 +1283,6 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
             break;
         }
 
-        // LOGSTREAMFN("prices", CCLOG_DEBUG1, stream << "test mpzResult=" << mpz_get_si64(mpzResult) << std::endl);
         // check overflow:
         if (mpz_cmp(mpzResult, mpzMAXINT64) > 0) {
             errcode = PRICESCC_OVERFLOW;
@@ -1264,14 +1291,7 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
 
         if (errcode != 0)
             break;
-
- //       if( depth > 0 )
- //           LOGSTREAMFN("prices", CCLOG_DEBUG1, stream << "top pricestack[depth-1=" << depth-1 << "]=" << pricestack[depth-1] << std::endl);
- //       else
- //           LOGSTREAMFN("prices", CCLOG_DEBUG1, stream << "pricestack empty" << std::endl);
-
     }
-    free(pricedata);
 
     mpz_clear(mpzMAXINT64);
     mpz_clear(mpzResult);
@@ -1289,43 +1309,225 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
     mpz_clear(mpzTotalPrice);
     mpz_clear(mpzPriceValue);
 
-    if (errcode != 0) 
-        LOGSTREAMFN("prices", CCLOG_ERROR, stream << "errcode in switch=" << errcode << std::endl);
-    
-    if( errcode == PRICESCC_ERR_CANT_GET_PRICES )  {
-        LOGSTREAMFN("prices", CCLOG_INFO, stream << "error getting price (could be end of chain)" << std::endl);
-        return errcode;
-    }
+    return prices_syntheticpriceresult(errcode, den, depth, priceIndex, fLog);
+}
 
-    if (errcode == PRICESCC_OVERFLOW) {
-        LOGSTREAMFN("prices", CCLOG_ERROR, stream << "overflow in price" << std::endl);
-        return errcode;
-    }
-    if (errcode == PRICESCC_PRICE_IS_NULL) {
-        LOGSTREAMFN("prices", CCLOG_INFO, stream << "price is zero, not enough historical data yet or end of chain reached" << std::endl);
-        return errcode;
-    }
-    if (den == 0) {
-        LOGSTREAMFN("prices", CCLOG_ERROR, stream << "den==0 in expr" << std::endl);
-        return PRICESCC_EMPTY_TOTAL_WEIGHT;
-    }
-    else if (depth != 0) {
-        LOGSTREAMFN("prices", CCLOG_ERROR, stream << "depth!=0 in expr" << std::endl);
-        return PRICESCC_EXTRA_DATA_IN_STACK;
+// int64 helpers for the synthetic price kernel, they return false if the bignum evaluation is needed
+static inline bool prices_mul64(int64_t a, int64_t b, int64_t &r)
+{
+    return !__builtin_mul_overflow(a, b, &r);
+}
+
+static inline bool prices_div64(int64_t a, int64_t b, int64_t &r)
+{
+    if (b == 0 || (b == -1 && a == std::numeric_limits<int64_t>::min()))
+        return false;
+    r = a / b;  // truncates like mpz_tdiv_q
+    return true;
+}
+
+// calculates prices for synthetic expression at heights firstheight .. firstheight+numheights-1 in one pass
+// the expression is evaluated column-wise over the heights in int64 arithmetic, heights where it would overflow are re-evaluated with bignums
+// prices[i] is set to exactly what prices_syntheticprice() returns for firstheight+i, errors are logged for single height requests only
+static void prices_syntheticprices(std::vector<int64_t> &prices, const std::vector<uint16_t> &vec, int32_t firstheight, int32_t numheights)
+{
+    enum { LIVE = 0, STOPPED, USEMPZ };
+
+    // scratch buffers reused between calls
+    thread_local std::vector<int64_t> pricestack[4], totals, lastprices, smoothed, dens;
+    thread_local std::vector<int32_t> errcodes, depths;
+    thread_local std::vector<uint8_t> states;
+
+    const int64_t SATOSHIDEN2 = (int64_t)SATOSHIDEN * (int64_t)SATOSHIDEN;
+    int32_t i, k, n, int32value, depth = 0, nlive = numheights;
+    int64_t den = 0;
+    uint16_t opcode;
+    bool fLog = (numheights == 1);
+
+    prices.assign(std::max(numheights, 0), 0);
+    if (numheights <= 0)
+        return;
+
+    for (i = 0; i < 4; i++)
+        pricestack[i].resize(numheights);
+    smoothed.resize(numheights);
+    totals.assign(numheights, 0);
+    lastprices.assign(numheights, 0);
+    dens.assign(numheights, 0);
+    errcodes.assign(numheights, 0);
+    depths.assign(numheights, 0);
+    states.assign(numheights, LIVE);
+
+    for (i = 0; i < vec.size() && nlive > 0; i++)
+    {
+        opcode = vec[i];
+        int32value = (opcode & (KOMODO_MAXPRICES - 1));   // index or weight 
+
+        switch (opcode & KOMODO_PRICEMASK)
+        {
+        case 0: // indices 
+            if (depth >= 4) {
+                // the bignum evaluation has only 4 stack slots too, let it behave as it does
+                for (k = 0; k < numheights; k++)
+                    if (states[k] == LIVE)
+                        states[k] = USEMPZ;
+                break;
+            }
+            n = komodo_pricesmoothed(&smoothed[0], int32value, firstheight, numheights);
+            for (k = 0; k < numheights; k++)
+            {
+                if (states[k] != LIVE)
+                    continue;
+                if (n < 0)
+                    pricestack[depth][k] = lastprices[k];  // no prices file for the index, previous price is reused
+                else if (k < n)
+                    pricestack[depth][k] = lastprices[k] = smoothed[k];
+                else
+                    pricestack[depth][k] = 0;
+                if (pricestack[depth][k] == 0)
+                    errcodes[k] = PRICESCC_PRICE_IS_NULL;
+            }
+            depth++;
+            break;
+
+        case PRICES_WEIGHT: // multiply by weight and consume top of stack by updating price
+            if (depth == 1) {
+                depth--;
+                for (k = 0; k < numheights; k++)
+                {
+                    int64_t value;
+                    if (states[k] != LIVE)
+                        continue;
+                    if (!prices_mul64(pricestack[0][k], int32value, value) || __builtin_add_overflow(totals[k], value, &totals[k]))
+                        states[k] = USEMPZ;
+                }
+                den += int32value;
+            }
+            else
+                std::replace(errcodes.begin(), errcodes.end(), 0, PRICESCC_BAD_EXPR_WEIGHT);
+            break;
+
+        case PRICES_MULT:   // "*"
+        case PRICES_DIV:    // "/"
+            if (depth >= 2) {
+                const std::vector<int64_t> &a = pricestack[depth - 2], &b = pricestack[depth - 1];
+                std::vector<int64_t> &r = pricestack[depth - 2];
+                for (k = 0; k < numheights; k++)
+                {
+                    int64_t t;
+                    if (states[k] != LIVE)
+                        continue;
+                    if ((opcode & KOMODO_PRICEMASK) == PRICES_MULT) {
+                        if (!(prices_mul64(a[k], b[k], t) && prices_div64(t, SATOSHIDEN, r[k])))
+                            states[k] = USEMPZ;
+                    }
+                    else if (!(prices_mul64(a[k], SATOSHIDEN, t) && prices_div64(t, b[k], r[k])))
+                        states[k] = USEMPZ;
+                }
+                depth--;
+            }
+            else
+                std::replace(errcodes.begin(), errcodes.end(), 0, (opcode & KOMODO_PRICEMASK) == PRICES_MULT ? PRICESCC_BAD_EXPR_MUL : PRICESCC_BAD_EXPR_DIV);
+            break;
+
+        case PRICES_INV:    // "!"
+            if (depth >= 1) {
+                std::vector<int64_t> &a = pricestack[depth - 1];
+                for (k = 0; k < numheights; k++)
+                    if (states[k] == LIVE && !prices_div64(SATOSHIDEN2, a[k], a[k]))
+                        states[k] = USEMPZ;
+            }
+            else
+                std::replace(errcodes.begin(), errcodes.end(), 0, PRICESCC_BAD_EXPR_INV);
+            break;
+
+        case PRICES_MDD:    // "*//"
+        case PRICES_MMD:    // "**/"
+        case PRICES_MMM:    // "***"
+        case PRICES_DDD:    // "///"
+            if (depth >= 3) {
+                const std::vector<int64_t> &a = pricestack[depth - 3], &b = pricestack[depth - 2], &c = pricestack[depth - 1];
+                std::vector<int64_t> &r = pricestack[depth - 3];
+                for (k = 0; k < numheights; k++)
+                {
+                    int64_t t;
+                    bool ok = false;
+                    if (states[k] != LIVE)
+                        continue;
+                    switch (opcode & KOMODO_PRICEMASK)
+                    {
+                    case PRICES_MDD:  // (((a * SATOSHIDEN) / b) * SATOSHIDEN) / c
+                        ok = prices_mul64(a[k], SATOSHIDEN, t) && prices_div64(t, b[k], t) && prices_mul64(t, SATOSHIDEN, t) && prices_div64(t, c[k], r[k]);
+                        break;
+                    case PRICES_MMD:  // (a * b) / c
+                        ok = prices_mul64(a[k], b[k], t) && prices_div64(t, c[k], r[k]);
+                        break;
+                    case PRICES_MMM:  // (((a * b) / SATOSHIDEN ) * c) / SATOSHIDEN
+                        ok = prices_mul64(a[k], b[k], t) && prices_div64(t, SATOSHIDEN, t) && prices_mul64(t, c[k], t) && prices_div64(t, SATOSHIDEN, r[k]);
+                        break;
+                    case PRICES_DDD:  // (((((SATOSHIDEN * SATOSHIDEN) / a) * SATOSHIDEN) / b) * SATOSHIDEN) / c
+                        ok = prices_div64(SATOSHIDEN2, a[k], t) && prices_mul64(t, SATOSHIDEN, t) && prices_div64(t, b[k], t) && prices_mul64(t, SATOSHIDEN, t) && prices_div64(t, c[k], r[k]);
+                        break;
+                    }
+                    if (!ok)
+                        states[k] = USEMPZ;
+                }
+                depth -= 2;
+            }
+            else {
+                int32_t err = PRICESCC_BAD_EXPR_DDD;
+                switch (opcode & KOMODO_PRICEMASK)
+                {
+                case PRICES_MDD: err = PRICESCC_BAD_EXPR_MDD; break;
+                case PRICES_MMD: err = PRICESCC_BAD_EXPR_MMD; break;
+                case PRICES_MMM: err = PRICESCC_BAD_EXPR_MMM; break;
+                }
+                std::replace(errcodes.begin(), errcodes.end(), 0, err);
+            }
+            break;
+
+        default:
+            std::replace(errcodes.begin(), errcodes.end(), 0, PRICESCC_BAD_OPCODE);
+            break;
+        }
+
+        // stop evaluating heights with errors, keeping the stack depth and weight total they stopped at
+        for (k = 0; k < numheights; k++)
+        {
+            if (states[k] == LIVE && errcodes[k] != 0) {
+                states[k] = STOPPED;
+                depths[k] = depth;
+                dens[k] = den;
+            }
+            if (states[k] != LIVE && states[k] != STOPPED)
+                errcodes[k] = 0;
+        }
+        nlive = std::count(states.begin(), states.end(), (uint8_t)LIVE);
     }
-    else if (errcode != 0) {
-        LOGSTREAMFN("prices", CCLOG_ERROR, stream << "unknown err=" << errcode << std::endl);
-        return(errcode);
+
+    for (k = 0; k < numheights; k++)
+    {
+        if (states[k] == USEMPZ)
+            prices[k] = prices_syntheticprice_mpz(vec, firstheight + k, fLog);
+        else if (states[k] == STOPPED)
+            prices[k] = prices_syntheticpriceresult(errcodes[k], dens[k], depths[k], 0, fLog);
+        else
+            prices[k] = prices_syntheticpriceresult(0, den, depth, den != 0 ? totals[k] / den : totals[k], fLog);
     }
-    LOGSTREAMFN("prices", CCLOG_DEBUG1, stream << "priceIndex=totalprice/den=" << priceIndex << " den=" << den << std::endl);
+}
 
-    return priceIndex;
+// calculates price for synthetic expression
+int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t minmax, int16_t leverage)
+{
+    std::vector<int64_t> prices;
+
+    prices_syntheticprices(prices, vec, height, 1);
+    return prices[0];
 }
 
-// calculates costbasis and profit/loss for the bet
-int32_t prices_syntheticprofits(int64_t &costbasis, int32_t firstheight, int32_t height, int16_t leverage, std::vector<uint16_t> vec, int64_t positionsize,  int64_t &profits, int64_t &outprice)
+// calculates costbasis and profit/loss for the bet from the synthetic price at height
+static int32_t prices_betprofits(int64_t &costbasis, int32_t firstheight, int32_t height, int16_t leverage, int64_t price, int64_t positionsize, int64_t &profits, int64_t &outprice)
 {
-    int64_t price;
     const int32_t COSTBASIS_PERIOD = PRICES_DAYWINDOW;
 
     if (height < firstheight) {
@@ -1335,7 +1537,7 @@ int32_t prices_syntheticprofits(int64_t &costbasis, int32_t firstheight, int32_t
 
     int32_t minmax = (height < firstheight + COSTBASIS_PERIOD);  // if we are within 24h then use min or max value 
 
-    if ((price = prices_syntheticprice(vec, height, minmax, leverage)) < 0)
+    if (price < 0)
     {
         LOGSTREAMFN("prices", CCLOG_INFO, stream << "error getting synthetic price at height=" << height << std::endl);
         return -1;
@@ -1431,6 +1633,16 @@ int32_t prices_syntheticprofits(int64_t &costbasis, int32_t firstheight, int32_t
     return 0; //  (positionsize + addedbets + profits);
 }
 
+// calculates costbasis and profit/loss for the bet
+int32_t prices_syntheticprofits(int64_t &costbasis, int32_t firstheight, int32_t height, int16_t leverage, std::vector<uint16_t> vec, int64_t positionsize,  int64_t &profits, int64_t &outprice)
+{
+    int64_t price = 0;
+
+    if (height >= firstheight)
+        price = prices_syntheticprice(vec, height, height < firstheight + PRICES_DAYWINDOW, leverage);
+    return prices_betprofits(costbasis, firstheight, height, leverage, price, positionsize, profits, outprice);
+}
+
 // makes result json object
 void prices_betjson(UniValue &result, std::vector<OneBetData> bets, int16_t leverage, int32_t endheight, int64_t lastprice)
 {
@@ -1700,17 +1912,29 @@ UniValue PricesAddFunding(int64_t txfee, uint256 bettxid, int64_t amount)
 int32_t prices_scanchain(std::vector<OneBetData> &bets, int16_t leverage, std::vector<uint16_t> vec, int64_t &lastprice, int32_t &endheight) {
 
     bool stop = false;
+    std::vector<int64_t> prices;            // synthetic prices from chunkheight on, evaluated a chunk at a time
+    int32_t chunkheight = 0, chunksize = PRICES_SCANCHAIN_MINCHUNK;
+
     for (int32_t height = bets[0].firstheight+1; ; height++)   // the last datum for 24h is the costbasis value
     {
         int64_t totalposition = 0;
         int64_t totalprofits = 0;
 
+        // the price does not depend on the bet, get it for the next heights in one pass
+        if (prices.empty() || height >= chunkheight + prices.size()) {
+            if (!prices.empty())
+                chunksize = std::min(chunksize * 2, PRICES_SCANCHAIN_MAXCHUNK);
+            chunkheight = height;
+            prices_syntheticprices(prices, vec, chunkheight, chunksize);
+        }
+        int64_t price = prices[height - chunkheight];
+
         // scan upto the chain tip
         for (int i = 0; i < bets.size(); i++) {
 
             if (height > bets[i].firstheight) {
 
-                int32_t retcode = prices_syntheticprofits(bets[i].costbasis, bets[i].firstheight, height, leverage, vec, bets[i].positionsize, bets[i].profits, lastprice);
+                int32_t retcode = prices_betprofits(bets[i].costbasis, bets[i].firstheight, height, leverage, price, bets[i].positionsize, bets[i].profits, lastprice);
                 if (retcode < 0) {
                     LOGSTREAMFN("prices", CCLOG_DEBUG1, stream << "function prices_syntheticprofits returned -1, finishing..." << std::endl);
                     stop = true;
@@ -85,10 +85,8 @@ void CBlockIndex::TrimSolution()
     AssertLockHeld(cs_main);
 
     // We can correctly trim a solution as soon as the block index entry has been added
-    // to leveldb. Updates to the block index entry (to update validity status) will be
-    // handled by re-reading the solution from the existing db entry. It does not help to
-    // try to avoid these reads by gating trimming on the validity status: the re-reads are
-    // efficient anyway because of caching in leveldb, and most of them are unavoidable.
+    // to leveldb. The solution is stored under its own key, so updates to the block index
+    // entry (to update validity status) only rewrite the other fields and leave it alone.
     if (HasSolution()) {
         std::vector<unsigned char> empty;
         nSolution.swap(empty);
@@ -112,12 +110,10 @@ CBlockHeader CBlockIndex::GetBlockHeader() const
     if (HasSolution()) {
         header.nSolution        = nSolution;
     } else {
-        CDiskBlockIndex dbindex;
-        if (!pblocktree->ReadDiskBlockIndex(GetBlockHash(), dbindex)) {
+        if (!pblocktree->ReadBlockSolution(GetBlockHash(), header.nSolution)) {
             LogPrintf("%s: Failed to read index entry", __func__);
             throw std::runtime_error("Failed to read index entry");
         }
-        header.nSolution        = dbindex.GetSolution();
     }
     return header;
 }
@@ -498,17 +498,20 @@ public:
         hashPrev = uint256();
     }
 
-    explicit CDiskBlockIndex(const CBlockIndex* pindex, std::function<std::vector<unsigned char>()> getSolution) : CBlockIndex(*pindex) {
+    explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex) {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
-        if (!HasSolution()) {
-            nSolution = getSolution();
-        }
     }
 
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action) {
+        SerializeIndex(s, ser_action, true);
+    }
+
+    //! Serialize the entry, leaving out the Equihash solution unless fSolution is set.
+    template <typename Stream, typename Operation>
+    inline void SerializeIndex(Stream& s, Operation ser_action, bool fSolution) {
         int nVersion = s.GetVersion();
         if (!(s.GetType() & SER_GETHASH))
             READWRITE(VARINT(nVersion));
@@ -547,7 +550,8 @@ public:
         READWRITE(nTime);
         READWRITE(nBits);
         READWRITE(nNonce);
-        READWRITE(nSolution);
+        if (fSolution)
+            READWRITE(nSolution);
 
         // Only read/write nSproutValue if the client version used to create
         // this index was storing them.
@@ -622,6 +626,27 @@ public:
     }
 };
 
+/**
+ * A CDiskBlockIndex serialized without its Equihash solution. The block tree
+ * database keeps the solution under a key of its own, so loading the block
+ * index at startup does not read ~1.3 KB per block only to drop it again.
+ */
+class CDiskBlockIndexNoSolution
+{
+private:
+    CDiskBlockIndex& dbindex;
+
+public:
+    explicit CDiskBlockIndexNoSolution(CDiskBlockIndex& dbindexIn) : dbindex(dbindexIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        dbindex.SerializeIndex(s, ser_action, false);
+    }
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain {
 private:
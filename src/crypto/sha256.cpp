@@ -10,8 +10,8 @@
 #include <stdexcept>
 
 #if defined(__x86_64__) || defined(__amd64__)
-#if defined(EXPERIMENTAL_ASM)
 #include <cpuid.h>
+#if defined(EXPERIMENTAL_ASM)
 namespace sha256_sse4
 {
 void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
@@ -19,6 +19,33 @@ void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
 #endif
 #endif
 
+// The multi-buffer back-ends are built into separate libraries with their own
+// instruction set flags, which the consensus library does not link.
+#if !defined(BUILD_BITCOIN_INTERNAL)
+#if defined(ENABLE_SHANI)
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+namespace sha256d64_shani
+{
+void Transform_2way(unsigned char* out, const unsigned char* in);
+}
+#endif
+#if defined(ENABLE_SSE41)
+namespace sha256d64_sse41
+{
+void Transform_4way(unsigned char* out, const unsigned char* in);
+}
+#endif
+#if defined(ENABLE_AVX2)
+namespace sha256d64_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in);
+}
+#endif
+#endif
+
 // Internal implementation code.
 namespace
 {
@@ -144,8 +171,37 @@ void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
 } // namespace sha256
 
 typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
+typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+
+/** Double-SHA256 of one 64-byte input, on top of a single-block transform. */
+template<TransformType tr>
+void TransformD64Wrapper(unsigned char* out, const unsigned char* in)
+{
+    static const unsigned char padding1[64] = {
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0
+    };
+    unsigned char buffer2[64] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0
+    };
+    uint32_t s[8];
+    sha256::Initialize(s);
+    tr(s, in, 1);
+    tr(s, padding1, 1);
+    for (int i = 0; i < 8; i++) WriteBE32(buffer2 + 4 * i, s[i]);
+    sha256::Initialize(s);
+    tr(s, buffer2, 1);
+    for (int i = 0; i < 8; i++) WriteBE32(out + 4 * i, s[i]);
+}
 
-bool SelfTest(TransformType tr) {
+TransformType Transform = sha256::Transform;
+TransformD64Type TransformD64 = TransformD64Wrapper<sha256::Transform>;
+TransformD64Type TransformD64_2way = nullptr;
+TransformD64Type TransformD64_4way = nullptr;
+TransformD64Type TransformD64_8way = nullptr;
+
+bool SelfTest() {
     static const unsigned char in1[65] = {0, 0x80};
     static const unsigned char in2[129] = {
         0,
@@ -160,35 +216,109 @@ bool SelfTest(TransformType tr) {
     uint32_t buf[8];
     memcpy(buf, init, sizeof(buf));
     // Process nothing, and check we remain in the initial state.
-    tr(buf, nullptr, 0);
+    Transform(buf, nullptr, 0);
     if (memcmp(buf, init, sizeof(buf))) return false;
     // Process the padded empty string (unaligned)
-    tr(buf, in1 + 1, 1);
+    Transform(buf, in1 + 1, 1);
     if (memcmp(buf, out1, sizeof(buf))) return false;
     // Process 64 spaces (unaligned)
     memcpy(buf, init, sizeof(buf));
-    tr(buf, in2 + 1, 2);
+    Transform(buf, in2 + 1, 2);
     if (memcmp(buf, out2, sizeof(buf))) return false;
+
+    // Double-SHA256 of eight 64-byte inputs, checked through every multi-way
+    // back-end against the reference computed with the generic transform.
+    unsigned char data[8 * 64 + 1], expected[8 * 32], out[8 * 32];
+    for (int i = 0; i < (int)sizeof(data); i++) data[i] = (unsigned char)(i * 0x9d + 0x31);
+    for (int i = 0; i < 8; i++) TransformD64Wrapper<sha256::Transform>(expected + 32 * i, data + 1 + 64 * i);
+    for (int i = 0; i < 8; i++) {
+        TransformD64(out, data + 1 + 64 * i);
+        if (memcmp(out, expected + 32 * i, 32)) return false;
+    }
+    if (TransformD64_2way) {
+        for (int i = 0; i < 8; i += 2) TransformD64_2way(out + 32 * i, data + 1 + 64 * i);
+        if (memcmp(out, expected, sizeof(out))) return false;
+    }
+    if (TransformD64_4way) {
+        for (int i = 0; i < 8; i += 4) TransformD64_4way(out + 32 * i, data + 1 + 64 * i);
+        if (memcmp(out, expected, sizeof(out))) return false;
+    }
+    if (TransformD64_8way) {
+        TransformD64_8way(out, data + 1);
+        if (memcmp(out, expected, sizeof(out))) return false;
+    }
     return true;
 }
 
-TransformType Transform = sha256::Transform;
+#if defined(__x86_64__) || defined(__amd64__)
+/** Whether the OS saves the YMM registers on context switch, so AVX code may run. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
 
 } // namespace
 
 std::string SHA256AutoDetect()
 {
-#if defined(EXPERIMENTAL_ASM) && (defined(__x86_64__) || defined(__amd64__))
+    std::string ret = "standard";
+#if defined(__x86_64__) || defined(__amd64__)
+    bool have_sse4 = false;
+    bool have_avx = false;
+    bool have_avx2 = false;
+    bool have_shani = false;
     uint32_t eax, ebx, ecx, edx;
-    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx >> 19) & 1) {
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        have_sse4 = (ecx >> 19) & 1;
+        // AVX needs both the CPU flag and OS support (OSXSAVE + XCR0).
+        have_avx = ((ecx >> 27) & 1) && ((ecx >> 28) & 1) && AVXEnabled();
+    }
+    if (have_sse4 && __get_cpuid_max(0, nullptr) >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = (ebx >> 5) & 1;
+        have_shani = (ebx >> 29) & 1;
+    }
+    (void)have_avx;
+    (void)have_avx2;
+    (void)have_shani;
+
+#if defined(ENABLE_SHANI) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_shani) {
+        Transform = sha256_shani::Transform;
+        TransformD64 = TransformD64Wrapper<sha256_shani::Transform>;
+        TransformD64_2way = sha256d64_shani::Transform_2way;
+        ret = "shani(1way,2way)";
+        // The SHA extensions beat the SIMD back-ends; don't use those.
+        have_sse4 = false;
+        have_avx2 = false;
+    }
+#endif
+
+    if (have_sse4) {
+#if defined(EXPERIMENTAL_ASM)
         Transform = sha256_sse4::Transform;
-        assert(SelfTest(Transform));
-        return "sse4";
+        TransformD64 = TransformD64Wrapper<sha256_sse4::Transform>;
+        ret = "sse4(1way)";
+#endif
+#if defined(ENABLE_SSE41) && !defined(BUILD_BITCOIN_INTERNAL)
+        TransformD64_4way = sha256d64_sse41::Transform_4way;
+        ret += ",sse41(4way)";
+#endif
     }
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_avx2 && have_avx) {
+        TransformD64_8way = sha256d64_avx2::Transform_8way;
+        ret += ",avx2(8way)";
+    }
+#endif
 #endif
 
-    assert(SelfTest(Transform));
-    return "standard";
+    assert(SelfTest());
+    return ret;
 }
 
 ////// SHA-256
@@ -256,3 +386,37 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformD64_8way) {
+        while (blocks >= 8) {
+            TransformD64_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (TransformD64_4way) {
+        while (blocks >= 4) {
+            TransformD64_4way(out, in);
+            out += 128;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+    if (TransformD64_2way) {
+        while (blocks >= 2) {
+            TransformD64_2way(out, in);
+            out += 64;
+            in += 128;
+            blocks -= 2;
+        }
+    }
+    while (blocks) {
+        TransformD64(out, in);
+        out += 32;
+        in += 64;
+        --blocks;
+    }
+}
@@ -0,0 +1,214 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// SHA-256 using the x86 SHA extensions (SHA-NI), based on the public domain
+// reference code by Intel and by Jeffrey Walton.
+
+#ifdef ENABLE_SHANI
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <immintrin.h>
+
+namespace {
+
+alignas(16) const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+alignas(16) const uint32_t INIT[8] = {0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul, 0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul};
+
+/** Padding block following a 64-byte message, and the trailer of a 32-byte message. */
+alignas(16) const uint32_t PAD64[16] = {0x80000000ul, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x200};
+alignas(16) const uint32_t PAD32[8] = {0x80000000ul, 0, 0, 0, 0, 0, 0, 0x100};
+
+/** Byte shuffle that swaps every 32-bit lane between big- and little-endian. */
+__m128i inline MASK() { return _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull); }
+
+__m128i inline Load(const unsigned char* in) { return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), MASK()); }
+__m128i inline LoadWords(const uint32_t* in) { return _mm_loadu_si128((const __m128i*)in); }
+void inline Save(unsigned char* out, __m128i s) { _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(s, MASK())); }
+
+/** Four rounds of SHA-256 over message words m, starting at round 4*i. */
+void inline QuadRound(__m128i& state0, __m128i& state1, __m128i m, int i)
+{
+    const __m128i msg = _mm_add_epi32(m, LoadWords(K256 + 4 * i));
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));
+}
+
+void inline ShiftMessageA(__m128i& m0, __m128i m1)
+{
+    m0 = _mm_sha256msg1_epu32(m0, m1);
+}
+
+void inline ShiftMessageC(__m128i& m0, __m128i m1, __m128i& m2)
+{
+    m2 = _mm_sha256msg2_epu32(_mm_add_epi32(m2, _mm_alignr_epi8(m1, m0, 4)), m1);
+}
+
+void inline ShiftMessageB(__m128i& m0, __m128i m1, __m128i& m2)
+{
+    ShiftMessageC(m0, m1, m2);
+    ShiftMessageA(m0, m1);
+}
+
+/** Convert eight state words in a..h order into the ABEF/CDGH layout used by the SHA instructions. */
+void inline Shuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0xB1);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0x1B);
+    s0 = _mm_alignr_epi8(t1, t2, 0x08);
+    s1 = _mm_blend_epi16(t2, t1, 0xF0);
+}
+
+/** Inverse of Shuffle. */
+void inline Unshuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0x1B);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0xB1);
+    s0 = _mm_blend_epi16(t1, t2, 0xF0);
+    s1 = _mm_alignr_epi8(t2, t1, 0x08);
+}
+
+/** All 64 rounds over the message words m0..m3, which are clobbered. */
+void inline Rounds(__m128i& s0, __m128i& s1, __m128i m0, __m128i m1, __m128i m2, __m128i m3)
+{
+    QuadRound(s0, s1, m0, 0);
+    QuadRound(s0, s1, m1, 1);
+    ShiftMessageA(m0, m1);
+    QuadRound(s0, s1, m2, 2);
+    ShiftMessageA(m1, m2);
+    QuadRound(s0, s1, m3, 3);
+    ShiftMessageB(m2, m3, m0);
+    QuadRound(s0, s1, m0, 4);
+    ShiftMessageB(m3, m0, m1);
+    QuadRound(s0, s1, m1, 5);
+    ShiftMessageB(m0, m1, m2);
+    QuadRound(s0, s1, m2, 6);
+    ShiftMessageB(m1, m2, m3);
+    QuadRound(s0, s1, m3, 7);
+    ShiftMessageB(m2, m3, m0);
+    QuadRound(s0, s1, m0, 8);
+    ShiftMessageB(m3, m0, m1);
+    QuadRound(s0, s1, m1, 9);
+    ShiftMessageB(m0, m1, m2);
+    QuadRound(s0, s1, m2, 10);
+    ShiftMessageB(m1, m2, m3);
+    QuadRound(s0, s1, m3, 11);
+    ShiftMessageB(m2, m3, m0);
+    QuadRound(s0, s1, m0, 12);
+    ShiftMessageB(m3, m0, m1);
+    QuadRound(s0, s1, m1, 13);
+    ShiftMessageC(m0, m1, m2);
+    QuadRound(s0, s1, m2, 14);
+    ShiftMessageC(m1, m2, m3);
+    QuadRound(s0, s1, m3, 15);
+}
+
+/** The same rounds for two independent messages, interleaved so the SHA units stay busy. */
+void inline Rounds2(__m128i& s0, __m128i& s1, __m128i m0, __m128i m1, __m128i m2, __m128i m3,
+                    __m128i& t0, __m128i& t1, __m128i n0, __m128i n1, __m128i n2, __m128i n3)
+{
+    QuadRound(s0, s1, m0, 0); QuadRound(t0, t1, n0, 0);
+    QuadRound(s0, s1, m1, 1); QuadRound(t0, t1, n1, 1);
+    ShiftMessageA(m0, m1); ShiftMessageA(n0, n1);
+    QuadRound(s0, s1, m2, 2); QuadRound(t0, t1, n2, 2);
+    ShiftMessageA(m1, m2); ShiftMessageA(n1, n2);
+    QuadRound(s0, s1, m3, 3); QuadRound(t0, t1, n3, 3);
+    ShiftMessageB(m2, m3, m0); ShiftMessageB(n2, n3, n0);
+    QuadRound(s0, s1, m0, 4); QuadRound(t0, t1, n0, 4);
+    ShiftMessageB(m3, m0, m1); ShiftMessageB(n3, n0, n1);
+    QuadRound(s0, s1, m1, 5); QuadRound(t0, t1, n1, 5);
+    ShiftMessageB(m0, m1, m2); ShiftMessageB(n0, n1, n2);
+    QuadRound(s0, s1, m2, 6); QuadRound(t0, t1, n2, 6);
+    ShiftMessageB(m1, m2, m3); ShiftMessageB(n1, n2, n3);
+    QuadRound(s0, s1, m3, 7); QuadRound(t0, t1, n3, 7);
+    ShiftMessageB(m2, m3, m0); ShiftMessageB(n2, n3, n0);
+    QuadRound(s0, s1, m0, 8); QuadRound(t0, t1, n0, 8);
+    ShiftMessageB(m3, m0, m1); ShiftMessageB(n3, n0, n1);
+    QuadRound(s0, s1, m1, 9); QuadRound(t0, t1, n1, 9);
+    ShiftMessageB(m0, m1, m2); ShiftMessageB(n0, n1, n2);
+    QuadRound(s0, s1, m2, 10); QuadRound(t0, t1, n2, 10);
+    ShiftMessageB(m1, m2, m3); ShiftMessageB(n1, n2, n3);
+    QuadRound(s0, s1, m3, 11); QuadRound(t0, t1, n3, 11);
+    ShiftMessageB(m2, m3, m0); ShiftMessageB(n2, n3, n0);
+    QuadRound(s0, s1, m0, 12); QuadRound(t0, t1, n0, 12);
+    ShiftMessageB(m3, m0, m1); ShiftMessageB(n3, n0, n1);
+    QuadRound(s0, s1, m1, 13); QuadRound(t0, t1, n1, 13);
+    ShiftMessageC(m0, m1, m2); ShiftMessageC(n0, n1, n2);
+    QuadRound(s0, s1, m2, 14); QuadRound(t0, t1, n2, 14);
+    ShiftMessageC(m1, m2, m3); ShiftMessageC(n1, n2, n3);
+    QuadRound(s0, s1, m3, 15); QuadRound(t0, t1, n3, 15);
+}
+
+} // namespace
+
+namespace sha256_shani {
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    __m128i s0 = _mm_loadu_si128((const __m128i*)s);
+    __m128i s1 = _mm_loadu_si128((const __m128i*)(s + 4));
+    Shuffle(s0, s1);
+
+    while (blocks--) {
+        const __m128i abef_save = s0, cdgh_save = s1;
+        Rounds(s0, s1, Load(chunk), Load(chunk + 16), Load(chunk + 32), Load(chunk + 48));
+        s0 = _mm_add_epi32(s0, abef_save);
+        s1 = _mm_add_epi32(s1, cdgh_save);
+        chunk += 64;
+    }
+
+    Unshuffle(s0, s1);
+    _mm_storeu_si128((__m128i*)s, s0);
+    _mm_storeu_si128((__m128i*)(s + 4), s1);
+}
+} // namespace sha256_shani
+
+namespace sha256d64_shani {
+void Transform_2way(unsigned char* out, const unsigned char* in)
+{
+    __m128i init0 = LoadWords(INIT), init1 = LoadWords(INIT + 4);
+    Shuffle(init0, init1);
+
+    // First transform: the two 64-byte inputs.
+    __m128i as0 = init0, as1 = init1, bs0 = init0, bs1 = init1;
+    Rounds2(as0, as1, Load(in), Load(in + 16), Load(in + 32), Load(in + 48),
+            bs0, bs1, Load(in + 64), Load(in + 80), Load(in + 96), Load(in + 112));
+    as0 = _mm_add_epi32(as0, init0); as1 = _mm_add_epi32(as1, init1);
+    bs0 = _mm_add_epi32(bs0, init0); bs1 = _mm_add_epi32(bs1, init1);
+
+    // Second transform: the padding block.
+    const __m128i p0 = LoadWords(PAD64), p1 = LoadWords(PAD64 + 4), p2 = LoadWords(PAD64 + 8), p3 = LoadWords(PAD64 + 12);
+    __m128i aw0 = as0, aw1 = as1, bw0 = bs0, bw1 = bs1;
+    Rounds2(aw0, aw1, p0, p1, p2, p3, bw0, bw1, p0, p1, p2, p3);
+    aw0 = _mm_add_epi32(aw0, as0); aw1 = _mm_add_epi32(aw1, as1);
+    bw0 = _mm_add_epi32(bw0, bs0); bw1 = _mm_add_epi32(bw1, bs1);
+
+    // Third transform: the 32-byte intermediate hashes, in a..h order as message words.
+    Unshuffle(aw0, aw1);
+    Unshuffle(bw0, bw1);
+    const __m128i q2 = LoadWords(PAD32), q3 = LoadWords(PAD32 + 4);
+    as0 = init0; as1 = init1; bs0 = init0; bs1 = init1;
+    Rounds2(as0, as1, aw0, aw1, q2, q3, bs0, bs1, bw0, bw1, q2, q3);
+    as0 = _mm_add_epi32(as0, init0); as1 = _mm_add_epi32(as1, init1);
+    bs0 = _mm_add_epi32(bs0, init0); bs1 = _mm_add_epi32(bs1, init1);
+
+    Unshuffle(as0, as1);
+    Unshuffle(bs0, bs1);
+    Save(out, as0);
+    Save(out + 16, as1);
+    Save(out + 32, bs0);
+    Save(out + 48, bs1);
+}
+} // namespace sha256d64_shani
+
+#endif
@@ -0,0 +1,154 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// 4-way SSE4.1 implementation of double-SHA256 over 64-byte inputs, used to
+// hash the pairs of one merkle tree level side by side.
+
+#ifdef ENABLE_SSE41
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+namespace sha256d64_sse41 {
+namespace {
+
+const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+const uint32_t INIT[8] = {0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul, 0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul};
+
+__m128i inline K(uint32_t x) { return _mm_set1_epi32(x); }
+
+__m128i inline Add(__m128i x, __m128i y) { return _mm_add_epi32(x, y); }
+__m128i inline Add(__m128i x, __m128i y, __m128i z) { return Add(Add(x, y), z); }
+__m128i inline Add(__m128i x, __m128i y, __m128i z, __m128i w) { return Add(Add(x, y), Add(z, w)); }
+__m128i inline Inc(__m128i& x, __m128i y) { x = Add(x, y); return x; }
+__m128i inline Xor(__m128i x, __m128i y) { return _mm_xor_si128(x, y); }
+__m128i inline Xor(__m128i x, __m128i y, __m128i z) { return Xor(Xor(x, y), z); }
+__m128i inline Or(__m128i x, __m128i y) { return _mm_or_si128(x, y); }
+__m128i inline And(__m128i x, __m128i y) { return _mm_and_si128(x, y); }
+__m128i inline ShR(__m128i x, int n) { return _mm_srli_epi32(x, n); }
+__m128i inline ShL(__m128i x, int n) { return _mm_slli_epi32(x, n); }
+
+__m128i inline Ch(__m128i x, __m128i y, __m128i z) { return Xor(z, And(x, Xor(y, z))); }
+__m128i inline Maj(__m128i x, __m128i y, __m128i z) { return Or(And(x, y), And(z, Or(x, y))); }
+__m128i inline Sigma0(__m128i x) { return Xor(Or(ShR(x, 2), ShL(x, 30)), Or(ShR(x, 13), ShL(x, 19)), Or(ShR(x, 22), ShL(x, 10))); }
+__m128i inline Sigma1(__m128i x) { return Xor(Or(ShR(x, 6), ShL(x, 26)), Or(ShR(x, 11), ShL(x, 21)), Or(ShR(x, 25), ShL(x, 7))); }
+__m128i inline sigma0(__m128i x) { return Xor(Or(ShR(x, 7), ShL(x, 25)), Or(ShR(x, 18), ShL(x, 14)), ShR(x, 3)); }
+__m128i inline sigma1(__m128i x) { return Xor(Or(ShR(x, 17), ShL(x, 15)), Or(ShR(x, 19), ShL(x, 13)), ShR(x, 10)); }
+
+/** One round of SHA-256; k is the sum of the round constant and the message word. */
+void inline Round(__m128i a, __m128i b, __m128i c, __m128i& d, __m128i e, __m128i f, __m128i g, __m128i& h, __m128i k)
+{
+    __m128i t1 = Add(h, Sigma1(e), Ch(e, f, g), k);
+    __m128i t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+/** Message schedule of the padding block that follows a 64-byte message, with the round constants added. */
+struct PaddingSchedule
+{
+    uint32_t kw[64];
+
+    PaddingSchedule()
+    {
+        uint32_t w[64] = {0x80000000ul, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x200};
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = (w[i - 15] >> 7 | w[i - 15] << 25) ^ (w[i - 15] >> 18 | w[i - 15] << 14) ^ (w[i - 15] >> 3);
+            uint32_t s1 = (w[i - 2] >> 17 | w[i - 2] << 15) ^ (w[i - 2] >> 19 | w[i - 2] << 13) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        for (int i = 0; i < 64; i++) kw[i] = K256[i] + w[i];
+    }
+};
+
+const PaddingSchedule padding;
+
+/** Eight rounds fed by a precomputed schedule kw. */
+void inline Rounds8(__m128i* v, const uint32_t* kw)
+{
+    Round(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], K(kw[0]));
+    Round(v[7], v[0], v[1], v[2], v[3], v[4], v[5], v[6], K(kw[1]));
+    Round(v[6], v[7], v[0], v[1], v[2], v[3], v[4], v[5], K(kw[2]));
+    Round(v[5], v[6], v[7], v[0], v[1], v[2], v[3], v[4], K(kw[3]));
+    Round(v[4], v[5], v[6], v[7], v[0], v[1], v[2], v[3], K(kw[4]));
+    Round(v[3], v[4], v[5], v[6], v[7], v[0], v[1], v[2], K(kw[5]));
+    Round(v[2], v[3], v[4], v[5], v[6], v[7], v[0], v[1], K(kw[6]));
+    Round(v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[0], K(kw[7]));
+}
+
+/** Eight rounds starting at round i, expanding the message schedule in w as it goes. */
+void inline Rounds8(__m128i* v, __m128i* w, int i)
+{
+    __m128i kw[8];
+    for (int j = 0; j < 8; j++) {
+        int n = i + j;
+        if (n >= 16) Inc(w[n & 15], Add(sigma1(w[(n - 2) & 15]), w[(n - 7) & 15], sigma0(w[(n - 15) & 15])));
+        kw[j] = Add(K(K256[n]), w[n & 15]);
+    }
+    Round(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], kw[0]);
+    Round(v[7], v[0], v[1], v[2], v[3], v[4], v[5], v[6], kw[1]);
+    Round(v[6], v[7], v[0], v[1], v[2], v[3], v[4], v[5], kw[2]);
+    Round(v[5], v[6], v[7], v[0], v[1], v[2], v[3], v[4], kw[3]);
+    Round(v[4], v[5], v[6], v[7], v[0], v[1], v[2], v[3], kw[4]);
+    Round(v[3], v[4], v[5], v[6], v[7], v[0], v[1], v[2], kw[5]);
+    Round(v[2], v[3], v[4], v[5], v[6], v[7], v[0], v[1], kw[6]);
+    Round(v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[0], kw[7]);
+}
+
+/** Read the 32-bit big-endian word at offset from each of the four 64-byte inputs. */
+__m128i inline Read4(const unsigned char* chunk, int offset)
+{
+    return _mm_set_epi32(ReadBE32(chunk + 192 + offset), ReadBE32(chunk + 128 + offset), ReadBE32(chunk + 64 + offset), ReadBE32(chunk + offset));
+}
+
+/** Write the four lanes of v as big-endian words at offset of each 32-byte output. */
+void inline Write4(unsigned char* out, int offset, __m128i v)
+{
+    WriteBE32(out + offset, _mm_extract_epi32(v, 0));
+    WriteBE32(out + 32 + offset, _mm_extract_epi32(v, 1));
+    WriteBE32(out + 64 + offset, _mm_extract_epi32(v, 2));
+    WriteBE32(out + 96 + offset, _mm_extract_epi32(v, 3));
+}
+
+} // namespace
+
+void Transform_4way(unsigned char* out, const unsigned char* in)
+{
+    __m128i s[8], v[8], w[16];
+
+    // First transform: the 64-byte inputs themselves.
+    for (int i = 0; i < 8; i++) v[i] = K(INIT[i]);
+    for (int i = 0; i < 16; i++) w[i] = Read4(in, 4 * i);
+    for (int i = 0; i < 64; i += 8) Rounds8(v, w, i);
+    for (int i = 0; i < 8; i++) s[i] = Add(v[i], K(INIT[i]));
+
+    // Second transform: the padding block, whose schedule is the same for every input.
+    for (int i = 0; i < 8; i++) v[i] = s[i];
+    for (int i = 0; i < 64; i += 8) Rounds8(v, padding.kw + i);
+    for (int i = 0; i < 8; i++) w[i] = Add(v[i], s[i]);
+
+    // Third transform: SHA256 of the 32-byte intermediate hashes.
+    w[8] = K(0x80000000ul);
+    for (int i = 9; i < 15; i++) w[i] = K(0);
+    w[15] = K(0x100);
+    for (int i = 0; i < 8; i++) v[i] = K(INIT[i]);
+    for (int i = 0; i < 64; i += 8) Rounds8(v, w, i);
+    for (int i = 0; i < 8; i++) Write4(out, 4 * i, Add(v[i], K(INIT[i])));
+}
+
+} // namespace sha256d64_sse41
+
+#endif
@@ -148,6 +148,16 @@ public:
         return true;
     }
 
+    bool GetValueDataStream(CDataStream &ssValue) {
+        leveldb::Slice slValue = piter->value();
+        try {
+            ssValue = CDataStream(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+        } catch(std::exception &e) {
+            return false;
+        }
+        return true;
+    }
+
     unsigned int GetValueSize() {
         return piter->value().size();
     }
@@ -267,6 +277,27 @@ public:
         return new CDBIterator(*this, pdb->NewIterator(iteroptions));
     }
 
+    /**
+     * Consistent point-in-time view of the database; iterators created from it
+     * do not see later writes. Must be handed back with ReleaseSnapshot().
+     */
+    const leveldb::Snapshot *GetSnapshot() const
+    {
+        return pdb->GetSnapshot();
+    }
+
+    void ReleaseSnapshot(const leveldb::Snapshot *snapshot) const
+    {
+        pdb->ReleaseSnapshot(snapshot);
+    }
+
+    CDBIterator *NewIterator(const leveldb::Snapshot *snapshot) const
+    {
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot;
+        return new CDBIterator(*this, pdb->NewIterator(options));
+    }
+
     /**
      * Return true if the database managed by this class contains no entries.
      */
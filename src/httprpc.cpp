@@ -27,6 +27,7 @@
 #include "ui_interface.h"
 
 #include <boost/algorithm/string.hpp> // boost::trim
+#include <boost/foreach.hpp>
 
 // WWW-Authenticate to present with 401 Unauthorized response
 static const char *WWW_AUTH_HEADER_DATA = "Basic realm=\"jsonrpc\"";
@@ -134,7 +135,8 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
     try {
         // Parse request
         UniValue valRequest;
-        if (!valRequest.read(req->ReadBody()))
+        std::string strRequest = req->ReadBody();
+        if (!valRequest.read(strRequest))
             throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
 
         std::string strReply;
@@ -155,6 +157,7 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 
             // Send reply
             strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            RPCStatsAddBytes(jreq.strMethod, strRequest.size(), strReply.size());
 
         // array of requests
         } else if (valRequest.isArray())
@@ -174,6 +177,115 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
     return true;
 }
 
+/** Methods queued in the high priority lane unless overridden by -rpcpriority */
+static const char* const DEFAULT_HIGH_PRIORITY_METHODS[] = {
+    "getblockcount", "getbestblockhash", "getconnectioncount", "getrpcqueueinfo", "DEX_orderbook", "help", "stop"
+};
+/** Methods known to take seconds, queued in the low priority lane unless overridden */
+static const char* const DEFAULT_LOW_PRIORITY_METHODS[] = {
+    "marmaraposstat", "marmarainfo", "getsnapshot", "gettxoutsetinfo", "DEX_publish"
+};
+/** Scheduling of JSON-RPC methods, read by the event loop thread; only changed before the workers start */
+static std::map<std::string, HTTPWorkClass> mapRPCWorkClasses;
+
+/** Fill mapRPCWorkClasses from the defaults, -rpcpriority and -rpcmethodlimit */
+static bool InitRPCWorkClasses()
+{
+    mapRPCWorkClasses.clear();
+    for (size_t i = 0; i < sizeof(DEFAULT_HIGH_PRIORITY_METHODS) / sizeof(DEFAULT_HIGH_PRIORITY_METHODS[0]); i++)
+        mapRPCWorkClasses[DEFAULT_HIGH_PRIORITY_METHODS[i]] = HTTPWorkClass(DEFAULT_HIGH_PRIORITY_METHODS[i], HTTP_PRIORITY_HIGH);
+    for (size_t i = 0; i < sizeof(DEFAULT_LOW_PRIORITY_METHODS) / sizeof(DEFAULT_LOW_PRIORITY_METHODS[0]); i++)
+        mapRPCWorkClasses[DEFAULT_LOW_PRIORITY_METHODS[i]] = HTTPWorkClass(DEFAULT_LOW_PRIORITY_METHODS[i], HTTP_PRIORITY_LOW);
+
+    BOOST_FOREACH(const std::string& strArg, mapMultiArgs["-rpcpriority"]) {
+        size_t pos = strArg.find(':');
+        HTTPWorkPriority priority;
+        if (pos == std::string::npos || pos == 0 || !ParseHTTPWorkPriority(strArg.substr(pos + 1), priority)) {
+            uiInterface.ThreadSafeMessageBox(
+                strprintf(_("Invalid -rpcpriority '%s', expected <method>:<high|normal|low>"), strArg),
+                "", CClientUIInterface::MSG_ERROR);
+            return false;
+        }
+        std::string strMethod = strArg.substr(0, pos);
+        mapRPCWorkClasses[strMethod].name = strMethod;
+        mapRPCWorkClasses[strMethod].priority = priority;
+    }
+    BOOST_FOREACH(const std::string& strArg, mapMultiArgs["-rpcmethodlimit"]) {
+        size_t pos = strArg.find(':');
+        int32_t nLimit;
+        if (pos == std::string::npos || pos == 0 || !ParseInt32(strArg.substr(pos + 1), &nLimit) || nLimit < 0) {
+            uiInterface.ThreadSafeMessageBox(
+                strprintf(_("Invalid -rpcmethodlimit '%s', expected <method>:<n>"), strArg),
+                "", CClientUIInterface::MSG_ERROR);
+            return false;
+        }
+        std::string strMethod = strArg.substr(0, pos);
+        mapRPCWorkClasses[strMethod].name = strMethod;
+        mapRPCWorkClasses[strMethod].maxConcurrent = nLimit;
+    }
+    return true;
+}
+
+/**
+ * Find the string value of "method" in a JSON-RPC request without parsing it,
+ * as this runs on the event loop thread. A false match (e.g. inside params)
+ * only affects scheduling: the request is still parsed properly by its worker.
+ */
+static std::string PeekRPCMethod(const std::string& strBody)
+{
+    static const std::string strKey = "\"method\"";
+    size_t pos = strBody.find(strKey);
+    if (pos == std::string::npos)
+        return "";
+    pos = strBody.find_first_not_of(" \t\r\n", pos + strKey.size());
+    if (pos == std::string::npos || strBody[pos] != ':')
+        return "";
+    pos = strBody.find_first_not_of(" \t\r\n", pos + 1);
+    if (pos == std::string::npos || strBody[pos] != '"')
+        return "";
+    size_t end = strBody.find('"', pos + 1);
+    if (end == std::string::npos || end - pos - 1 > 64)
+        return "";
+    return strBody.substr(pos + 1, end - pos - 1);
+}
+
+static HTTPWorkClass HTTPReq_JSONRPC_Classify(HTTPRequest* req, const std::string &)
+{
+    // Large requests carry their payload in params, the method comes first in practice
+    std::string strBody = req->PeekBody(0x10000);
+    size_t pos = strBody.find_first_not_of(" \t\r\n");
+    if (pos != std::string::npos && strBody[pos] == '[')
+        return HTTPWorkClass("(batch)");
+
+    std::string strMethod = PeekRPCMethod(strBody);
+    if (strMethod.empty())
+        return HTTPWorkClass("(unknown)");
+    std::map<std::string, HTTPWorkClass>::const_iterator it = mapRPCWorkClasses.find(strMethod);
+    if (it != mapRPCWorkClasses.end())
+        return it->second;
+    if (tableRPC[strMethod] == NULL)
+        return HTTPWorkClass("(unknown)"); // don't let clients grow the statistics without bound
+    return HTTPWorkClass(strMethod);
+}
+
+/** Serve the RPC statistics to Prometheus, with the same authentication as JSON-RPC */
+static bool HTTPReq_Metrics(HTTPRequest* req, const std::string &)
+{
+    if (req->GetRequestMethod() != HTTPRequest::GET) {
+        req->WriteReply(HTTP_BAD_METHOD, "Only GET requests are supported");
+        return false;
+    }
+    std::pair<bool, std::string> authHeader = req->GetHeader("authorization");
+    if (!authHeader.first || !RPCAuthorized(authHeader.second)) {
+        req->WriteHeader("WWW-Authenticate", WWW_AUTH_HEADER_DATA);
+        req->WriteReply(HTTP_UNAUTHORIZED);
+        return false;
+    }
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, RPCStatsToPrometheus());
+    return true;
+}
+
 static bool InitRPCAuthentication()
 {
     if (mapArgs["-rpcpassword"] == "")
@@ -196,8 +308,12 @@ bool StartHTTPRPC()
     LogPrint("rpc", "Starting HTTP RPC server\n");
     if (!InitRPCAuthentication())
         return false;
+    if (!InitRPCWorkClasses())
+        return false;
 
-    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
+    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC, HTTPReq_JSONRPC_Classify);
+    if (GetBoolArg("-rpcprometheus", DEFAULT_RPC_PROMETHEUS))
+        RegisterHTTPHandler("/metrics", true, HTTPReq_Metrics, HTTPRequestClassifier());
 
     assert(EventBase());
     httpRPCTimerInterface = new HTTPRPCTimerInterface(EventBase());
@@ -214,6 +330,7 @@ void StopHTTPRPC()
 {
     LogPrint("rpc", "Stopping HTTP RPC server\n");
     UnregisterHTTPHandler("/", true);
+    UnregisterHTTPHandler("/metrics", true);
     if (httpRPCTimerInterface) {
         RPCUnregisterTimerInterface(httpRPCTimerInterface);
         delete httpRPCTimerInterface;
@@ -25,6 +25,9 @@
 
 class HTTPRequest;
 
+/** Whether the RPC statistics are served to Prometheus at /metrics */
+static const bool DEFAULT_RPC_PROMETHEUS = false;
+
 /** Start HTTP RPC subsystem.
  * Precondition; HTTP and RPC has been started.
  */
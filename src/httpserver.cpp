@@ -36,6 +36,9 @@
 #endif
 #endif
 
+#include <deque>
+#include <map>
+
 #include <boost/algorithm/string/case_conv.hpp> // for to_lower()
 #include <boost/foreach.hpp>
 #include <boost/scoped_ptr.hpp>
@@ -60,21 +63,33 @@ private:
     HTTPRequestHandler func;
 };
 
-/** Simple work queue for distributing work over multiple threads.
- * Work items are simply callable objects.
+/** Work queue for distributing work over multiple threads, in priority lanes.
+ * Work items are simply callable objects. Each item belongs to a class with an
+ * optional cap on the number of workers running it at once; items over their
+ * cap wait in place while later ones are served. The low priority lane may
+ * never occupy all workers, so slow requests can't starve fast ones.
  */
 template <typename WorkItem>
 class WorkQueue
 {
 private:
+    struct Entry
+    {
+        WorkItem* item;
+        HTTPWorkClass cls;
+        int64_t nTimeQueued;
+    };
+
     /** Mutex protects entire object */
     CWaitableCriticalSection cs;
     CConditionVariable cond;
     /* XXX in C++11 we can use std::unique_ptr here and avoid manual cleanup */
-    std::deque<WorkItem*> queue;
+    std::deque<Entry> queue[HTTP_PRIORITY_COUNT];
     bool running;
     size_t maxDepth;
     int numThreads;
+    int numRunningLow;
+    std::map<std::string, HTTPWorkClassStats> stats;
 
     /** RAII object to keep track of number of running worker threads */
     class ThreadCounter
@@ -94,10 +109,48 @@ private:
         }
     };
 
+    HTTPWorkClassStats& GetStats(const HTTPWorkClass& cls)
+    {
+        std::map<std::string, HTTPWorkClassStats>::iterator it = stats.find(cls.name);
+        if (it == stats.end()) {
+            HTTPWorkClassStats s = {};
+            s.name = cls.name;
+            it = stats.insert(std::make_pair(cls.name, s)).first;
+        }
+        it->second.priority = cls.priority;
+        it->second.maxConcurrent = cls.maxConcurrent;
+        return it->second;
+    }
+
+    bool CanRun(const Entry& e)
+    {
+        if (e.cls.maxConcurrent > 0 && GetStats(e.cls).running >= (size_t)e.cls.maxConcurrent)
+            return false;
+        if (e.cls.priority == HTTP_PRIORITY_LOW && numRunningLow >= std::max(numThreads - 1, 1))
+            return false;
+        return true;
+    }
+
+    /** Take the first runnable entry of the highest lane. Requires cs. */
+    bool Pop(Entry& e)
+    {
+        for (int p = 0; p < HTTP_PRIORITY_COUNT; p++) {
+            for (typename std::deque<Entry>::iterator it = queue[p].begin(); it != queue[p].end(); ++it) {
+                if (CanRun(*it)) {
+                    e = *it;
+                    queue[p].erase(it);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
 public:
     WorkQueue(size_t maxDepth) : running(true),
                                  maxDepth(maxDepth),
-                                 numThreads(0)
+                                 numThreads(0),
+                                 numRunningLow(0)
     {
     }
     /*( Precondition: worker threads have all stopped
@@ -105,20 +158,27 @@ public:
      */
     ~WorkQueue()
     {
-        while (!queue.empty()) {
-            delete queue.front();
-            queue.pop_front();
+        for (int p = 0; p < HTTP_PRIORITY_COUNT; p++) {
+            while (!queue[p].empty()) {
+                delete queue[p].front().item;
+                queue[p].pop_front();
+            }
         }
     }
-    /** Enqueue a work item */
-    bool Enqueue(WorkItem* item)
+    /** Enqueue a work item. Every lane holds up to maxDepth items. */
+    bool Enqueue(WorkItem* item, const HTTPWorkClass& cls)
     {
         boost::unique_lock<boost::mutex> lock(cs);
-        if (queue.size() >= maxDepth) {
+        HTTPWorkClassStats& s = GetStats(cls);
+        if (queue[cls.priority].size() >= maxDepth) {
+            s.rejected++;
             return false;
         }
-        queue.push_back(item);
-        cond.notify_one();
+        Entry e = { item, cls, GetTimeMicros() };
+        queue[cls.priority].push_back(e);
+        s.queued++;
+        // Wake everyone: the first waiter may not be allowed to run this class
+        cond.notify_all();
         return true;
     }
     /** Thread function */
@@ -126,18 +186,38 @@ public:
     {
         ThreadCounter count(*this);
         while (running) {
-            WorkItem* i = 0;
+            Entry e;
             {
                 boost::unique_lock<boost::mutex> lock(cs);
-                while (running && queue.empty())
+                while (running && !Pop(e))
                     cond.wait(lock);
                 if (!running)
                     break;
-                i = queue.front();
-                queue.pop_front();
+                HTTPWorkClassStats& s = GetStats(e.cls);
+                int64_t nWait = GetTimeMicros() - e.nTimeQueued;
+                s.queued--;
+                s.running++;
+                s.totalWaitMicros += nWait;
+                s.maxWaitMicros = std::max(s.maxWaitMicros, nWait);
+                if (e.cls.priority == HTTP_PRIORITY_LOW)
+                    numRunningLow++;
+            }
+            int64_t nStart = GetTimeMicros();
+            (*e.item)();
+            delete e.item;
+            int64_t nRun = GetTimeMicros() - nStart;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                HTTPWorkClassStats& s = GetStats(e.cls);
+                s.running--;
+                s.completed++;
+                s.totalRunMicros += nRun;
+                s.maxRunMicros = std::max(s.maxRunMicros, nRun);
+                if (e.cls.priority == HTTP_PRIORITY_LOW)
+                    numRunningLow--;
+                // Items held back by the limits may be runnable now
+                cond.notify_all();
             }
-            (*i)();
-            delete i;
         }
     }
     /** Interrupt and exit loops */
@@ -159,20 +239,34 @@ public:
     size_t Depth()
     {
         boost::unique_lock<boost::mutex> lock(cs);
-        return queue.size();
+        size_t depth = 0;
+        for (int p = 0; p < HTTP_PRIORITY_COUNT; p++)
+            depth += queue[p].size();
+        return depth;
+    }
+
+    /** Return the statistics of every class seen so far */
+    std::vector<HTTPWorkClassStats> GetAllStats()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        std::vector<HTTPWorkClassStats> ret;
+        for (std::map<std::string, HTTPWorkClassStats>::const_iterator it = stats.begin(); it != stats.end(); ++it)
+            ret.push_back(it->second);
+        return ret;
     }
 };
 
 struct HTTPPathHandler
 {
     HTTPPathHandler() {}
-    HTTPPathHandler(std::string prefix, bool exactMatch, HTTPRequestHandler handler):
-        prefix(prefix), exactMatch(exactMatch), handler(handler)
+    HTTPPathHandler(std::string prefix, bool exactMatch, HTTPRequestHandler handler, HTTPRequestClassifier classifier):
+        prefix(prefix), exactMatch(exactMatch), handler(handler), classifier(classifier)
     {
     }
     std::string prefix;
     bool exactMatch;
     HTTPRequestHandler handler;
+    HTTPRequestClassifier classifier;
 };
 
 /** HTTP module state */
@@ -227,6 +321,38 @@ static bool InitHTTPAllowList()
     return true;
 }
 
+bool ParseHTTPWorkPriority(const std::string& str, HTTPWorkPriority& priority)
+{
+    if (str == "high")
+        priority = HTTP_PRIORITY_HIGH;
+    else if (str == "normal")
+        priority = HTTP_PRIORITY_NORMAL;
+    else if (str == "low")
+        priority = HTTP_PRIORITY_LOW;
+    else
+        return false;
+    return true;
+}
+
+std::string HTTPWorkPriorityString(HTTPWorkPriority priority)
+{
+    switch (priority) {
+    case HTTP_PRIORITY_HIGH:
+        return "high";
+    case HTTP_PRIORITY_LOW:
+        return "low";
+    default:
+        return "normal";
+    }
+}
+
+std::vector<HTTPWorkClassStats> GetHTTPWorkQueueStats()
+{
+    if (!workQueue)
+        return std::vector<HTTPWorkClassStats>();
+    return workQueue->GetAllStats();
+}
+
 /** HTTP request method as string - use for logging only */
 static std::string RequestMethodString(HTTPRequest::RequestMethod m)
 {
@@ -301,9 +427,12 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 
     // Dispatch to worker thread
     if (i != iend) {
+        HTTPWorkClass cls(i->prefix);
+        if (i->classifier)
+            cls = i->classifier(hreq.get(), path);
         std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(hreq.release(), path, i->handler));
         assert(workQueue);
-        if (workQueue->Enqueue(item.get()))
+        if (workQueue->Enqueue(item.get(), cls))
             item.release(); /* if true, queue took ownership */
         else
             item->req->WriteReply(HTTP_INTERNAL, "Work queue depth exceeded");
@@ -596,6 +725,18 @@ std::string HTTPRequest::ReadBody()
     return rv;
 }
 
+std::string HTTPRequest::PeekBody(size_t maxSize)
+{
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return "";
+    size_t size = std::min(evbuffer_get_length(buf), maxSize);
+    std::string rv(size, '\0');
+    if (size > 0 && evbuffer_copyout(buf, &rv[0], size) != (ev_ssize_t)size)
+        return "";
+    return rv;
+}
+
 void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
 {
     struct evkeyvalq* headers = evhttp_request_get_output_headers(req);
@@ -675,10 +816,11 @@ HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod()
     }
 }
 
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler)
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler,
+                         const HTTPRequestClassifier &classifier)
 {
     LogPrint("http", "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
-    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
+    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler, classifier));
 }
 
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
@@ -6,6 +6,7 @@
 #define BITCOIN_HTTPSERVER_H
 
 #include <string>
+#include <vector>
 #include <stdint.h>
 #ifdef _WIN32
 #undef __cpuid
@@ -39,11 +40,57 @@ void StopHTTPServer();
 
 /** Handler for requests to a certain HTTP path */
 typedef boost::function<void(HTTPRequest* req, const std::string &)> HTTPRequestHandler;
+
+/** Lanes of the HTTP work queue. Idle workers take from the highest lane first. */
+enum HTTPWorkPriority {
+    HTTP_PRIORITY_HIGH = 0,
+    HTTP_PRIORITY_NORMAL,
+    HTTP_PRIORITY_LOW,
+    HTTP_PRIORITY_COUNT
+};
+/** Parse "high", "normal" or "low". Returns false for anything else. */
+bool ParseHTTPWorkPriority(const std::string& str, HTTPWorkPriority& priority);
+std::string HTTPWorkPriorityString(HTTPWorkPriority priority);
+
+/** How a request is scheduled on the worker threads. */
+struct HTTPWorkClass
+{
+    //! Requests of the same class share a concurrency limit and statistics (e.g. an RPC method name)
+    std::string name;
+    HTTPWorkPriority priority;
+    //! Maximum number of workers running this class at once, 0 for no limit
+    int maxConcurrent;
+
+    HTTPWorkClass(const std::string& name = "", HTTPWorkPriority priority = HTTP_PRIORITY_NORMAL, int maxConcurrent = 0) :
+        name(name), priority(priority), maxConcurrent(maxConcurrent) {}
+};
+/** Classifier of requests to a certain HTTP path. Called on the event loop
+ * thread before the request is queued, so it must not block or consume the body.
+ */
+typedef boost::function<HTTPWorkClass(HTTPRequest* req, const std::string &)> HTTPRequestClassifier;
+
+/** Work queue statistics of one request class */
+struct HTTPWorkClassStats
+{
+    std::string name;
+    HTTPWorkPriority priority;
+    int maxConcurrent;
+    //! Currently waiting in the queue and running on a worker
+    size_t queued, running;
+    //! Totals since startup
+    uint64_t completed, rejected;
+    int64_t totalWaitMicros, maxWaitMicros, totalRunMicros, maxRunMicros;
+};
+/** Snapshot of the work queue statistics, per request class */
+std::vector<HTTPWorkClassStats> GetHTTPWorkQueueStats();
+
 /** Register handler for prefix.
  * If multiple handlers match a prefix, the first-registered one will
- * be invoked.
+ * be invoked. Without a classifier, requests are queued at normal priority
+ * under a class named after the prefix.
  */
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler);
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler,
+                         const HTTPRequestClassifier &classifier = HTTPRequestClassifier());
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
@@ -102,6 +149,11 @@ public:
      */
     std::string ReadBody();
 
+    /**
+     * Return up to maxSize bytes of the request body without consuming it.
+     */
+    std::string PeekBody(size_t maxSize);
+
     /**
      * Write output header.
      *
@@ -46,6 +46,7 @@
 #include "net.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
+#include "script/sigcache.h"
 #include "script/standard.h"
 #include "scheduler.h"
 #include "txdb.h"
@@ -260,6 +261,9 @@ void Shutdown()
         fFeeEstimatesInitialized = false;
     }
 
+    // Hand subscribers whatever is still queued while the chain state is around
+    StopValidationInterfaceQueue();
+    StopIndexer();
     {
         LOCK(cs_main);
         if (pcoinsTip != NULL) {
@@ -273,6 +277,14 @@ void Shutdown()
         pcoinsdbview = NULL;
         delete pblocktree;
         pblocktree = NULL;
+        delete ptxindexdb;
+        ptxindexdb = NULL;
+        delete paddressindexdb;
+        paddressindexdb = NULL;
+        delete pspentindexdb;
+        pspentindexdb = NULL;
+        delete ptimestampindexdb;
+        ptimestampindexdb = NULL;
     }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
@@ -393,9 +405,14 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
+    strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
+    strUsage += HelpMessageOpt("-mempoolverifythreads=<n>", strprintf(_("Set the number of threads verifying the signatures of relayed transactions before they are added to the mempool (0 to %d, 0 = verify in the message handler, default: %d)"),
+        MAX_MEMPOOL_VERIFY_THREADS, DEFAULT_MEMPOOL_VERIFY_THREADS));
     strUsage += HelpMessageOpt("-mempooltxinputlimit=<n>", _("[DEPRECATED FROM OVERWINTER] Set the maximum number of transparent inputs in a transaction that the mempool will accept (default: 0 = no limit applied)"));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-ccparalleleval", strprintf(_("Run validators of cc modules audited as thread-safe concurrently on the script verification threads (default: %u)"), 1));
 #ifndef _WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "marmarad.pid"));
 #endif
@@ -408,13 +425,16 @@ std::string HelpMessage(HelpMessageMode mode)
 #endif
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), 0));
     strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses (default: %u)"), DEFAULT_ADDRESSINDEX));
+    strUsage += HelpMessageOpt("-addressbalanceindex", strprintf(_("Maintain running balances per address alongside the address index, so getaddressbalance is a single lookup (default: %u)"), DEFAULT_ADDRESSBALANCEINDEX));
     strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps (default: %u)"), DEFAULT_TIMESTAMPINDEX));
     strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent index, used to query the spending txid and input index for an outpoint (default: %u)"), DEFAULT_SPENTINDEX));
+    strUsage += HelpMessageOpt("-tokenindex", strprintf(_("Maintain a token ownership index of confirmed token outputs, used by token validation and balance queries (default: %u)"), DEFAULT_TOKENINDEX));
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
     strUsage += HelpMessageOpt("-banscore=<n>", strprintf(_("Threshold for disconnecting misbehaving peers (default: %u)"), 100));
     strUsage += HelpMessageOpt("-bantime=<n>", strprintf(_("Number of seconds to keep misbehaving peers from reconnecting (default: %u)"), 86400));
     strUsage += HelpMessageOpt("-bind=<addr>", _("Bind to given address and always listen on it. Use [host]:port notation for IPv6"));
+    strUsage += HelpMessageOpt("-compactblocks", strprintf(_("Relay new blocks to peers as short transaction ids, rebuilt from their mempools (default: %u)"), DEFAULT_COMPACT_BLOCKS));
     strUsage += HelpMessageOpt("-connect=<ip>", _("Connect only to the specified node(s)"));
     strUsage += HelpMessageOpt("-discover", _("Discover own IP addresses (default: 1 when listening and no -externalip or -proxy)"));
     strUsage += HelpMessageOpt("-dns", _("Allow DNS lookups for -addnode, -seednode and -connect") + " " + _("(default: 1)"));
@@ -436,6 +456,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), 1));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Socket events mode, which must be one of: %s (default: %s)"), GetSupportedSocketEventsModes(), DEFAULT_SOCKETEVENTS));
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
@@ -510,7 +531,7 @@ std::string HelpMessage(HelpMessageMode mode)
     {
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", 15));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", 0));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> entries (default: %u)", 50000));
+        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature and cryptocondition verification cache to <n> MiB, at most %d (default: %u)", MAX_MAX_SIG_CACHE_SIZE, DEFAULT_MAX_SIG_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/kB) smaller than this are considered zero fee for relaying (default: %s)"),
@@ -562,9 +583,12 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcpassword=<pw>", _("Password for JSON-RPC connections"));
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), 7771, 17771));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
+    strUsage += HelpMessageOpt("-rpcmethodlimit=<method>:<n>", _("Run at most <n> calls of RPC method <method> at once, the rest wait in the work queue. This option can be specified multiple times"));
+    strUsage += HelpMessageOpt("-rpcpriority=<method>:<lane>", _("Queue calls of RPC method <method> in the high, normal or low priority lane. Low priority calls never occupy all RPC threads. This option can be specified multiple times"));
+    strUsage += HelpMessageOpt("-rpcprometheus", strprintf(_("Serve RPC call statistics in the Prometheus text format at /metrics on the RPC port, using the RPC credentials (default: %u)"), DEFAULT_RPC_PROMETHEUS));
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
     if (showDebug) {
-        strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
+        strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of each priority lane of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
     }
 
@@ -1074,7 +1098,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
     nMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     //fprintf(stderr,"nMaxConnections %d\n",nMaxConnections);
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    if (!SetSocketEventsMode(GetArg("-socketevents", DEFAULT_SOCKETEVENTS)))
+        return InitError(strprintf(_("Invalid -socketevents mode '%s', must be one of: %s"), GetArg("-socketevents", ""), GetSupportedSocketEventsModes()));
+    // select() can't wait on descriptors numbered FD_SETSIZE or above
+    if (nSocketEventsMode == SOCKETEVENTS_SELECT)
+        nMaxConnections = std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS));
+    nMaxConnections = std::max(nMaxConnections, 0);
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     //fprintf(stderr,"nMaxConnections %d FD_SETSIZE.%d nBind.%d expr.%d \n",nMaxConnections,FD_SETSIZE,nBind,(int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS));
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
@@ -1144,6 +1173,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    nMempoolVerifyThreads = std::max(0, std::min((int)GetArg("-mempoolverifythreads", DEFAULT_MEMPOOL_VERIFY_THREADS), MAX_MEMPOOL_VERIFY_THREADS));
+
     fServer = GetBoolArg("-server", false);
 
     // block pruning; get the amount of disk space (in MB) to allot for block & undo files
@@ -1214,6 +1245,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                                        mapArgs["-paytxfee"], ::minRelayTxFee.ToString()));
         }
     }
+    if (GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) > MAX_MAX_SIG_CACHE_SIZE)
+        InitWarning(strprintf(_("Warning: -maxsigcachesize is given in MiB now and at most %d, %s looks like an entry count from an older version. Using the default of %u MiB."),
+                              MAX_MAX_SIG_CACHE_SIZE, mapArgs["-maxsigcachesize"], DEFAULT_MAX_SIG_CACHE_SIZE));
     if (mapArgs.count("-maxtxfee"))
     {
         CAmount nMaxFee = 0;
@@ -1248,7 +1282,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     {
         if (GetBoolArg("-peerbloomfilters", true))
             nLocalServices |= NODE_BLOOM;
+        fCompactBlocks = GetBoolArg("-compactblocks", DEFAULT_COMPACT_BLOCKS);
+        if (fCompactBlocks)
+            nLocalServices |= NODE_COMPACT_BLOCKS;
     }
+    else
+        fCompactBlocks = false;
     nMaxTipAge = GetArg("-maxtipage", DEFAULT_MAX_TIP_AGE);
 
 #ifdef ENABLE_MINING
@@ -1383,8 +1422,18 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        // Same number of workers for computing the txids of large blocks as they are read
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadTxHash);
+        // And for verifying the Equihash solutions of received headers outside cs_main
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadEquihashCheck);
     }
 
+    LogPrintf("Using %u threads for mempool transaction verification\n", nMempoolVerifyThreads);
+    for (int i=0; i<nMempoolVerifyThreads; i++)
+        threadGroup.create_thread(&ThreadTxAdmission);
+
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
     threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
@@ -1630,43 +1679,60 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20); // total cache cannot be greated than nMaxDbcache
     int64_t nBlockTreeDBCache = nTotalCache / 8;
-
-    if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) || GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
-        // enable 3/4 of the cache if addressindex and/or spentindex is enabled
-        nBlockTreeDBCache = nTotalCache * 3 / 4;
-    } else {
-        if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", false)) {
-            nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
-        }
+    if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-tokenindex", DEFAULT_TOKENINDEX)) {
+        nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
     }
     nTotalCache -= nBlockTreeDBCache;
+
+    // the optional indexes live in their own databases (indexes/), which can be enabled
+    // without -reindex: the background indexer builds them from the block files
+    fTxIndex = GetBoolArg("-txindex", true);
+    fAddressIndex = 1; //GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    fAddressBalanceIndex = GetBoolArg("-addressbalanceindex", DEFAULT_ADDRESSBALANCEINDEX);
+    fSpentIndex = 1; //GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    fTimestampIndex = GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
+
+    // enable 3/4 of the cache if addressindex and/or spentindex is enabled, and give
+    // each index database a share of it weighted by its typical size
+    int64_t nIndexWeights = (fTxIndex ? 2 : 0) + (fAddressIndex ? 4 : 0) + (fSpentIndex ? 2 : 0) + (fTimestampIndex ? 1 : 0);
+    int64_t nIndexCache = 0;
+    if (fAddressIndex || fSpentIndex)
+        nIndexCache = nTotalCache * 3 / 4;
+    else if (nIndexWeights > 0)
+        nIndexCache = nTotalCache / 8;
+    int64_t nTxIndexCache = fTxIndex ? nIndexCache * 2 / nIndexWeights : 0;
+    int64_t nAddressIndexCache = fAddressIndex ? nIndexCache * 4 / nIndexWeights : 0;
+    int64_t nSpentIndexCache = fSpentIndex ? nIndexCache * 2 / nIndexWeights : 0;
+    int64_t nTimestampIndexCache = fTimestampIndex ? nIndexCache / nIndexWeights : 0;
+    nTotalCache -= nIndexCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Max cache setting possible %.1fMiB\n", nMaxDbCache);
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    if (fTxIndex)
+        LogPrintf("* Using %.1fMiB for transaction index database\n", nTxIndexCache * (1.0 / 1024 / 1024));
+    if (fAddressIndex)
+        LogPrintf("* Using %.1fMiB for address index database%s\n", nAddressIndexCache * (1.0 / 1024 / 1024), fAddressBalanceIndex ? " (with balances)" : "");
+    if (fSpentIndex)
+        LogPrintf("* Using %.1fMiB for spent index database\n", nSpentIndexCache * (1.0 / 1024 / 1024));
+    if (fTimestampIndex)
+        LogPrintf("* Using %.1fMiB for timestamp index database\n", nTimestampIndexCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
 
     if ( fReindex == 0 )
     {
-        bool checkval,fAddressIndex,fSpentIndex;
+        bool checkval,fTokenIndex;
         pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex, dbCompression, dbMaxOpenFiles);
-        fAddressIndex = 1; //GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
-        pblocktree->ReadFlag("addressindex", checkval);
-        if ( checkval != fAddressIndex && fAddressIndex != 0 )
-        {
-            pblocktree->WriteFlag("addressindex", fAddressIndex);
-            fprintf(stderr,"set addressindex, will reindex. could take a while.\n");
-            fReindex = true;
-        }
-        fSpentIndex = 1; //GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
-        pblocktree->ReadFlag("spentindex", checkval);
-        if ( checkval != fSpentIndex && fSpentIndex != 0 )
+        fTokenIndex = GetBoolArg("-tokenindex", DEFAULT_TOKENINDEX);
+        checkval = false;
+        pblocktree->ReadFlag("tokenindex", checkval);
+        if ( checkval != fTokenIndex && fTokenIndex != 0 )
         {
-            pblocktree->WriteFlag("spentindex", fSpentIndex);
-            fprintf(stderr,"set spentindex, will reindex. could take a while.\n");
+            pblocktree->WriteFlag("tokenindex", fTokenIndex);
+            fprintf(stderr,"set tokenindex, will reindex. could take a while.\n");
             fReindex = true;
         }
     }
@@ -1688,9 +1754,17 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
+                delete ptxindexdb;
+                delete paddressindexdb;
+                delete pspentindexdb;
+                delete ptimestampindexdb;
                 delete pnotarisations;
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex, dbCompression, dbMaxOpenFiles);
+                ptxindexdb = fTxIndex ? new CIndexDB("txindex", nTxIndexCache, false, fReindex, dbCompression, dbMaxOpenFiles) : NULL;
+                paddressindexdb = fAddressIndex ? new CIndexDB("addressindex", nAddressIndexCache, false, fReindex, dbCompression, dbMaxOpenFiles) : NULL;
+                pspentindexdb = fSpentIndex ? new CIndexDB("spentindex", nSpentIndexCache, false, fReindex, dbCompression, dbMaxOpenFiles) : NULL;
+                ptimestampindexdb = fTimestampIndex ? new CIndexDB("timestampindex", nTimestampIndexCache, false, fReindex, dbCompression, dbMaxOpenFiles) : NULL;
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
@@ -1722,9 +1796,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
                 KOMODO_LOADINGBLOCKS = 0;
-                // Check for changed -txindex state
-                if (fTxIndex != GetBoolArg("-txindex", true)) {
-                    strLoadError = _("You need to rebuild the database using -reindex to change -txindex");
+                // Move indexes written by older versions out of the block index database
+                if (!MigrateLegacyIndexes()) {
+                    strLoadError = _("Error moving the indexes to their own databases");
                     break;
                 }
 
@@ -1734,15 +1808,6 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     strLoadError = _("You need to rebuild the database using -reindex to go back to unpruned mode.  This will redownload the entire blockchain");
                     break;
                 }
-                
-                if ( ASSETCHAINS_CC != 0 && KOMODO_SNAPSHOT_INTERVAL != 0 && chainActive.Height() >= KOMODO_SNAPSHOT_INTERVAL )
-                {
-                    if ( !komodo_dailysnapshot(chainActive.Height()) )
-                    {
-                        strLoadError = _("daily snapshot failed, please reindex your chain.");
-                        break;
-                    }
-                }
 
                 if (!fReindex) {
                     uiInterface.InitMessage(_("Rewinding blocks if needed..."));
@@ -1804,6 +1869,24 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
+    // indexes that are behind the active chain are caught up before any block is connected,
+    // so cc validation and the daily snapshot never read an index that is behind
+    if (!StartIndexer())
+        return InitError(_("Error starting the background indexer"));
+    if (!WaitForIndexerCatchUp())
+        return InitError(_("Error catching up the index databases"));
+    if (fRequestShutdown)
+    {
+        LogPrintf("Shutdown requested. Exiting.\n");
+        return false;
+    }
+
+    if ( ASSETCHAINS_CC != 0 && KOMODO_SNAPSHOT_INTERVAL != 0 && chainActive.Height() >= KOMODO_SNAPSHOT_INTERVAL )
+    {
+        if ( !komodo_dailysnapshot(chainActive.Height()) )
+            return InitError(_("daily snapshot failed, please reindex your chain."));
+    }
+
     boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -2017,6 +2100,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
     // ********************************************************* Step 10: import blocks
 
+    // From here on blocks are connected while the node runs, so deliver chain
+    // notifications to the wallet and ZMQ off the validation thread.
+    StartValidationInterfaceQueue();
     if (mapArgs.count("-blocknotify"))
         uiInterface.NotifyBlockTip.connect(BlockNotifyCallback);
     if ( KOMODO_REWIND >= 0 )
@@ -772,6 +772,7 @@ bool komodo_hardfork_active(uint32_t time)
 uint256 komodo_calcmerkleroot(CBlock *pblock, uint256 prevBlockHash, int32_t nHeight, bool fNew, CScript scriptPubKey)
 {
     std::vector<uint256> vLeaves;
+    vLeaves.reserve(pblock->vtx.size() + 1);
     // rereate coinbase tx
     CMutableTransaction txNew = CreateNewContextualCMutableTransaction(Params().GetConsensus(), nHeight);
     txNew.vin.resize(1);
@@ -1588,7 +1589,8 @@ uint32_t komodo_stakehash(uint256 *hashp,char *address,uint8_t *hashbuf,uint256
 {
     bits256 addrhash;
     //add address hash
-    vcalc_sha256(0, (uint8_t *)&addrhash, (uint8_t *)address, (int32_t)strlen(address));
+    // CSHA256 uses the sha256 transform picked by SHA256AutoDetect() (SHA-NI where available)
+    CSHA256().Write((uint8_t *)address, strlen(address)).Finalize((uint8_t *)&addrhash);
     memcpy(&hashbuf[100], &addrhash, sizeof(addrhash));
     // add txid
     memcpy(&hashbuf[100 + sizeof(addrhash)], &txid, sizeof(txid));
@@ -1619,7 +1621,7 @@ uint32_t komodo_stakehash(uint256 *hashp,char *address,uint8_t *hashbuf,uint256
             */
         }
     }
-    vcalc_sha256(0,(uint8_t *)hashp, hashbuf, hashed_size);
+    CSHA256().Write(hashbuf, hashed_size).Finalize((uint8_t *)hashp);
     return(addrhash.uints[0]);
 }
 
@@ -2849,12 +2851,13 @@ int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blockt
 {
     thread_local std::vector<struct komodo_staking> array; 
     thread_local int32_t numkp = 0, maxkp = 0; 
-    thread_local uint32_t lasttime = 0L;
+    thread_local uint64_t lastgeneration = 0;
+    thread_local int32_t lastheight = 0;
 
     int32_t PoSperc = 0, newStakerActive;
     set<CBitcoinAddress> setAddress;
     struct komodo_staking *kp;
-    int32_t winners, segid, minage, nHeight, counter = 0, i, m, siglen = 0, nMinDepth = 1, nMaxDepth = 99999999; vector<COutput> vecOutputs;
+    int32_t winners, segid, minage, nHeight, counter = 0, i, m, siglen = 0, nMinDepth = 1, nMaxDepth = 99999999;
     uint32_t block_from_future_rejecttime, besttime, eligible, earliest = 0;
     CScript best_scriptPubKey;
     arith_uint256 mindiff, ratio, bnTarget, tmpTarget;
@@ -2886,75 +2889,55 @@ int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blockt
     komodo_segids(hashbuf, nHeight - 101, 100);
     // this was for VerusHash PoS64
     //tmpTarget = komodo_PoWtarget(&PoSperc,bnTarget,nHeight,ASSETCHAINS_STAKED);
-    bool resetstaker = false;
-
-    if (array.size() != 0)
+    if (!needSpecialStakeUtxo)
     {
-        LOCK(cs_main);
-        CBlockIndex* pblockindex = chainActive[tipindex->GetHeight()];
-        CBlock block; CTxDestination addressout;
-        if (needSpecialStakeUtxo)
-            resetstaker = true;
-        else if (ReadBlockFromDisk(block, pblockindex, 1) && komodo_isPoS(&block, nHeight, &addressout) != 0 && IsMine(*pwalletMain, addressout) != 0)
+        // add normal staking UTXO from the wallet's stakeable output view, which the wallet keeps
+        // up to date as blocks connect, so neither cs_main nor cs_wallet is needed here:
+        std::vector<CStakeableOutput> vStakeable;
+        uint64_t generation = (array.size() != 0 && lastheight == nHeight) ? lastgeneration : 0;
+        if (!pwalletMain->GetStakeableOutputs(vStakeable, generation))
         {
-            resetstaker = true;
-            fprintf(stderr, "[%s:%d] Reset ram staker after mining a block!\n", ASSETCHAINS_SYMBOL, nHeight);
+            pwalletMain->RebuildStakeableOutputs();
+            generation = 0;
+            pwalletMain->GetStakeableOutputs(vStakeable, generation);
         }
-    }
-
-    if ( resetstaker || array.size() == 0 || time(NULL) > lasttime+600 )
-    {
-        LOCK2(cs_main, pwalletMain->cs_wallet);
-        pwalletMain->AvailableCoins(vecOutputs, false, NULL, true);
-        if (array.size() != 0)
+        if (generation != lastgeneration || lastheight != nHeight || array.size() == 0)
         {
             array.clear();
-            //array = 0;
             maxkp = numkp = 0;
-            lasttime = 0;
-        }
-        if (!needSpecialStakeUtxo)
-        {
-            // add normal staking UTXO:
-            BOOST_FOREACH(const COutput& out, vecOutputs)
+            for (const CStakeableOutput& out : vStakeable)
             {
-                if ((tipindex= chainActive.Tip()) == 0 || tipindex->GetHeight()+1 > nHeight)
-                {
-                    fprintf(stderr,"[%s:%d] chain tip changed during staking loop t.%u counter.%d\n",ASSETCHAINS_SYMBOL,nHeight,(uint32_t)time(NULL),counter);
-                    return(0);
-                }
                 counter++;
-                if ( out.nDepth < nMinDepth || out.nDepth > nMaxDepth )
-                {
-                    //fprintf(stderr,"komodo_staked invalid depth %d\n",(int32_t)out.nDepth);
+                int32_t nDepth = out.GetDepth(nHeight - 1);
+                if ( nDepth < nMinDepth || nDepth > nMaxDepth || !out.IsMature(nHeight - 1) )
                     continue;
-                }
-                CAmount nValue = out.tx->vout[out.i].nValue;
-                if ( nValue < COIN  || !out.fSpendable )
+                if ( out.nValue < COIN )
                     continue;
-                const CScript& pk = out.tx->vout[out.i].scriptPubKey;
-                if ( ExtractDestination(pk,address) != 0 )
+                if ( ExtractDestination(out.scriptPubKey,address) != 0 )
                 {
                     if ( IsMine(*pwalletMain,address) == 0 )
                         continue;
-                    if ( myGetTransaction(out.tx->GetHash(),tx,hashBlock) != 0 && (pindex= komodo_getblockindex(hashBlock)) != 0 )
-                    {
-                        komodo_addutxo(array,&numkp,&maxkp,(uint32_t)pindex->nTime,(uint64_t)nValue,out.tx->GetHash(),out.i,(char *)CBitcoinAddress(address).ToString().c_str(),hashbuf,(CScript)pk);
-                        //fprintf(stderr,"addutxo numkp.%d vs max.%d\n",numkp,maxkp);
-                    }
+                    komodo_addutxo(array,&numkp,&maxkp,out.nBlockTime,(uint64_t)out.nValue,out.txid,out.vout,(char *)CBitcoinAddress(address).ToString().c_str(),hashbuf,out.scriptPubKey);
                 }
             }
+            lastgeneration = generation;
+            lastheight = nHeight;
+            //fprintf(stderr,"finished kp data of utxo for staking %u ht.%d numkp.%d maxkp.%d\n",(uint32_t)time(NULL),nHeight,numkp,maxkp);
         }
-        else  
+    }
+    else
+    {
+        // placeholder for special staking utxo cases, these are rebuilt on every call:
+        if (array.size() != 0)
         {
-            // placeholder for special staking utxo cases:
-            // marmara case:
-            if (ASSETCHAINS_MARMARA != 0) {
-                MarmaraGetStakingUtxos(array, &numkp, &maxkp, hashbuf, nHeight);
-            }
+            array.clear();
+            maxkp = numkp = 0;
+        }
+        // marmara case:
+        if (ASSETCHAINS_MARMARA != 0) {
+            LOCK2(cs_main, pwalletMain->cs_wallet);
+            MarmaraGetStakingUtxos(array, &numkp, &maxkp, hashbuf, nHeight);
         }
-        lasttime = (uint32_t)time(NULL);
-        //fprintf(stderr,"finished kp data of utxo for staking %u ht.%d numkp.%d maxkp.%d\n",(uint32_t)time(NULL),nHeight,numkp,maxkp);
     }
     block_from_future_rejecttime = (uint32_t)GetAdjustedTime() + ASSETCHAINS_STAKED_BLOCK_FUTURE_MAX;    
     std::vector<uint8_t> vhashpk;
@@ -3054,7 +3037,7 @@ int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blockt
         array.clear();
         //array = 0;
         maxkp = numkp = 0;
-        lasttime = 0;
+        lastgeneration = 0;
     }
     if (earliest != 0)
     {
@@ -2621,6 +2621,11 @@ int32_t komodo_pricesinit()
 
 pthread_mutex_t pricemutex;
 
+// smoothed prices already read from the PRICES files, by height then price index
+// komodo_pricesupdate() drops a height when it rewrites it, access is under pricemutex
+#define PRICES_SMOOTHEDCACHE_MAXHEIGHTS 16384
+static std::map<int32_t,std::vector<int64_t> > PRICES_SMOOTHEDCACHE;
+
 // PRICES file layouts
 // [0] rawprice32 / timestamp
 // [1] correlated
@@ -2649,6 +2654,7 @@ void komodo_pricesupdate(int32_t height,CBlock *pblock)
         if ( PRICES[0].fp != 0 )
         {
             pthread_mutex_lock(&pricemutex);
+            PRICES_SMOOTHEDCACHE.erase(height);
             fseek(PRICES[0].fp,height * numprices * sizeof(uint32_t),SEEK_SET);
             if ( fwrite(rawprices,sizeof(uint32_t),numprices,PRICES[0].fp) != numprices )
                 fprintf(stderr,"error writing rawprices for ht.%d\n",height);
@@ -2715,6 +2721,45 @@ int32_t komodo_priceget(int64_t *buf64,int32_t ind,int32_t height,int32_t numblo
     return(retval);
 }
 
+// reads the smoothed price of index ind for numblocks heights starting at height
+// returns -1 if there is no prices file for ind (smoothed[] is untouched), otherwise the number of leading heights whose record could be read
+int32_t komodo_pricesmoothed(int64_t *smoothed,int32_t ind,int32_t height,int32_t numblocks)
+{
+    FILE *fp; int32_t i,num,numread; std::map<int32_t,std::vector<int64_t> >::iterator it;
+    const int64_t notcached = std::numeric_limits<int64_t>::min();
+    if ( ind < 0 || ind >= KOMODO_MAXPRICES || height < 0 || numblocks <= 0 )
+        return(0);
+    pthread_mutex_lock(&pricemutex);
+    if ( (fp= PRICES[ind].fp) == 0 )
+    {
+        pthread_mutex_unlock(&pricemutex);
+        return(-1);
+    }
+    for (num=0; num<numblocks; num++)
+    {
+        if ( (it= PRICES_SMOOTHEDCACHE.find(height+num)) == PRICES_SMOOTHEDCACHE.end() || ind >= it->second.size() || it->second[ind] == notcached )
+            break;
+        smoothed[num] = it->second[ind];
+    }
+    if ( num < numblocks )
+    {
+        std::vector<int64_t> buf64((numblocks - num) * PRICES_MAXDATAPOINTS);
+        fseek(fp,(height+num) * PRICES_MAXDATAPOINTS * sizeof(int64_t),SEEK_SET);
+        numread = (int32_t)(fread(&buf64[0],sizeof(int64_t),buf64.size(),fp) / PRICES_MAXDATAPOINTS);
+        for (i=0; i<numread; i++,num++)
+        {
+            std::vector<int64_t> &cached = PRICES_SMOOTHEDCACHE[height+num];
+            if ( cached.size() <= ind )
+                cached.resize(ind+1,notcached);
+            cached[ind] = smoothed[num] = buf64[i*PRICES_MAXDATAPOINTS + 2];
+        }
+        while ( PRICES_SMOOTHEDCACHE.size() > PRICES_SMOOTHEDCACHE_MAXHEIGHTS )
+            PRICES_SMOOTHEDCACHE.erase(PRICES_SMOOTHEDCACHE.begin());
+    }
+    pthread_mutex_unlock(&pricemutex);
+    return(num);
+}
+
 // place to add miner's created transactions
 UniValue sendrawtransaction(const UniValue& params, bool fHelp, const CPubKey &mypk);  
 
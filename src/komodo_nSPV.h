@@ -87,6 +87,36 @@ int32_t NSPV_rwutxoresp(int32_t rwflag,uint8_t *serialized,struct NSPV_utxoresp
     return(len);
 }
 
+int32_t NSPV_rwcursor(int32_t rwflag,uint8_t *serialized,struct NSPV_cursor *ptr)
+{
+    int32_t len = 0;
+    len += iguana_rwbignum(rwflag,&serialized[len],sizeof(ptr->txid),(uint8_t *)&ptr->txid);
+    len += iguana_rwnum(rwflag,&serialized[len],sizeof(ptr->height),&ptr->height);
+    len += iguana_rwnum(rwflag,&serialized[len],sizeof(ptr->txindex),&ptr->txindex);
+    len += iguana_rwnum(rwflag,&serialized[len],sizeof(ptr->vout),&ptr->vout);
+    len += iguana_rwnum(rwflag,&serialized[len],sizeof(ptr->spending),&ptr->spending);
+    len += iguana_rwnum(rwflag,&serialized[len],sizeof(ptr->valid),&ptr->valid);
+    len += iguana_rwbuf(rwflag,&serialized[len],sizeof(ptr->pad16),ptr->pad16);
+    return(len);
+}
+
+std::string NSPV_cursorhex(struct NSPV_cursor *ptr)
+{
+    uint8_t serialized[sizeof(*ptr)]; int32_t len;
+    len = NSPV_rwcursor(1,serialized,ptr);
+    return(HexStr(serialized,serialized+len));
+}
+
+int32_t NSPV_parsecursor(struct NSPV_cursor *ptr,std::string hexstr)
+{
+    std::vector<uint8_t> serialized = ParseHex(hexstr);
+    memset(ptr,0,sizeof(*ptr));
+    if ( serialized.size() != sizeof(*ptr) )
+        return(-1);
+    NSPV_rwcursor(0,&serialized[0],ptr);
+    return(0);
+}
+
 int32_t NSPV_rwutxosresp(int32_t rwflag,uint8_t *serialized,struct NSPV_utxosresp *ptr) // check mempool
 {
     int32_t i,len = 0;
@@ -114,6 +144,7 @@ int32_t NSPV_rwutxosresp(int32_t rwflag,uint8_t *serialized,struct NSPV_utxosres
         memcpy(ptr->coinaddr,&serialized[len],sizeof(ptr->coinaddr));
         len += sizeof(ptr->coinaddr);
     }
+    len += NSPV_rwcursor(rwflag,&serialized[len],&ptr->cursor); // trailing, ignored by older clients
     return(len);
 }
 
@@ -172,6 +203,7 @@ int32_t NSPV_rwtxidsresp(int32_t rwflag,uint8_t *serialized,struct NSPV_txidsres
         memcpy(ptr->coinaddr,&serialized[len],sizeof(ptr->coinaddr));
         len += sizeof(ptr->coinaddr);
     }
+    len += NSPV_rwcursor(rwflag,&serialized[len],&ptr->cursor); // trailing, ignored by older clients
 //fprintf(stderr,"rwlen.%d\n",len);
     return(len);
 }
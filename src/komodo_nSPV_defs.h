@@ -80,6 +80,14 @@ struct NSPV_utxoresp
     int32_t vout,height;
 };
 
+// resume position of a paged address index read, valid is 0 when there are no more entries
+struct NSPV_cursor
+{
+    uint256 txid;
+    int32_t height,txindex,vout;
+    uint8_t spending,valid,pad16[2];
+};
+
 struct NSPV_utxosresp
 {
     struct NSPV_utxoresp *utxos;
@@ -87,6 +95,7 @@ struct NSPV_utxosresp
     int64_t total,interest;
     int32_t nodeheight,skipcount,filter;
     uint16_t numutxos,CCflag;
+    struct NSPV_cursor cursor;
 };
 
 struct NSPV_txidresp
@@ -102,6 +111,7 @@ struct NSPV_txidsresp
     char coinaddr[64];
     int32_t nodeheight,skipcount,filter;
     uint16_t numtxids,CCflag;
+    struct NSPV_cursor cursor;
 };
 
 struct NSPV_mempoolresp
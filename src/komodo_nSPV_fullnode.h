@@ -147,13 +147,39 @@ int32_t NSPV_getinfo(struct NSPV_inforesp *ptr,int32_t reqheight)
     } else return(-1);
 }
 
-int32_t NSPV_getaddressutxos(struct NSPV_utxosresp *ptr,char *coinaddr,bool isCC,int32_t skipcount,uint32_t filter)
+int32_t NSPV_addressindexkey(char *coinaddr,bool isCC,uint160 &hashBytes,int &type)
+{
+    CBitcoinAddress address(coinaddr);
+    type = 0;
+    if ( address.GetIndexKey(hashBytes,type,isCC) == 0 )
+        return(-1);
+    return(0);
+}
+
+// with a cursor the address index is read one page at a time starting after cursor (skipcount is ignored)
+int32_t NSPV_getaddressutxos(struct NSPV_utxosresp *ptr,char *coinaddr,bool isCC,int32_t skipcount,uint32_t filter,struct NSPV_cursor *cursor)
 {
     int64_t total = 0,interest=0; uint32_t locktime; int32_t ind=0,tipheight,maxlen,txheight,n = 0,len = 0;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-    SetCCunspents(unspentOutputs,coinaddr,isCC);
     maxlen = MAX_BLOCK_SIZE(tipheight) - 512;
     maxlen /= sizeof(*ptr->utxos);
+    if ( cursor != 0 )
+    {
+        uint160 hashBytes; int type;
+        if ( NSPV_addressindexkey(coinaddr,isCC,hashBytes,type) == 0 )
+        {
+            CAddressUnspentKey afterkey(type,hashBytes,cursor->txid,cursor->vout);
+            GetAddressUnspent(hashBytes,type,unspentOutputs,cursor->valid != 0 ? &afterkey : 0,maxlen-1);
+        }
+        memset(&ptr->cursor,0,sizeof(ptr->cursor));
+        if ( (int32_t)unspentOutputs.size() == maxlen-1 )
+        {
+            ptr->cursor.txid = unspentOutputs.back().first.txhash;
+            ptr->cursor.vout = (int32_t)unspentOutputs.back().first.index;
+            ptr->cursor.valid = 1;
+        }
+        skipcount = 0;
+    } else SetCCunspents(unspentOutputs,coinaddr,isCC);
     strncpy(ptr->coinaddr,coinaddr,sizeof(ptr->coinaddr)-1);
     ptr->CCflag = isCC;
     ptr->filter = filter;
@@ -427,14 +453,34 @@ int32_t NSPV_getccmoduleutxos(struct NSPV_utxosresp *ptr, char *coinaddr, int64_
     }
 }
 
-int32_t NSPV_getaddresstxids(struct NSPV_txidsresp *ptr,char *coinaddr,bool isCC,int32_t skipcount,uint32_t filter)
+int32_t NSPV_getaddresstxids(struct NSPV_txidsresp *ptr,char *coinaddr,bool isCC,int32_t skipcount,uint32_t filter,struct NSPV_cursor *cursor)
 {
     int32_t maxlen,txheight,ind=0,n = 0,len = 0; CTransaction tx; uint256 hashBlock;
     std::vector<std::pair<CAddressIndexKey, CAmount> > txids;
-    SetCCtxids(txids,coinaddr,isCC);
     ptr->nodeheight = chainActive.LastTip()->GetHeight();
     maxlen = MAX_BLOCK_SIZE(ptr->nodeheight) - 512;
     maxlen /= sizeof(*ptr->txids);
+    if ( cursor != 0 )
+    {
+        uint160 hashBytes; int type;
+        if ( NSPV_addressindexkey(coinaddr,isCC,hashBytes,type) == 0 )
+        {
+            CAddressIndexKey afterkey(type,hashBytes,cursor->height,cursor->txindex,cursor->txid,cursor->vout,cursor->spending != 0);
+            GetAddressIndex(hashBytes,type,txids,0,0,cursor->valid != 0 ? &afterkey : 0,maxlen-1);
+        }
+        memset(&ptr->cursor,0,sizeof(ptr->cursor));
+        if ( (int32_t)txids.size() == maxlen-1 )
+        {
+            const CAddressIndexKey &lastkey = txids.back().first;
+            ptr->cursor.txid = lastkey.txhash;
+            ptr->cursor.height = lastkey.blockHeight;
+            ptr->cursor.txindex = lastkey.txindex;
+            ptr->cursor.vout = (int32_t)lastkey.index;
+            ptr->cursor.spending = lastkey.spending;
+            ptr->cursor.valid = 1;
+        }
+        skipcount = 0;
+    } else SetCCtxids(txids,coinaddr,isCC);
     strncpy(ptr->coinaddr,coinaddr,sizeof(ptr->coinaddr)-1);
     ptr->CCflag = isCC;
     ptr->filter = filter;
@@ -473,7 +519,7 @@ int32_t NSPV_getaddresstxids(struct NSPV_txidsresp *ptr,char *coinaddr,bool isCC
 
 int32_t NSPV_mempoolfuncs(bits256 *satoshisp,int32_t *vindexp,std::vector<uint256> &txids,char *coinaddr,bool isCC,uint8_t funcid,uint256 txid,int32_t vout)
 {
-    int32_t num = 0,vini = 0,vouti = 0; uint8_t evalcode=0,func=0;  std::vector<uint8_t> vopret; char destaddr[64];
+    int32_t num = 0,vini = 0,vouti = 0; uint8_t evalcode=0,func=0; char destaddr[64];
     *vindexp = -1;
     memset(satoshisp,0,sizeof(*satoshisp));
     if ( funcid == NSPV_CC_TXIDS)
@@ -534,6 +580,9 @@ int32_t NSPV_mempoolfuncs(bits256 *satoshisp,int32_t *vindexp,std::vector<uint25
         isCC = true;
         evalcode = vout & 0xff;
         func = (vout >> 8) & 0xff;
+        num = (int32_t)txids.size();
+        mempool.getCCIndex(evalcode,func,uint256(),txids);
+        return((int32_t)txids.size() - num);
     }
     LOCK(mempool.cs);
     BOOST_FOREACH(const CTxMemPoolEntry &e,mempool.mapTx)
@@ -555,20 +604,6 @@ int32_t NSPV_mempoolfuncs(bits256 *satoshisp,int32_t *vindexp,std::vector<uint25
             }
             continue;
         }
-        else if ( funcid == NSPV_MEMPOOL_CCEVALCODE )
-        {
-            if ( tx.vout.size() > 1 )
-            {
-                CScript scriptPubKey = tx.vout[tx.vout.size()-1].scriptPubKey;
-                if ( GetOpReturnData(scriptPubKey,vopret) != 0 )
-                {
-                    if ( vopret[0] != evalcode || (func!=0 && vopret[1] != func) ) continue;
-                    txids.push_back(hash);
-                    num++;
-                }
-            }
-            continue;
-        }
         if ( funcid == NSPV_MEMPOOL_ISSPENT )
         {
             BOOST_FOREACH(const CTxIn &txin,tx.vin)
@@ -840,7 +875,13 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
             //fprintf(stderr,"utxos: %u > %u, ind.%d, len.%d\n",timestamp,pfrom->prevtimes[ind],ind,len);
             if ( timestamp > pfrom->prevtimes[ind] )
             {
-                struct NSPV_utxosresp U;
+                struct NSPV_utxosresp U; struct NSPV_cursor cursor,*cursorp = 0;
+                if ( len > 11+sizeof(cursor) && request[1] == len-11-sizeof(cursor) )
+                {
+                    NSPV_rwcursor(0,&request[len-sizeof(cursor)],&cursor);
+                    cursorp = &cursor;
+                    len -= sizeof(cursor);
+                }
                 if ( len < 64+5 && (request[1] == len-3 || request[1] == len-7 || request[1] == len-11) )
                 {
                     int32_t skipcount = 0; char coinaddr[64]; uint8_t filter; uint8_t isCC = 0;
@@ -862,7 +903,7 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
                     if ( 0 && isCC != 0 )
                         fprintf(stderr,"utxos %s isCC.%d skipcount.%d filter.%x\n",coinaddr,isCC,skipcount,filter);
                     memset(&U,0,sizeof(U));
-                    if ( (slen= NSPV_getaddressutxos(&U,coinaddr,isCC,skipcount,filter)) > 0 )
+                    if ( (slen= NSPV_getaddressutxos(&U,coinaddr,isCC,skipcount,filter,cursorp)) > 0 )
                     {
                         response.resize(1 + slen);
                         response[0] = NSPV_UTXOSRESP;
@@ -880,7 +921,13 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
         {
             if ( timestamp > pfrom->prevtimes[ind] )
             {
-                struct NSPV_txidsresp T;
+                struct NSPV_txidsresp T; struct NSPV_cursor cursor,*cursorp = 0;
+                if ( len > 11+sizeof(cursor) && request[1] == len-11-sizeof(cursor) )
+                {
+                    NSPV_rwcursor(0,&request[len-sizeof(cursor)],&cursor);
+                    cursorp = &cursor;
+                    len -= sizeof(cursor);
+                }
                 if ( len < 64+5 && (request[1] == len-3 || request[1] == len-7 || request[1] == len-11) )
                 {
                     int32_t skipcount = 0; char coinaddr[64]; uint32_t filter; uint8_t isCC = 0;
@@ -902,7 +949,7 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
                     if ( 0 && isCC != 0 )
                         fprintf(stderr,"txids %s isCC.%d skipcount.%d filter.%d\n",coinaddr,isCC,skipcount,filter);
                     memset(&T,0,sizeof(T));
-                    if ( (slen= NSPV_getaddresstxids(&T,coinaddr,isCC,skipcount,filter)) > 0 )
+                    if ( (slen= NSPV_getaddresstxids(&T,coinaddr,isCC,skipcount,filter,cursorp)) > 0 )
                     {
 //fprintf(stderr,"slen.%d\n",slen);
                         response.resize(1 + slen);
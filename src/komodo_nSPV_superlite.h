@@ -160,11 +160,13 @@ void komodo_nSPVresp(CNode *pfrom,std::vector<uint8_t> response) // received a r
                 }
                 break;
             case NSPV_UTXOSRESP:
+                response.resize(len + sizeof(NSPV_utxosresult.cursor)); // older full nodes dont send a cursor
                 NSPV_utxosresp_purge(&NSPV_utxosresult);
                 NSPV_rwutxosresp(0,&response[1],&NSPV_utxosresult);
                 fprintf(stderr,"got utxos response %u size.%d\n",timestamp,(int32_t)response.size());
                 break;
             case NSPV_TXIDSRESP:
+                response.resize(len + sizeof(NSPV_txidsresult.cursor));
                 NSPV_txidsresp_purge(&NSPV_txidsresult);
                 NSPV_rwtxidsresp(0,&response[1],&NSPV_txidsresult);
                 fprintf(stderr,"got txids response %u size.%d %s CC.%d num.%d\n",timestamp,(int32_t)response.size(),NSPV_txidsresult.coinaddr,NSPV_txidsresult.CCflag,NSPV_txidsresult.numtxids);
@@ -413,6 +415,8 @@ UniValue NSPV_utxosresp_json(struct NSPV_utxosresp *ptr)
     if ( ASSETCHAINS_SYMBOL[0] == 0 )
         result.push_back(Pair("interest",(double)ptr->interest/COIN));
     result.push_back(Pair("filter",(int64_t)ptr->filter));
+    if ( ptr->cursor.valid != 0 )
+        result.push_back(Pair("continuation",NSPV_cursorhex(&ptr->cursor)));
     result.push_back(Pair("lastpeer",NSPV_lastpeer));
     return(result);
 }
@@ -444,6 +448,8 @@ UniValue NSPV_txidsresp_json(struct NSPV_txidsresp *ptr)
     result.push_back(Pair("height",(int64_t)ptr->nodeheight));
     result.push_back(Pair("numtxids",(int64_t)ptr->numtxids));
     result.push_back(Pair("filter",(int64_t)ptr->filter));
+    if ( ptr->cursor.valid != 0 )
+        result.push_back(Pair("continuation",NSPV_cursorhex(&ptr->cursor)));
     result.push_back(Pair("lastpeer",NSPV_lastpeer));
     return(result);
 }
@@ -591,7 +597,7 @@ uint32_t NSPV_blocktime(int32_t hdrheight)
     return(0);
 }
 
-UniValue NSPV_addressutxos(char *coinaddr,int32_t CCflag,int32_t skipcount,int32_t filter)
+UniValue NSPV_addressutxos(char *coinaddr,int32_t CCflag,int32_t skipcount,int32_t filter,struct NSPV_cursor *cursor)
 {
     UniValue result(UniValue::VOBJ); uint8_t msg[512]; int32_t i,iter,slen,len = 0;
     //fprintf(stderr,"utxos %s NSPV addr %s\n",coinaddr,NSPV_address.c_str());
@@ -613,6 +619,8 @@ UniValue NSPV_addressutxos(char *coinaddr,int32_t CCflag,int32_t skipcount,int32
     msg[len++] = (CCflag != 0);
     len += iguana_rwnum(1,&msg[len],sizeof(skipcount),&skipcount);
     len += iguana_rwnum(1,&msg[len],sizeof(filter),&filter);
+    if ( cursor != 0 )
+        len += NSPV_rwcursor(1,&msg[len],cursor);
     for (iter=0; iter<3; iter++)
     if ( NSPV_req(0,msg,len,NODE_ADDRINDEX,msg[0]>>1) != 0 )
     {
@@ -629,10 +637,10 @@ UniValue NSPV_addressutxos(char *coinaddr,int32_t CCflag,int32_t skipcount,int32
     return(result);
 }
 
-UniValue NSPV_addresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,int32_t filter)
+UniValue NSPV_addresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,int32_t filter,struct NSPV_cursor *cursor)
 {
     UniValue result(UniValue::VOBJ); uint8_t msg[512]; int32_t i,iter,slen,len = 0;
-    if ( NSPV_txidsresult.nodeheight >= NSPV_inforesult.height && strcmp(coinaddr,NSPV_txidsresult.coinaddr) == 0 && CCflag == NSPV_txidsresult.CCflag && skipcount == NSPV_txidsresult.skipcount )
+    if ( cursor == 0 && NSPV_txidsresult.nodeheight >= NSPV_inforesult.height && strcmp(coinaddr,NSPV_txidsresult.coinaddr) == 0 && CCflag == NSPV_txidsresult.CCflag && skipcount == NSPV_txidsresult.skipcount )
         return(NSPV_txidsresp_json(&NSPV_txidsresult));
     if ( skipcount < 0 )
         skipcount = 0;
@@ -650,6 +658,8 @@ UniValue NSPV_addresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,int32
     msg[len++] = (CCflag != 0);
     len += iguana_rwnum(1,&msg[len],sizeof(skipcount),&skipcount);
     len += iguana_rwnum(1,&msg[len],sizeof(filter),&filter);
+    if ( cursor != 0 )
+        len += NSPV_rwcursor(1,&msg[len],cursor);
     //fprintf(stderr,"skipcount.%d\n",skipcount);
     for (iter=0; iter<3; iter++)
     if ( NSPV_req(0,msg,len,NODE_ADDRINDEX,msg[0]>>1) != 0 )
@@ -26,6 +26,7 @@
 #include "addrman.h"
 #include "alert.h"
 #include "arith_uint256.h"
+#include "blockencodings.h"
 #include "importcoin.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -51,6 +52,7 @@
 #include "wallet/asyncrpcoperation_sendmany.h"
 #include "wallet/asyncrpcoperation_shieldcoinbase.h"
 #include "notaries_staked.h"
+#include "cc/CCtokens.h"
 
 #include <cstring>
 #include <algorithm>
@@ -97,13 +99,17 @@ static int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nMempoolVerifyThreads = 0;
 bool fExperimentalMode = true;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = false;
 bool fAddressIndex = true;
 bool fTimestampIndex = false;
+bool fAddressBalanceIndex = false;
 bool fSpentIndex = true;
+bool fTokenIndex = false;
+bool fCompactBlocks = DEFAULT_COMPACT_BLOCKS;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = true;
@@ -263,6 +269,7 @@ namespace {
         int64_t nTime;  //! Time of "getdata" request in microseconds.
         bool fValidatedHeaders;  //! Whether this block has validated headers at the time of request.
         int64_t nTimeDisconnect; //! The timeout for this block request (for disconnecting a slow peer)
+        std::shared_ptr<PartiallyDownloadedBlock> partialBlock;  //! Set while reassembling a compact block.
     };
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
@@ -326,6 +333,10 @@ namespace {
         int nBlocksInFlightValidHeaders;
         //! Whether we consider this a preferred download peer.
         bool fPreferredDownload;
+        //! Whether this peer sent "sendcmpct", so it understands the compact block messages.
+        bool fSupportsCompactBlocks;
+        //! Whether this peer wants new blocks pushed as "cmpctblock" instead of announced by inv.
+        bool fPreferCompactBlocks;
 
         CNodeState() {
             fCurrentlyConnected = false;
@@ -339,6 +350,8 @@ namespace {
             nBlocksInFlight = 0;
             nBlocksInFlightValidHeaders = 0;
             fPreferredDownload = false;
+            fSupportsCompactBlocks = false;
+            fPreferCompactBlocks = false;
         }
     };
 
@@ -405,14 +418,14 @@ namespace {
 
     void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age)
     {
-        /*    int expired = pool.Expire(GetTime() - age);
-         if (expired != 0)
-         LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
+        int expired = pool.Expire(GetTime() - age);
+        if (expired != 0)
+            LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
 
-         std::vector<uint256> vNoSpendsRemaining;
-         pool.TrimToSize(limit, &vNoSpendsRemaining);
-         BOOST_FOREACH(const uint256& removed, vNoSpendsRemaining)
-         pcoinsTip->Uncache(removed);*/
+        std::vector<uint256> vNoSpendsRemaining;
+        pool.TrimToSize(limit, &vNoSpendsRemaining);
+        BOOST_FOREACH(const uint256& removed, vNoSpendsRemaining)
+            pcoinsTip->Uncache(removed);
     }
 
     // Requires cs_main.
@@ -433,7 +446,7 @@ namespace {
     }
 
     // Requires cs_main.
-    void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Params& consensusParams, CBlockIndex *pindex = NULL) {
+    void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Params& consensusParams, CBlockIndex *pindex = NULL, list<QueuedBlock>::iterator *pit = NULL) {
         CNodeState *state = State(nodeid);
         assert(state != NULL);
 
@@ -447,6 +460,8 @@ namespace {
         state->nBlocksInFlight++;
         state->nBlocksInFlightValidHeaders += newentry.fValidatedHeaders;
         mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
+        if (pit)
+            *pit = it;
     }
 
     /** Check whether the last unknown block a peer advertized is not yet known. */
@@ -644,23 +659,27 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
+CIndexDB *ptxindexdb = NULL;
+CIndexDB *paddressindexdb = NULL;
+CIndexDB *pspentindexdb = NULL;
+CIndexDB *ptimestampindexdb = NULL;
 
 // Komodo globals
 
 #define KOMODO_ZCASH
 #include "komodo.h"
 
+// the address index is read from a LevelDB snapshot, cs_main is only taken briefly inside
 UniValue komodo_snapshot(int top)
 {
-    LOCK(cs_main);
     int64_t total = -1;
     UniValue result(UniValue::VOBJ);
 
     if (fAddressIndex) {
-	    if ( pblocktree != 0 ) {
-		result = pblocktree->Snapshot(top);
+	    if ( paddressindexdb != 0 && SyncIndexes(false) ) {
+		result = paddressindexdb->Snapshot(top);
 	    } else {
-		fprintf(stderr,"null pblocktree start with -addressindex=1\n");
+		fprintf(stderr,"%s\n", paddressindexdb != 0 && IndexesSyncing() ? "address index is syncing" : "null paddressindexdb start with -addressindex=1");
 	    }
     } else {
 	    fprintf(stderr,"getsnapshot requires -addressindex=1\n");
@@ -668,11 +687,12 @@ UniValue komodo_snapshot(int top)
     return(result);
 }
 
+// waits until the address index has every connected block, so the snapshot is taken at the tip
 bool komodo_snapshot2(std::map <std::string, CAmount> &addressAmounts)
 {
-    if ( fAddressIndex && pblocktree != 0 ) 
+    if ( fAddressIndex && paddressindexdb != 0 && SyncIndexes() )
     {
-		return pblocktree->Snapshot2(addressAmounts, 0);
+		return paddressindexdb->Snapshot2(addressAmounts, 0);
     }
     else return false;
 }
@@ -758,12 +778,15 @@ bool komodo_dailysnapshot(int32_t height)
     // convert address string to destination for easier conversion to what ever is required, eg, scriptPubKey. 
     for ( auto element : addressAmounts)
         vAddressSnapshot.push_back(make_pair(element.second, DecodeDestination(element.first)));
-    // sort the vector by amount, highest at top.
-    std::sort(vAddressSnapshot.rbegin(), vAddressSnapshot.rend());
+    // sort the vector by amount, highest at top. include only top 3999 address.
+    if ( vAddressSnapshot.size() > 3999 )
+    {
+        std::partial_sort(vAddressSnapshot.begin(), vAddressSnapshot.begin() + 3999, vAddressSnapshot.end(), std::greater<std::pair<CAmount, CTxDestination> >());
+        vAddressSnapshot.resize(3999);
+    }
+    else std::sort(vAddressSnapshot.rbegin(), vAddressSnapshot.rend());
     //for (int j = 0; j < 50; j++) 
     //    fprintf(stderr, "j.%i address.%s nValue.%li\n",j, CBitcoinAddress(vAddressSnapshot[j].second).ToString().c_str(), vAddressSnapshot[j].first );
-    // include only top 3999 address.
-    if ( vAddressSnapshot.size() > 3999 ) vAddressSnapshot.resize(3999);
     lastSnapShotHeight = undo_height; 
     fprintf(stderr, "vAddressSnapshot.size.%d\n", (int32_t)vAddressSnapshot.size());
     return true;
@@ -2025,6 +2048,15 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                 return state.DoS(0, error("AcceptToMemoryPool: not enough fees %s, %d < %d",hash.ToString(), nFees, txMinFee),REJECT_INSUFFICIENTFEE, "insufficient fee");
             }
         }
+
+        // Once the pool has been full, it only takes transactions paying more than what it evicted.
+        // Transactions added while validating a block (dosLevel -1) are not subject to the size limit.
+        if (dosLevel != -1 && !tx.IsCoinImport() && !tx.IsPegsImport())
+        {
+            CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+            if (mempoolRejectFee > 0 && nFees < mempoolRejectFee)
+                return state.DoS(0, error("AcceptToMemoryPool: mempool min fee not met %s, %d < %d", hash.ToString(), nFees, mempoolRejectFee), REJECT_INSUFFICIENTFEE, "mempool min fee not met");
+        }
         
         // Require that free transactions have sufficient priority to be mined in the next block.
         if (GetBoolArg("-relaypriority", false) && nFees < ::minRelayTxFee.GetFee(nSize) && !AllowFree(view.GetPriority(tx, chainActive.Height() + 1))) {
@@ -2094,6 +2126,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         }
 //fprintf(stderr,"addmempool 7\n");
 
+        CCValidationMemoScope ccValidationMemo(ASSETCHAINS_CC != 0, (1<<30) + (chainActive.LastTip() != 0 ? (int32_t)chainActive.LastTip()->GetHeight() + 1 : 0));
         if (!ContextualCheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, txdata, Params().GetConsensus(), consensusBranchId))
         {
             if ( flag != 0 )
@@ -2120,6 +2153,13 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                 }
             }
         }
+
+        if (dosLevel != -1)
+        {
+            LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+            if (!pool.exists(hash))
+                return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+        }
     }
     // This should be here still? 
     //SyncWithWallets(tx, NULL); 
@@ -2161,10 +2201,12 @@ bool CCTxFixAcceptToMemPoolUnchecked(CTxMemPool& pool, const CTransaction &tx)
 
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes)
 {
-    if (!fTimestampIndex)
+    if (!fTimestampIndex || ptimestampindexdb == NULL)
         return error("Timestamp index not enabled");
 
-    if (!pblocktree->ReadTimestampIndex(high, low, fActiveOnly, hashes))
+    if (!SyncIndexes(false))
+        return error(IndexesSyncing() ? "Timestamp index is syncing" : "Timestamp index failed");
+    if (!ptimestampindexdb->ReadTimestampIndex(high, low, fActiveOnly, hashes))
         return error("Unable to get hashes for timestamps");
 
     return true;
@@ -2172,42 +2214,72 @@ bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const
 
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
 {
-    if (!fSpentIndex)
+    if (!fSpentIndex || pspentindexdb == NULL)
         return false;
 
     if (mempool.getSpentIndex(key, value))
         return true;
 
-    if (!pblocktree->ReadSpentIndex(key, value))
+    if (!SyncIndexes() || !pspentindexdb->ReadSpentIndex(key, value))
+        return false;
+
+    return true;
+}
+
+bool GetTokenIndex(const CTokenIndexKey &key, CTokenIndexValue &value)
+{
+    if (!fTokenIndex)
+        return false;
+
+    if (!pblocktree->ReadTokenIndex(key, value))
         return false;
 
     return true;
 }
 
 bool GetAddressIndex(uint160 addressHash, int type,
-                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end)
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end,
+                     const CAddressIndexKey *pAfterKey, size_t nMaxResults)
 {
-    if (!fAddressIndex)
+    if (!fAddressIndex || paddressindexdb == NULL)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+    if (!SyncIndexes())
+        return error(IndexesSyncing() ? "address index is syncing" : "address index failed");
+    if (!paddressindexdb->ReadAddressIndex(addressHash, type, addressIndex, start, end, pAfterKey, nMaxResults))
         return error("unable to get txids for address");
 
     return true;
 }
 
 bool GetAddressUnspent(uint160 addressHash, int type,
-                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       const CAddressUnspentKey *pAfterKey, size_t nMaxResults)
 {
-    if (!fAddressIndex)
+    if (!fAddressIndex || paddressindexdb == NULL)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+    if (!SyncIndexes())
+        return error(IndexesSyncing() ? "address index is syncing" : "address index failed");
+    if (!paddressindexdb->ReadAddressUnspentIndex(addressHash, type, unspentOutputs, pAfterKey, nMaxResults))
         return error("unable to get txids for address");
 
     return true;
 }
 
+bool GetAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value)
+{
+    if (!fAddressIndex || !fAddressBalanceIndex || paddressindexdb == NULL)
+        return false;
+
+    if (!SyncIndexes())
+        return error(IndexesSyncing() ? "address index is syncing" : "address index failed");
+    if (!paddressindexdb->ReadAddressBalance(addressHash, type, value))
+        return error("unable to get balance for address");
+
+    return true;
+}
+
 struct CompareBlocksByHeightMain
 {
     bool operator()(const CBlockIndex* a, const CBlockIndex* b) const
@@ -2234,6 +2306,107 @@ struct CompareBlocksByHeightMain
     else return(coins.vout[n].nValue);
 }*/
 
+CBlockTxOverlay::CBlockTxOverlay(const CBlock& block, int32_t height)
+{
+    int32_t n = (int32_t)block.vtx.size();
+    bool fPoS = (n > 1 && komodo_isPoS((CBlock *)&block,height,0) != 0);
+    std::vector<int32_t> candidates;
+    std::map<uint256, int32_t> mapIndex;
+    for (int32_t i=0; i<n; i++)
+    {
+        const CTransaction &tx = block.vtx[i];
+        if ( tx.IsCoinBase() || !tx.vjoinsplit.empty() || !tx.vShieldedSpend.empty() || (i == n-1 && fPoS) )
+            continue;
+        mapIndex[tx.GetHash()] = i;
+        candidates.push_back(i);
+    }
+    // order in-block parents before their children, keeping block order otherwise
+    std::vector<uint8_t> state(n, 0); // 0 - unvisited, 1 - in progress, 2 - done
+    std::vector<std::pair<int32_t, size_t> > stack;
+    vtx.reserve(candidates.size());
+    BOOST_FOREACH(int32_t start, candidates)
+    {
+        if ( state[start] != 0 )
+            continue;
+        stack.push_back(std::make_pair(start, (size_t)0));
+        state[start] = 1;
+        while ( !stack.empty() )
+        {
+            int32_t i = stack.back().first;
+            size_t &vini = stack.back().second;
+            const CTransaction &tx = block.vtx[i];
+            if ( vini < tx.vin.size() )
+            {
+                std::map<uint256, int32_t>::const_iterator mi = mapIndex.find(tx.vin[vini++].prevout.hash);
+                if ( mi != mapIndex.end() && state[mi->second] == 0 ) // a dependency cycle is invalid anyway, just skip it
+                {
+                    state[mi->second] = 1;
+                    stack.push_back(std::make_pair(mi->second, (size_t)0));
+                }
+                continue;
+            }
+            state[i] = 2;
+            mapTx[tx.GetHash()] = vtx.size();
+            vtx.push_back(tx);
+            for (int32_t j=0; j<tx.vin.size(); j++)
+                mapSpends[tx.vin[j].prevout] = std::make_pair(tx.GetHash(), j);
+            stack.pop_back();
+        }
+    }
+}
+
+bool CBlockTxOverlay::GetTransaction(const uint256& hash, CTransaction& txOut) const
+{
+    std::map<uint256, size_t>::const_iterator mi = mapTx.find(hash);
+    if ( mi == mapTx.end() )
+        return false;
+    txOut = vtx[mi->second];
+    return true;
+}
+
+bool CBlockTxOverlay::GetSpender(const uint256& txid, int32_t vout, uint256& spenttxid, int32_t& spentvini) const
+{
+    std::map<COutPoint, std::pair<uint256, int32_t> >::const_iterator mi = mapSpends.find(COutPoint(txid, vout));
+    if ( mi == mapSpends.end() )
+        return false;
+    spenttxid = mi->second.first;
+    spentvini = mi->second.second;
+    return true;
+}
+
+// Per thread: only the thread validating a block may see its transactions. RPC
+// calls, mempool workers and other CheckBlock callers run on their own threads.
+static thread_local std::shared_ptr<const CBlockTxOverlay> pblocktxoverlay;
+
+std::shared_ptr<const CBlockTxOverlay> GetBlockTxOverlay()
+{
+    return pblocktxoverlay;
+}
+
+CBlockTxOverlayScope::CBlockTxOverlayScope(const CBlock& block, int32_t height, bool fEnable) : fInstalled(false)
+{
+    // a nested scope comes from ConnectBlock calling CheckBlock for the same block
+    if ( !fEnable || pblocktxoverlay )
+        return;
+    pblocktxoverlay = std::make_shared<const CBlockTxOverlay>(block, height);
+    fInstalled = true;
+}
+
+CBlockTxOverlayScope::CBlockTxOverlayScope(const std::shared_ptr<const CBlockTxOverlay>& overlay) : fInstalled(false)
+{
+    if ( !overlay || pblocktxoverlay == overlay )
+        return;
+    prevoverlay = pblocktxoverlay;
+    pblocktxoverlay = overlay;
+    fInstalled = true;
+}
+
+CBlockTxOverlayScope::~CBlockTxOverlayScope()
+{
+    if ( fInstalled )
+        pblocktxoverlay = prevoverlay;
+}
+
 bool myAddtomempool(CTransaction &tx, CValidationState *pstate, bool fSkipExpiry)
 {
     CValidationState state;
@@ -2267,6 +2440,10 @@ bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlo
     }
     // need a GetTransaction without lock so the validation code for assets can run without deadlock
     {
+        // transactions of the block under validation are returned like mempool ones, with a null hashBlock
+        std::shared_ptr<const CBlockTxOverlay> overlay = GetBlockTxOverlay();
+        if (overlay && overlay->GetTransaction(hash, txOut))
+            return true;
         //fprintf(stderr,"check mempool %s\n",hash.GetHex().c_str());
         if (mempool.lookup(hash, txOut))
         {
@@ -2276,10 +2453,10 @@ bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlo
     }
     //fprintf(stderr,"check disk %s\n",hash.GetHex().c_str());
 
-    if (fTxIndex) {
+    if (fTxIndex && ptxindexdb != NULL && SyncIndexes()) {
         CDiskTxPos postx;
         //fprintf(stderr,"ReadTxIndex\n");
-        if (pblocktree->ReadTxIndex(hash, postx)) {
+        if (ptxindexdb->ReadTxIndex(hash, postx)) {
             //fprintf(stderr,"OpenBlockFile\n");
             CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
             if (file.IsNull())
@@ -2336,9 +2513,9 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
         return true;
     }
 
-    if (fTxIndex) {
+    if (fTxIndex && ptxindexdb != NULL && SyncIndexes()) {
         CDiskTxPos postx;
-        if (pblocktree->ReadTxIndex(hash, postx)) {
+        if (ptxindexdb->ReadTxIndex(hash, postx)) {
             CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
             if (file.IsNull())
                 return error("%s: OpenBlockFile failed", __func__);
@@ -2427,6 +2604,119 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
     return true;
 }
 
+/** Computes the txid of one transaction deserialized under a CTxHashDeferral. */
+class CTxHashCheck
+{
+private:
+    const CTransaction *ptx;
+
+public:
+    CTxHashCheck(): ptx(NULL) {}
+    CTxHashCheck(const CTransaction& txIn): ptx(&txIn) {}
+
+    bool operator()() {
+        CTxHashDeferral::Complete(*ptx);
+        return true;
+    }
+
+    void swap(CTxHashCheck &check) {
+        std::swap(ptx, check.ptx);
+    }
+};
+
+/** Blocks with fewer transactions are hashed on the calling thread, waking the workers costs more. */
+static const size_t MIN_PARALLEL_TXHASH_TXS = 64;
+
+static CCheckQueue<CTxHashCheck> txhashqueue(16);
+// A CCheckQueue serves one master at a time; blocks are read by the message
+// handler, the import thread and rpc, so whoever finds it busy hashes serially.
+static boost::mutex cs_txhashqueue;
+
+void ThreadTxHash() {
+    RenameThread("zcash-txhash");
+    txhashqueue.Thread();
+}
+
+void UpdateBlockTxHashes(const CBlock& block)
+{
+    if (nScriptCheckThreads && block.vtx.size() >= MIN_PARALLEL_TXHASH_TXS) {
+        boost::unique_lock<boost::mutex> lock(cs_txhashqueue, boost::try_to_lock);
+        if (lock.owns_lock()) {
+            CCheckQueueControl<CTxHashCheck> control(&txhashqueue);
+            std::vector<CTxHashCheck> vChecks;
+            vChecks.reserve(block.vtx.size());
+            for (const CTransaction& tx : block.vtx)
+                vChecks.push_back(CTxHashCheck(tx));
+            control.Add(vChecks);
+            control.Wait();
+            return;
+        }
+    }
+    for (const CTransaction& tx : block.vtx)
+        CTxHashDeferral::Complete(tx);
+}
+
+/** Verifies the Equihash solution of one received header, filling the cache for the checks of its block. */
+class CEquihashCheck
+{
+private:
+    const CBlockHeader *pheader;
+
+public:
+    CEquihashCheck(): pheader(NULL) {}
+    CEquihashCheck(const CBlockHeader& headerIn): pheader(&headerIn) {}
+
+    bool operator()() {
+        return CheckEquihashSolution(pheader, Params());
+    }
+
+    void swap(CEquihashCheck &check) {
+        std::swap(pheader, check.pheader);
+    }
+};
+
+static CCheckQueue<CEquihashCheck> equihashqueue(4);
+// Only the message handler drives this queue, the lock just keeps that an invariant.
+static boost::mutex cs_equihashqueue;
+
+void ThreadEquihashCheck() {
+    RenameThread("zcash-equihash");
+    equihashqueue.Thread();
+}
+
+/** Verify the Equihash solutions of a batch of headers, on the worker threads when they are free. */
+static bool CheckHeadersEquihash(const std::vector<CBlockHeader>& headers)
+{
+    if (nScriptCheckThreads && headers.size() > 1) {
+        boost::unique_lock<boost::mutex> lock(cs_equihashqueue, boost::try_to_lock);
+        if (lock.owns_lock()) {
+            CCheckQueueControl<CEquihashCheck> control(&equihashqueue);
+            std::vector<CEquihashCheck> vChecks;
+            vChecks.reserve(headers.size());
+            for (const CBlockHeader& header : headers)
+                vChecks.push_back(CEquihashCheck(header));
+            control.Add(vChecks);
+            return control.Wait();
+        }
+    }
+    for (const CBlockHeader& header : headers) {
+        if (!CheckEquihashSolution(&header, Params()))
+            return false;
+    }
+    return true;
+}
+
+/** Deserialize a block, computing its txids with UpdateBlockTxHashes rather than one by one while reading. */
+template <typename Stream>
+static void ReadBlockHashingTxs(Stream& s, CBlock& block)
+{
+    {
+        CTxHashDeferral deferTxHashes;
+        s >> block;
+    }
+    UpdateBlockTxHashes(block);
+}
+
 bool ReadBlockFromDisk(int32_t height,CBlock& block, const CDiskBlockPos& pos,bool checkPOW)
 {
     uint8_t pubkey33[33];
@@ -2442,7 +2732,7 @@ bool ReadBlockFromDisk(int32_t height,CBlock& block, const CDiskBlockPos& pos,bo
 
     // Read block
     try {
-        filein >> block;
+        ReadBlockHashingTxs(filein, block);
     }
     catch (const std::exception& e) {
         fprintf(stderr,"readblockfromdisk err B\n");
@@ -2796,6 +3086,9 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
 }
 
 bool CScriptCheck::operator()() {
+    // may run on a script check thread, give CC validation the view of the thread that queued it
+    CBlockTxOverlayScope blockTxOverlay(pblocktxoverlay);
+    CCValidationMemoScope ccValidationMemo(pccvalidationmemo);
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     ServerTransactionSignatureChecker checker(ptxTo, nIn, amount, cacheStore, *txdata);
     if (!VerifyScript(scriptSig, scriptPubKey, nFlags, checker, consensusBranchId, &error, &stateCC)) {
@@ -3196,124 +3489,579 @@ int8_t GetAddressType(const CScript &scriptPubKey, CTxDestination &vDest, txnout
     return keyType;
 }
 
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+//////////////////////////////////////////////////////////////////////////////
+//
+// Background indexer
+//
+// The transaction, address, spent and timestamp indexes each live in their own
+// database and are written by one indexer thread, off the ConnectBlock path.
+// Every database records the block it is synced to, so an index that is
+// behind (newly enabled, or cut short by a crash or shutdown) is caught up
+// from the block and undo files when the node starts, before any block is
+// connected. Readers call SyncIndexes() first, so cc validation sees every
+// block connected before the read. Only rpc readers may skip a catch-up that
+// is still running and report the indexes as syncing instead.
+//
+
+/**
+ * One block to add to (or, with fDisconnect, remove from) the index databases.
+ * Blocks are queued with their data while connecting and without it otherwise,
+ * in which case the indexer reads them back from the block and undo files.
+ */
+struct CIndexerBlock
 {
-    assert(pindex->GetBlockHash() == view.GetBestBlock());
+    uint256 hashBlock;
+    uint256 hashPrevBlock;
+    int nHeight;
+    unsigned int nTime;
+    CDiskBlockPos blockPos;
+    CDiskBlockPos undoPos;
+    bool fDisconnect;
+    bool fLoaded;
+    CBlock block;
+    CBlockUndo blockundo;
 
-    if (pfClean)
-        *pfClean = false;
+    CIndexerBlock() : nHeight(0), nTime(0), fDisconnect(false), fLoaded(false) {}
+};
 
-    bool fClean = true;
-    //komodo_disconnect(pindex,block); does nothing?
-    CBlockUndo blockUndo;
-    CDiskBlockPos pos = pindex->GetUndoPos();
-    if (pos.IsNull())
-        return error("DisconnectBlock(): no undo data available");
-    if (!UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash()))
-        return error("DisconnectBlock(): failure reading undo data");
+//! queued blocks beyond which newly connected blocks are queued without their data
+static const unsigned int MAX_INDEXER_LOADED_BLOCKS = 64;
+
+static boost::mutex cs_indexer;
+static boost::condition_variable condIndexer;
+static boost::condition_variable condIndexerIdle;
+static std::deque<CIndexerBlock> queueIndexer;
+//! blocks of the active chain (and stale blocks to remove first) the indexes are behind on at startup
+static std::vector<std::pair<const CBlockIndex*, bool> > vIndexerCatchUp;
+static size_t nIndexerCatchUpPos = 0;
+static unsigned int nIndexerLoaded = 0;
+//! blocks put on queueIndexer and written out of it so far, so readers wait only for blocks queued before them
+static uint64_t nIndexerQueued = 0, nIndexerDone = 0;
+static bool fIndexerRunning = false;
+static bool fIndexerStopped = false;
+static bool fIndexerFailed = false;
+static boost::thread *pthreadIndexer = NULL;
+
+static bool IndexesOpen()
+{
+    return ptxindexdb != NULL || paddressindexdb != NULL || pspentindexdb != NULL || ptimestampindexdb != NULL;
+}
 
-    if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
-        return error("DisconnectBlock(): block and undo data inconsistent");
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+// block index entries do not change once the block was connected, so the indexer may read them without cs_main
+static void InitIndexerBlock(CIndexerBlock &item, const CBlockIndex *pindex, bool fDisconnect)
+{
+    item.hashBlock = pindex->GetBlockHash();
+    item.hashPrevBlock = pindex->pprev ? pindex->pprev->GetBlockHash() : uint256();
+    item.nHeight = pindex->GetHeight();
+    item.nTime = pindex->nTime;
+    item.blockPos = pindex->GetBlockPos();
+    item.undoPos = pindex->GetUndoPos();
+    item.fDisconnect = fDisconnect;
+}
 
-    // undo transactions in reverse order
-    for (int i = block.vtx.size() - 1; i >= 0; i--) {
+/** Hand a block that was just connected or disconnected over to the indexer */
+static void QueueIndexerBlock(const CBlockIndex *pindex, bool fDisconnect, const CBlock *pblock = NULL, const CBlockUndo *pblockundo = NULL)
+{
+    if (!IndexesOpen())
+        return;
+
+    boost::unique_lock<boost::mutex> lock(cs_indexer);
+    if (fIndexerStopped)
+        return; // indexed from disk on the next start
+    queueIndexer.push_back(CIndexerBlock());
+    CIndexerBlock &item = queueIndexer.back();
+    InitIndexerBlock(item, pindex, fDisconnect);
+    nIndexerQueued++;
+    if (pblock != NULL && pblockundo != NULL && nIndexerLoaded < MAX_INDEXER_LOADED_BLOCKS) {
+        item.block = *pblock;
+        item.blockundo = *pblockundo;
+        item.fLoaded = true;
+        nIndexerLoaded++;
+    }
+    condIndexer.notify_one();
+}
+
+static bool LoadIndexerBlock(CIndexerBlock &item)
+{
+    if (!ReadBlockFromDisk(item.nHeight, item.block, item.blockPos, false) || item.block.GetHash() != item.hashBlock)
+        return error("%s: failed to read block %s", __func__, item.hashBlock.ToString());
+    if (item.undoPos.IsNull() || !UndoReadFromDisk(item.blockundo, item.undoPos, item.hashPrevBlock))
+        return error("%s: failed to read undo data of block %s", __func__, item.hashBlock.ToString());
+    item.fLoaded = true;
+    return true;
+}
+
+static void GetIndexerOutputEntries(const CIndexerBlock &item, unsigned int i,
+                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &addressUnspentIndex)
+{
+    const CTransaction &tx = item.block.vtx[i];
+    const uint256 txhash = tx.GetHash();
+    for (unsigned int k = 0; k < tx.vout.size(); k++) {
+        const CTxOut &out = tx.vout[k];
+
+        vector<vector<unsigned char>> vSols;
+        CTxDestination vDest;
+        txnouttype txType = TX_PUBKEYHASH;
+        int keyType = GetAddressType(out.scriptPubKey, vDest, txType, vSols);
+        if ( keyType != 0 )
+        {
+            for (auto addr : vSols)
+            {
+                uint160 addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
+                // record receiving activity
+                addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, item.nHeight, i, txhash, k, false), out.nValue));
+
+                // record the unspent output, or remove it when disconnecting
+                addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, txhash, k),
+                    item.fDisconnect ? CAddressUnspentValue() : CAddressUnspentValue(out.nValue, out.scriptPubKey, item.nHeight)));
+            }
+        }
+    }
+}
+
+/**
+ * Derives the address, unspent and spent index entries of a block from the
+ * block and its undo data, which holds every output the block spent. The
+ * transactions are walked in the order ConnectBlock (or, disconnecting,
+ * DisconnectBlock) handles them, so that when a block creates and spends the
+ * same output the right entry is the one written last.
+ */
+static bool GetIndexerEntries(const CIndexerBlock &item,
+                              std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                              std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &addressUnspentIndex,
+                              std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &spentIndex)
+{
+    const CBlock &block = item.block;
+    if (item.blockundo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s: block and undo data of %s inconsistent", __func__, item.hashBlock.ToString());
+
+    for (unsigned int n = 0; n < block.vtx.size(); n++) {
+        unsigned int i = item.fDisconnect ? block.vtx.size() - 1 - n : n;
         const CTransaction &tx = block.vtx[i];
-        uint256 hash = tx.GetHash();
-        if (fAddressIndex) {
+        const uint256 txhash = tx.GetHash();
 
-            for (unsigned int k = tx.vout.size(); k-- > 0;) {
-                const CTxOut &out = tx.vout[k];
+        if (item.fDisconnect)
+            GetIndexerOutputEntries(item, i, addressIndex, addressUnspentIndex);
+        if (!tx.IsMint()) {
+            // the undo data of a pegs import has no entry for its first input
+            const CTxUndo &txundo = item.blockundo.vtxundo[i-1];
+            unsigned int nSkip = tx.IsPegsImport() ? 1 : 0;
+            if (txundo.vprevout.size() + nSkip != tx.vin.size())
+                return error("%s: transaction and undo data of %s inconsistent", __func__, txhash.ToString());
+            for (unsigned int j = nSkip; j < tx.vin.size(); j++) {
+                const CTxIn &input = tx.vin[j];
+                const CTxInUndo &undo = txundo.vprevout[j - nSkip];
+                const CTxOut &prevout = undo.txout;
 
                 vector<vector<unsigned char>> vSols;
                 CTxDestination vDest;
                 txnouttype txType = TX_PUBKEYHASH;
-                int keyType = GetAddressType(out.scriptPubKey, vDest, txType, vSols);
-                if ( keyType != 0 )
+                uint160 addrHash;
+                int keyType = GetAddressType(prevout.scriptPubKey, vDest, txType, vSols);
+                if (item.fDisconnect)
+                    spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue()));
+                if ( keyType == 0 )
+                    continue;
+                for (auto addr : vSols)
                 {
-                    for (auto addr : vSols)
-                    {
-                        uint160 addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
-                        addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->GetHeight(), i, hash, k, false), out.nValue));
-                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, hash, k), CAddressUnspentValue()));
-                    }
+                    addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
+                    // record spending activity
+                    addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, item.nHeight, i, txhash, j, true), prevout.nValue * -1));
+
+                    // remove the spent output from the unspent index, or restore it when disconnecting
+                    addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, input.prevout.hash, input.prevout.n),
+                        item.fDisconnect ? CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight) : CAddressUnspentValue()));
+                }
+                if (!item.fDisconnect) {
+                    // add the spent index to determine the txid and input that spent an output
+                    // and to find the amount and address from an input
+                    spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, item.nHeight, prevout.nValue, keyType, addrHash)));
                 }
             }
         }
+        if (!item.fDisconnect)
+            GetIndexerOutputEntries(item, i, addressIndex, addressUnspentIndex);
+    }
+    return true;
+}
 
-        // Check that all outputs are available and match the outputs in the block itself
-        // exactly.
-        {
-            CCoinsModifier outs = view.ModifyCoins(hash);
-            outs->ClearUnspendable();
+// an index without a best block is empty, which is where the genesis block (never indexed) leaves it
+static uint256 IndexBestBlock(const CIndexDB *pdb)
+{
+    uint256 hash;
+    if (!pdb->ReadBestBlock(hash))
+        hash = Params().GetConsensus().hashGenesisBlock;
+    return hash;
+}
 
-            CCoins outsBlock(tx, pindex->GetHeight());
-            // The CCoins serialization does not serialize negative numbers.
-            // No network rules currently depend on the version here, so an inconsistency is harmless
-            // but it must be corrected before txout nversion ever influences a network rule.
-            if (outsBlock.nVersion < 0)
-                outs->nVersion = outsBlock.nVersion;
-            if (*outs != outsBlock)
-                fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
+/** Whether the block extends the best block of pdb, or when disconnecting, is its best block */
+static bool IndexerTakesBlock(const CIndexDB *pdb, const CIndexerBlock &item)
+{
+    return pdb != NULL && IndexBestBlock(pdb) == (item.fDisconnect ? item.hashBlock : item.hashPrevBlock);
+}
 
-            // remove outputs
-            outs->Clear();
+/**
+ * Writes one block to every index database it applies to. Databases at a
+ * different block skip it: they are either ahead of it (a block that was
+ * reconnected by -checklevel=4 or queued before a catch-up) or on another
+ * branch that a queued disconnect has yet to leave.
+ */
+static bool ApplyIndexerBlock(CIndexerBlock &item)
+{
+    bool fTx = IndexerTakesBlock(ptxindexdb, item);
+    bool fAddress = IndexerTakesBlock(paddressindexdb, item);
+    bool fSpent = IndexerTakesBlock(pspentindexdb, item);
+    bool fTimestamp = IndexerTakesBlock(ptimestampindexdb, item);
+    const uint256 &hashBest = item.fDisconnect ? item.hashPrevBlock : item.hashBlock;
+
+    if (!fTx && !fAddress && !fSpent && !fTimestamp) {
+        LogPrint("index", "%s: no index at the parent of %s, skipped\n", __func__, item.hashBlock.ToString());
+        return true;
+    }
+    if (!item.fLoaded && (fAddress || fSpent || (fTx && !item.fDisconnect)) && !LoadIndexerBlock(item))
+        return false;
+
+    if (fTx) {
+        if (item.fDisconnect) {
+            // entries of disconnected transactions stay until the transactions are confirmed again
+            if (!ptxindexdb->WriteBestBlock(hashBest))
+                return error("%s: failed to write transaction index", __func__);
+        } else {
+            CDiskTxPos pos(item.blockPos, GetSizeOfCompactSize(item.block.vtx.size()));
+            std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+            vPos.reserve(item.block.vtx.size());
+            BOOST_FOREACH(const CTransaction& tx, item.block.vtx) {
+                vPos.push_back(std::make_pair(tx.GetHash(), pos));
+                pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+            }
+            if (!ptxindexdb->WriteTxIndex(vPos, hashBest))
+                return error("%s: failed to write transaction index", __func__);
         }
+    }
 
-        // unspend nullifiers
-        view.SetNullifiers(tx, false);
+    if (fAddress || fSpent) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+        std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+        if (!GetIndexerEntries(item, addressIndex, addressUnspentIndex, spentIndex))
+            return false;
+        if (fAddress && !paddressindexdb->UpdateAddressIndexes(addressIndex, addressUnspentIndex, item.fDisconnect, fAddressBalanceIndex, hashBest))
+            return error("%s: failed to write address index", __func__);
+        if (fSpent && !pspentindexdb->UpdateSpentIndex(spentIndex, hashBest))
+            return error("%s: failed to write spent index", __func__);
+    }
 
-        // restore inputs
-        if (!tx.IsMint()) {
-            CTxUndo &txundo = blockUndo.vtxundo[i-1];
-            if (tx.IsPegsImport()) txundo.vprevout.insert(txundo.vprevout.begin(),CTxInUndo());
-            if (txundo.vprevout.size() != tx.vin.size())
-                return error("DisconnectBlock(): transaction and undo data inconsistent");
-            for (unsigned int j = tx.vin.size(); j-- > 0;) {
-                if (tx.IsPegsImport() && j==0)  continue;
-                const COutPoint &out = tx.vin[j].prevout;
-                const CTxInUndo &undo = txundo.vprevout[j];
-                if (!ApplyTxInUndo(undo, view, out))
-                    fClean = false;
+    if (fTimestamp) {
+        if (item.fDisconnect) {
+            // inactive blocks are filtered out when reading
+            if (!ptimestampindexdb->WriteBestBlock(hashBest))
+                return error("%s: failed to write timestamp index", __func__);
+        } else {
+            unsigned int logicalTS = item.nTime;
+            unsigned int prevLogicalTS = 0;
 
-                const CTxIn input = tx.vin[j];
+            // retrieve logical timestamp of the previous block
+            if (item.nHeight > 1 && !ptimestampindexdb->ReadTimestampBlockIndex(item.hashPrevBlock, prevLogicalTS))
+                LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
 
-                if (fSpentIndex) {
-                    // undo and delete the spent index
-                    spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue()));
-                }
+            if (logicalTS <= prevLogicalTS) {
+                logicalTS = prevLogicalTS + 1;
+                LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, item.nTime, prevLogicalTS, logicalTS);
+            }
 
-                if (fAddressIndex) {
-                    const CTxOut &prevout = view.GetOutputFor(tx.vin[j]);
+            if (!ptimestampindexdb->WriteTimestampIndex(CTimestampIndexKey(logicalTS, item.hashBlock), CTimestampBlockIndexKey(item.hashBlock),
+                                                        CTimestampBlockIndexValue(logicalTS), hashBest))
+                return error("%s: failed to write timestamp index", __func__);
+        }
+    }
+    return true;
+}
 
-                    vector<vector<unsigned char>> vSols;
-                    CTxDestination vDest;
-                    txnouttype txType = TX_PUBKEYHASH;
-                    int keyType = GetAddressType(prevout.scriptPubKey, vDest, txType, vSols);
-                    if ( keyType != 0 )
-                    {
-                        for (auto addr : vSols)
-                        {
-                            uint160 addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
-                            // undo spending activity
-                            addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->GetHeight(), i, hash, j, true), prevout.nValue * -1));
-                            // restore unspent index
-                            addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight)));
-                        }
+static void ThreadIndexer()
+{
+    bool fFailed = false;
+    try {
+        while (true) {
+            boost::this_thread::interruption_point();
+            CIndexerBlock item;
+            bool fQueued = false, fCaughtUp = false;
+            {
+                boost::unique_lock<boost::mutex> lock(cs_indexer);
+                if (nIndexerCatchUpPos < vIndexerCatchUp.size()) {
+                    InitIndexerBlock(item, vIndexerCatchUp[nIndexerCatchUpPos].first, vIndexerCatchUp[nIndexerCatchUpPos].second);
+                    if (++nIndexerCatchUpPos == vIndexerCatchUp.size()) {
+                        LogPrintf("%s: catch-up reached block %s\n", __func__, item.hashBlock.ToString());
+                        std::vector<std::pair<const CBlockIndex*, bool> >().swap(vIndexerCatchUp);
+                        nIndexerCatchUpPos = 0;
+                        fCaughtUp = true;
+                    } else if (nIndexerCatchUpPos % 10000 == 0) {
+                        LogPrintf("%s: catching up, %u of %u blocks done\n", __func__, nIndexerCatchUpPos, vIndexerCatchUp.size());
                     }
+                } else {
+                    while (queueIndexer.empty())
+                        condIndexer.wait(lock);
+                    std::swap(item, queueIndexer.front());
+                    queueIndexer.pop_front();
+                    if (item.fLoaded)
+                        nIndexerLoaded--;
+                    fQueued = true;
                 }
             }
+            if (!ApplyIndexerBlock(item)) {
+                fFailed = true;
+                break;
+            }
+            if (fQueued || fCaughtUp) {
+                boost::unique_lock<boost::mutex> lock(cs_indexer);
+                if (fQueued)
+                    nIndexerDone++;
+                condIndexerIdle.notify_all();
+            }
         }
-        else if (tx.IsCoinImport() || tx.IsPegsImport())
-        {
-            RemoveImportTombstone(tx, view);
-        }
+    } catch (const boost::thread_interrupted&) {
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+        fFailed = true;
     }
 
-    // set the old best Sprout anchor back
-    view.PopAnchor(blockUndo.old_sprout_tree_root, SPROUT);
+    {
+        boost::unique_lock<boost::mutex> lock(cs_indexer);
+        fIndexerRunning = false;
+        fIndexerFailed |= fFailed;
+        condIndexerIdle.notify_all();
+    }
+    if (fFailed)
+        AbortNode("Failed to write the index databases");
+}
+
+bool MigrateLegacyIndexes()
+{
+    LOCK(cs_main);
+    CIndexDB *dbs[] = { ptxindexdb, paddressindexdb, pspentindexdb, ptimestampindexdb };
+    BOOST_FOREACH(CIndexDB *pdb, dbs) {
+        if (pdb == NULL || pblocktree == NULL || chainActive.Tip() == NULL || !pdb->HaveLegacyEntries(*pblocktree))
+            continue;
+        uint256 hashBest;
+        if (!pdb->ReadBestBlock(hashBest)) {
+            // the block tree entries were written in step with the active chain
+            LogPrintf("%s: moving the %s out of the block index database\n", __func__, pdb->GetName());
+            uiInterface.InitMessage(_("Upgrading index databases..."));
+            if (pdb == paddressindexdb) {
+                bool fBalanceIndex = false;
+                pblocktree->ReadFlag("addressbalanceindex", fBalanceIndex);
+                if (!pdb->WriteFlag("addressbalanceindex", fBalanceIndex))
+                    return error("%s: failed to write the %s", __func__, pdb->GetName());
+            }
+            if (!pdb->MigrateFrom(*pblocktree, false) || !pdb->WriteBestBlock(chainActive.Tip()->GetBlockHash()))
+                return error("%s: failed to write the %s", __func__, pdb->GetName());
+        }
+        if (!pdb->MigrateFrom(*pblocktree, true))
+            return error("%s: failed to erase the %s from the block index database", __func__, pdb->GetName());
+    }
+    return true;
+}
+
+bool StartIndexer()
+{
+    if (!IndexesOpen())
+        return true;
+
+    std::vector<std::pair<const CBlockIndex*, bool> > vCatchUp;
+    {
+        LOCK(cs_main);
+        CBlockIndex *pindexTip = chainActive.Tip();
+        CIndexDB *dbs[] = { ptxindexdb, paddressindexdb, pspentindexdb, ptimestampindexdb };
+        int nForkHeight = pindexTip ? pindexTip->GetHeight() : 0;
+        BOOST_FOREACH(CIndexDB *pdb, dbs) {
+            if (pdb == NULL)
+                continue;
+            uint256 hashBest;
+            bool fHaveBest = pdb->ReadBestBlock(hashBest);
+            if (pdb == paddressindexdb) {
+                // the balances can only be added or dropped by building the address index again
+                bool fBalanceIndex = false;
+                if (fHaveBest && (!pdb->ReadFlag("addressbalanceindex", fBalanceIndex) || fBalanceIndex != fAddressBalanceIndex)) {
+                    LogPrintf("%s: address balance index %s, rebuilding the address index\n", __func__, fAddressBalanceIndex ? "enabled" : "disabled");
+                    if (!pdb->Wipe())
+                        return error("%s: failed to wipe the %s", __func__, pdb->GetName());
+                }
+                if (!pdb->WriteFlag("addressbalanceindex", fAddressBalanceIndex))
+                    return error("%s: failed to write the %s", __func__, pdb->GetName());
+            }
+            if (pindexTip == NULL)
+                continue;
+
+            // blocks the index has but the active chain does not are removed again with their undo data
+            BlockMap::iterator mi = mapBlockIndex.find(IndexBestBlock(pdb));
+            const CBlockIndex *pindexFork = mi != mapBlockIndex.end() ? chainActive.FindFork(mi->second) : NULL;
+            std::vector<std::pair<const CBlockIndex*, bool> > vStale;
+            for (const CBlockIndex *pindex = pindexFork ? mi->second : NULL; pindex != pindexFork; pindex = pindex->pprev) {
+                if (!(pindex->nStatus & BLOCK_HAVE_DATA) || !(pindex->nStatus & BLOCK_HAVE_UNDO)) {
+                    pindexFork = NULL;
+                    break;
+                }
+                vStale.push_back(std::make_pair(pindex, true));
+            }
+            if (pindexFork == NULL) {
+                LogPrintf("%s: the %s is at an unknown block, rebuilding it\n", __func__, pdb->GetName());
+                if (!pdb->Wipe() || (pdb == paddressindexdb && !pdb->WriteFlag("addressbalanceindex", fAddressBalanceIndex)))
+                    return error("%s: failed to wipe the %s", __func__, pdb->GetName());
+                pindexFork = chainActive.Genesis();
+                vStale.clear();
+            }
+            if (pindexFork != pindexTip || !vStale.empty())
+                LogPrintf("%s: the %s is at height %d, catching up with height %d\n", __func__, pdb->GetName(), pindexFork->GetHeight(), pindexTip->GetHeight());
+            vCatchUp.insert(vCatchUp.end(), vStale.begin(), vStale.end());
+            nForkHeight = std::min(nForkHeight, pindexFork->GetHeight());
+        }
+        for (int nHeight = nForkHeight + 1; pindexTip != NULL && nHeight <= pindexTip->GetHeight(); nHeight++)
+            vCatchUp.push_back(std::make_pair(chainActive[nHeight], false));
+    }
+
+    boost::unique_lock<boost::mutex> lock(cs_indexer);
+    vIndexerCatchUp.swap(vCatchUp);
+    nIndexerCatchUpPos = 0;
+    fIndexerRunning = true;
+    fIndexerStopped = false;
+    fIndexerFailed = false;
+    pthreadIndexer = new boost::thread(boost::bind(&TraceThread<void (*)()>, "indexer", &ThreadIndexer));
+    return true;
+}
+
+void StopIndexer()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs_indexer);
+        fIndexerStopped = true;
+    }
+    if (pthreadIndexer != NULL) {
+        pthreadIndexer->interrupt();
+        pthreadIndexer->join();
+        delete pthreadIndexer;
+        pthreadIndexer = NULL;
+    }
+    boost::unique_lock<boost::mutex> lock(cs_indexer);
+    queueIndexer.clear();
+    vIndexerCatchUp.clear();
+    nIndexerCatchUpPos = 0;
+    nIndexerLoaded = 0;
+    nIndexerDone = nIndexerQueued;
+    fIndexerRunning = false;
+    condIndexerIdle.notify_all();
+}
+
+static bool IndexerCatchingUp()
+{
+    return fIndexerRunning && nIndexerCatchUpPos < vIndexerCatchUp.size();
+}
+
+bool IndexesSyncing()
+{
+    boost::unique_lock<boost::mutex> lock(cs_indexer);
+    return IndexerCatchingUp();
+}
+
+bool SyncIndexes(bool fWaitCatchUp)
+{
+    boost::unique_lock<boost::mutex> lock(cs_indexer);
+    if (!fWaitCatchUp && IndexerCatchingUp())
+        return false;
+    // blocks queued during the catch-up are written after it
+    uint64_t nTarget = nIndexerQueued;
+    while (fIndexerRunning && (IndexerCatchingUp() || nIndexerDone < nTarget))
+        condIndexerIdle.wait(lock);
+    return !fIndexerFailed;
+}
+
+bool WaitForIndexerCatchUp()
+{
+    boost::unique_lock<boost::mutex> lock(cs_indexer);
+    while (IndexerCatchingUp() && !ShutdownRequested()) {
+        std::string strMessage = strprintf(_("Catching up the indexes (%u of %u blocks)..."), nIndexerCatchUpPos, vIndexerCatchUp.size());
+        lock.unlock();
+        uiInterface.InitMessage(strMessage);
+        lock.lock();
+        condIndexerIdle.timed_wait(lock, boost::posix_time::seconds(1));
+    }
+    return !fIndexerFailed;
+}
+
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+{
+    assert(pindex->GetBlockHash() == view.GetBestBlock());
+
+    if (pfClean)
+        *pfClean = false;
+
+    bool fClean = true;
+    //komodo_disconnect(pindex,block); does nothing?
+    CBlockUndo blockUndo;
+    CDiskBlockPos pos = pindex->GetUndoPos();
+    if (pos.IsNull())
+        return error("DisconnectBlock(): no undo data available");
+    if (!UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash()))
+        return error("DisconnectBlock(): failure reading undo data");
+
+    if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
+        return error("DisconnectBlock(): block and undo data inconsistent");
+    std::vector<std::pair<CTokenIndexKey, CTokenIndexValue> > tokenIndex;
+
+    // undo transactions in reverse order
+    for (int i = block.vtx.size() - 1; i >= 0; i--) {
+        const CTransaction &tx = block.vtx[i];
+        uint256 hash = tx.GetHash();
+        if (fTokenIndex) {
+            // erase token ownership entries of the outputs this block created
+            for (unsigned int k = 0; k < tx.vout.size(); k++)
+                if (tx.vout[k].scriptPubKey.IsPayToCryptoCondition())
+                    tokenIndex.push_back(make_pair(CTokenIndexKey(hash, k), CTokenIndexValue()));
+        }
+
+        // Check that all outputs are available and match the outputs in the block itself
+        // exactly.
+        {
+            CCoinsModifier outs = view.ModifyCoins(hash);
+            outs->ClearUnspendable();
+
+            CCoins outsBlock(tx, pindex->GetHeight());
+            // The CCoins serialization does not serialize negative numbers.
+            // No network rules currently depend on the version here, so an inconsistency is harmless
+            // but it must be corrected before txout nversion ever influences a network rule.
+            if (outsBlock.nVersion < 0)
+                outs->nVersion = outsBlock.nVersion;
+            if (*outs != outsBlock)
+                fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
+
+            // remove outputs
+            outs->Clear();
+        }
+
+        // unspend nullifiers
+        view.SetNullifiers(tx, false);
+
+        // restore inputs
+        if (!tx.IsMint()) {
+            CTxUndo &txundo = blockUndo.vtxundo[i-1];
+            if (tx.IsPegsImport()) txundo.vprevout.insert(txundo.vprevout.begin(),CTxInUndo());
+            if (txundo.vprevout.size() != tx.vin.size())
+                return error("DisconnectBlock(): transaction and undo data inconsistent");
+            for (unsigned int j = tx.vin.size(); j-- > 0;) {
+                if (tx.IsPegsImport() && j==0)  continue;
+                const COutPoint &out = tx.vin[j].prevout;
+                const CTxInUndo &undo = txundo.vprevout[j];
+                if (!ApplyTxInUndo(undo, view, out))
+                    fClean = false;
+            }
+        }
+        else if (tx.IsCoinImport() || tx.IsPegsImport())
+        {
+            RemoveImportTombstone(tx, view);
+        }
+    }
+
+    // set the old best Sprout anchor back
+    view.PopAnchor(blockUndo.old_sprout_tree_root, SPROUT);
 
     // set the old best Sapling anchor back
     // We can get this from the `hashFinalSaplingRoot` of the last block
@@ -3334,12 +4082,12 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         return true;
     }
 
-    if (fAddressIndex) {
-        if (!pblocktree->EraseAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to delete address index");
-        }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
+    // disconnects are rare, the background indexer reads the block and undo data back from disk
+    QueueIndexerBlock(pindex, true);
+
+    if (fTokenIndex && !tokenIndex.empty()) {
+        if (!pblocktree->UpdateTokenIndex(tokenIndex)) {
+            return AbortNode(state, "Failed to delete token index");
         }
     }
 
@@ -3475,6 +4223,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     int32_t futureblock;
     CAmount blockReward = GetBlockSubsidy(pindex->GetHeight(), chainparams.GetConsensus());
     uint64_t notarypaycheque = 0;
+    // make the block's transactions visible to CC validation for the whole connect, each tx is validated once below
+    CBlockTxOverlayScope blockTxOverlay(block, pindex->GetHeight(), ASSETCHAINS_CC != 0 && fCheckPOW);
+    CCValidationMemoScope ccValidationMemo(ASSETCHAINS_CC != 0, (int32_t)pindex->GetHeight());
     // Check it again to verify JoinSplit proofs, and in case a previous version let a bad block in
     if ( !CheckBlock(&futureblock,pindex->GetHeight(),pindex,block, state, fExpensiveChecks ? verifier : disabledVerifier, fCheckPOW, !fJustCheck) || futureblock != 0 )
     {
@@ -3595,13 +4346,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     uint64_t valueout;
     int64_t voutsum = 0, prevsum = 0, interest, sum = 0, stakeTxValue = 0;
     unsigned int nSigOps = 0;
-    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
-    vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
     // Construct the incremental merkle tree at the current
     // block position,
     auto old_sprout_tree_root = view.GetBestAnchor(SPROUT);
@@ -3633,7 +4378,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = block.vtx[i];
-        const uint256 txhash = tx.GetHash();
         nInputs += tx.vin.size();
         nSigOps += GetLegacySigOpCount(tx);
         if (nSigOps > MAX_BLOCK_SIGOPS)
@@ -3653,39 +4397,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 return state.DoS(100, error("ConnectBlock(): JoinSplit requirements not met"),
                                  REJECT_INVALID, "bad-txns-joinsplit-requirements-not-met");
 
-            if (fAddressIndex || fSpentIndex)
-            {
-                for (size_t j = 0; j < tx.vin.size(); j++) 
-                {
-                    if (tx.IsPegsImport() && j==0) continue;
-                    const CTxIn input = tx.vin[j];
-                    const CTxOut &prevout = view.GetOutputFor(tx.vin[j]);
-
-                    vector<vector<unsigned char>> vSols;
-                    CTxDestination vDest;
-                    txnouttype txType = TX_PUBKEYHASH;
-                    uint160 addrHash;
-                    int keyType = GetAddressType(prevout.scriptPubKey, vDest, txType, vSols);
-                    if ( keyType != 0 )
-                    {
-                        for (auto addr : vSols)
-                        {
-                            addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
-                            // record spending activity
-                            addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->GetHeight(), i, txhash, j, true), prevout.nValue * -1));
-
-                            // remove address from unspent index
-                            addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
-                        }
-
-                        if (fSpentIndex) {
-                            // add the spent index to determine the txid and input that spent an output
-                            // and to find the amount and address from an input
-                            spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, pindex->GetHeight(), prevout.nValue, keyType, addrHash)));
-                        }
-                    }
-                }
-            }
             // Add in sigops done by pay-to-script-hash inputs;
             // this is to prevent a "rogue miner" from creating
             // an incredibly-expensive-to-validate block.
@@ -3725,31 +4436,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             control.Add(vChecks);
         }
 
-        if (fAddressIndex) {
-            for (unsigned int k = 0; k < tx.vout.size(); k++) {
-                const CTxOut &out = tx.vout[k];
-
-                uint160 addrHash;
-
-                vector<vector<unsigned char>> vSols;
-                CTxDestination vDest;
-                txnouttype txType = TX_PUBKEYHASH;
-                int keyType = GetAddressType(out.scriptPubKey, vDest, txType, vSols);
-                if ( keyType != 0 )
-                {
-                    for (auto addr : vSols)
-                    {
-                        addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
-                        // record receiving activity
-                        addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->GetHeight(), i, txhash, k, false), out.nValue));
-
-                        // record unspent output
-                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->GetHeight())));
-                    }
-                }
-            }
-        }
-
         //if ( ASSETCHAINS_SYMBOL[0] == 0 )
         //    komodo_earned_interest(pindex->GetHeight(),sum);
         CTxUndo undoDummy;
@@ -3770,8 +4456,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             sapling_tree.append(outputDescription.cm);
         }
 
-        vPos.push_back(std::make_pair(tx.GetHash(), pos));
-        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
     
     // This is moved from CheckBlock for staking chains, so we can enforce the staking tx value was indeed paid to the coinbase.
@@ -3871,43 +4555,18 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     ConnectNotarisations(block, pindex->GetHeight()); // MoMoM notarisation DB.
 
-    if (fTxIndex)
-        if (!pblocktree->WriteTxIndex(vPos))
-            return AbortNode(state, "Failed to write transaction index");
-    if (fAddressIndex) {
-        if (!pblocktree->WriteAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to write address index");
-        }
-
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
-        }
-    }
-
-    if (fSpentIndex)
-        if (!pblocktree->UpdateSpentIndex(spentIndex))
-            return AbortNode(state, "Failed to write transaction index");
+    // the transaction, address, spent and timestamp indexes are written by the background indexer
+    QueueIndexerBlock(pindex, false, &block, &blockundo);
 
-    if (fTimestampIndex)
+    if (fTokenIndex && ASSETCHAINS_CC != 0)
     {
-        unsigned int logicalTS = pindex->nTime;
-        unsigned int prevLogicalTS = 0;
-
-        // retrieve logical timestamp of the previous block
-        if (pindex->pprev)
-            if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
-                LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
-
-        if (logicalTS <= prevLogicalTS) {
-            logicalTS = prevLogicalTS + 1;
-            LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
-        }
-
-        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())))
-            return AbortNode(state, "Failed to write timestamp index");
-
-        if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
-            return AbortNode(state, "Failed to write blockhash index");
+        // record token ownership of the new outputs, so token validation and
+        // balance queries need not re-derive it from the token tx history
+        std::vector<std::pair<CTokenIndexKey, CTokenIndexValue> > tokenIndex;
+        for (unsigned int i = 0; i < block.vtx.size(); i++)
+            TokensIndexTransaction(block.vtx[i], pindex->GetHeight(), tokenIndex);
+        if (!tokenIndex.empty() && !pblocktree->UpdateTokenIndex(tokenIndex))
+            return AbortNode(state, "Failed to write token index");
     }
 
     // add this block to the view's block chain
@@ -3918,7 +4577,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     // Watch for changes to the previous coinbase transaction.
     static uint256 hashPrevBestCoinBase;
-    GetMainSignals().UpdatedTransaction(hashPrevBestCoinBase);
+    QueueValidationNotification(boost::bind(boost::ref(GetMainSignals().UpdatedTransaction), hashPrevBestCoinBase));
     hashPrevBestCoinBase = block.vtx[0].GetHash();
 
     int64_t nTime4 = GetTimeMicros(); nTimeCallbacks += nTime4 - nTime3;
@@ -3980,7 +4639,8 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         }
         size_t cacheSize = pcoinsTip->DynamicMemoryUsage();
         // The cache is large and close to the limit, but we have time now (not in the middle of a block processing).
-        bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize * (10.0/9) > nCoinCacheUsage;
+        // An import connects blocks back to back and never has time, so it fills the whole cache before flushing.
+        bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && !(fImporting || fReindex) && cacheSize * (10.0/9) > nCoinCacheUsage;
         // The cache is over the limit, we have to write now.
         bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nCoinCacheUsage;
         // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
@@ -4042,7 +4702,7 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         }
         if ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000) {
             // Update best block in wallet (so we can detect restored wallets).
-            GetMainSignals().SetBestChain(chainActive.GetLocator());
+            QueueValidationNotification(boost::bind(boost::ref(GetMainSignals().SetBestChain), chainActive.GetLocator()));
             nLastSetChain = nNow;
         }
     } catch (const std::runtime_error& e) {
@@ -4122,11 +4782,65 @@ void static UpdateTip(CBlockIndex *pindexNew) {
  * Disconnect chainActive's tip. You probably want to call mempool.removeForReorg and
  * mempool.removeWithoutBranchId after this, with cs_main held.
  */
+/** The commitment trees handed to ChainTip, shared by the queued notification instead of copied. */
+struct CommitmentTrees {
+    SproutMerkleTree sprout;
+    SaplingMerkleTree sapling;
+
+    CommitmentTrees(const SproutMerkleTree& sproutIn, const SaplingMerkleTree& saplingIn) : sprout(sproutIn), sapling(saplingIn) {}
+};
+
+/**
+ * Queued by DisconnectTip and delivered without cs_main, so whether the block
+ * ends in a staking tx is worked out by DisconnectTip.
+ */
+static void NotifyDisconnectedBlock(const CBlockIndex *pindexDelete, std::shared_ptr<const CBlock> pblock, std::shared_ptr<const CommitmentTrees> trees, bool fStakingTx)
+{
+    const CBlock &block = *pblock;
+    // Let wallets know transactions went from 1-confirmed to
+    // 0-confirmed or conflicted:
+    for (int i = 0; i < block.vtx.size(); i++)
+    {
+        const CTransaction &tx = block.vtx[i];
+        //if ((i == (block.vtx.size() - 1)) && ((ASSETCHAINS_LWMAPOS && block.IsVerusPOSBlock()) || (ASSETCHAINS_STAKED != 0 && (komodo_isPoS((CBlock *)&block) != 0))))
+        if ( fStakingTx && i == block.vtx.size()-1 )
+        {
+#ifdef ENABLE_WALLET
+             // new staking tx cannot be accepted to mempool and expires in 1 block, so no need for this! :D
+             if ( !GetBoolArg("-disablewallet", false) && KOMODO_NSPV_FULLNODE )
+                 pwalletMain->EraseFromWallet(tx.GetHash());
+#endif
+        } else SyncWithWallets(tx, NULL);
+    }
+    // Update cached incremental witnesses
+    GetMainSignals().ChainTip(pindexDelete, &block, trees->sprout, trees->sapling, false);
+}
+
+/** Queued by ConnectTip and delivered without cs_main, the wallets get the block's index entry with each tx. */
+static void NotifyConnectedBlock(const CBlockIndex *pindexNew, std::shared_ptr<const CBlock> pblock, std::shared_ptr<const std::list<CTransaction> > txConflicted, std::shared_ptr<const CommitmentTrees> trees)
+{
+    if ( KOMODO_NSPV_FULLNODE )
+    {
+        // Tell wallet about transactions that went from mempool
+        // to conflicted:
+        BOOST_FOREACH(const CTransaction &tx, *txConflicted) {
+            SyncWithWallets(tx, NULL);
+        }
+        // ... and about transactions that got confirmed:
+        BOOST_FOREACH(const CTransaction &tx, pblock->vtx) {
+            SyncWithWallets(tx, pblock.get(), pindexNew);
+        }
+    }
+    // Update cached incremental witnesses
+    GetMainSignals().ChainTip(pindexNew, pblock.get(), trees->sprout, trees->sapling, true);
+}
+
 bool static DisconnectTip(CValidationState &state, bool fBare = false) {
     CBlockIndex *pindexDelete = chainActive.Tip();
     assert(pindexDelete);
-    // Read block from disk.
-    CBlock block;
+    // Read block from disk, straight into the copy the queued notification keeps.
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    CBlock &block = *pblock;
     if (!ReadBlockFromDisk(block, pindexDelete,1))
         return AbortNode(state, "Failed to read block");
     //if ( ASSETCHAINS_SYMBOL[0] != 0 || pindexDelete->GetHeight() > 1400000 )
@@ -4163,6 +4877,8 @@ bool static DisconnectTip(CValidationState &state, bool fBare = false) {
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
         return false;
 
+    // whether the last tx is a staking tx, also needed by the queued wallet notification
+    bool fStakingTx = !block.vtx.empty() && komodo_newStakerActive(0, pindexDelete->nTime) == 0 && komodo_isPoS((CBlock *)&block,pindexDelete->GetHeight(),0) != 0;
     if (!fBare) {
         // resurrect mempool transactions from the disconnected block.
         for (int i = 0; i < block.vtx.size(); i++)
@@ -4173,7 +4889,7 @@ bool static DisconnectTip(CValidationState &state, bool fBare = false) {
             CValidationState stateDummy;
             
             // don't keep staking or invalid transactions
-            if (tx.IsCoinBase() || (i == block.vtx.size()-1 && komodo_newStakerActive(0, pindexDelete->nTime) == 0 && komodo_isPoS((CBlock *)&block,pindexDelete->GetHeight(),0) != 0) || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL))
+            if (tx.IsCoinBase() || (i == block.vtx.size()-1 && fStakingTx) || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL))
             {
                 mempool.remove(tx, removed, true);
             }
@@ -4198,24 +4914,8 @@ bool static DisconnectTip(CValidationState &state, bool fBare = false) {
     SaplingMerkleTree newSaplingTree;
     assert(pcoinsTip->GetSproutAnchorAt(pcoinsTip->GetBestAnchor(SPROUT), newSproutTree));
     assert(pcoinsTip->GetSaplingAnchorAt(pcoinsTip->GetBestAnchor(SAPLING), newSaplingTree));
-    // Let wallets know transactions went from 1-confirmed to
-    // 0-confirmed or conflicted:
-    std::vector<uint256> TxToRemove;
-    for (int i = 0; i < block.vtx.size(); i++)
-    {
-        CTransaction &tx = block.vtx[i];
-        //if ((i == (block.vtx.size() - 1)) && ((ASSETCHAINS_LWMAPOS && block.IsVerusPOSBlock()) || (ASSETCHAINS_STAKED != 0 && (komodo_isPoS((CBlock *)&block) != 0))))
-        if ( komodo_newStakerActive(0, pindexDelete->nTime) == 0 && i == block.vtx.size()-1 && komodo_isPoS((CBlock *)&block,pindexDelete->GetHeight(),0) != 0 )
-        {
-#ifdef ENABLE_WALLET
-             // new staking tx cannot be accepted to mempool and expires in 1 block, so no need for this! :D
-             if ( !GetBoolArg("-disablewallet", false) && KOMODO_NSPV_FULLNODE )
-                 pwalletMain->EraseFromWallet(tx.GetHash());
-#endif
-        } else SyncWithWallets(tx, NULL);
-    }
-    // Update cached incremental witnesses
-    GetMainSignals().ChainTip(pindexDelete, &block, newSproutTree, newSaplingTree, false);
+    QueueValidationNotification(boost::bind(&NotifyDisconnectedBlock, pindexDelete,
+        std::shared_ptr<const CBlock>(pblock), std::make_shared<const CommitmentTrees>(newSproutTree, newSaplingTree), fStakingTx));
     return true;
 }
 
@@ -4290,107 +4990,44 @@ static int64_t nTimeChainState = 0;
 static int64_t nTimePostConnect = 0;
 
 // @author dimxy
-// class to save mempool state to a temp mempool object
-// and auto restore it (in destructor)
-// this is used for assets chains where we need to restore mempool form the txns of a validated block 
-// and restore the previous mempool state if block is failed 
+// class to checkpoint the mempool state and auto restore it (in destructor)
+// this is used for assets chains where validating a block may change the mempool
+// and the previous mempool state should be restored if the block is failed.
+// Only the mempool changes made while the checkpoint is open are journaled and undone,
+// so the cost does not depend on the mempool size.
 class CMempoolStateSaver 
 {
 public: 
-    CMempoolStateSaver(const std::string & _caller) : isAssetChain(false), preventRestore(false), caller(_caller), savedMempool(::minRelayTxFee) {}
+    CMempoolStateSaver(const std::string & _caller) : isAssetChain(false), preventRestore(false), checkpoint(0), caller(_caller) {}
     void Save(bool _isAssetChain) 
     {
         isAssetChain = _isAssetChain;
         if (isAssetChain)
-        {
-            // Copy all non Z-txs in mempool to temporary mempool because there can be tx in local mempool that make the block invalid.
-            LOCK2(cs_main, mempool.cs);
-
-            BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx) {
-                const CTransaction &tx = e.GetTx();
-                const uint256 &hash = tx.GetHash();
-                if (tx.vjoinsplit.empty() && tx.vShieldedSpend.empty()) {
-                    savedMempool.addUnchecked(hash, e, true);
-                }
-            }
-        }
+            checkpoint = mempool.StartJournal();
     }
 
-    // fix mempool state, so it would not return it to the real mempool
+    // fix mempool state, so the changes would be kept
     // if the block was valid and connected 
     void PreventRestore() 
     {
-        if (isAssetChain)   {
-            savedMempool.clear();
+        if (isAssetChain && !preventRestore)   {
+            mempool.CommitJournal();
             preventRestore = true;
         }
     } 
 
-private:
-    void _RestoreState()
-    {
-        if (isAssetChain)
-        {
-            if (!preventRestore)
-            {
-                LOCK2(cs_main, mempool.cs);
-
-                // clear current mempool:
-
-                list<CTransaction> transactionsToRemove;
-                BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx) {
-                    const CTransaction &tx = e.GetTx();
-                    if (tx.vjoinsplit.empty() && tx.vShieldedSpend.empty()) {
-                        transactionsToRemove.push_back(tx);
-                    }                
-                }
-                BOOST_FOREACH(const CTransaction& tx, transactionsToRemove) {
-                    list<CTransaction> removed;
-                    mempool.remove(tx, removed, false);
-                }            
-
-                // return the saved txns to mempool:
-
-                CCoinsView dummy;
-                CCoinsViewCache view(&dummy);
-                {
-                    CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
-                    view.SetBackend(viewMemPool);
-
-                    BOOST_FOREACH(const CTxMemPoolEntry& e, savedMempool.mapTx) {
-                        const CTransaction &tx = e.GetTx();
-                        const uint256 &hash = tx.GetHash();
-                        mempool.addUnchecked(hash, e, true);
-                        /* TODO: check why asserts for no inputs.prev.hash in coin cache here
-                        if (!tx.IsCoinImport())
-                        {
-                            // Add memory address index
-                            if (fAddressIndex) {
-                                mempool.addAddressIndex(e, view);
-                            }
-
-                            // Add memory spent index
-                            if (fSpentIndex) {
-                                mempool.addSpentIndex(e, view);
-                            }
-                        }*/
-                    }
-                    savedMempool.clear();
-                }
-            }
-        }
-    }
 public:
     // auto restore the saved state
     ~CMempoolStateSaver()
     {
-        _RestoreState();
+        if (isAssetChain && !preventRestore)
+            mempool.RollbackJournal(checkpoint);
     }
 
 private:
     bool isAssetChain;
     bool preventRestore;
-    CTxMemPool savedMempool;
+    size_t checkpoint;
     std::string caller;
 };
 
@@ -4405,11 +5042,13 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
     assert(pindexNew->pprev == chainActive.Tip());
     // Read block from disk.
     int64_t nTime1 = GetTimeMicros();
-    CBlock block;
+    // a block read here is shared with the queued notification rather than copied
+    std::shared_ptr<CBlock> pblockRead;
     if (!pblock) {
-        if (!ReadBlockFromDisk(block, pindexNew,1))
+        pblockRead = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblockRead, pindexNew,1))
             return AbortNode(state, "Failed to read block");
-        pblock = &block;
+        pblock = pblockRead.get();
     }
     KOMODO_CONNECTING = (int32_t)pindexNew->GetHeight();
     //fprintf(stderr,"%s connecting ht.%d maxsize.%d vs %d\n",ASSETCHAINS_SYMBOL,(int32_t)pindexNew->GetHeight(),MAX_BLOCK_SIZE(pindexNew->GetHeight()),(int32_t)::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION));
@@ -4475,20 +5114,11 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
 
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
-    if ( KOMODO_NSPV_FULLNODE )
-    {
-        // Tell wallet about transactions that went from mempool
-        // to conflicted:
-        BOOST_FOREACH(const CTransaction &tx, txConflicted) {
-            SyncWithWallets(tx, NULL);
-        }
-        // ... and about transactions that got confirmed:
-        BOOST_FOREACH(const CTransaction &tx, pblock->vtx) {
-            SyncWithWallets(tx, pblock);
-        }
-    }
-    // Update cached incremental witnesses
-    GetMainSignals().ChainTip(pindexNew, pblock, oldSproutTree, oldSaplingTree, true);
+    // A block passed in may be freed by the caller before the notification is delivered, so that one is copied.
+    QueueValidationNotification(boost::bind(&NotifyConnectedBlock, pindexNew,
+        pblockRead ? std::shared_ptr<const CBlock>(pblockRead) : std::make_shared<const CBlock>(*pblock),
+        std::make_shared<const std::list<CTransaction> >(txConflicted),
+        std::make_shared<const CommitmentTrees>(oldSproutTree, oldSaplingTree)));
 
     EnforceNodeDeprecation(pindexNew->GetHeight());
 
@@ -4769,12 +5399,16 @@ static bool ActivateBestChainStep(bool fSkipdpow, CValidationState &state, CBloc
  * or an activated best chain. pblock is either NULL or a pointer to a block
  * that is already loaded (to avoid loading it again from disk).
  */
-bool ActivateBestChain(bool fSkipdpow, CValidationState &state, CBlock *pblock) {
+bool ActivateBestChain(bool fSkipdpow, CValidationState &state, CBlock *pblock, bool fLimitQueue) {
     CBlockIndex *pindexNewTip = NULL;
     CBlockIndex *pindexMostWork = NULL;
     const CChainParams& chainParams = Params();
     do {
         boost::this_thread::interruption_point();
+        // Each step queues notifications holding up to 32 blocks, don't let a long
+        // activation (startup, reorg, reconsiderblock) run ahead of the subscribers.
+        if (fLimitQueue)
+            LimitValidationInterfaceQueue();
 
         bool fInitialDownload;
         {
@@ -4802,13 +5436,38 @@ bool ActivateBestChain(bool fSkipdpow, CValidationState &state, CBlock *pblock)
             // Don't relay blocks if pruning -- could cause a peer to try to download, resulting
             // in a stalled download if the block file is pruned before the request.
             if (nLocalServices & NODE_NETWORK) {
+                // Peers that asked for high-bandwidth compact relay get the new tip pushed
+                // as a cmpctblock, which saves them the inv/getdata round trip and most
+                // of the block's bytes.
+                std::set<NodeId> setCompactPeers;
+                std::shared_ptr<CBlockHeaderAndShortTxIDs> pcmpctblock;
+                if (fCompactBlocks && pblock != NULL && pblock->GetHash() == hashNewTip && pblock->vtx.size() <= MAX_COMPACT_BLOCK_TXS) {
+                    LOCK(cs_main);
+                    for (map<NodeId, CNodeState>::const_iterator it = mapNodeState.begin(); it != mapNodeState.end(); ++it)
+                        if (it->second.fPreferCompactBlocks)
+                            setCompactPeers.insert(it->first);
+                    if (!setCompactPeers.empty())
+                        pcmpctblock = std::make_shared<CBlockHeaderAndShortTxIDs>(*pblock);
+                }
+                CInv inv(MSG_BLOCK, hashNewTip);
                 LOCK(cs_vNodes);
                 BOOST_FOREACH(CNode* pnode, vNodes)
                 if (chainActive.Height() > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                    pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                {
+                    if (pcmpctblock && setCompactPeers.count(pnode->GetId())) {
+                        bool fKnown;
+                        {
+                            LOCK(pnode->cs_inventory);
+                            fKnown = !pnode->setInventoryKnown.insert(inv).second;
+                        }
+                        if (!fKnown)
+                            pnode->PushMessage("cmpctblock", *pcmpctblock);
+                    } else
+                        pnode->PushInventory(inv);
+                }
             }
             // Notify external listeners about the new tip.
-            GetMainSignals().UpdatedBlockTip(pindexNewTip);
+            QueueValidationNotification(boost::bind(boost::ref(GetMainSignals().UpdatedBlockTip), pindexNewTip));
             uiInterface.NotifyBlockTip(hashNewTip);
         } //else fprintf(stderr,"initial download skips propagation\n");
     } while(pindexMostWork != chainActive.Tip());
@@ -4844,7 +5503,7 @@ bool InvalidateBlock(CValidationState& state, CBlockIndex *pindex) {
             return false;
         }
     }
-    //LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+    LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
 
     // The resulting new best tip may not be in setBlockIndexCandidates anymore, so
     // add it again.
@@ -5374,69 +6033,14 @@ bool CheckBlock(int32_t *futureblockp,int32_t height,CBlockIndex *pindex,const C
     if ( ASSETCHAINS_CC != 0 && !fCheckPOW )
         return true;
 
-    if ( ASSETCHAINS_CC != 0 ) // CC contracts might refer to transactions in the current block, from a CC spend within the same block and out of order
+    // CC contracts might refer to transactions in the current block, from a CC spend within the same block and out of order.
+    // They find them through the block tx overlay (ConnectBlock normally has it installed already)
+    CBlockTxOverlayScope blockTxOverlay(block, height, ASSETCHAINS_CC != 0);
+    if ( ASSETCHAINS_CC != 0 && ASSETCHAINS_LWMAPOS && block.IsVerusPOSBlock() )
     {
-        int32_t i,j,rejects=0,lastrejects=0;
-        
-        /* dimxy: we already did this in CMempoolStateSaver:
-        //fprintf(stderr,"put block's tx into mempool\n");
-        // Copy all non Z-txs in mempool to temporary mempool because there can be tx in local mempool that make the block invalid.
-        LOCK2(cs_main,mempool.cs);
-        //fprintf(stderr, "starting... mempoolsize.%ld\n",mempool.size());
-        list<CTransaction> transactionsToRemove;
-        BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx) {
-            const CTransaction &tx = e.GetTx();
-            const uint256 &hash = tx.GetHash();
-            if ( tx.vjoinsplit.empty() && tx.vShieldedSpend.empty()) {
-                transactionsToRemove.push_back(tx);
-                tmpmempool.addUnchecked(hash,e,true);
-            }
-        }
-        BOOST_FOREACH(const CTransaction& tx, transactionsToRemove) {
-            list<CTransaction> removed;
-            mempool.remove(tx, removed, false);
-        }     */
-
-        // add all the txs in the block to the empty mempool.
-        // CC validation shouldnt (cant) depend on the state of mempool!
-        while ( 1 )
-        {
-            list<CTransaction> removed;
-            for (i=0; i<block.vtx.size(); i++)
-            {
-                CValidationState state; CTransaction Tx; 
-                const CTransaction &tx = (CTransaction)block.vtx[i];
-                if ( tx.IsCoinBase() || !tx.vjoinsplit.empty() || !tx.vShieldedSpend.empty() || (i == block.vtx.size()-1 && komodo_isPoS((CBlock *)&block,height,0) != 0) )
-                    continue;
-                Tx = tx;
-                if ( myAddtomempool(Tx, &state, true) == false ) // happens with out of order tx in block on resync
-                {
-                    //LogPrintf("Rejected by mempool, reason: .%s.\n", state.GetRejectReason().c_str());
-                    // take advantage of other checks, but if we were only rejected because it is a valid staking
-                    // transaction, sync with wallets and don't mark as a reject
-                    if (i == (block.vtx.size() - 1) && ASSETCHAINS_LWMAPOS && block.IsVerusPOSBlock() && state.GetRejectReason() == "staking")
-                    {
-                        sTx = Tx;
-                        ptx = &sTx;
-                    } else rejects++;
-                }
-                // here we remove any txs in the temp mempool that were included in the block.
-                // dimxy: we do not do this anymore as tmpmempool is used for saving the mempool state
-                // and if a block tx was in tmpmempool it would just try to add it to the mempool second time, no problem with this
-                // tmpmempool.remove(tx, removed, false);
-            }
-            //fprintf(stderr, "removed.%ld\n",removed.size());
-            if ( rejects == 0 || rejects == lastrejects )
-            {
-                if ( 0 && lastrejects != 0 )
-                    fprintf(stderr,"lastrejects.%d -> all tx in mempool\n",lastrejects);
-                break;
-            }
-            //fprintf(stderr,"addtomempool ht.%d for CC checking: n.%d rejects.%d last.%d\n",height,(int32_t)block.vtx.size(),rejects,lastrejects);
-            lastrejects = rejects;
-            rejects = 0;
-        }
-        //fprintf(stderr,"done putting block's tx into mempool\n");
+        // a valid staking transaction is never accepted to the mempool, sync it with wallets here
+        sTx = block.vtx.back();
+        ptx = &sTx;
     }
 
     for (uint32_t i = 0; i < block.vtx.size(); i++)
@@ -5470,7 +6074,7 @@ bool CheckBlock(int32_t *futureblockp,int32_t height,CBlockIndex *pindex,const C
 
     if (ptx)
     {
-        SyncWithWallets(*ptx, &block);
+        SyncWithWallets(*ptx, &block, pindex);
     }
 
     if ( ASSETCHAINS_CC != 0 )
@@ -5958,6 +6562,8 @@ bool ProcessNewBlock(bool from_miner,int32_t height,CValidationState &state, CNo
     bool checked; uint256 hash; int32_t futureblock=0;
     auto verifier = libzcash::ProofVerifier::Disabled();
     hash = pblock->GetHash();
+    // Don't let block processing run too far ahead of the wallet and other subscribers
+    LimitValidationInterfaceQueue();
     //fprintf(stderr,"ProcessBlock %d\n",(int32_t)chainActive.LastTip()->GetHeight());
     {
         LOCK(cs_main);
@@ -6262,6 +6868,33 @@ boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char
     return GetDataDir() / "blocks" / strprintf("%s%05u.dat", prefix, pos.nFile);
 }
 
+// Entries loaded from the block tree database are carved out of one allocation
+// (see ReserveBlockIndex); entries created afterwards are allocated one by one.
+static std::vector<CBlockIndex> vBlockIndexArena;
+static size_t nBlockIndexArenaUsed = 0;
+
+void ReserveBlockIndex(size_t nCount)
+{
+    mapBlockIndex.reserve(mapBlockIndex.size() + nCount);
+    if (!vBlockIndexArena.empty())
+        return;
+    std::vector<CBlockIndex>(nCount).swap(vBlockIndexArena);
+    nBlockIndexArenaUsed = 0;
+}
+
+static void DeleteBlockIndex(CBlockIndex* pindex)
+{
+    std::less<const CBlockIndex*> before;
+    if (vBlockIndexArena.empty() || before(pindex, &vBlockIndexArena.front()) || before(&vBlockIndexArena.back(), pindex))
+        delete pindex;
+}
+
+static void ReleaseBlockIndexArena()
+{
+    std::vector<CBlockIndex>().swap(vBlockIndexArena);
+    nBlockIndexArenaUsed = 0;
+}
+
 CBlockIndex * InsertBlockIndex(uint256 hash)
 {
     if (hash.IsNull())
@@ -6273,7 +6906,7 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = nBlockIndexArenaUsed < vBlockIndexArena.size() ? &vBlockIndexArena[nBlockIndexArenaUsed++] : new CBlockIndex();
     if (!pindexNew)
         throw runtime_error("LoadBlockIndex(): new CBlockIndex failed");
     mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
@@ -6410,20 +7043,12 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadReindexing(fReindexing);
     fReindex |= fReindexing;
 
-    // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
-    // Check whether we have an address index
-    pblocktree->ReadFlag("addressindex", fAddressIndex);
-    LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
-
-    // Check whether we have a timestamp index
-    pblocktree->ReadFlag("timestampindex", fTimestampIndex);
-    LogPrintf("%s: timestamp index %s\n", __func__, fTimestampIndex ? "enabled" : "disabled");
+    // The transaction, address, spent and timestamp indexes have their own databases,
+    // which the background indexer builds whenever the index is enabled
 
-    // Check whether we have a spent index
-    pblocktree->ReadFlag("spentindex", fSpentIndex);
-    LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
+    // Check whether we have a token ownership index
+    pblocktree->ReadFlag("tokenindex", fTokenIndex);
+    LogPrintf("%s: token index %s\n", __func__, fTokenIndex ? "enabled" : "disabled");
 
     // Fill in-memory data
     BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
@@ -6755,9 +7380,10 @@ void UnloadBlockIndex()
     recentRejects.reset(NULL);
 
     BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
-        delete entry.second;
+        DeleteBlockIndex(entry.second);
     }
     mapBlockIndex.clear();
+    ReleaseBlockIndexArena();
     fHavePruned = false;
 }
 
@@ -6789,19 +7415,9 @@ bool InitBlockIndex() {
     }
     if ( pblocktree != 0 )
     {
-        // Use the provided setting for -txindex in the new database
-        fTxIndex = GetBoolArg("-txindex", true);
-        pblocktree->WriteFlag("txindex", fTxIndex);
-        // Use the provided setting for -addressindex in the new database
-        fAddressIndex = 1; //GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
-        pblocktree->WriteFlag("addressindex", fAddressIndex);
-        
-        // Use the provided setting for -timestampindex in the new database
-        fTimestampIndex = GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
-        pblocktree->WriteFlag("timestampindex", fTimestampIndex);
-        
-        fSpentIndex = 1; //GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
-        pblocktree->WriteFlag("spentindex", fSpentIndex);
+        // Use the provided setting for -tokenindex in the new database
+        fTokenIndex = GetBoolArg("-tokenindex", DEFAULT_TOKENINDEX);
+        pblocktree->WriteFlag("tokenindex", fTokenIndex);
         fprintf(stderr,"fAddressIndex.%d/%d fSpentIndex.%d/%d\n",fAddressIndex,DEFAULT_ADDRESSINDEX,fSpentIndex,DEFAULT_SPENTINDEX);
         LogPrintf("Initializing databases...\n");
     }
@@ -6839,21 +7455,49 @@ bool InitBlockIndex() {
 
 
 
-bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp)
+/** A block read by LoadExternalBlockFile, with its position when reindexing. */
+struct CImportBlock
 {
-    const CChainParams& chainparams = Params();
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
+    CBlock block;
+    CDiskBlockPos pos;
+    bool fHavePos;
 
-    int nLoaded = 0;
+    CImportBlock() : fHavePos(false) {}
+};
+
+/** Blocks read and checked ahead of the ones being connected, per batch. */
+static const size_t IMPORT_BATCH_BLOCKS = 256;
+static const size_t IMPORT_BATCH_BYTES = 32 << 20;
+
+/** Verifies the Equihash solutions of every nStep-th block from nStart, filling the cache. */
+static void PrecheckImportBlocks(const std::vector<CImportBlock> *pvBatch, size_t nStart, size_t nStep)
+{
+    for (size_t i = nStart; i < pvBatch->size(); i += nStep) {
+        boost::this_thread::interruption_point();
+        // failures are reported again, with a DoS score, when the block is processed
+        CheckEquihashSolution(&(*pvBatch)[i].block, Params());
+    }
+}
+
+/**
+ * Reads the next batch of blocks from blkdat and verifies their Equihash
+ * solutions on all cores, so that the checks while connecting hit the cache.
+ * Runs on its own thread while the previous batch is being connected; sets
+ * *pfDone when the file is exhausted and *pstrError on an I/O failure.
+ */
+static void ReadImportBatch(CBufferedFile *pblkdat, uint64_t *pnRewind, const CDiskBlockPos *dbp,
+                            std::vector<CImportBlock> *pvBatch, bool *pfDone, std::string *pstrError)
+{
+    CBufferedFile &blkdat = *pblkdat;
+    uint64_t &nRewind = *pnRewind;
+    size_t nBytes = 0;
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        //CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE, MAX_BLOCK_SIZE+8, SER_DISK, CLIENT_VERSION);
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE(10000000), MAX_BLOCK_SIZE(10000000)+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        while (pvBatch->size() < IMPORT_BATCH_BLOCKS && nBytes < IMPORT_BATCH_BYTES) {
             boost::this_thread::interruption_point();
+            if (blkdat.eof()) {
+                *pfDone = true;
+                break;
+            }
 
             blkdat.SetPos(nRewind);
             nRewind++; // start one byte further next time, in case of failure
@@ -6873,69 +7517,163 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp)
                     continue;
             } catch (const std::exception&) {
                 // no valid block header found; don't complain
+                *pfDone = true;
                 break;
             }
+            pvBatch->push_back(CImportBlock());
+            CImportBlock &item = pvBatch->back();
             try {
                 // read block
-                CBlock block;
                 uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
+                if (dbp) {
+                    item.pos = *dbp;
+                    item.pos.nPos = nBlockPos;
+                    item.fHavePos = true;
+                }
                 blkdat.SetLimit(nBlockPos + nSize);
                 blkdat.SetPos(nBlockPos);
-                blkdat >> block;
-                
+                ReadBlockHashingTxs(blkdat, item.block);
                 nRewind = blkdat.GetPos();
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                             block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
+            } catch (const std::exception& e) {
+                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                pvBatch->pop_back();
+                continue;
+            }
+            nBytes += nSize;
+        }
+    } catch (const boost::thread_interrupted&) {
+        throw;
+    } catch (const std::exception& e) {
+        *pstrError = e.what();
+        return;
+    }
+
+    int nThreads = std::max(1, std::min(GetNumCores(), (int)pvBatch->size()));
+    boost::thread_group workers;
+    for (int i = 0; i < nThreads; i++)
+        workers.create_thread(boost::bind(&PrecheckImportBlocks, pvBatch, i, nThreads));
+    try {
+        workers.join_all();
+    } catch (const boost::thread_interrupted&) {
+        workers.interrupt_all();
+        workers.join_all();
+        throw;
+    }
+}
+
+/** Joins the batch reader, stopping it first if this thread is interrupted. */
+static void JoinImportReader(boost::thread &threadRead)
+{
+    try {
+        threadRead.join();
+    } catch (const boost::thread_interrupted&) {
+        threadRead.interrupt();
+        threadRead.join();
+        throw;
+    }
+}
+
+/**
+ * Processes one imported block, then the successors read earlier that were
+ * waiting for it. Returns false if the import has to stop.
+ */
+static bool ProcessImportBlock(CImportBlock &item, std::multimap<uint256, CDiskBlockPos> &mapBlocksUnknownParent, int &nLoaded)
+{
+    const CChainParams& chainparams = Params();
+    CBlock &block = item.block;
+    try {
+        // detect out of order blocks, and store them for later
+        uint256 hash = block.GetHash();
+        if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+            LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                     block.hashPrevBlock.ToString());
+            if (item.fHavePos)
+                mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, item.pos));
+            return true;
+        }
+
+        // process in case the block isn't known yet
+        if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+            CValidationState state;
+            if (ProcessNewBlock(0,0,state, NULL, &block, true, item.fHavePos ? &item.pos : NULL))
+                nLoaded++;
+            if (state.IsError())
+                return false;
+        } else if (hash != chainparams.GetConsensus().hashGenesisBlock && komodo_blockheight(hash) % 1000 == 0) {
+            LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), komodo_blockheight(hash));
+        }
+
+        // Recursively process earlier encountered successors of this block
+        deque<uint256> queue;
+        queue.push_back(hash);
+        while (!queue.empty()) {
+            uint256 head = queue.front();
+            queue.pop_front();
+            std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+            while (range.first != range.second) {
+                std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    if (ProcessNewBlock(0,0,state, NULL, &block, true, dbp))
+                if (ReadBlockFromDisk(mapBlockIndex.count(hash)!=0?mapBlockIndex[hash]->GetHeight():0,block, it->second,1))
+                {
+                    LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
+                              head.ToString());
+                    CValidationState dummy;
+                    if (ProcessNewBlock(0,0,dummy, NULL, &block, true, &it->second))
+                    {
                         nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && komodo_blockheight(hash) % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), komodo_blockheight(hash));
+                        queue.push_back(block.GetHash());
+                    }
                 }
+                range.first++;
+                mapBlocksUnknownParent.erase(it);
+            }
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+    }
+    return true;
+}
 
-                // Recursively process earlier encountered successors of this block
-                deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        
-                        if (ReadBlockFromDisk(mapBlockIndex.count(hash)!=0?mapBlockIndex[hash]->GetHeight():0,block, it->second,1))
-                        {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                      head.ToString());
-                            CValidationState dummy;
-                            if (ProcessNewBlock(0,0,dummy, NULL, &block, true, &it->second))
-                            {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                    }
+bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp)
+{
+    // Map of disk positions for blocks with unknown parent (only used for reindex)
+    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+    int64_t nStart = GetTimeMillis();
+
+    int nLoaded = 0;
+    try {
+        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+        //CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE, MAX_BLOCK_SIZE+8, SER_DISK, CLIENT_VERSION);
+        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE(10000000), MAX_BLOCK_SIZE(10000000)+8, SER_DISK, CLIENT_VERSION);
+        uint64_t nRewind = blkdat.GetPos();
+        bool fDone = false;
+        std::string strError;
+        std::vector<CImportBlock> vBatch, vNext;
+        ReadImportBatch(&blkdat, &nRewind, dbp, &vBatch, &fDone, &strError);
+        while (!vBatch.empty()) {
+            // Read and check the next batch while this one is connected
+            boost::thread threadRead;
+            if (!fDone && strError.empty())
+                threadRead = boost::thread(boost::bind(&ReadImportBatch, &blkdat, &nRewind, dbp, &vNext, &fDone, &strError));
+            bool fStop = false;
+            try {
+                for (size_t i = 0; i < vBatch.size() && !fStop; i++) {
+                    boost::this_thread::interruption_point();
+                    fStop = !ProcessImportBlock(vBatch[i], mapBlocksUnknownParent, nLoaded);
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+            } catch (...) {
+                threadRead.interrupt();
+                threadRead.join();
+                throw;
             }
+            JoinImportReader(threadRead);
+            if (fStop)
+                break;
+            vBatch.swap(vNext);
+            vNext.clear();
         }
+        if (!strError.empty())
+            throw std::runtime_error(strError);
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
@@ -7207,6 +7945,261 @@ std::string GetWarnings(const std::string& strFor)
 //
 
 
+/** Relay, orphan handling and reject/DoS bookkeeping after a peer's tx went through AcceptToMemoryPool. */
+static void ProcessRelayedTx(CNode* pfrom, const CTransaction& tx, bool fAccepted, bool fMissingInputs, CValidationState& state)
+{
+    AssertLockHeld(cs_main);
+    vector<uint256> vWorkQueue;
+    vector<uint256> vEraseQueue;
+
+    if (fAccepted)
+    {
+        mempool.check(pcoinsTip);
+        RelayTransaction(tx);
+        vWorkQueue.push_back(tx.GetHash());
+
+        LogPrint("mempool", "AcceptToMemoryPool: peer=%d %s: accepted %s (poolsz %u)\n",
+                 pfrom->id, pfrom->cleanSubVer,
+                 tx.GetHash().ToString(),
+                 mempool.mapTx.size());
+
+        // Recursively process any orphan transactions that depended on this one
+        set<NodeId> setMisbehaving;
+        for (unsigned int i = 0; i < vWorkQueue.size(); i++)
+        {
+            map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
+            if (itByPrev == mapOrphanTransactionsByPrev.end())
+                continue;
+            for (set<uint256>::iterator mi = itByPrev->second.begin();
+                 mi != itByPrev->second.end();
+                 ++mi)
+            {
+                const uint256& orphanHash = *mi;
+                const CTransaction& orphanTx = mapOrphanTransactions[orphanHash].tx;
+                NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
+                bool fMissingInputs2 = false;
+                // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
+                // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
+                // anyone relaying LegitTxX banned)
+                CValidationState stateDummy;
+
+
+                if (setMisbehaving.count(fromPeer))
+                    continue;
+                if (AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2))
+                {
+                    LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
+                    RelayTransaction(orphanTx);
+                    vWorkQueue.push_back(orphanHash);
+                    vEraseQueue.push_back(orphanHash);
+                }
+                else if (!fMissingInputs2)
+                {
+                    int nDos = 0;
+                    if (stateDummy.IsInvalid(nDos) && nDos > 0)
+                    {
+                        // Punish peer that gave us an invalid orphan tx
+                        Misbehaving(fromPeer, nDos);
+                        setMisbehaving.insert(fromPeer);
+                        LogPrint("mempool", "   invalid orphan tx %s\n", orphanHash.ToString());
+                    }
+                    // Has inputs but not accepted to mempool
+                    // Probably non-standard or insufficient fee/priority
+                    LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
+                    vEraseQueue.push_back(orphanHash);
+                    assert(recentRejects);
+                    recentRejects->insert(orphanHash);
+                }
+                mempool.check(pcoinsTip);
+            }
+        }
+
+        BOOST_FOREACH(uint256 hash, vEraseQueue)
+        EraseOrphanTx(hash);
+    }
+    // TODO: currently, prohibit joinsplits and shielded spends/outputs from entering mapOrphans
+    else if (fMissingInputs &&
+             tx.vjoinsplit.empty() &&
+             tx.vShieldedSpend.empty() &&
+             tx.vShieldedOutput.empty())
+    {
+        // valid stake transactions end up in the orphan tx bin
+        AddOrphanTx(tx, pfrom->GetId());
+
+        // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
+        unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+        unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+        if (nEvicted > 0)
+            LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
+    } else {
+        assert(recentRejects);
+        recentRejects->insert(tx.GetHash());
+
+        if (pfrom->fWhitelisted) {
+            // Always relay transactions received from whitelisted peers, even
+            // if they were already in the mempool or rejected from it due
+            // to policy, allowing the node to function as a gateway for
+            // nodes hidden behind it.
+            //
+            // Never relay transactions that we would assign a non-zero DoS
+            // score for, as we expect peers to do the same with us in that
+            // case.
+            int nDoS = 0;
+            if (!state.IsInvalid(nDoS) || nDoS == 0) {
+                LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->id);
+                RelayTransaction(tx);
+            } else {
+                LogPrintf("Not relaying invalid transaction %s from whitelisted peer=%d (%s (code %d))\n",
+                          tx.GetHash().ToString(), pfrom->id, state.GetRejectReason(), state.GetRejectCode());
+            }
+        }
+    }
+    int nDoS = 0;
+    if (state.IsInvalid(nDoS))
+    {
+        LogPrint("mempool", "%s from peer=%d %s was not accepted into the memory pool: %s\n", tx.GetHash().ToString(),
+                 pfrom->id, pfrom->cleanSubVer,
+                 state.GetRejectReason());
+        pfrom->PushMessage("reject", string("tx"), state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), tx.GetHash());
+        if (nDoS > 0)
+            Misbehaving(pfrom->GetId(), nDoS);
+    }
+}
+
+//
+// Mempool admission pipeline. Relayed transactions are queued by the "tx"
+// handler and picked up by -mempoolverifythreads workers, which verify their
+// transparent and crypto-condition signatures without holding cs_main. The
+// results land in the signature cache, so the AcceptToMemoryPool call that
+// follows under cs_main only has to run the cc evals and policy checks.
+//
+
+struct CTxAdmissionItem
+{
+    CTransaction tx;
+    CNode* pfrom;
+};
+
+static boost::mutex cs_txadmission;
+static boost::condition_variable condTxAdmission;
+static std::deque<CTxAdmissionItem> queueTxAdmission;
+static std::set<uint256> setTxAdmissionQueued;
+
+static bool IsTxQueuedForAdmission(const uint256& hash)
+{
+    boost::unique_lock<boost::mutex> lock(cs_txadmission);
+    return setTxAdmissionQueued.count(hash) != 0;
+}
+
+/** Queue a relayed transaction for pre-verification. Returns false if it has to be accepted inline. */
+static bool QueueTxForAdmission(const CTransaction& tx, CNode* pfrom)
+{
+    if (nMempoolVerifyThreads == 0)
+        return false;
+    {
+        boost::unique_lock<boost::mutex> lock(cs_txadmission);
+        if (queueTxAdmission.size() >= MAX_TX_ADMISSION_QUEUE)
+            return false;
+        if (!setTxAdmissionQueued.insert(tx.GetHash()).second)
+            return true;
+        {
+            LOCK(cs_vNodes);
+            pfrom->AddRef();
+        }
+        CTxAdmissionItem item;
+        item.tx = tx;
+        item.pfrom = pfrom;
+        queueTxAdmission.push_back(item);
+    }
+    condTxAdmission.notify_one();
+    return true;
+}
+
+/**
+ * Cheap context-free checks and signature verification of a relayed transaction.
+ * The inputs are snapshotted under cs_main, the scripts are verified without it.
+ * Returns false with state set if the transaction is certain to be rejected;
+ * anything the snapshot can't decide (missing inputs, imports) is left to
+ * AcceptToMemoryPool.
+ */
+bool PreVerifyTransaction(const CTransaction& tx, CValidationState& state)
+{
+    CCoinsView dummy;
+    CCoinsViewCache view(&dummy);
+    uint32_t consensusBranchId;
+    {
+        LOCK2(cs_main, mempool.cs);
+        uint32_t tiptime = chainActive.LastTip() != 0 ? (uint32_t)chainActive.LastTip()->nTime : (uint32_t)time(NULL);
+        if (!CheckTransactionWithoutProofVerification(tiptime, tx, state))
+            return false;
+        if (tx.IsCoinBase() || tx.IsCoinImport() || tx.IsPegsImport() || mempool.exists(tx.GetHash()))
+            return true;
+        consensusBranchId = CurrentEpochBranchId(chainActive.Height() + 1, Params().GetConsensus());
+
+        CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+        view.SetBackend(viewMemPool);
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        {
+            if (!view.HaveCoins(txin.prevout.hash))
+                return true;
+        }
+        if (!view.HaveInputs(tx))
+            return true;
+        view.SetBackend(dummy);
+    }
+
+    PrecomputedTransactionData txdata(tx);
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
+    {
+        const CTxOut& prevout = view.AccessCoins(tx.vin[i].prevout.hash)->vout[tx.vin[i].prevout.n];
+        ScriptError serror = SCRIPT_ERR_OK;
+        if (VerifyScript(tx.vin[i].scriptSig, prevout.scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS,
+                         PreVerifyTransactionSignatureChecker(&tx, i, prevout.nValue, txdata), consensusBranchId, &serror))
+            continue;
+        // Same classification as ContextualCheckInputs: failures that only
+        // break standardness rules don't cost the peer any DoS score.
+        if (VerifyScript(tx.vin[i].scriptSig, prevout.scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS,
+                         PreVerifyTransactionSignatureChecker(&tx, i, prevout.nValue, txdata), consensusBranchId))
+            return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(serror)));
+        return state.DoS(100, false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(serror)));
+    }
+    return true;
+}
+
+void ThreadTxAdmission()
+{
+    RenameThread("zcash-txadmit");
+    while (true)
+    {
+        CTxAdmissionItem item;
+        {
+            boost::unique_lock<boost::mutex> lock(cs_txadmission);
+            while (queueTxAdmission.empty())
+                condTxAdmission.wait(lock);
+            item = queueTxAdmission.front();
+            queueTxAdmission.pop_front();
+        }
+
+        CValidationState state;
+        bool fAccepted = false, fMissingInputs = false;
+        bool fPreVerified = PreVerifyTransaction(item.tx, state);
+        {
+            LOCK(cs_main);
+            if (fPreVerified)
+                fAccepted = AcceptToMemoryPool(mempool, state, item.tx, true, &fMissingInputs);
+            ProcessRelayedTx(item.pfrom, item.tx, fAccepted, fMissingInputs, state);
+
+            boost::unique_lock<boost::mutex> lock(cs_txadmission);
+            setTxAdmissionQueued.erase(item.tx.GetHash());
+        }
+        {
+            LOCK(cs_vNodes);
+            item.pfrom->Release();
+        }
+    }
+}
+
 bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     switch (inv.type)
@@ -7226,6 +8219,7 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 
             return recentRejects->contains(inv.hash) ||
             mempool.exists(inv.hash) ||
+            IsTxQueuedForAdmission(inv.hash) ||
             mapOrphanTransactions.count(inv.hash) ||
             pcoinsTip->HaveCoins(inv.hash);
         }
@@ -7254,7 +8248,7 @@ void static ProcessGetData(CNode* pfrom)
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
             {
                 bool send = false;
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
@@ -7296,6 +8290,18 @@ void static ProcessGetData(CNode* pfrom)
                             LogPrint("net1", "sending block %s to %d in resp to getdata\n", block.GetHash().ToString(), pfrom->id);
                             pfrom->PushMessage("block", block);
                         }
+                        else if (inv.type == MSG_CMPCT_BLOCK)
+                        {
+                            // Older blocks are unlikely to be reconstructable from the peer's
+                            // mempool, so they are sent in full.
+                            if (chainActive.Height() - mi->second->GetHeight() < MAX_CMPCTBLOCK_DEPTH && block.vtx.size() <= MAX_COMPACT_BLOCK_TXS)
+                            {
+                                CBlockHeaderAndShortTxIDs cmpctblock(block);
+                                pfrom->PushMessage("cmpctblock", cmpctblock);
+                            }
+                            else
+                                pfrom->PushMessage("block", block);
+                        }
                         else // MSG_FILTERED_BLOCK)
                         {
                             LOCK(pfrom->cs_filter);
@@ -7380,6 +8386,30 @@ void static ProcessGetData(CNode* pfrom)
     }
 }
 
+/** Hand a block received from, or reconstructed with the help of, pfrom to ProcessNewBlock. */
+static void ProcessBlockFromPeer(CNode* pfrom, CBlock& block, const std::string& strCommand)
+{
+    CInv inv(MSG_BLOCK, block.GetHash());
+    pfrom->AddInventoryKnown(inv);
+
+    CValidationState state;
+    // Process all blocks from whitelisted peers, even if not requested,
+    // unless we're still syncing with the network.
+    // Such an unrequested block may still be processed, subject to the
+    // conditions in AcceptBlock().
+    bool forceProcessing = pfrom->fWhitelisted && !IsInitialBlockDownload();
+    ProcessNewBlock(0,0,state, pfrom, &block, forceProcessing, NULL);
+    int nDoS;
+    if (state.IsInvalid(nDoS)) {
+        pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
+        if (nDoS > 0) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+    }
+}
+
 #include "komodo_nSPV_defs.h"
 #include "komodo_nSPV.h"            // shared defines, structs, serdes, purge functions
 #include "komodo_nSPV_fullnode.h"   // nSPV fullnode handling of the getnSPV request messages
@@ -7585,6 +8615,16 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             LOCK(cs_main);
             State(pfrom->GetId())->fCurrentlyConnected = true;
         }
+
+        // Ask peers that advertise compact blocks to use them. Our outbound peers are
+        // asked to push new blocks as cmpctblock straight away (high-bandwidth mode),
+        // inbound ones only to answer MSG_CMPCT_BLOCK requests.
+        if (fCompactBlocks && (pfrom->nServices & NODE_COMPACT_BLOCKS))
+        {
+            bool fAnnounceUsingCMPCTBLOCK = !pfrom->fInbound;
+            uint64_t nCMPCTBLOCKVersion = COMPACT_BLOCKS_VERSION;
+            pfrom->PushMessage("sendcmpct", fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion);
+        }
     }
 
 
@@ -7843,7 +8883,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     CNodeState *nodestate = State(pfrom->GetId());
                     if (chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - chainparams.GetConsensus().nPowTargetSpacing * 20 &&
                         nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
-                        vToFetch.push_back(inv);
+                        // Peers that negotiated compact blocks send the block as short ids, to be
+                        // filled in from our mempool.
+                        vToFetch.push_back(nodestate->fSupportsCompactBlocks ? CInv(MSG_CMPCT_BLOCK, inv.hash) : inv);
                         // Mark block as in flight already, even though the actual "getdata" message only goes out
                         // later (within the same cs_main lock, though).
                         MarkBlockAsInFlight(pfrom->GetId(), inv.hash, chainparams.GetConsensus());
@@ -7988,8 +9030,6 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if (IsInitialBlockDownload())
             return true;
 
-        vector<uint256> vWorkQueue;
-        vector<uint256> vEraseQueue;
         CTransaction tx;
         vRecv >> tx;
 
@@ -8004,118 +9044,12 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         pfrom->setAskFor.erase(inv.hash);
         mapAlreadyAskedFor.erase(inv);
 
-        if (!AlreadyHave(inv) && AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs))
-        {
-            mempool.check(pcoinsTip);
-            RelayTransaction(tx);
-            vWorkQueue.push_back(inv.hash);
-
-            LogPrint("mempool", "AcceptToMemoryPool: peer=%d %s: accepted %s (poolsz %u)\n",
-                     pfrom->id, pfrom->cleanSubVer,
-                     tx.GetHash().ToString(),
-                     mempool.mapTx.size());
-
-            // Recursively process any orphan transactions that depended on this one
-            set<NodeId> setMisbehaving;
-            for (unsigned int i = 0; i < vWorkQueue.size(); i++)
-            {
-                map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
-                if (itByPrev == mapOrphanTransactionsByPrev.end())
-                    continue;
-                for (set<uint256>::iterator mi = itByPrev->second.begin();
-                     mi != itByPrev->second.end();
-                     ++mi)
-                {
-                    const uint256& orphanHash = *mi;
-                    const CTransaction& orphanTx = mapOrphanTransactions[orphanHash].tx;
-                    NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
-                    bool fMissingInputs2 = false;
-                    // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
-                    // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
-                    // anyone relaying LegitTxX banned)
-                    CValidationState stateDummy;
-
-
-                    if (setMisbehaving.count(fromPeer))
-                        continue;
-                    if (AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2))
-                    {
-                        LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
-                        RelayTransaction(orphanTx);
-                        vWorkQueue.push_back(orphanHash);
-                        vEraseQueue.push_back(orphanHash);
-                    }
-                    else if (!fMissingInputs2)
-                    {
-                        int nDos = 0;
-                        if (stateDummy.IsInvalid(nDos) && nDos > 0)
-                        {
-                            // Punish peer that gave us an invalid orphan tx
-                            Misbehaving(fromPeer, nDos);
-                            setMisbehaving.insert(fromPeer);
-                            LogPrint("mempool", "   invalid orphan tx %s\n", orphanHash.ToString());
-                        }
-                        // Has inputs but not accepted to mempool
-                        // Probably non-standard or insufficient fee/priority
-                        LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
-                        vEraseQueue.push_back(orphanHash);
-                        assert(recentRejects);
-                        recentRejects->insert(orphanHash);
-                    }
-                    mempool.check(pcoinsTip);
-                }
-            }
-
-            BOOST_FOREACH(uint256 hash, vEraseQueue)
-            EraseOrphanTx(hash);
-        }
-        // TODO: currently, prohibit joinsplits and shielded spends/outputs from entering mapOrphans
-        else if (fMissingInputs &&
-                 tx.vjoinsplit.empty() &&
-                 tx.vShieldedSpend.empty() &&
-                 tx.vShieldedOutput.empty())
-        {
-            // valid stake transactions end up in the orphan tx bin
-            AddOrphanTx(tx, pfrom->GetId());
-
-            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
-            unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-            unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
-            if (nEvicted > 0)
-                LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
-        } else {
-            assert(recentRejects);
-            recentRejects->insert(tx.GetHash());
-
-            if (pfrom->fWhitelisted) {
-                // Always relay transactions received from whitelisted peers, even
-                // if they were already in the mempool or rejected from it due
-                // to policy, allowing the node to function as a gateway for
-                // nodes hidden behind it.
-                //
-                // Never relay transactions that we would assign a non-zero DoS
-                // score for, as we expect peers to do the same with us in that
-                // case.
-                int nDoS = 0;
-                if (!state.IsInvalid(nDoS) || nDoS == 0) {
-                    LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->id);
-                    RelayTransaction(tx);
-                } else {
-                    LogPrintf("Not relaying invalid transaction %s from whitelisted peer=%d (%s (code %d))\n",
-                              tx.GetHash().ToString(), pfrom->id, state.GetRejectReason(), state.GetRejectCode());
-                }
-            }
-        }
-        int nDoS = 0;
-        if (state.IsInvalid(nDoS))
+        if (AlreadyHave(inv))
+            ProcessRelayedTx(pfrom, tx, false, false, state);
+        else if (!QueueTxForAdmission(tx, pfrom))
         {
-            LogPrint("mempool", "%s from peer=%d %s was not accepted into the memory pool: %s\n", tx.GetHash().ToString(),
-                     pfrom->id, pfrom->cleanSubVer,
-                     state.GetRejectReason());
-            pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
-                               state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-            if (nDoS > 0)
-                Misbehaving(pfrom->GetId(), nDoS);
+            bool fAccepted = AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs);
+            ProcessRelayedTx(pfrom, tx, fAccepted, fMissingInputs, state);
         }
     }
 
@@ -8135,11 +9069,22 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
-        LogPrint("net1", "%s received headers: [", __func__);
-        for (auto hdr : headers) {
-            LogPrint("net1", "%s ", hdr.GetHash().ToString().c_str());
+        if (LogAcceptCategory("net1")) {
+            LogPrint("net1", "%s received headers: [", __func__);
+            for (const CBlockHeader& hdr : headers) {
+                LogPrint("net1", "%s ", hdr.GetHash().ToString().c_str());
+            }
+            LogPrint("net1", "]\n");
+        }
+
+        // The Equihash solutions are the expensive part of a header and need no chain
+        // context, so the whole batch is verified on the worker threads before taking
+        // cs_main. Full blocks are checked again later and then hit the cache.
+        if (!CheckHeadersEquihash(headers)) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 100);
+            return error("headers message with an invalid Equihash solution");
         }
-        LogPrint("net1", "]\n");
 
         LOCK(cs_main);
 
@@ -8188,33 +9133,202 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         CheckBlockIndex();
     }
 
-    else if (strCommand == "block" && !fImporting && !fReindex) // Ignore blocks received while importing
+    else if (strCommand == "sendcmpct")
     {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        if (fCompactBlocks && nCMPCTBLOCKVersion == COMPACT_BLOCKS_VERSION) {
+            LOCK(cs_main);
+            CNodeState *nodestate = State(pfrom->GetId());
+            nodestate->fSupportsCompactBlocks = true;
+            nodestate->fPreferCompactBlocks = fAnnounceUsingCMPCTBLOCK;
+        }
+    }
+
+
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+
+        // As for "headers", the Equihash solution is checked before taking cs_main.
+        if (!CheckEquihashSolution(&cmpctblock.header, chainparams)) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 100);
+            return error("cmpctblock with an invalid Equihash solution");
+        }
+
         CBlock block;
-        vRecv >> block;
+        bool fBlockReconstructed = false;
+        {
+            LOCK(cs_main);
 
-        CInv inv(MSG_BLOCK, block.GetHash());
-        LogPrint("net", "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
+            if (mapBlockIndex.find(cmpctblock.header.hashPrevBlock) == mapBlockIndex.end()) {
+                // Doesn't connect to a header we know: sync the headers, the block
+                // itself then follows the normal download.
+                if (!IsInitialBlockDownload())
+                    pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), uint256());
+                return true;
+            }
 
-        pfrom->AddInventoryKnown(inv);
+            CBlockIndex *pindex = NULL;
+            CValidationState state;
+            int32_t futureblock = 0;
+            if (!AcceptBlockHeader(&futureblock, cmpctblock.header, state, &pindex) || pindex == NULL) {
+                int nDoS;
+                if (state.IsInvalid(nDoS) && futureblock == 0)
+                {
+                    if (nDoS > 0)
+                        Misbehaving(pfrom->GetId(), nDoS/nDoS);
+                    return error("invalid header received in cmpctblock");
+                }
+                return true;
+            }
 
-        CValidationState state;
-        // Process all blocks from whitelisted peers, even if not requested,
-        // unless we're still syncing with the network.
-        // Such an unrequested block may still be processed, subject to the
-        // conditions in AcceptBlock().
-        bool forceProcessing = pfrom->fWhitelisted && !IsInitialBlockDownload();
-        ProcessNewBlock(0,0,state, pfrom, &block, forceProcessing, NULL);
-        int nDoS;
-        if (state.IsInvalid(nDoS)) {
-            pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
-                               state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-            if (nDoS > 0) {
-                LOCK(cs_main);
-                Misbehaving(pfrom->GetId(), nDoS);
+            const uint256 hash = pindex->GetBlockHash();
+            pfrom->AddInventoryKnown(CInv(MSG_BLOCK, hash));
+            UpdateBlockAvailability(pfrom->GetId(), hash);
+
+            if (pindex->nStatus & BLOCK_HAVE_DATA)
+                return true;
+
+            // Leave blocks requested from another peer, or already being reassembled, alone.
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+            bool fAlreadyInFlight = itInFlight != mapBlocksInFlight.end();
+            if (fAlreadyInFlight && (itInFlight->second.first != pfrom->GetId() || itInFlight->second.second->partialBlock))
+                return true;
+
+            // Unsolicited compact blocks are only worth reconstructing when they would
+            // become our new tip; anything else follows the normal download.
+            if (!fAlreadyInFlight && (pindex->chainPower <= chainActive.Tip()->chainPower ||
+                                      State(pfrom->GetId())->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER))
+                return true;
+
+            list<QueuedBlock>::iterator itQueued;
+            if (fAlreadyInFlight)
+                itQueued = itInFlight->second.second;
+            else
+                MarkBlockAsInFlight(pfrom->GetId(), hash, chainparams.GetConsensus(), pindex, &itQueued);
+
+            itQueued->partialBlock.reset(new PartiallyDownloadedBlock(&mempool));
+            PartiallyDownloadedBlock& partialBlock = *itQueued->partialBlock;
+            ReadStatus status = partialBlock.InitData(cmpctblock);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(hash); // Reset in-flight state in case of whitelist
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d sent us invalid compact block", pfrom->id);
             }
+
+            BlockTransactionsRequest req;
+            if (status == READ_STATUS_OK) {
+                for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                    if (!partialBlock.IsTxAvailable(i))
+                        req.indexes.push_back(i);
+                }
+                if (req.indexes.empty()) {
+                    status = partialBlock.FillBlock(block, std::vector<CTransaction>());
+                    fBlockReconstructed = (status == READ_STATUS_OK);
+                }
+            }
+
+            if (status != READ_STATUS_OK) {
+                // Short id collision: fetch the full block, which stays marked in flight.
+                itQueued->partialBlock.reset();
+                pfrom->PushMessage("getdata", std::vector<CInv>(1, CInv(MSG_BLOCK, hash)));
+            } else if (!fBlockReconstructed) {
+                req.blockhash = hash;
+                LogPrint("net", "requesting %u of %u txs of cmpctblock %s from peer=%d\n", req.indexes.size(), cmpctblock.BlockTxCount(), hash.ToString(), pfrom->id);
+                pfrom->PushMessage("getblocktxn", req);
+            }
+        }
+
+        if (fBlockReconstructed)
+            ProcessBlockFromPeer(pfrom, block, strCommand);
+    }
+
+
+    else if (strCommand == "getblocktxn")
+    {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        LOCK(cs_main);
+
+        BlockMap::iterator it = mapBlockIndex.find(req.blockhash);
+        if (it == mapBlockIndex.end() || !(it->second->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrint("net", "peer %d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+            return true;
         }
 
+        if (it->second->GetHeight() < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+            // Deeper blocks are answered as a getdata for the full block would be, with
+            // the same checks against serving blocks off the main chain.
+            LogPrint("net", "peer %d sent us a getblocktxn for a block > %i deep\n", pfrom->id, MAX_BLOCKTXN_DEPTH);
+            pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.blockhash));
+            ProcessGetData(pfrom);
+            return true;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, it->second, false))
+            return error("getblocktxn: cannot load block %s from disk", req.blockhash.ToString());
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= block.vtx.size()) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d sent us a getblocktxn with out-of-bounds tx indices", pfrom->id);
+            }
+            resp.txn[i] = block.vtx[req.indexes[i]];
+        }
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        CBlock block;
+        bool fBlockRead = false;
+        {
+            LOCK(cs_main);
+
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator it = mapBlocksInFlight.find(resp.blockhash);
+            if (it == mapBlocksInFlight.end() || !it->second.second->partialBlock ||
+                    it->second.first != pfrom->GetId()) {
+                LogPrint("net", "peer %d sent us block transactions for block we weren't expecting\n", pfrom->id);
+                return true;
+            }
+
+            ReadStatus status = it->second.second->partialBlock->FillBlock(block, resp.txn);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(resp.blockhash); // Reset in-flight state in case of whitelist
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d sent us invalid compact block/non-matching block transactions", pfrom->id);
+            } else if (status == READ_STATUS_FAILED) {
+                // Might have collided, fall back to getdata now
+                it->second.second->partialBlock.reset();
+                pfrom->PushMessage("getdata", std::vector<CInv>(1, CInv(MSG_BLOCK, resp.blockhash)));
+            } else
+                fBlockRead = true;
+        }
+
+        if (fBlockRead)
+            ProcessBlockFromPeer(pfrom, block, strCommand);
+    }
+
+
+    else if (strCommand == "block" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlock block;
+        ReadBlockHashingTxs(vRecv, block);
+
+        LogPrint("net", "received block %s peer=%d\n", block.GetHash().ToString(), pfrom->id);
+
+        ProcessBlockFromPeer(pfrom, block, strCommand);
     }
 
 
@@ -8821,8 +9935,9 @@ public:
         // block headers
         BlockMap::iterator it1 = mapBlockIndex.begin();
         for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
+            DeleteBlockIndex((*it1).second);
         mapBlockIndex.clear();
+        ReleaseBlockIndexArena();
 
         // orphan transactions
         mapOrphanTransactions.clear();
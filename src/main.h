@@ -40,6 +40,7 @@
 #include "script/script_ext.h"
 #include "consensus/validation.h"
 #include "spentindex.h"
+#include "tokenindex.h"
 #include "sync.h"
 #include "tinyformat.h"
 #include "txmempool.h"
@@ -48,6 +49,7 @@
 #include <algorithm>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -58,6 +60,7 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CIndexDB;
 class CBloomFilter;
 class CInv;
 class CScriptCheck;
@@ -88,6 +91,8 @@ static const unsigned int MAX_STANDARD_TX_SIGOPS = MAX_BLOCK_SIGOPS/5;
 static const unsigned int DEFAULT_MIN_RELAY_TX_FEE = 100;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -maxmempool, maximum megabytes of mempool memory usage */
+static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
 /** Default for -txexpirydelta, in number of blocks */
 static const unsigned int DEFAULT_TX_EXPIRY_DELTA = 200;
 /** The maximum size of a blk?????.dat file (since 0.8) */
@@ -101,6 +106,12 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -mempoolverifythreads default (number of threads pre-verifying relayed transactions outside cs_main, 0 = none) */
+static const int DEFAULT_MEMPOOL_VERIFY_THREADS = 2;
+/** Maximum number of mempool pre-verification threads allowed */
+static const int MAX_MEMPOOL_VERIFY_THREADS = 16;
+/** Relayed transactions waiting for pre-verification beyond which new ones are accepted inline */
+static const unsigned int MAX_TX_ADMISSION_QUEUE = 1000;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -119,6 +130,12 @@ static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
+/** -compactblocks default: relay new blocks as short transaction ids to peers advertising NODE_COMPACT_BLOCKS */
+static const bool DEFAULT_COMPACT_BLOCKS = true;
+/** Maximum depth of blocks we're willing to serve as compact blocks to peers when requested. */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Maximum depth of blocks we're willing to respond to getblocktxn requests for. */
+static const int MAX_BLOCKTXN_DEPTH = 10;
 static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 
 //static const bool DEFAULT_ADDRESSINDEX = false;
@@ -126,6 +143,8 @@ static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 #define DEFAULT_ADDRESSINDEX true //(GetArg("-ac_cc",0) != 0 || GetArg("-ac_ccactivate",0) != 0)
 #define DEFAULT_SPENTINDEX true //(GetArg("-ac_cc",0) != 0 || GetArg("-ac_ccactivate",0) != 0)
 static const bool DEFAULT_TIMESTAMPINDEX = false;
+static const bool DEFAULT_ADDRESSBALANCEINDEX = false;
+static const bool DEFAULT_TOKENINDEX = false;
 static const unsigned int DEFAULT_DB_MAX_OPEN_FILES = 1000;
 static const bool DEFAULT_DB_COMPRESSION = true;
 
@@ -157,7 +176,14 @@ extern bool fExperimentalMode;
 extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+extern int nMempoolVerifyThreads;
 extern bool fTxIndex;
+extern bool fAddressIndex;
+extern bool fAddressBalanceIndex;
+extern bool fSpentIndex;
+extern bool fTimestampIndex;
+extern bool fTokenIndex;
+extern bool fCompactBlocks;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
@@ -240,6 +266,19 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the mempool admission thread, which pre-verifies relayed transactions outside cs_main */
+void ThreadTxAdmission();
+/**
+ * Verify the signatures of a relayed transaction without cs_main (cc evals are left to
+ * AcceptToMemoryPool) and cache them. Returns false with state set if it is certain to be rejected.
+ */
+bool PreVerifyTransaction(const CTransaction& tx, CValidationState& state);
+/** Run an instance of the txid hashing thread */
+void ThreadTxHash();
+/** Compute the txids of a block deserialized under a CTxHashDeferral, in parallel for large blocks */
+void UpdateBlockTxHashes(const CBlock& block);
+/** Run an instance of the Equihash verification thread for received headers */
+void ThreadEquihashCheck();
 /** Try to detect Partition (network isolation) attacks against us */
 void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const CBlockIndex *const &bestHeader, int64_t nPowTargetSpacing);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
@@ -252,8 +291,11 @@ int IsNotInSync();
 std::string GetWarnings(const std::string& strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock, bool fAllowSlow = false);
-/** Find the best known block, and make it the tip of the block chain */
-bool ActivateBestChain(bool fSkipdpow, CValidationState &state, CBlock *pblock = NULL);
+/**
+ * Find the best known block, and make it the tip of the block chain. With fLimitQueue it waits
+ * between steps for the validation notification queue to drain, which callers holding cs_main must not do.
+ */
+bool ActivateBestChain(bool fSkipdpow, CValidationState &state, CBlock *pblock = NULL, bool fLimitQueue = true);
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams);
 
 /**
@@ -280,6 +322,8 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune);
 
 /** Create a new block index entry for a given block hash */
 CBlockIndex * InsertBlockIndex(uint256 hash);
+/** Make room for nCount more block index entries, which InsertBlockIndex then takes from a single allocation. */
+void ReserveBlockIndex(size_t nCount);
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 /** Increase a node's misbehavior score. */
@@ -595,6 +639,36 @@ struct CAddressIndexIteratorKey {
     }
 };
 
+/** Running totals of an address, kept in sync with the address index when -addressbalanceindex is set. */
+struct CAddressBalanceValue {
+    CAmount balance;
+    CAmount received;
+    int64_t utxos;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(balance);
+        READWRITE(received);
+        READWRITE(utxos);
+    }
+
+    CAddressBalanceValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+        utxos = 0;
+    }
+
+    bool IsNull() const {
+        return (balance == 0 && received == 0 && utxos == 0);
+    }
+};
+
 struct CAddressIndexIteratorHeightKey {
     unsigned int type;
     uint160 hashBytes;
@@ -756,6 +830,53 @@ bool IsExpiredTx(const CTransaction &tx, int nBlockHeight);
  */
 bool CheckFinalTx(const CTransaction &tx, int flags = -1);
 
+/**
+ * Transactions of a block being validated on a CC chain. CC contracts may refer to
+ * transactions of the same block, also out of order, so myGetTransaction, CCgettxout
+ * and the "in mempool" spent/unspent helpers consult this overlay in addition to the
+ * mempool. The transactions are kept in topological order of their in-block
+ * dependencies. Coinbase, shielded and PoS stake transactions are not included.
+ */
+class CBlockTxOverlay
+{
+public:
+    CBlockTxOverlay(const CBlock& block, int32_t height);
+
+    bool GetTransaction(const uint256& hash, CTransaction& txOut) const;
+    bool HaveTransaction(const uint256& hash) const { return mapTx.count(hash) != 0; }
+    bool GetSpender(const uint256& txid, int32_t vout, uint256& spenttxid, int32_t& spentvini) const;
+    const std::vector<CTransaction>& GetTransactions() const { return vtx; }
+
+private:
+    std::vector<CTransaction> vtx;
+    std::map<uint256, size_t> mapTx;
+    std::map<COutPoint, std::pair<uint256, int32_t> > mapSpends;
+};
+
+/** Returns the overlay of the block the calling thread is validating, or an empty pointer */
+std::shared_ptr<const CBlockTxOverlay> GetBlockTxOverlay();
+
+/**
+ * Makes a block's transactions visible through GetBlockTxOverlay() on the calling
+ * thread while in scope. Nested scopes on the same thread are no-ops.
+ */
+class CBlockTxOverlayScope
+{
+public:
+    CBlockTxOverlayScope(const CBlock& block, int32_t height, bool fEnable);
+    /** Shares another thread's overlay, for script checks run on its behalf */
+    CBlockTxOverlayScope(const std::shared_ptr<const CBlockTxOverlay>& overlay);
+    ~CBlockTxOverlayScope();
+
+private:
+    bool fInstalled;
+    std::shared_ptr<const CBlockTxOverlay> prevoverlay;
+};
+
+/** Memo of CC validator results, see cc/eval.h */
+class CCValidationMemo;
+std::shared_ptr<CCValidationMemo> GetCCValidationMemo();
+
 /**
  * Closure representing one script verification
  * Note that this stores references to the spending transaction
@@ -773,12 +894,14 @@ private:
     ScriptError error;
     PrecomputedTransactionData *txdata;
     CValidationState stateCC;
+    std::shared_ptr<const CBlockTxOverlay> pblocktxoverlay;
+    std::shared_ptr<CCValidationMemo> pccvalidationmemo;
 
 public:
     CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), consensusBranchId(0), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
     CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, uint32_t consensusBranchIdIn, PrecomputedTransactionData* txdataIn) :
         scriptPubKey(CCoinsViewCache::GetSpendFor(&txFromIn, txToIn.vin[nInIn])), amount(txFromIn.vout[txToIn.vin[nInIn].prevout.n].nValue),
-        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), consensusBranchId(consensusBranchIdIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), consensusBranchId(consensusBranchIdIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn), pblocktxoverlay(GetBlockTxOverlay()), pccvalidationmemo(GetCCValidationMemo()) { }
 
     bool operator()();
 
@@ -793,6 +916,8 @@ public:
         std::swap(error, check.error);
         std::swap(txdata, check.txdata);
         std::swap(stateCC, check.stateCC);
+        pblocktxoverlay.swap(check.pblocktxoverlay);
+        pccvalidationmemo.swap(check.pccvalidationmemo);
     }
 
     ScriptError GetScriptError() const { return error; }
@@ -803,9 +928,30 @@ bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                     int start = 0, int end = 0);
+                     int start = 0, int end = 0,
+                     const CAddressIndexKey *pAfterKey = NULL, size_t nMaxResults = 0);
 bool GetAddressUnspent(uint160 addressHash, int type,
-                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       const CAddressUnspentKey *pAfterKey = NULL, size_t nMaxResults = 0);
+bool GetAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value);
+bool GetTokenIndex(const CTokenIndexKey &key, CTokenIndexValue &value);
+
+/** Move the index entries older versions kept in the block tree into the index databases */
+bool MigrateLegacyIndexes();
+/** Start the background indexer, which first catches up the index databases with the active chain */
+bool StartIndexer();
+/** Stop the background indexer. Blocks it did not get to are indexed again on the next start. */
+void StopIndexer();
+/**
+ * Wait until the background indexer has caught up and written all blocks queued so far.
+ * Returns false if the indexer failed, and with !fWaitCatchUp (rpc readers only) without
+ * waiting while the indexes are still catching up at startup.
+ */
+bool SyncIndexes(bool fWaitCatchUp = true);
+/** Wait until the indexer has caught up the index databases with the active chain, or shutdown is requested */
+bool WaitForIndexerCatchUp();
+/** True while the indexer is still catching up the index databases with the active chain */
+bool IndexesSyncing();
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
@@ -939,6 +1085,12 @@ extern CCoinsViewCache *pcoinsTip;
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
+/** Index databases written by the background indexer, NULL while the index is disabled */
+extern CIndexDB *ptxindexdb;
+extern CIndexDB *paddressindexdb;
+extern CIndexDB *pspentindexdb;
+extern CIndexDB *ptimestampindexdb;
+
 /**
  * Return the spend height, which is one more than the inputs.GetBestBlock().
  * While checking, GetBestBlock() refers to the parent block. (protected by cs_main)
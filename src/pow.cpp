@@ -26,6 +26,7 @@
 #include "chainparams.h"
 #include "crypto/equihash.h"
 #include "primitives/block.h"
+#include "script/sigcache.h"
 #include "streams.h"
 #include "uint256.h"
 #include "util.h"
@@ -759,6 +760,21 @@ uint32_t lwmaGetNextPOSRequired(const CBlockIndex* pindexLast, const Consensus::
     return nextTarget.GetCompact();
 }
 
+/** Size of the cache of verified Equihash solutions, ~30000 headers. */
+static const size_t EQUIHASH_CACHE_BYTES = 1 << 20;
+
+/**
+ * Blocks whose Equihash solution has been verified, by block hash. The hash
+ * commits to the solution, so a hit means this very header passed before:
+ * a block is checked several times on its way to the chain, and the block
+ * import checks solutions ahead of time on worker threads.
+ */
+static CSignatureCacheTable& GetEquihashCache()
+{
+    static CSignatureCacheTable equihashCache(EQUIHASH_CACHE_BYTES);
+    return equihashCache;
+}
+
 bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& params)
 {
     if (ASSETCHAINS_ALGO != ASSETCHAINS_EQUIHASH)
@@ -772,6 +788,9 @@ bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& param
 
     if ( Params().NetworkIDString() == "regtest" )
         return(true);
+    uint256 entry = EquihashCacheEntry(pblock->GetHash());
+    if (GetEquihashCache().Contains(entry))
+        return true;
     // Hash state
     crypto_generichash_blake2b_state state;
     EhInitialiseState(n, k, state);
@@ -792,6 +811,7 @@ bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& param
     if (!isValid)
         return error("CheckEquihashSolution(): invalid solution");
 
+    GetEquihashCache().Insert(entry);
     return true;
 }
 
@@ -24,6 +24,7 @@
 #include "tinyformat.h"
 #include "utilstrencodings.h"
 #include "crypto/common.h"
+#include "crypto/sha256.h"
 #include "komodo_defs.h"
 
 
@@ -172,15 +173,18 @@ uint256 BuildMerkleTree(bool* fMutated, const std::vector<uint256> leaves,
     bool mutated = false;
     for (int nSize = leaves.size(); nSize > 1; nSize = (nSize + 1) / 2)
     {
-        for (int i = 0; i < nSize; i += 2)
-        {
-            int i2 = std::min(i+1, nSize-1);
-            if (i2 == i + 1 && i2 + 1 == nSize && vMerkleTree[j+i] == vMerkleTree[j+i2]) {
-                // Two identical hashes at the end of the list at a particular level.
-                mutated = true;
-            }
-            vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j+i]),  END(vMerkleTree[j+i]),
-                                       BEGIN(vMerkleTree[j+i2]), END(vMerkleTree[j+i2])));
+        if (nSize % 2 == 0 && vMerkleTree[j+nSize-2] == vMerkleTree[j+nSize-1]) {
+            // Two identical hashes at the end of the list at a particular level.
+            mutated = true;
+        }
+        // The complete pairs of this level are contiguous 64-byte blobs, so
+        // double-SHA256 them all at once with the multi-way back-ends.
+        int nPairs = nSize / 2;
+        vMerkleTree.resize(j + nSize + (nSize + 1) / 2);
+        SHA256D64(vMerkleTree[j+nSize].begin(), vMerkleTree[j].begin(), nPairs);
+        if (nSize % 2) {
+            const uint256& last = vMerkleTree[j+nSize-1];
+            vMerkleTree[j+nSize+nPairs] = Hash(BEGIN(last), END(last), BEGIN(last), END(last));
         }
         j += nSize;
     }
@@ -194,6 +198,7 @@ uint256 BuildMerkleTree(bool* fMutated, const std::vector<uint256> leaves,
 uint256 CBlock::BuildMerkleTree(bool* fMutated) const
 {
     std::vector<uint256> leaves;
+    leaves.reserve(vtx.size());
     for (int i=0; i<vtx.size(); i++) leaves.push_back(vtx[i].GetHash());
     return ::BuildMerkleTree(fMutated, leaves, vMerkleTree);
 }
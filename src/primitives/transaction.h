@@ -520,6 +520,29 @@ static constexpr uint32_t SAPLING_VERSION_GROUP_ID = 0x892F2085;
 static_assert(SAPLING_VERSION_GROUP_ID != 0, "version group id must be non-zero as specified in ZIP 202");
 
 struct CMutableTransaction;
+class CTransaction;
+
+/**
+ * While an instance is alive, transactions deserialized on the same thread
+ * leave their txid unset, so that the txids of a whole block can be computed
+ * afterwards in parallel (see UpdateBlockTxHashes in main.cpp). Every
+ * transaction read under the guard must be passed to Complete() before use.
+ */
+class CTxHashDeferral
+{
+private:
+    static thread_local bool fActive;
+    bool fPrevious;
+
+public:
+    CTxHashDeferral() : fPrevious(fActive) { fActive = true; }
+    ~CTxHashDeferral() { fActive = fPrevious; }
+
+    static bool IsActive() { return fActive; }
+
+    /** Compute the deferred txid of tx. Distinct transactions may be completed concurrently. */
+    static void Complete(const CTransaction& tx);
+};
 
 /** The basic transaction that is broadcasted on the network and contained in
  * blocks.  A transaction can contain multiple inputs and outputs.
@@ -531,6 +554,8 @@ private:
     const uint256 hash;
     void UpdateHash() const;
 
+    friend class CTxHashDeferral;
+
 protected:
     /** Developer testing only.  Set evilDeveloperFlag to true.
      * Convert a CMutableTransaction into a CTransaction without invoking UpdateHash()
@@ -647,7 +672,7 @@ public:
         if (isSaplingV4 && !(vShieldedSpend.empty() && vShieldedOutput.empty())) {
             READWRITE(*const_cast<binding_sig_t*>(&bindingSig));
         }
-        if (ser_action.ForRead())
+        if (ser_action.ForRead() && !CTxHashDeferral::IsActive())
             UpdateHash();
     }
 
@@ -96,6 +96,9 @@ enum {
     NODE_SPENTINDEX = (1 << 28),
     NODE_DEXP2P = (1 << 27),
     NODE_DEXP2P_INDEXED = (1 << 26),
+    // NODE_COMPACT_BLOCKS means the node understands sendcmpct, cmpctblock,
+    // getblocktxn and blocktxn, and serves MSG_CMPCT_BLOCK in getdata.
+    NODE_COMPACT_BLOCKS = (1 << 25),
 
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
@@ -175,6 +178,9 @@ enum {
     // Nodes may always request a MSG_FILTERED_BLOCK in a getdata, however,
     // MSG_FILTERED_BLOCK should not appear in any invs except as a part of getdata.
     MSG_FILTERED_BLOCK,
+    // Only used in getdata, to peers with NODE_COMPACT_BLOCKS; answered with a
+    // "cmpctblock" for recent blocks and a full "block" otherwise.
+    MSG_CMPCT_BLOCK,
 };
 
 #endif // BITCOIN_PROTOCOL_H
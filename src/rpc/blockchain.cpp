@@ -403,6 +403,9 @@ bool myIsutxo_spentinmempool(uint256 &spenttxid, int32_t &spentvini, uint256 txi
     int32_t vini = 0;
     if (KOMODO_NSPV_SUPERLITE)
         return(NSPV_spentinmempool(spenttxid, spentvini, txid, vout));
+    std::shared_ptr<const CBlockTxOverlay> overlay = GetBlockTxOverlay();
+    if (overlay && overlay->GetSpender(txid, vout, spenttxid, spentvini))
+        return(true);
     BOOST_FOREACH(const CTxMemPoolEntry &e, mempool.mapTx)
     {
         const CTransaction &tx = e.GetTx();
@@ -429,6 +432,9 @@ bool mytxid_inmempool(uint256 txid)
     {
 
     }
+    std::shared_ptr<const CBlockTxOverlay> overlay = GetBlockTxOverlay();
+    if (overlay && overlay->HaveTransaction(txid))
+        return(true);
     BOOST_FOREACH(const CTxMemPoolEntry &e, mempool.mapTx)
     {
         const CTransaction &tx = e.GetTx();
@@ -1679,6 +1685,11 @@ UniValue mempoolInfoToJSON()
     ret.push_back(Pair("size", (int64_t)mempool.size()));
     ret.push_back(Pair("bytes", (int64_t)mempool.GetTotalTxSize()));
     ret.push_back(Pair("usage", (int64_t)mempool.DynamicMemoryUsage()));
+    size_t maxmempool = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    ret.push_back(Pair("maxmempool", (int64_t)maxmempool));
+    ret.push_back(Pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK())));
+    ret.push_back(Pair("evicted", (int64_t)mempool.GetEvictedCount()));
+    ret.push_back(Pair("expired", (int64_t)mempool.GetExpiredCount()));
 
     if (Params().NetworkIDString() == "regtest") {
         ret.push_back(Pair("fullyNotified", mempool.IsFullyNotified()));
@@ -1698,6 +1709,10 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "  \"size\": xxxxx                (numeric) Current tx count\n"
             "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
             "  \"usage\": xxxxx               (numeric) Total memory usage for the mempool\n"
+            "  \"maxmempool\": xxxxx          (numeric) Maximum memory usage for the mempool\n"
+            "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee per kB for a tx to be accepted\n"
+            "  \"evicted\": xxxxx             (numeric) Transactions evicted to keep the mempool below maxmempool\n"
+            "  \"expired\": xxxxx             (numeric) Transactions expired after mempoolexpiry hours\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmempoolinfo", "")
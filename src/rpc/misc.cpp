@@ -928,6 +928,45 @@ bool getAddressesFromParams(const UniValue& params, std::vector<std::pair<uint16
     return true;
 }
 
+/**
+ * Continuation tokens for paged address index reads are the hex encoded index
+ * key of the last returned entry, so the next page can seek straight to it.
+ */
+template <typename Key>
+std::string EncodeAddressContinuation(const Key &key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    return HexStr(ss.begin(), ss.end());
+}
+
+template <typename Key>
+bool DecodeAddressContinuation(const UniValue &value, Key &key)
+{
+    if (value.isNull())
+        return false;
+    if (!value.isStr() || !IsHex(value.get_str()))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid continuation token");
+    std::vector<unsigned char> data(ParseHex(value.get_str()));
+    if (data.size() != key.GetSerializeSize(SER_DISK, CLIENT_VERSION))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid continuation token");
+    CDataStream ss(data, SER_DISK, CLIENT_VERSION);
+    ss >> key;
+    return true;
+}
+
+size_t getAddressPageLimit(const UniValue& params)
+{
+    if (!params[0].isObject())
+        return 0;
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    if (limitValue.isNull())
+        return 0;
+    if (!limitValue.isNum() || limitValue.get_int() <= 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit is expected to be greater than zero");
+    return (size_t)limitValue.get_int();
+}
+
 bool heightSort(std::pair<CAddressUnspentKey, CAddressUnspentValue> a,
                 std::pair<CAddressUnspentKey, CAddressUnspentValue> b) {
     return a.second.blockHeight < b.second.blockHeight;
@@ -1024,6 +1063,8 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp, const CPubKey& mypk
             "      ,...\n"
             "    ],\n"
             "  \"chainInfo\"  (boolean) Include chain info with results\n"
+            "  \"limit\"  (number, optional) Return at most this many outputs in index order\n"
+            "  \"continuation\"  (string, optional) Token from a previous page to resume after\n"
             "}\n"
             "\nCCvout (optional) Return CCvouts instead of normal vouts\n"
             "\nResult\n"
@@ -1037,6 +1078,8 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp, const CPubKey& mypk
             "    \"satoshis\"  (number) The number of satoshis of the output\n"
             "  }\n"
             "]\n"
+            "\nIf limit is set the outputs are returned as {\"utxos\": [...], \"continuation\": \"token\"},\n"
+            "where continuation is only present when more outputs may follow.\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]}' (ccvout)")
             + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]} (ccvout)")
@@ -1058,13 +1101,32 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp, const CPubKey& mypk
 
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
 
+    size_t nLimit = getAddressPageLimit(params);
+    CAddressUnspentKey afterKey;
+    bool fResume = nLimit > 0 && DecodeAddressContinuation(find_value(params[0].get_obj(), "continuation"), afterKey);
+
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
+        if (fResume) {
+            // addresses before the one the token points into were exhausted by earlier pages
+            if (afterKey.hashBytes != (*it).first || afterKey.type != (unsigned int)(*it).second)
+                continue;
+            fResume = false;
+            if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs, &afterKey, nLimit)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+        } else if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs, NULL, nLimit > 0 ? nLimit - unspentOutputs.size() : 0)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
+        if (nLimit > 0 && unspentOutputs.size() >= nLimit)
+            break;
+    }
+    if (fResume) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Continuation token does not match the requested addresses");
     }
 
-    std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+    // paged results stay in index order so that the continuation token is monotonic
+    if (nLimit == 0)
+        std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
 
     UniValue utxos(UniValue::VARR);
 
@@ -1084,13 +1146,18 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp, const CPubKey& mypk
         utxos.push_back(output);
     }
 
-    if (includeChainInfo) {
+    if (includeChainInfo || nLimit > 0) {
         UniValue result(UniValue::VOBJ);
         result.push_back(Pair("utxos", utxos));
 
-        LOCK(cs_main);
-        result.push_back(Pair("hash", chainActive.LastTip()->GetBlockHash().GetHex()));
-        result.push_back(Pair("height", (int)chainActive.Height()));
+        if (nLimit > 0 && unspentOutputs.size() >= nLimit) {
+            result.push_back(Pair("continuation", EncodeAddressContinuation(unspentOutputs.back().first)));
+        }
+        if (includeChainInfo) {
+            LOCK(cs_main);
+            result.push_back(Pair("hash", chainActive.LastTip()->GetBlockHash().GetHex()));
+            result.push_back(Pair("height", (int)chainActive.Height()));
+        }
         return result;
     } else {
         return utxos;
@@ -1342,6 +1409,7 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp, const CPubKey& my
             "{\n"
             "  \"balance\"  (string) The current balance in satoshis\n"
             "  \"received\"  (string) The total number of satoshis received (including change)\n"
+            "  \"utxos\"  (number) The number of unspent outputs (only with -addressbalanceindex)\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]}' (ccvout)")
@@ -1354,6 +1422,29 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp, const CPubKey& my
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    CAmount balance = 0;
+    CAmount received = 0;
+    int64_t utxos = 0;
+    CAddressBalanceValue value;
+
+    // with the balance index each address is a single key read
+    if (GetAddressBalance(addresses[0].first, addresses[0].second, value)) {
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (it != addresses.begin() && !GetAddressBalance((*it).first, (*it).second, value)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+            balance += value.balance;
+            received += value.received;
+            utxos += value.utxos;
+        }
+
+        UniValue result(UniValue::VOBJ);
+        result.push_back(Pair("balance", balance));
+        result.push_back(Pair("received", received));
+        result.push_back(Pair("utxos", utxos));
+        return result;
+    }
+
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
@@ -1362,9 +1453,6 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp, const CPubKey& my
         }
     }
 
-    CAmount balance = 0;
-    CAmount received = 0;
-
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
         if (it->second > 0) {
             received += it->second;
@@ -1454,6 +1542,8 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp, const CPubKey& mypk
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Read at most this many index entries\n"
+            "  \"continuation\" (string, optional) Token from a previous page to resume after\n"
             "}\n"
             "\nCCvout (optional) Return CCvouts instead of normal vouts\n"
             "\nResult:\n"
@@ -1461,6 +1551,8 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp, const CPubKey& mypk
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nIf limit is set the txids are returned as {\"txids\": [...], \"continuation\": \"token\"},\n"
+            "where continuation is only present when more entries may follow.\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]}' (ccvout)")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]} (ccvout)")
@@ -1485,16 +1577,33 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp, const CPubKey& mypk
 
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
+    size_t nLimit = getAddressPageLimit(params);
+    CAddressIndexKey afterKey;
+    bool fResume = nLimit > 0 && DecodeAddressContinuation(find_value(params[0].get_obj(), "continuation"), afterKey);
+
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+        const CAddressIndexKey *pAfterKey = NULL;
+        if (fResume) {
+            if (afterKey.hashBytes != (*it).first || afterKey.type != (unsigned int)(*it).second)
+                continue;
+            fResume = false;
+            pAfterKey = &afterKey;
+        }
+        size_t nRemaining = nLimit > 0 ? nLimit - addressIndex.size() : 0;
         if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
+            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end, pAfterKey, nRemaining)) {
                 throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
             }
         } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, 0, 0, pAfterKey, nRemaining)) {
                 throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
             }
         }
+        if (nLimit > 0 && addressIndex.size() >= nLimit)
+            break;
+    }
+    if (fResume) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Continuation token does not match the requested addresses");
     }
 
     std::set<std::pair<int, std::string> > txids;
@@ -1519,6 +1628,15 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp, const CPubKey& mypk
         }
     }
 
+    if (nLimit > 0) {
+        UniValue page(UniValue::VOBJ);
+        page.push_back(Pair("txids", result));
+        if (addressIndex.size() >= nLimit) {
+            page.push_back(Pair("continuation", EncodeAddressContinuation(addressIndex.back().first)));
+        }
+        return page;
+    }
+
     return result;
 
 }
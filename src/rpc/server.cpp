@@ -21,6 +21,7 @@
 
 #include "rpc/server.h"
 
+#include "httpserver.h"
 #include "init.h"
 #include "key_io.h"
 #include "random.h"
@@ -28,6 +29,7 @@
 #include "ui_interface.h"
 #include "util.h"
 #include "utilstrencodings.h"
+#include "validationinterface.h"
 #include "asyncrpcqueue.h"
 
 #include <memory>
@@ -58,6 +60,11 @@ static std::vector<RPCTimerInterface*> timerInterfaces;
  * @note Can be changed to std::unique_ptr when C++11 */
 static std::map<std::string, boost::shared_ptr<RPCTimerBase> > deadlineTimers;
 
+extern CCriticalSection cs_main;
+/* Per-command call statistics, only of commands found in tableRPC */
+static CCriticalSection cs_rpcStats;
+static std::map<std::string, CRPCCommandStats> mapRPCStats;
+
 static struct CRPCSignals
 {
     boost::signals2::signal<void ()> Started;
@@ -285,6 +292,110 @@ UniValue stop(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return buf;
 }
 
+UniValue getrpcqueueinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrpcqueueinfo\n"
+            "\nReturns the state of the RPC work queue for every method called since startup.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"method\": \"name\",       (string) the RPC method, or (batch) or (unknown)\n"
+            "    \"priority\": \"lane\",     (string) high, normal or low\n"
+            "    \"limit\": n,              (numeric) maximum number of concurrent calls, 0 for none\n"
+            "    \"queued\": n,             (numeric) calls waiting for a worker\n"
+            "    \"running\": n,            (numeric) calls being executed\n"
+            "    \"completed\": n,          (numeric) calls finished since startup\n"
+            "    \"rejected\": n,           (numeric) calls refused because the queue was full\n"
+            "    \"avg_wait_ms\": x.xxx,    (numeric) average time spent in the queue\n"
+            "    \"max_wait_ms\": x.xxx,    (numeric) longest time spent in the queue\n"
+            "    \"avg_run_ms\": x.xxx,     (numeric) average execution time\n"
+            "    \"max_run_ms\": x.xxx      (numeric) longest execution time\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcqueueinfo", "")
+            + HelpExampleRpc("getrpcqueueinfo", "")
+        );
+
+    UniValue ret(UniValue::VARR);
+    BOOST_FOREACH(const HTTPWorkClassStats& s, GetHTTPWorkQueueStats()) {
+        uint64_t nStarted = s.completed + s.running;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("method", s.name));
+        obj.push_back(Pair("priority", HTTPWorkPriorityString(s.priority)));
+        obj.push_back(Pair("limit", s.maxConcurrent));
+        obj.push_back(Pair("queued", (uint64_t)s.queued));
+        obj.push_back(Pair("running", (uint64_t)s.running));
+        obj.push_back(Pair("completed", s.completed));
+        obj.push_back(Pair("rejected", s.rejected));
+        obj.push_back(Pair("avg_wait_ms", nStarted ? s.totalWaitMicros / 1000.0 / nStarted : 0.0));
+        obj.push_back(Pair("max_wait_ms", s.maxWaitMicros / 1000.0));
+        obj.push_back(Pair("avg_run_ms", s.completed ? s.totalRunMicros / 1000.0 / s.completed : 0.0));
+        obj.push_back(Pair("max_run_ms", s.maxRunMicros / 1000.0));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+UniValue getrpcstats(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getrpcstats ( \"command\" )\n"
+            "\nReturns call statistics of every RPC command called since startup, or of one command.\n"
+            "\nArguments:\n"
+            "1. \"command\"     (string, optional) Only return the statistics of this command\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"command\": {             (string) the RPC command\n"
+            "    \"calls\": n,            (numeric) number of calls\n"
+            "    \"errors\": n,           (numeric) calls that returned an error\n"
+            "    \"total_ms\": x.xxx,     (numeric) total execution time\n"
+            "    \"avg_ms\": x.xxx,       (numeric) average execution time\n"
+            "    \"p50_ms\": x.xxx,       (numeric) median execution time, estimated from a histogram\n"
+            "    \"p99_ms\": x.xxx,       (numeric) 99th percentile of the execution time, estimated likewise\n"
+            "    \"max_ms\": x.xxx,       (numeric) longest execution time\n"
+            "    \"cs_main_wait_ms\": x.xxx, (numeric) total time spent waiting for the main lock\n"
+            "    \"bytes_in\": n,         (numeric) total request size of the successful calls\n"
+            "    \"bytes_out\": n         (numeric) total reply size of the successful calls\n"
+            "  }\n"
+            "  ,...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcstats", "")
+            + HelpExampleCli("getrpcstats", "\"getblock\"")
+            + HelpExampleRpc("getrpcstats", "\"getblock\"")
+        );
+
+    std::string strCommand;
+    if (params.size() > 0)
+        strCommand = params[0].get_str();
+
+    UniValue ret(UniValue::VOBJ);
+    std::map<std::string, CRPCCommandStats> mapStats = GetRPCStats();
+    for (std::map<std::string, CRPCCommandStats>::const_iterator it = mapStats.begin(); it != mapStats.end(); ++it) {
+        if (!strCommand.empty() && it->first != strCommand)
+            continue;
+        const CRPCCommandStats& s = it->second;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("calls", s.nCalls));
+        obj.push_back(Pair("errors", s.nErrors));
+        obj.push_back(Pair("total_ms", s.nTotalMicros / 1000.0));
+        obj.push_back(Pair("avg_ms", s.nCalls ? s.nTotalMicros / 1000.0 / s.nCalls : 0.0));
+        obj.push_back(Pair("p50_ms", s.LatencyQuantile(0.5) * 1000));
+        obj.push_back(Pair("p99_ms", s.LatencyQuantile(0.99) * 1000));
+        obj.push_back(Pair("max_ms", s.nMaxMicros / 1000.0));
+        obj.push_back(Pair("cs_main_wait_ms", s.nLockWaitMicros / 1000.0));
+        obj.push_back(Pair("bytes_in", s.nBytesIn));
+        obj.push_back(Pair("bytes_out", s.nBytesOut));
+        ret.push_back(Pair(it->first, obj));
+    }
+    return ret;
+}
+
 /**
  * Call Table
  */
@@ -297,6 +408,8 @@ static const CRPCCommand vRPCCommands[] =
     { "control",            "getnotarysendmany",      &getnotarysendmany,      true  },
     { "control",            "geterablockheights",     &geterablockheights,     true  },
     { "control",            "stop",                   &stop,                   true  },
+    { "control",            "getrpcqueueinfo",        &getrpcqueueinfo,        true  },
+    { "control",            "getrpcstats",            &getrpcstats,            true  },
 
     /* P2P networking */
     { "network",            "getnetworkinfo",         &getnetworkinfo,         true  },
@@ -815,6 +928,7 @@ static UniValue JSONRPCExecOne(const UniValue& req)
 
         UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
         rpc_result = JSONRPCReplyObj(result, NullUniValue, jreq.id);
+        RPCStatsAddBytes(jreq.strMethod, req.write().size(), rpc_result.write().size());
     }
     catch (const UniValue& objError)
     {
@@ -838,6 +952,117 @@ std::string JSONRPCExecBatch(const UniValue& vReq)
     return ret.write() + "\n";
 }
 
+CRPCCommandStats::CRPCCommandStats() :
+    nCalls(0), nErrors(0), nBytesIn(0), nBytesOut(0), nTotalMicros(0), nMaxMicros(0), nLockWaitMicros(0)
+{
+    std::fill(vLatencyBuckets, vLatencyBuckets + RPC_LATENCY_BUCKET_COUNT, 0);
+}
+
+void CRPCCommandStats::AddCall(int64_t nMicros, int64_t nLockWaitMicrosIn, bool fError)
+{
+    nCalls++;
+    if (fError)
+        nErrors++;
+    nTotalMicros += nMicros;
+    nMaxMicros = std::max(nMaxMicros, nMicros);
+    nLockWaitMicros += nLockWaitMicrosIn;
+    size_t i = 0;
+    while (i < RPC_LATENCY_BUCKET_COUNT - 1 && nMicros > RPC_LATENCY_BUCKETS[i] * 1000000)
+        i++;
+    vLatencyBuckets[i]++;
+}
+
+double CRPCCommandStats::LatencyQuantile(double q) const
+{
+    if (nCalls == 0)
+        return 0;
+    double nRank = q * nCalls;
+    uint64_t nCumulative = 0;
+    for (size_t i = 0; i < RPC_LATENCY_BUCKET_COUNT; i++) {
+        if (vLatencyBuckets[i] == 0 || nCumulative + vLatencyBuckets[i] < nRank) {
+            nCumulative += vLatencyBuckets[i];
+            continue;
+        }
+        // Interpolate within the bucket; the last one has no upper bound but the maximum
+        double nLower = i == 0 ? 0 : RPC_LATENCY_BUCKETS[i - 1];
+        double nUpper = i == RPC_LATENCY_BUCKET_COUNT - 1 ? nMaxMicros / 1000000.0 : RPC_LATENCY_BUCKETS[i];
+        double nEstimate = nLower + (nUpper - nLower) * (nRank - nCumulative) / vLatencyBuckets[i];
+        return std::min(nEstimate, nMaxMicros / 1000000.0);
+    }
+    return nMaxMicros / 1000000.0;
+}
+
+void RPCStatsAddBytes(const std::string& strMethod, size_t nBytesIn, size_t nBytesOut)
+{
+    LOCK(cs_rpcStats);
+    std::map<std::string, CRPCCommandStats>::iterator it = mapRPCStats.find(strMethod);
+    if (it == mapRPCStats.end())
+        return;
+    it->second.nBytesIn += nBytesIn;
+    it->second.nBytesOut += nBytesOut;
+}
+
+std::map<std::string, CRPCCommandStats> GetRPCStats()
+{
+    LOCK(cs_rpcStats);
+    return mapRPCStats;
+}
+
+std::string RPCStatsToPrometheus()
+{
+    std::map<std::string, CRPCCommandStats> mapStats = GetRPCStats();
+    std::string strRet;
+    std::map<std::string, CRPCCommandStats>::const_iterator it;
+
+    strRet += "# HELP rpc_calls_total RPC calls by method.\n# TYPE rpc_calls_total counter\n";
+    for (it = mapStats.begin(); it != mapStats.end(); ++it)
+        strRet += strprintf("rpc_calls_total{method=\"%s\"} %u\n", it->first, it->second.nCalls);
+    strRet += "# HELP rpc_errors_total RPC calls that returned an error, by method.\n# TYPE rpc_errors_total counter\n";
+    for (it = mapStats.begin(); it != mapStats.end(); ++it)
+        strRet += strprintf("rpc_errors_total{method=\"%s\"} %u\n", it->first, it->second.nErrors);
+    strRet += "# HELP rpc_duration_seconds RPC execution time by method.\n# TYPE rpc_duration_seconds histogram\n";
+    for (it = mapStats.begin(); it != mapStats.end(); ++it) {
+        uint64_t nCumulative = 0;
+        for (size_t i = 0; i < RPC_LATENCY_BUCKET_COUNT; i++) {
+            nCumulative += it->second.vLatencyBuckets[i];
+            std::string strBound = i == RPC_LATENCY_BUCKET_COUNT - 1 ? "+Inf" : strprintf("%g", RPC_LATENCY_BUCKETS[i]);
+            strRet += strprintf("rpc_duration_seconds_bucket{method=\"%s\",le=\"%s\"} %u\n", it->first, strBound, nCumulative);
+        }
+        strRet += strprintf("rpc_duration_seconds_sum{method=\"%s\"} %.6f\n", it->first, it->second.nTotalMicros / 1000000.0);
+        strRet += strprintf("rpc_duration_seconds_count{method=\"%s\"} %u\n", it->first, it->second.nCalls);
+    }
+    strRet += "# HELP rpc_cs_main_wait_seconds_total Time RPC calls spent waiting for cs_main, by method.\n# TYPE rpc_cs_main_wait_seconds_total counter\n";
+    for (it = mapStats.begin(); it != mapStats.end(); ++it)
+        strRet += strprintf("rpc_cs_main_wait_seconds_total{method=\"%s\"} %.6f\n", it->first, it->second.nLockWaitMicros / 1000000.0);
+    strRet += "# HELP rpc_request_bytes_total Size of successful RPC requests, by method.\n# TYPE rpc_request_bytes_total counter\n";
+    for (it = mapStats.begin(); it != mapStats.end(); ++it)
+        strRet += strprintf("rpc_request_bytes_total{method=\"%s\"} %u\n", it->first, it->second.nBytesIn);
+    strRet += "# HELP rpc_response_bytes_total Size of successful RPC replies, by method.\n# TYPE rpc_response_bytes_total counter\n";
+    for (it = mapStats.begin(); it != mapStats.end(); ++it)
+        strRet += strprintf("rpc_response_bytes_total{method=\"%s\"} %u\n", it->first, it->second.nBytesOut);
+    return strRet;
+}
+
+/** Record a finished call of cmd */
+static void RPCStatsAddCall(const CRPCCommand& cmd, int64_t nMicros, int64_t nLockWaitMicros, bool fError)
+{
+    LOCK(cs_rpcStats);
+    mapRPCStats[cmd.name].AddCall(nMicros, nLockWaitMicros, fError);
+}
+
+/**
+ * Commands that only look at the chain, the mempool or the network don't
+ * depend on the wallet and other notification subscribers having caught up.
+ */
+static bool RPCWaitsForValidationQueue(const CRPCCommand& cmd)
+{
+    static const char* const categories[] = { "blockchain", "network", "addressindex", "mining", "DEX", "nSPV" };
+    for (unsigned int i = 0; i < ARRAYLEN(categories); i++)
+        if (cmd.category == categories[i])
+            return false;
+    return true;
+}
+
 UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
 {
     // Return immediately if in warmup
@@ -856,17 +1081,30 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
 
     g_rpcSignals.PreCommand(*pcmd);
 
+    int64_t nStart = GetTimeMicros();
+    // Let results reflect every block accepted before the call, e.g. a
+    // balance queried right after generate or submitblock.
+    if (RPCWaitsForValidationQueue(*pcmd))
+        SyncWithValidationInterfaceQueue();
+    CLockWaitTimer lockWait(&cs_main);
     try
     {
         // Execute
-        return pcmd->actor(params, false, CPubKey());
+        UniValue result = pcmd->actor(params, false, CPubKey());
+        RPCStatsAddCall(*pcmd, GetTimeMicros() - nStart, lockWait.GetWaitMicros(), false);
+        g_rpcSignals.PostCommand(*pcmd);
+        return result;
     }
     catch (const std::exception& e)
     {
+        RPCStatsAddCall(*pcmd, GetTimeMicros() - nStart, lockWait.GetWaitMicros(), true);
         throw JSONRPCError(RPC_MISC_ERROR, e.what());
     }
-
-    g_rpcSignals.PostCommand(*pcmd);
+    catch (...)
+    {
+        RPCStatsAddCall(*pcmd, GetTimeMicros() - nStart, lockWait.GetWaitMicros(), true);
+        throw;
+    }
 }
 
 std::string HelpExampleCli(const std::string& methodname, const std::string& args)
@@ -176,6 +176,36 @@ public:
 
 extern CRPCTable tableRPC;
 
+/** Upper bounds of the RPC latency histogram buckets in seconds, a last bucket takes the rest */
+static const double RPC_LATENCY_BUCKETS[] = {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60};
+static const size_t RPC_LATENCY_BUCKET_COUNT = sizeof(RPC_LATENCY_BUCKETS) / sizeof(RPC_LATENCY_BUCKETS[0]) + 1;
+
+/** Statistics of one RPC command since startup, recorded by CRPCTable::execute */
+struct CRPCCommandStats
+{
+    uint64_t nCalls;
+    //! Calls that threw, i.e. returned a JSON-RPC error
+    uint64_t nErrors;
+    //! Request and reply sizes of the successful calls
+    uint64_t nBytesIn, nBytesOut;
+    int64_t nTotalMicros, nMaxMicros;
+    //! Time spent blocked waiting for cs_main
+    int64_t nLockWaitMicros;
+    uint64_t vLatencyBuckets[RPC_LATENCY_BUCKET_COUNT];
+
+    CRPCCommandStats();
+    void AddCall(int64_t nMicros, int64_t nLockWaitMicrosIn, bool fError);
+    /** Estimate the q-quantile of the latency in seconds from the histogram */
+    double LatencyQuantile(double q) const;
+};
+
+/** Add the request and reply sizes of a successful call of strMethod to its statistics */
+void RPCStatsAddBytes(const std::string& strMethod, size_t nBytesIn, size_t nBytesOut);
+/** Snapshot of the statistics of every command called since startup */
+std::map<std::string, CRPCCommandStats> GetRPCStats();
+/** The RPC statistics in the Prometheus text exposition format */
+std::string RPCStatsToPrometheus();
+
 /**
  * Utilities: convert hex-encoded Values
  * (throws error if not hex).
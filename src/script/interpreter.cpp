@@ -1398,6 +1398,20 @@ int TransactionSignatureChecker::CheckCryptoCondition(
         fprintf(stderr,"%02x",((uint8_t *)&sighash)[z]);
     fprintf(stderr," sighash nIn.%d nHashType.%d %.8f id.%d\n",(int32_t)nIn,(int32_t)nHashType,(double)amount/COIN,(int32_t)consensusBranchId);
      */
+    int out = CheckFulfillment(cond, sighash, condBin, ffillBin, pstateCC);
+    cc_free(cond);
+    return out;
+}
+
+
+int TransactionSignatureChecker::CheckFulfillment(const CC *cond, const uint256& sighash, const std::vector<unsigned char>& condBin, const std::vector<unsigned char>& ffillBin, CValidationState *pstateCC) const
+{
+    return VerifyFulfillment(cond, sighash, condBin, false, pstateCC);
+}
+
+
+int TransactionSignatureChecker::VerifyFulfillment(const CC *cond, const uint256& sighash, const std::vector<unsigned char>& condBin, bool fEvalOnly, CValidationState *pstateCC) const
+{
     VerifyEval eval = [] (CC *cond, void *pctx) {
         EVAL_STATE_CONTEXT *pstate_ctx = (EVAL_STATE_CONTEXT *)pctx;
         //fprintf(stderr,"checker.%p\n",(TransactionSignatureChecker*)checker);
@@ -1405,10 +1419,11 @@ int TransactionSignatureChecker::CheckCryptoCondition(
     };
     //fprintf(stderr,"non-checker path\n");
     EVAL_STATE_CONTEXT ctx { this,  pstateCC }; 
+    if (fEvalOnly)
+        return cc_verifyEval(cond, eval, (void*)&ctx);
     int out = cc_verify(cond, (const unsigned char*)&sighash, 32, 0,
                         condBin.data(), condBin.size(), eval, (void*)&ctx);
     //fprintf(stderr,"out.%d from cc_verify\n",(int32_t)out);
-    cc_free(cond);
     return out;
 }
 
@@ -170,6 +170,9 @@ protected:
     const PrecomputedTransactionData* txdata;
 
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
+    //! check a parsed fulfillment against its condition: signatures over sighash and then eval nodes, or only the eval nodes if fEvalOnly
+    int VerifyFulfillment(const CC *cond, const uint256& sighash, const std::vector<unsigned char>& condBin, bool fEvalOnly, CValidationState *pstateCC) const;
+    virtual int CheckFulfillment(const CC *cond, const uint256& sighash, const std::vector<unsigned char>& condBin, const std::vector<unsigned char>& ffillBin, CValidationState *pstateCC) const;
 
 public:
     TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn) : txTo(txToIn), nIn(nInIn), amount(amountIn), txdata(NULL) {}
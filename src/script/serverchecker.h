@@ -37,7 +37,22 @@ public:
     ServerTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nIn, const CAmount& amount, bool storeIn) : TransactionSignatureChecker(txToIn, nIn, amount), store(storeIn) {}
 
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
+    int CheckFulfillment(const CC *cond, const uint256& sighash, const std::vector<unsigned char>& condBin, const std::vector<unsigned char>& ffillBin, CValidationState *pstateCC) const;
     virtual int CheckEvalCondition(const CC *cond, CValidationState *pstateCC = NULL) const;
 };
 
+/**
+ * Verifies (and caches) ECDSA signatures and the signatures of crypto-condition
+ * fulfillments without running cc eval nodes, which need the chain state under
+ * cs_main. Used to pre-verify mempool candidates so the full check that follows
+ * under the lock hits the signature cache and only runs the evals.
+ */
+class PreVerifyTransactionSignatureChecker : public ServerTransactionSignatureChecker
+{
+public:
+    PreVerifyTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nIn, const CAmount& amount, const PrecomputedTransactionData& txdataIn) : ServerTransactionSignatureChecker(txToIn, nIn, amount, true, txdataIn) {}
+
+    int CheckEvalCondition(const CC *cond, CValidationState *pstateCC = NULL) const { return true; }
+};
+
 #endif // BITCOIN_SCRIPT_SERVERCHECKER_H
@@ -20,88 +20,184 @@
 
 #include "sigcache.h"
 
+#include "crypto/common.h"
+#include "crypto/sha256.h"
 #include "pubkey.h"
 #include "random.h"
 #include "uint256.h"
 #include "util.h"
-#ifdef _WIN32
-#undef __cpuid
-#endif
-#include <boost/thread.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
+
+#include <algorithm>
+
+CSignatureCacheTable::CSignatureCacheTable(size_t nBytes) : nInsertCounter(0)
+{
+    // a zero size disables the cache
+    nBuckets = nBytes / sizeof(Bucket);
+    // value-initialized, so all entries start empty (zero)
+    if (nBuckets > 0)
+        buckets.reset(new Bucket[nBuckets]());
+}
+
+CSignatureCacheTable::Bucket& CSignatureCacheTable::BucketFor(const uint256& entry) const
+{
+    uint64_t word;
+    memcpy(&word, entry.begin(), sizeof(word));
+    return buckets[word % nBuckets];
+}
+
+bool CSignatureCacheTable::Contains(const uint256& entry) const
+{
+    if (nBuckets == 0)
+        return false;
+    uint64_t words[4];
+    memcpy(words, entry.begin(), sizeof(words));
+    Bucket& bucket = BucketFor(entry);
+
+    uint32_t seq = bucket.seq.load(std::memory_order_acquire);
+    if (seq & 1)
+        return false; // being written, treat as a miss
+    bool found = false;
+    for (unsigned int way = 0; way < WAYS && !found; way++) {
+        found = true;
+        for (int i = 0; i < 4; i++) {
+            if (bucket.words[way][i].load(std::memory_order_relaxed) != words[i]) {
+                found = false;
+                break;
+            }
+        }
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return found && bucket.seq.load(std::memory_order_relaxed) == seq;
+}
+
+void CSignatureCacheTable::Insert(const uint256& entry)
+{
+    if (nBuckets == 0)
+        return;
+    uint64_t words[4];
+    memcpy(words, entry.begin(), sizeof(words));
+    Bucket& bucket = BucketFor(entry);
+
+    std::lock_guard<std::mutex> lock(cs_insert);
+    if (Contains(entry))
+        return;
+    // prefer an empty way, otherwise evict the ways in turn
+    unsigned int way = WAYS;
+    for (unsigned int i = 0; i < WAYS && way == WAYS; i++) {
+        if (bucket.words[i][0].load(std::memory_order_relaxed) == 0 && bucket.words[i][1].load(std::memory_order_relaxed) == 0)
+            way = i;
+    }
+    if (way == WAYS)
+        way = nInsertCounter++ % WAYS;
+
+    uint32_t seq = bucket.seq.load(std::memory_order_relaxed);
+    bucket.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i = 0; i < 4; i++)
+        bucket.words[way][i].store(words[i], std::memory_order_relaxed);
+    bucket.seq.store(seq + 2, std::memory_order_release);
+}
 
 namespace {
 
 /**
- * Valid signature cache, to avoid doing expensive ECDSA signature checking
- * twice for every transaction (once when accepted into memory pool, and
- * again when accepted into the block chain)
+ * Salted hasher for cache entries. The salt is random per process so entries
+ * cannot be precomputed by an attacker.
  */
-class CSignatureCache
+class CSignatureCacheHasher
 {
 private:
-     //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
-    boost::shared_mutex cs_sigcache;
+    CSHA256 salted;
 
 public:
-    bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    CSignatureCacheHasher()
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
-        return false;
+        unsigned char nonce[32];
+        GetRandBytes(nonce, sizeof(nonce));
+        salted.Write(nonce, sizeof(nonce));
     }
 
-    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    CSHA256 Start(unsigned char type) const
     {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there can be no more than 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
-
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
-        }
-
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+        CSHA256 hasher = salted;
+        hasher.Write(&type, 1);
+        return hasher;
     }
 };
 
+const CSignatureCacheHasher& GetSignatureCacheHasher()
+{
+    static const CSignatureCacheHasher hasher;
+    return hasher;
+}
+
+void WriteVector(CSHA256& hasher, const unsigned char* data, size_t size)
+{
+    uint32_t len = htole32((uint32_t)size);
+    hasher.Write((const unsigned char*)&len, sizeof(len));
+    hasher.Write(data, size);
+}
+
+}
+
+uint256 SignatureCacheEntry(const uint256& sighash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey)
+{
+    uint256 entry;
+    CSHA256 hasher = GetSignatureCacheHasher().Start('E');
+    hasher.Write(sighash.begin(), 32);
+    WriteVector(hasher, vchSig.data(), vchSig.size());
+    WriteVector(hasher, pubkey.begin(), pubkey.size());
+    hasher.Finalize(entry.begin());
+    return entry;
+}
+
+uint256 CryptoConditionCacheEntry(const uint256& sighash, const std::vector<unsigned char>& condBin, const std::vector<unsigned char>& ffillBin)
+{
+    uint256 entry;
+    CSHA256 hasher = GetSignatureCacheHasher().Start('C');
+    hasher.Write(sighash.begin(), 32);
+    WriteVector(hasher, condBin.data(), condBin.size());
+    WriteVector(hasher, ffillBin.data(), ffillBin.size());
+    hasher.Finalize(entry.begin());
+    return entry;
+}
+
+uint256 EquihashCacheEntry(const uint256& hashBlock)
+{
+    uint256 entry;
+    CSHA256 hasher = GetSignatureCacheHasher().Start('H');
+    hasher.Write(hashBlock.begin(), 32);
+    hasher.Finalize(entry.begin());
+    return entry;
+}
+
+int64_t GetSignatureCacheSizeMiB()
+{
+    int64_t nSize = GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE);
+    if (nSize > MAX_MAX_SIG_CACHE_SIZE)
+        return DEFAULT_MAX_SIG_CACHE_SIZE; // an entry count from an older config
+    return std::max(nSize, (int64_t)0);
+}
+
+CSignatureCacheTable& GetSignatureCache()
+{
+    // DoS prevention: the cache never grows beyond its initial fixed size
+    static CSignatureCacheTable signatureCache(GetSignatureCacheSizeMiB() << 20);
+    return signatureCache;
 }
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
+    CSignatureCacheTable& signatureCache = GetSignatureCache();
+    uint256 entry = SignatureCacheEntry(sighash, vchSig, pubkey);
 
-    if (signatureCache.Get(sighash, vchSig, pubkey))
+    if (signatureCache.Contains(entry))
         return true;
 
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
 
     if (store)
-        signatureCache.Set(sighash, vchSig, pubkey);
+        signatureCache.Insert(entry);
     return true;
 }
@@ -23,10 +23,64 @@
 
 #include "script/interpreter.h"
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 class CPubKey;
 
+//! Default size of the signature cache in MiB, shared by ECDSA and cryptocondition verifications
+static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+//! Maximum size of the signature cache in MiB. -maxsigcachesize used to be an entry
+//! count (default 50000), larger values are taken for one and replaced by the default.
+static const int64_t MAX_MAX_SIG_CACHE_SIZE = 4096;
+
+/**
+ * Fixed-memory set of successfully verified signatures and cryptocondition
+ * fulfillments. Entries are salted hashes of the verified data, kept in
+ * buckets of a few ways. Lookups are lock-free, guarded by a per-bucket
+ * sequence counter; inserts are serialized and evict the ways of a bucket
+ * in turn.
+ */
+class CSignatureCacheTable
+{
+public:
+    static const unsigned int WAYS = 4;
+
+    explicit CSignatureCacheTable(size_t nBytes);
+
+    bool Contains(const uint256& entry) const;
+    void Insert(const uint256& entry);
+
+    size_t Capacity() const { return nBuckets * WAYS; }
+
+private:
+    struct Bucket
+    {
+        std::atomic<uint32_t> seq;
+        std::atomic<uint64_t> words[WAYS][4];
+    };
+
+    std::unique_ptr<Bucket[]> buckets;
+    size_t nBuckets;
+    uint32_t nInsertCounter;
+    std::mutex cs_insert;
+
+    Bucket& BucketFor(const uint256& entry) const;
+};
+
+/** Salted cache entries for an ECDSA signature and for a cryptocondition fulfillment */
+uint256 SignatureCacheEntry(const uint256& sighash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey);
+uint256 CryptoConditionCacheEntry(const uint256& sighash, const std::vector<unsigned char>& condBin, const std::vector<unsigned char>& ffillBin);
+uint256 EquihashCacheEntry(const uint256& hashBlock);
+
+/** Size of the signature cache in MiB from -maxsigcachesize, the default if the value is out of range */
+int64_t GetSignatureCacheSizeMiB();
+
+/** The process wide cache, sized by -maxsigcachesize (MiB) on first use */
+CSignatureCacheTable& GetSignatureCache();
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
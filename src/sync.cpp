@@ -27,6 +27,8 @@
 #include <boost/foreach.hpp>
 #include <boost/thread.hpp>
 
+thread_local CLockWaitStats* pLockWaitStats = NULL;
+
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 {
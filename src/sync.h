@@ -22,6 +22,7 @@
 #define BITCOIN_SYNC_H
 
 #include "threadsafety.h"
+#include "utiltime.h"
 
 #undef __cpuid
 #include <boost/thread/condition_variable.hpp>
@@ -115,6 +116,39 @@ void static inline AssertLockHeldInternal(const char* pszName, const char* pszFi
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/** Time the current thread spent blocked acquiring one mutex, see CLockWaitTimer */
+struct CLockWaitStats
+{
+    const void* pmutex;
+    int64_t nWaitMicros;
+};
+extern thread_local CLockWaitStats* pLockWaitStats;
+
+/**
+ * While in scope, accumulates how long the current thread waits for pmutex in
+ * LOCK(), e.g. to tell how much of an RPC call was spent waiting for cs_main.
+ * Uncontended locking only pays for a try_lock().
+ */
+class CLockWaitTimer
+{
+private:
+    CLockWaitStats stats;
+    CLockWaitStats* pprev;
+
+public:
+    CLockWaitTimer(const void* pmutex) : pprev(pLockWaitStats)
+    {
+        stats.pmutex = pmutex;
+        stats.nWaitMicros = 0;
+        pLockWaitStats = &stats;
+    }
+    ~CLockWaitTimer()
+    {
+        pLockWaitStats = pprev;
+    }
+    int64_t GetWaitMicros() const { return stats.nWaitMicros; }
+};
+
 /** Wrapper around boost::unique_lock<Mutex> */
 template <typename Mutex>
 class SCOPED_LOCKABLE CMutexLock
@@ -125,6 +159,14 @@ private:
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
+        if (pLockWaitStats != NULL && pLockWaitStats->pmutex == (const void*)lock.mutex()) {
+            if (!lock.try_lock()) {
+                int64_t nStart = GetTimeMicros();
+                lock.lock();
+                pLockWaitStats->nWaitMicros += GetTimeMicros() - nStart;
+            }
+            return;
+        }
 #ifdef DEBUG_LOCKCONTENTION
         if (!lock.try_lock()) {
             PrintLockContention(pszName, pszFile, nLine);
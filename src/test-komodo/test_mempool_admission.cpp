@@ -0,0 +1,133 @@
+#include <cryptoconditions.h>
+#include <gtest/gtest.h>
+
+#include "cc/eval.h"
+#include "consensus/validation.h"
+#include "main.h"
+#include "primitives/transaction.h"
+#include "script/cc.h"
+#include "script/interpreter.h"
+#include "script/sigcache.h"
+#include "txmempool.h"
+#include "utilstrencodings.h"
+
+#include "testutils.h"
+
+
+extern Eval* EVAL_TEST;
+
+namespace TestMempoolAdmission {
+
+
+/*
+ * Relayed transactions are pre-verified by PreVerifyTransaction, which caches
+ * the signatures but skips the cc eval nodes, and then go through
+ * AcceptToMemoryPool, which must still run the evals on a cache hit.
+ */
+class TestMempoolAdmission : public ::testing::Test, public Eval {
+public:
+    int nEvalCalls;
+    bool fEvalValid;
+
+    bool Dispatch(const CC *cond, const CTransaction &txTo, unsigned int nIn)
+    {
+        nEvalCalls++;
+        state = CValidationState();
+        return fEvalValid ? Valid() : Invalid("test-eval");
+    }
+
+    // a condition that needs a signature of notaryKey and a passing eval node
+    CC *MakeCond() { return CCNewThreshold(2, { CCNewSecp256k1(notaryKey.GetPubKey()), CCNewEval({1}) }); }
+
+    CMutableTransaction SpendCond(CC *cond)
+    {
+        CTransaction txIn;
+        getInputTx(CCPubKey(cond), txIn);
+        CMutableTransaction mtx = spendTx(txIn);
+        mtx.vout[0].scriptPubKey = CScript() << ParseHex(notaryPubkey) << OP_CHECKSIG;
+        uint256 sighash = SignatureHash(CCPubKey(cond), mtx, 0, SIGHASH_ALL, 0, 0);
+        cc_signTreeSecp256k1Msg32(cond, notaryKey.begin(), sighash.begin());
+        mtx.vin[0].scriptSig = CCSig(cond);
+        return mtx;
+    }
+
+    // the signature cache entry of the fulfillment in tx's first input
+    uint256 FulfillmentCacheEntry(const CTransaction &tx, CC *cond)
+    {
+        std::vector<unsigned char> condBin, ffillBin;
+        CScript scriptPubKey = CCPubKey(cond);
+        CScript::const_iterator pc = scriptPubKey.begin();
+        opcodetype opcode;
+        scriptPubKey.GetOp(pc, opcode, condBin);
+        pc = tx.vin[0].scriptSig.begin();
+        tx.vin[0].scriptSig.GetOp(pc, opcode, ffillBin);
+        uint256 sighash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, 0);
+        return CryptoConditionCacheEntry(sighash, condBin, ffillBin);
+    }
+
+protected:
+    static void SetUpTestCase() { setupChain(); }
+    virtual void SetUp() {
+        ASSETCHAINS_CC = 1;
+        EVAL_TEST = this;
+        nEvalCalls = 0;
+        fEvalValid = true;
+    }
+    virtual void TearDown() {
+        EVAL_TEST = NULL;
+    }
+};
+
+
+TEST_F(TestMempoolAdmission, testEvalRunsOnCacheHit)
+{
+    CC *cond = MakeCond();
+    CTransaction tx(SpendCond(cond));
+    uint256 entry = FulfillmentCacheEntry(tx, cond);
+    ASSERT_FALSE(GetSignatureCache().Contains(entry));
+
+    // the eval would fail, but pre-verification only checks and caches the signature
+    fEvalValid = false;
+    CValidationState state;
+    ASSERT_TRUE(PreVerifyTransaction(tx, state));
+    EXPECT_EQ(0, nEvalCalls);
+    ASSERT_TRUE(GetSignatureCache().Contains(entry));
+
+    // mempool acceptance hits the cache and still runs the eval
+    ASSERT_FALSE(acceptTx(tx, state));
+    EXPECT_GT(nEvalCalls, 0);
+
+    nEvalCalls = 0;
+    fEvalValid = true;
+    CValidationState state2;
+    ASSERT_TRUE(acceptTx(tx, state2)) << state2.GetRejectReason();
+    EXPECT_GT(nEvalCalls, 0);
+    cc_free(cond);
+}
+
+
+TEST_F(TestMempoolAdmission, testBadSignatureRejected)
+{
+    CC *cond = MakeCond();
+    CMutableTransaction mtx = SpendCond(cond);
+    memset(cond->subconditions[0]->signature, 0, 32);
+    mtx.vin[0].scriptSig = CCSig(cond);
+    CTransaction tx(mtx);
+
+    CValidationState state;
+    int nDoS = 0;
+    ASSERT_FALSE(PreVerifyTransaction(tx, state));
+    EXPECT_TRUE(state.IsInvalid(nDoS));
+    EXPECT_EQ(100, nDoS);
+    EXPECT_EQ(REJECT_INVALID, state.GetRejectCode());
+    EXPECT_EQ(0, nEvalCalls);
+    EXPECT_FALSE(GetSignatureCache().Contains(FulfillmentCacheEntry(tx, cond)));
+
+    // nothing was cached, so the full check rejects it as well
+    CValidationState state2;
+    ASSERT_FALSE(acceptTx(tx, state2));
+    cc_free(cond);
+}
+
+
+} /* namespace TestMempoolAdmission */
@@ -4,6 +4,8 @@
 
 #include "chainparams.h"
 #include "main.h"
+#include "random.h"
+#include "streams.h"
 
 #include "test/test_bitcoin.h"
 
@@ -101,4 +103,82 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     BOOST_CHECK(Test());
 }
 
+BOOST_AUTO_TEST_CASE(block_txhash_deferral)
+{
+    CBlock block;
+    for (int i = 0; i < 100; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = COutPoint(GetRandHash(), i);
+        mtx.vout.resize(1);
+        mtx.vout[0].nValue = i;
+        block.vtx.push_back(CTransaction(mtx));
+    }
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << block;
+
+    CBlock block2;
+    {
+        CTxHashDeferral deferTxHashes;
+        ss >> block2;
+    }
+    BOOST_CHECK(block2.vtx.size() == block.vtx.size());
+    BOOST_CHECK(block2.vtx[0].GetHash().IsNull());
+
+    UpdateBlockTxHashes(block2);
+    for (size_t i = 0; i < block.vtx.size(); i++)
+        BOOST_CHECK(block2.vtx[i].GetHash() == block.vtx[i].GetHash());
+    BOOST_CHECK(block2.BuildMerkleTree() == block.BuildMerkleTree());
+
+    // Outside the guard txids are computed while reading again.
+    CDataStream ss2(SER_DISK, CLIENT_VERSION);
+    ss2 << block;
+    CBlock block3;
+    ss2 >> block3;
+    BOOST_CHECK(block3.vtx[0].GetHash() == block.vtx[0].GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(block_index_solution_split)
+{
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashMerkleRoot = GetRandHash();
+    header.nTime = 1234567;
+    header.nBits = 0x200f0f0f;
+    header.nNonce = GetRandHash();
+    header.nSolution = std::vector<unsigned char>(1344, 0x5a);
+    CBlockIndex index(header);
+    index.SetHeight(42);
+    index.nStatus = BLOCK_VALID_TREE | BLOCK_HAVE_DATA;
+    index.nFile = 3;
+    index.nDataPos = 1000;
+    index.nTx = 7;
+
+    CDiskBlockIndex dbindex(&index);
+    CDataStream ssFull(SER_DISK, CLIENT_VERSION), ssFields(SER_DISK, CLIENT_VERSION);
+    ssFull << dbindex;
+    ssFields << CDiskBlockIndexNoSolution(dbindex);
+    // the solution and its 3-byte length prefix are all that is left out
+    BOOST_CHECK_EQUAL(ssFull.size(), ssFields.size() + header.nSolution.size() + 3);
+
+    CDiskBlockIndex dbindex2;
+    CDiskBlockIndexNoSolution record(dbindex2);
+    ssFields >> record;
+    BOOST_CHECK(ssFields.empty());
+    BOOST_CHECK(!dbindex2.HasSolution());
+    BOOST_CHECK_EQUAL(dbindex2.GetHeight(), 42);
+    BOOST_CHECK_EQUAL(dbindex2.nStatus, index.nStatus);
+    BOOST_CHECK_EQUAL(dbindex2.nFile, 3);
+    BOOST_CHECK_EQUAL(dbindex2.nDataPos, 1000u);
+    BOOST_CHECK_EQUAL(dbindex2.nTx, 7u);
+    BOOST_CHECK(dbindex2.hashMerkleRoot == header.hashMerkleRoot);
+    BOOST_CHECK(dbindex2.nNonce == header.nNonce);
+    BOOST_CHECK_EQUAL(dbindex2.nTime, header.nTime);
+
+    // records written by older versions still read with the solution inline
+    CDiskBlockIndex dbindex3;
+    ssFull >> dbindex3;
+    BOOST_CHECK(dbindex3.GetSolution() == header.nSolution);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
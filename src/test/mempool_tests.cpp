@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "cc/eval.h"
 #include "consensus/upgrades.h"
 #include "main.h"
 #include "txmempool.h"
@@ -157,6 +158,134 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
     BOOST_CHECK(it == pool.mapTx.get<1>().end());
 }
 
+BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+    TestMemPoolEntryHelper entry;
+    entry.hadNoDependencies = true;
+
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vin.resize(1);
+    tx1.vin[0].prevout = COutPoint(uint256S("01"), 0);
+    tx1.vin[0].scriptSig = CScript() << OP_1;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(10000LL).Time(1).FromTx(tx1, &pool));
+
+    /* low fee parent of a high fee child */
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vin.resize(1);
+    tx2.vin[0].prevout = COutPoint(uint256S("02"), 0);
+    tx2.vin[0].scriptSig = CScript() << OP_2;
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx2.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx2.GetHash(), entry.Fee(5000LL).Time(1).FromTx(tx2, &pool));
+
+    CMutableTransaction tx3 = CMutableTransaction();
+    tx3.vin.resize(1);
+    tx3.vin[0].prevout = COutPoint(tx2.GetHash(), 0);
+    tx3.vin[0].scriptSig = CScript() << OP_3;
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx3.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx3.GetHash(), entry.Fee(50000LL).Time(5).FromTx(tx3, &pool));
+
+    CMutableTransaction tx4 = CMutableTransaction();
+    tx4.vin.resize(1);
+    tx4.vin[0].prevout = COutPoint(uint256S("04"), 0);
+    tx4.vin[0].scriptSig = CScript() << OP_4;
+    tx4.vout.resize(1);
+    tx4.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx4.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx4.GetHash(), entry.Fee(1000LL).Time(5).FromTx(tx4, &pool));
+    BOOST_CHECK_EQUAL(pool.size(), 4);
+    BOOST_CHECK(pool.GetMinFee(1) == CFeeRate(0));
+
+    // The lowest fee rate goes first, and the pool then asks for more than it paid
+    std::vector<uint256> vNoSpendsRemaining;
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1, &vNoSpendsRemaining);
+    BOOST_CHECK(!pool.exists(tx4.GetHash()));
+    BOOST_CHECK_EQUAL(pool.size(), 3);
+    BOOST_CHECK_EQUAL(pool.GetEvictedCount(), 1);
+    BOOST_CHECK_EQUAL(vNoSpendsRemaining.size(), 1);
+    BOOST_CHECK(vNoSpendsRemaining[0] == tx4.vin[0].prevout.hash);
+    BOOST_CHECK(pool.GetMinFee(1) > CFeeRate(1000LL, ::GetSerializeSize(tx4, SER_NETWORK, PROTOCOL_VERSION)));
+
+    // tx2 has the lowest fee rate left, but its child pays for it
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(!pool.exists(tx1.GetHash()));
+    BOOST_CHECK(pool.exists(tx2.GetHash()));
+    BOOST_CHECK(pool.exists(tx3.GetHash()));
+
+    // Expiry takes the descendants of expired transactions along
+    BOOST_CHECK_EQUAL(pool.Expire(2), 2);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    BOOST_CHECK_EQUAL(pool.GetExpiredCount(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolCCIndexTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    uint256 oracletxid = uint256S("aa"), otheroracletxid = uint256S("bb");
+
+    std::vector<CMutableTransaction> txs(4);
+    uint8_t funcids[4] = { 'D', 'D', 'F', 'D' };
+    uint256 reftxids[4] = { oracletxid, otheroracletxid, oracletxid, oracletxid };
+    for (int i = 0; i < 4; i++)
+    {
+        std::vector<uint8_t> vopret;
+        vopret.push_back(EVAL_ORACLES);
+        vopret.push_back(funcids[i]);
+        vopret.insert(vopret.end(), reftxids[i].begin(), reftxids[i].end());
+        vopret.push_back(i);
+        txs[i].vout.resize(2);
+        txs[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txs[i].vout[0].nValue = COIN;
+        txs[i].vout[1].scriptPubKey = CScript() << OP_RETURN << vopret;
+        pool.addUnchecked(txs[i].GetHash(), entry.FromTx(txs[i]));
+    }
+    /* no opret */
+    CMutableTransaction tx5 = CMutableTransaction();
+    tx5.vout.resize(1);
+    tx5.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx5.vout[0].nValue = COIN;
+    pool.addUnchecked(tx5.GetHash(), entry.FromTx(tx5));
+
+    std::vector<uint256> txids;
+    pool.getCCIndex(EVAL_ORACLES, 0, uint256(), txids);
+    BOOST_CHECK_EQUAL(txids.size(), 4);
+
+    txids.clear();
+    pool.getCCIndex(EVAL_ORACLES, 'D', uint256(), txids);
+    BOOST_CHECK_EQUAL(txids.size(), 3);
+
+    txids.clear();
+    pool.getCCIndex(EVAL_ORACLES, 'D', oracletxid, txids);
+    BOOST_CHECK_EQUAL(txids.size(), 2);
+    BOOST_CHECK(std::count(txids.begin(), txids.end(), txs[0].GetHash()) == 1);
+    BOOST_CHECK(std::count(txids.begin(), txids.end(), txs[3].GetHash()) == 1);
+
+    txids.clear();
+    pool.getCCIndex(EVAL_ORACLES, 0, oracletxid, txids);
+    BOOST_CHECK_EQUAL(txids.size(), 3);
+
+    // removal drops the entries of the removed tx only
+    std::list<CTransaction> removed;
+    pool.remove(txs[0], removed, false);
+    txids.clear();
+    pool.getCCIndex(EVAL_ORACLES, 'D', oracletxid, txids);
+    BOOST_CHECK_EQUAL(txids.size(), 1);
+    BOOST_CHECK(txids[0] == txs[3].GetHash());
+
+    pool.clear();
+    txids.clear();
+    pool.getCCIndex(EVAL_ORACLES, 0, uint256(), txids);
+    BOOST_CHECK(txids.empty());
+}
+
 BOOST_AUTO_TEST_CASE(RemoveWithoutBranchId) {
     CTxMemPool pool(CFeeRate(0));
     TestMemPoolEntryHelper entry;
@@ -96,4 +96,19 @@ BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(equihash_solution_cache)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    CBlockHeader header = Params().GenesisBlock().GetBlockHeader();
+
+    // the second check of the same header is answered from the cache
+    BOOST_CHECK(CheckEquihashSolution(&header, Params()));
+    BOOST_CHECK(CheckEquihashSolution(&header, Params()));
+
+    // a different nonce is a different block hash, and failures are not cached
+    header.nNonce = ArithToUint256(UintToArith256(header.nNonce) + 1);
+    BOOST_CHECK(!CheckEquihashSolution(&header, Params()));
+    BOOST_CHECK(!CheckEquihashSolution(&header, Params()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -346,4 +346,27 @@ BOOST_AUTO_TEST_CASE(rpc_getnetworksolps)
     BOOST_CHECK_NO_THROW(CallRPC("getnetworksolps 120 -1"));
 }
 
+BOOST_AUTO_TEST_CASE(rpc_command_stats)
+{
+    CRPCCommandStats stats;
+    BOOST_CHECK_EQUAL(stats.LatencyQuantile(0.5), 0);
+
+    // 98 calls of 0.2ms and two of 3s
+    for (int i = 0; i < 98; i++)
+        stats.AddCall(200, 0, false);
+    stats.AddCall(3000000, 1500, true);
+    stats.AddCall(3000000, 0, false);
+    BOOST_CHECK_EQUAL(stats.nCalls, 100);
+    BOOST_CHECK_EQUAL(stats.nErrors, 1);
+    BOOST_CHECK_EQUAL(stats.nLockWaitMicros, 1500);
+    BOOST_CHECK_EQUAL(stats.nMaxMicros, 3000000);
+    BOOST_CHECK(stats.LatencyQuantile(0.5) > 0.0001 && stats.LatencyQuantile(0.5) <= 0.00025);
+    BOOST_CHECK(stats.LatencyQuantile(0.99) > 2.5 && stats.LatencyQuantile(0.99) <= 3);
+    BOOST_CHECK_EQUAL(stats.LatencyQuantile(1), 3);
+
+    // Calls beyond the last bucket are bounded by the slowest one
+    stats.AddCall(100000000, 0, false);
+    BOOST_CHECK(stats.LatencyQuantile(1) <= 100);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
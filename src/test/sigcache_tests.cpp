@@ -0,0 +1,73 @@
+// Copyright (c) 2019 The SuperNET Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "script/sigcache.h"
+#include "pubkey.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(sigcache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(sigcache_table_basics)
+{
+    CSignatureCacheTable table(1 << 20);
+    BOOST_CHECK(table.Capacity() > 0);
+
+    uint256 a = GetRandHash(), b = GetRandHash();
+    BOOST_CHECK(!table.Contains(a));
+    table.Insert(a);
+    BOOST_CHECK(table.Contains(a));
+    BOOST_CHECK(!table.Contains(b));
+    table.Insert(a);
+    BOOST_CHECK(table.Contains(a));
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_table_disabled)
+{
+    CSignatureCacheTable table(0);
+    BOOST_CHECK_EQUAL(table.Capacity(), 0);
+
+    uint256 a = GetRandHash();
+    table.Insert(a);
+    BOOST_CHECK(!table.Contains(a));
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_table_fixed_size)
+{
+    // a table of a few buckets keeps at most its capacity, evicting older entries
+    CSignatureCacheTable table(4096);
+    std::vector<uint256> entries;
+    for (size_t i = 0; i < table.Capacity() * 4; i++) {
+        entries.push_back(GetRandHash());
+        table.Insert(entries.back());
+    }
+    size_t found = 0;
+    for (const uint256& entry : entries)
+        found += table.Contains(entry);
+    BOOST_CHECK(found > 0);
+    BOOST_CHECK(found <= table.Capacity());
+    BOOST_CHECK(table.Contains(entries.back()));
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_entries)
+{
+    uint256 sighash = GetRandHash();
+    std::vector<unsigned char> sig(72, 0x30), cond(40, 0xa0), ffill(80, 0xa2);
+    CPubKey pubkey;
+
+    // entries are deterministic within a process and separated by kind
+    BOOST_CHECK(SignatureCacheEntry(sighash, sig, pubkey) == SignatureCacheEntry(sighash, sig, pubkey));
+    BOOST_CHECK(CryptoConditionCacheEntry(sighash, cond, ffill) == CryptoConditionCacheEntry(sighash, cond, ffill));
+    BOOST_CHECK(SignatureCacheEntry(sighash, sig, pubkey) != CryptoConditionCacheEntry(sighash, sig, std::vector<unsigned char>()));
+
+    // moving bytes between fields gives a different entry
+    std::vector<unsigned char> cond2(cond), ffill2(ffill);
+    cond2.push_back(ffill2.front());
+    ffill2.erase(ffill2.begin());
+    BOOST_CHECK(CryptoConditionCacheEntry(sighash, cond, ffill) != CryptoConditionCacheEntry(sighash, cond2, ffill2));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
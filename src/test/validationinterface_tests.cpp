@@ -0,0 +1,87 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "validationinterface.h"
+
+#include "main.h"
+
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(validationinterface_tests, TestingSetup)
+
+static void AppendNotification(std::vector<int>& delivered, int n)
+{
+    // Only the delivering thread touches the vector until the queue is synced
+    delivered.push_back(n);
+    if (n == 0)
+        MilliSleep(50);
+}
+
+BOOST_AUTO_TEST_CASE(queue_delivers_in_order)
+{
+    std::vector<int> delivered;
+
+    // Not running: notifications are delivered right away
+    QueueValidationNotification(boost::bind(&AppendNotification, boost::ref(delivered), -1));
+    BOOST_CHECK_EQUAL(delivered.size(), 1U);
+
+    StartValidationInterfaceQueue();
+    for (int i = 0; i < 100; i++)
+        QueueValidationNotification(boost::bind(&AppendNotification, boost::ref(delivered), i));
+    LimitValidationInterfaceQueue();
+    BOOST_CHECK(ValidationInterfaceQueueDepth() <= MAX_VALIDATION_QUEUE_DEPTH);
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(ValidationInterfaceQueueDepth(), 0U);
+    BOOST_CHECK_EQUAL(delivered.size(), 101U);
+    for (int i = 0; i < 100; i++)
+        BOOST_CHECK_EQUAL(delivered[i + 1], i);
+
+    // Stopping delivers what is still queued
+    QueueValidationNotification(boost::bind(&AppendNotification, boost::ref(delivered), 100));
+    StopValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(delivered.size(), 102U);
+    QueueValidationNotification(boost::bind(&AppendNotification, boost::ref(delivered), 101));
+    BOOST_CHECK_EQUAL(delivered.size(), 103U);
+}
+
+static void SetDelivered(bool& fDelivered)
+{
+    fDelivered = true;
+}
+
+BOOST_AUTO_TEST_CASE(queue_delivers_without_cs_main)
+{
+    bool fDelivered = false;
+    StartValidationInterfaceQueue();
+    {
+        // Validation queues notifications with cs_main held, delivery must not wait for it
+        LOCK(cs_main);
+        QueueValidationNotification(boost::bind(&SetDelivered, boost::ref(fDelivered)));
+        for (int i = 0; i < 500 && ValidationInterfaceQueueDepth() > 0; i++)
+            MilliSleep(10);
+        BOOST_CHECK_EQUAL(ValidationInterfaceQueueDepth(), 0U);
+    }
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(fDelivered);
+    StopValidationInterfaceQueue();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
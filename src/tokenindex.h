@@ -0,0 +1,88 @@
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2009-2015 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TOKENINDEX_H
+#define BITCOIN_TOKENINDEX_H
+
+#include "uint256.h"
+#include "amount.h"
+#include "pubkey.h"
+
+#include <vector>
+
+/**
+ * Token ownership index: for every confirmed token cc output records the
+ * tokenid, the token amount and the owner pubkeys, as established by the
+ * tokens cc module when the block was connected. An output's entry only
+ * depends on the transaction itself, so it stays valid while the tx is in
+ * the chain and is erased when its block is disconnected.
+ */
+struct CTokenIndexKey {
+    uint256 txid;
+    unsigned int outputIndex;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(outputIndex);
+    }
+
+    CTokenIndexKey(uint256 t, unsigned int i) {
+        txid = t;
+        outputIndex = i;
+    }
+
+    CTokenIndexKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        txid.SetNull();
+        outputIndex = 0;
+    }
+};
+
+struct CTokenIndexValue {
+    uint256 tokenid;
+    CAmount satoshis;
+    std::vector<CPubKey> owners;
+    int blockHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(tokenid);
+        READWRITE(satoshis);
+        READWRITE(owners);
+        READWRITE(blockHeight);
+    }
+
+    CTokenIndexValue(uint256 t, CAmount s, const std::vector<CPubKey> &o, int h) {
+        tokenid = t;
+        satoshis = s;
+        owners = o;
+        blockHeight = h;
+    }
+
+    CTokenIndexValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        tokenid.SetNull();
+        satoshis = 0;
+        owners.clear();
+        blockHeight = 0;
+    }
+
+    bool IsNull() const {
+        return tokenid.IsNull();
+    }
+};
+
+#endif // BITCOIN_TOKENINDEX_H
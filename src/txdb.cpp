@@ -27,9 +27,15 @@
 #include "pow.h"
 #include "uint256.h"
 #include "core_io.h"
+#include "ui_interface.h"
+#include "util.h"
 
 #include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
 
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -45,10 +51,14 @@ static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_ADDRESSINDEX = 'd';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_ADDRESSBALANCEINDEX = 'w';
 static const char DB_TIMESTAMPINDEX = 'S';
 static const char DB_BLOCKHASHINDEX = 'z';
 static const char DB_SPENTINDEX = 'p';
-static const char DB_BLOCK_INDEX = 'b';
+static const char DB_TOKENINDEX = 'k';
+static const char DB_BLOCK_INDEX = 'b'; // written by older versions, with the Equihash solution inline
+static const char DB_BLOCK_HEADER_INDEX = 'h';
+static const char DB_BLOCK_SOLUTION = 'e';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_BEST_SPROUT_ANCHOR = 'a';
@@ -291,22 +301,13 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     }
     batch.Write(DB_LAST_BLOCK, nLastFile);
     for (const auto& it : blockinfo) {
-        std::pair<char, uint256> key = make_pair(DB_BLOCK_INDEX, it->GetBlockHash());
-        try {
-            CDiskBlockIndex dbindex {it, [this, &key]() {
-                // It can happen that the index entry is written, then the Equihash solution is cleared from memory,
-                // then the index entry is rewritten. In that case we must read the solution from the old entry.
-                CDiskBlockIndex dbindex_old;
-                if (!Read(key, dbindex_old)) {
-                    LogPrintf("%s: Failed to read index entry", __func__);
-                    throw runtime_error("Failed to read index entry");
-                }
-                return dbindex_old.GetSolution();
-            }};
-            batch.Write(key, dbindex);
-        } catch (const runtime_error&) {
-            return false;
-        }
+        uint256 hash = it->GetBlockHash();
+        CDiskBlockIndex dbindex(it);
+        batch.Write(make_pair(DB_BLOCK_HEADER_INDEX, hash), CDiskBlockIndexNoSolution(dbindex));
+        // The solution is only in memory until the entry has been written once (see
+        // TrimSolution); rewrites to update the validity status leave its record alone.
+        if (dbindex.HasSolution())
+            batch.Write(make_pair(DB_BLOCK_SOLUTION, hash), dbindex.GetSolution());
     }
     return WriteBatch(batch, true);
 }
@@ -314,31 +315,178 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
 bool CBlockTreeDB::EraseBatchSync(const std::vector<const CBlockIndex*>& blockinfo) {
     CDBBatch batch(*this);
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
-        batch.Erase(make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()));
+        batch.Erase(make_pair(DB_BLOCK_HEADER_INDEX, (*it)->GetBlockHash()));
+        batch.Erase(make_pair(DB_BLOCK_SOLUTION, (*it)->GetBlockHash()));
     }
     return WriteBatch(batch, true);
 }
 
-bool CBlockTreeDB::ReadDiskBlockIndex(const uint256 &blockhash, CDiskBlockIndex &dbindex) const {
-    return Read(make_pair(DB_BLOCK_INDEX, blockhash), dbindex);
+bool CBlockTreeDB::ReadBlockSolution(const uint256 &blockhash, std::vector<unsigned char> &vSolution) const {
+    return Read(make_pair(DB_BLOCK_SOLUTION, blockhash), vSolution);
+}
+
+bool CBlockTreeDB::ReadTokenIndex(const CTokenIndexKey &key, CTokenIndexValue &value) const {
+    return Read(make_pair(DB_TOKENINDEX, key), value);
+}
+
+bool CBlockTreeDB::UpdateTokenIndex(const std::vector<std::pair<CTokenIndexKey, CTokenIndexValue> >&vect) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<CTokenIndexKey,CTokenIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_TOKENINDEX, it->first));
+        } else {
+            batch.Write(make_pair(DB_TOKENINDEX, it->first), it->second);
+        }
+    }
+    return WriteBatch(batch);
+}
+
+CIndexDB::CIndexDB(const std::string &name, size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles) : CDBWrapper(GetDataDir() / "indexes" / name, nCacheSize, fMemory, fWipe, compression, maxOpenFiles), strName(name) {
+}
+
+bool CIndexDB::ReadBestBlock(uint256 &hash) const {
+    return Read(DB_BEST_BLOCK, hash);
+}
+
+bool CIndexDB::WriteBestBlock(const uint256 &hash) {
+    return Write(DB_BEST_BLOCK, hash);
+}
+
+bool CIndexDB::WriteFlag(const std::string &name, bool fValue) {
+    return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
+}
+
+bool CIndexDB::ReadFlag(const std::string &name, bool &fValue) const {
+    char ch;
+    if (!Read(std::make_pair(DB_FLAG, name), ch))
+        return false;
+    fValue = ch == '1';
+    return true;
+}
+
+/** Deletes every entry, used when the index has to be rebuilt from scratch. */
+bool CIndexDB::Wipe() {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->SeekToFirst();
+    while (pcursor->Valid()) {
+        CDBBatch batch(*this);
+        for (int n = 0; n < 100000 && pcursor->Valid(); n++, pcursor->Next()) {
+            boost::this_thread::interruption_point();
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            if (!pcursor->GetKeyDataStream(ssKey))
+                return error("%s: unable to read key of %s", __func__, strName);
+            batch.Erase(ssKey);
+        }
+        if (!WriteBatch(batch))
+            return false;
+    }
+    return true;
+}
+
+// the key ranges each index database took over from blocks/index/
+static std::vector<char> LegacyIndexPrefixes(const std::string &name)
+{
+    std::vector<char> prefixes;
+    if (name == "txindex") {
+        prefixes.push_back(DB_TXINDEX);
+    } else if (name == "spentindex") {
+        prefixes.push_back(DB_SPENTINDEX);
+    } else if (name == "addressindex") {
+        prefixes.push_back(DB_ADDRESSINDEX);
+        prefixes.push_back(DB_ADDRESSUNSPENTINDEX);
+        prefixes.push_back(DB_ADDRESSBALANCEINDEX);
+    } else if (name == "timestampindex") {
+        prefixes.push_back(DB_TIMESTAMPINDEX);
+        prefixes.push_back(DB_BLOCKHASHINDEX);
+    }
+    return prefixes;
 }
 
-bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) const {
+/**
+ * Copies the prefix range of the block tree into db or, with fErase, deletes
+ * it from the block tree. Both are done in bounded batches.
+ */
+template <typename K, typename V>
+static bool MoveLegacyIndexRange(CBlockTreeDB &blocktree, CIndexDB &db, char prefix, bool fErase)
+{
+    CDBWrapper &target = fErase ? static_cast<CDBWrapper&>(blocktree) : static_cast<CDBWrapper&>(db);
+    boost::scoped_ptr<CDBIterator> pcursor(blocktree.NewIterator());
+    bool fDone = false;
+
+    pcursor->Seek(prefix);
+    while (!fDone) {
+        CDBBatch batch(target);
+        for (int n = 0; n < 100000; n++, pcursor->Next()) {
+            boost::this_thread::interruption_point();
+            std::pair<char, K> key;
+            if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != prefix) {
+                fDone = true;
+                break;
+            }
+            if (fErase) {
+                batch.Erase(key);
+            } else {
+                V value;
+                if (!pcursor->GetValue(value))
+                    return error("%s: unable to read index entry '%c'", __func__, prefix);
+                batch.Write(key, value);
+            }
+        }
+        if (!target.WriteBatch(batch))
+            return false;
+    }
+    return true;
+}
+
+bool CIndexDB::HaveLegacyEntries(CBlockTreeDB &blocktree) {
+    std::vector<char> prefixes = LegacyIndexPrefixes(strName);
+    boost::scoped_ptr<CDBIterator> pcursor(blocktree.NewIterator());
+    for (std::vector<char>::const_iterator it = prefixes.begin(); it != prefixes.end(); it++) {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        pcursor->Seek(*it);
+        if (pcursor->Valid() && pcursor->GetKeyDataStream(ssKey) && ssKey.size() > 0 && ssKey[0] == *it)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Moves the entries older versions kept in blocks/index/ into this database.
+ * The caller copies first, records the best block and only then erases, so an
+ * interrupted migration is simply repeated on the next start.
+ */
+bool CIndexDB::MigrateFrom(CBlockTreeDB &blocktree, bool fErase) {
+    if (strName == "txindex")
+        return MoveLegacyIndexRange<uint256, CDiskTxPos>(blocktree, *this, DB_TXINDEX, fErase);
+    if (strName == "spentindex")
+        return MoveLegacyIndexRange<CSpentIndexKey, CSpentIndexValue>(blocktree, *this, DB_SPENTINDEX, fErase);
+    if (strName == "addressindex")
+        return MoveLegacyIndexRange<CAddressIndexKey, CAmount>(blocktree, *this, DB_ADDRESSINDEX, fErase) &&
+               MoveLegacyIndexRange<CAddressUnspentKey, CAddressUnspentValue>(blocktree, *this, DB_ADDRESSUNSPENTINDEX, fErase) &&
+               MoveLegacyIndexRange<CAddressIndexIteratorKey, CAddressBalanceValue>(blocktree, *this, DB_ADDRESSBALANCEINDEX, fErase);
+    if (strName == "timestampindex")
+        return MoveLegacyIndexRange<CTimestampIndexKey, int>(blocktree, *this, DB_TIMESTAMPINDEX, fErase) &&
+               MoveLegacyIndexRange<CTimestampBlockIndexKey, CTimestampBlockIndexValue>(blocktree, *this, DB_BLOCKHASHINDEX, fErase);
+    return true;
+}
+
+bool CIndexDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) const {
     return Read(make_pair(DB_TXINDEX, txid), pos);
 }
 
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
+bool CIndexDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect, const uint256 &hashBestBlock) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(make_pair(DB_TXINDEX, it->first), it->second);
+    batch.Write(DB_BEST_BLOCK, hashBestBlock);
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) const {
+bool CIndexDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) const {
     return Read(make_pair(DB_SPENTINDEX, key), value);
 }
 
-bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
+bool CIndexDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect, const uint256 &hashBestBlock) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
@@ -347,27 +495,29 @@ bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey,
             batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
         }
     }
+    batch.Write(DB_BEST_BLOCK, hashBestBlock);
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
-        if (it->second.IsNull()) {
-            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
-        } else {
-            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
-        }
-    }
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+/**
+ * Reads the unspent outputs of an address in key order. If pAfterKey is set (and
+ * belongs to the same address) the scan resumes right after that key, and if
+ * nMaxResults is non-zero at most that many entries are appended, so callers can
+ * page through large addresses without materializing the whole index.
+ */
+bool CIndexDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
+                                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                                       const CAddressUnspentKey *pAfterKey, size_t nMaxResults) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    size_t nResults = 0;
 
-    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    if (pAfterKey != NULL && pAfterKey->type == (unsigned int)type && pAfterKey->hashBytes == addressHash) {
+        pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, *pAfterKey));
+    } else {
+        pAfterKey = NULL;
+        pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    }
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
@@ -379,10 +529,18 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
             CAddressUnspentKey indexKey = keyObj.second;
 
             if (chType == DB_ADDRESSUNSPENTINDEX && indexKey.hashBytes == addressHash) {
+                if (pAfterKey != NULL && indexKey.txhash == pAfterKey->txhash && indexKey.index == pAfterKey->index) {
+                    pcursor->Next();
+                    continue;
+                }
+                if (nMaxResults > 0 && nResults >= nMaxResults) {
+                    break;
+                }
                 try {
                     CAddressUnspentValue nValue;
                     pcursor->GetValue(nValue);
                     unspentOutputs.push_back(make_pair(indexKey, nValue));
+                    nResults++;
                     pcursor->Next();
                 } catch (const std::exception& e) {
                     return error("failed to get address unspent value");
@@ -397,27 +555,82 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
     return true;
 }
 
-bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+/**
+ * Applies the address index, unspent index and (optionally) balance index
+ * changes of one block in a single batch, so the three can never disagree.
+ * fErase is set when disconnecting a block: the deltas are removed and the
+ * running balances are rolled back by the same amounts.
+ */
+bool CIndexDB::UpdateAddressIndexes(const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                    const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentIndex,
+                                    bool fErase, bool fBalanceIndex, const uint256 &hashBestBlock) {
     CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    std::map<std::pair<unsigned int, uint160>, CAddressBalanceValue> mapDeltas;
+
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
+        if (fErase)
+            batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
+        else
+            batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+        if (fBalanceIndex) {
+            CAddressBalanceValue &delta = mapDeltas[make_pair(it->first.type, it->first.hashBytes)];
+            delta.balance += it->second;
+            if (it->second > 0)
+                delta.received += it->second;
+            delta.utxos += it->first.spending ? -1 : 1;
+        }
+    }
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentIndex.begin(); it!=unspentIndex.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+        } else {
+            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+        }
+    }
+    for (std::map<std::pair<unsigned int, uint160>, CAddressBalanceValue>::const_iterator it=mapDeltas.begin(); it!=mapDeltas.end(); it++) {
+        CAddressIndexIteratorKey key(it->first.first, it->first.second);
+        CAddressBalanceValue value;
+        Read(make_pair(DB_ADDRESSBALANCEINDEX, key), value);
+        int sign = fErase ? -1 : 1;
+        value.balance += sign * it->second.balance;
+        value.received += sign * it->second.received;
+        value.utxos += sign * it->second.utxos;
+        if (value.IsNull())
+            batch.Erase(make_pair(DB_ADDRESSBALANCEINDEX, key));
+        else
+            batch.Write(make_pair(DB_ADDRESSBALANCEINDEX, key), value);
+    }
+    batch.Write(DB_BEST_BLOCK, hashBestBlock);
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
-    return WriteBatch(batch);
+bool CIndexDB::ReadAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value) const {
+    // addresses without any activity have no entry
+    if (!Read(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(type, addressHash)), value))
+        value.SetNull();
+    return true;
 }
 
-bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
-                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                                    int start, int end) {
+/**
+ * Reads the address index deltas of an address ordered by height. The optional
+ * pAfterKey/nMaxResults pair works like in ReadAddressUnspentIndex and takes
+ * precedence over the start height when resuming a paged read.
+ */
+bool CIndexDB::ReadAddressIndex(uint160 addressHash, int type,
+                                std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                int start, int end,
+                                const CAddressIndexKey *pAfterKey, size_t nMaxResults) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    size_t nResults = 0;
 
-    if (start > 0 && end > 0) {
+    if (pAfterKey != NULL && (pAfterKey->type != (unsigned int)type || pAfterKey->hashBytes != addressHash)) {
+        pAfterKey = NULL;
+    }
+
+    if (pAfterKey != NULL) {
+        pcursor->Seek(make_pair(DB_ADDRESSINDEX, *pAfterKey));
+    } else if (start > 0 && end > 0) {
         pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
     } else {
         pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
@@ -435,11 +648,20 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
                 if (end > 0 && indexKey.blockHeight > end) {
                     break;
                 }
+                if (pAfterKey != NULL && indexKey.blockHeight == pAfterKey->blockHeight && indexKey.txindex == pAfterKey->txindex &&
+                    indexKey.txhash == pAfterKey->txhash && indexKey.index == pAfterKey->index && indexKey.spending == pAfterKey->spending) {
+                    pcursor->Next();
+                    continue;
+                }
+                if (nMaxResults > 0 && nResults >= nMaxResults) {
+                    break;
+                }
                 try {
                     CAmount nValue;
                     pcursor->GetValue(nValue);
 
                     addressIndex.push_back(make_pair(indexKey, nValue));
+                    nResults++;
                     pcursor->Next();
                 } catch (const std::exception& e) {
                     return error("failed to get address index value");
@@ -478,70 +700,68 @@ uint32_t komodo_segid32(char *coinaddr);
     {"RD6GgnrMpPaTSMn8vai6yiGA7mN4QGPVMY", 1} \
 };
 
-bool CBlockTreeDB::Snapshot2(std::map <std::string, CAmount> &addressAmounts, UniValue *ret)
+/** Per-thread tallies of one key range of the address unspent index. */
+struct CSnapshotShard
 {
-    int64_t total = 0; int64_t totalAddresses = 0; std::string address;
-    int64_t utxos = 0; int64_t ignoredAddresses = 0, cryptoConditionsUTXOs = 0, cryptoConditionsTotals = 0;
+    std::map <std::string, CAmount> addressAmounts;
+    int64_t total, utxos, ignoredAddresses, cryptoConditionsUTXOs, cryptoConditionsTotals;
+    bool fFailed;
+
+    CSnapshotShard() : total(0), utxos(0), ignoredAddresses(0), cryptoConditionsUTXOs(0), cryptoConditionsTotals(0), fFailed(false) {}
+};
+
+// (address type, first byte of the address hash) as a single sortable slot number
+static inline int SnapshotSlot(const CAddressIndexIteratorKey &key)
+{
+    return (int)((key.type & 0xff) << 8) | *key.hashBytes.begin();
+}
+
+static void SnapshotScanRange(const CIndexDB *pdb, const leveldb::Snapshot *snapshot, int slotStart, int slotEnd, CSnapshotShard *shard)
+{
+    std::string address;
     DECLARE_IGNORELIST
-    boost::scoped_ptr<CDBIterator> iter(NewIterator());
-    //std::map <std::string, CAmount> addressAmounts;
-    for (iter->SeekToLast(); iter->Valid(); iter->Prev())
+    boost::scoped_ptr<CDBIterator> iter(pdb->NewIterator(snapshot));
+    uint160 hashStart;
+    *hashStart.begin() = slotStart & 0xff;
+    for (iter->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(slotStart >> 8, hashStart))); iter->Valid(); iter->Next())
     {
         boost::this_thread::interruption_point();
         try
         {
-            std::vector<unsigned char> slKey = std::vector<unsigned char>();
             pair<char, CAddressIndexIteratorKey> keyObj;
             iter->GetKey(keyObj);
             char chType = keyObj.first;
             CAddressIndexIteratorKey indexKey = keyObj.second;
-            //fprintf(stderr, "chType=%d\n", chType);
-            if (chType == DB_ADDRESSUNSPENTINDEX)
-            {
-                try {
-                    CAmount nValue;
-                    iter->GetValue(nValue);
-                    if ( nValue == 0 )
-                        continue;
-                    getAddressFromIndex(indexKey.type, indexKey.hashBytes, address);
-                    if ( indexKey.type == 3 )
-                    {
-                        cryptoConditionsUTXOs++;
-                        cryptoConditionsTotals += nValue;
-                        total += nValue;
-                        continue;
-                    }
-                    std::map <std::string, int>::iterator ignored = ignoredMap.find(address);
-                    if (ignored != ignoredMap.end())
-                    {
-                        fprintf(stderr,"ignoring %s\n", address.c_str());
-                        ignoredAddresses++;
-                        continue;
-                    }
-                    std::map <std::string, CAmount>::iterator pos = addressAmounts.find(address);
-                    if ( pos == addressAmounts.end() )
-                    {
-                        // insert new address + utxo amount
-                        //fprintf(stderr, "inserting new address %s with amount %li\n", address.c_str(), nValue);
-                        addressAmounts[address] = nValue;
-                        totalAddresses++;
-                    }
-                    else
-                    {
-                        // update unspent tally for this address
-                        //fprintf(stderr, "updating address %s with new utxo amount %li\n", address.c_str(), nValue);
-                        addressAmounts[address] += nValue;
-                    }
-                    //fprintf(stderr,"{\"%s\", %.8f},\n",address.c_str(),(double)nValue/COIN);
-                    // total += nValue;
-                    utxos++;
-                    total += nValue;
+            if (chType != DB_ADDRESSUNSPENTINDEX || SnapshotSlot(indexKey) >= slotEnd)
+                break;
+            try {
+                CAmount nValue;
+                iter->GetValue(nValue);
+                if ( nValue == 0 )
+                    continue;
+                if ( indexKey.type == 3 )
+                {
+                    shard->cryptoConditionsUTXOs++;
+                    shard->cryptoConditionsTotals += nValue;
+                    shard->total += nValue;
+                    continue;
                 }
-                catch (const std::exception& e)
+                getAddressFromIndex(indexKey.type, indexKey.hashBytes, address);
+                if (ignoredMap.find(address) != ignoredMap.end())
                 {
-                    fprintf(stderr, "DONE %s: LevelDB addressindex exception! - %s\n", __func__, e.what());
-                    return false; //break; this means failiure of DB? we need to exit here if so for consensus code!
+                    fprintf(stderr,"ignoring %s\n", address.c_str());
+                    shard->ignoredAddresses++;
+                    continue;
                 }
+                shard->addressAmounts[address] += nValue;
+                shard->utxos++;
+                shard->total += nValue;
+            }
+            catch (const std::exception& e)
+            {
+                fprintf(stderr, "DONE %s: LevelDB addressindex exception! - %s\n", __func__, e.what());
+                shard->fFailed = true; // this means failiure of DB? we need to exit here if so for consensus code!
+                return;
             }
         }
         catch (const std::exception& e)
@@ -550,6 +770,65 @@ bool CBlockTreeDB::Snapshot2(std::map <std::string, CAmount> &addressAmounts, Un
             break;
         }
     }
+}
+
+/**
+ * Tallies the address unspent index into per-address balances. The scan runs
+ * on a LevelDB snapshot taken together with the chain height, so cs_main is
+ * only held for an instant, and the key space is split by (type, first hash
+ * byte) across worker threads whose disjoint results are merged at the end.
+ */
+bool CIndexDB::Snapshot2(std::map <std::string, CAmount> &addressAmounts, UniValue *ret)
+{
+    int64_t total = 0; int64_t totalAddresses = 0;
+    int64_t utxos = 0; int64_t ignoredAddresses = 0, cryptoConditionsUTXOs = 0, cryptoConditionsTotals = 0;
+    const leveldb::Snapshot *snapshot; int32_t height;
+    {
+        LOCK(cs_main);
+        snapshot = GetSnapshot();
+        height = chainActive.Height();
+    }
+    // address types in use are 1..3, spread those slots over the shards and let the outer ones take the remainder
+    const int slotFirst = 1 << 8, slotLast = 4 << 8;
+    int nShards = std::max(1, std::min(GetNumCores(), 8));
+    std::vector<CSnapshotShard> shards(nShards);
+    boost::thread_group workers;
+    for (int i = 0; i < nShards; i++)
+    {
+        int slotStart = (i == 0) ? 0 : slotFirst + (slotLast - slotFirst) * i / nShards;
+        int slotEnd = (i == nShards-1) ? (1 << 16) : slotFirst + (slotLast - slotFirst) * (i+1) / nShards;
+        workers.create_thread(boost::bind(&SnapshotScanRange, this, snapshot, slotStart, slotEnd, &shards[i]));
+    }
+    try {
+        workers.join_all();
+    } catch (const boost::thread_interrupted&) {
+        workers.interrupt_all();
+        workers.join_all();
+        ReleaseSnapshot(snapshot);
+        throw;
+    }
+    ReleaseSnapshot(snapshot);
+
+    for (std::vector<CSnapshotShard>::iterator shard = shards.begin(); shard != shards.end(); shard++)
+    {
+        if ( shard->fFailed )
+            return false;
+        for (std::map <std::string, CAmount>::const_iterator it = shard->addressAmounts.begin(); it != shard->addressAmounts.end(); it++)
+        {
+            std::map <std::string, CAmount>::iterator pos = addressAmounts.find(it->first);
+            if ( pos == addressAmounts.end() )
+            {
+                addressAmounts[it->first] = it->second;
+                totalAddresses++;
+            }
+            else pos->second += it->second;
+        }
+        total += shard->total;
+        utxos += shard->utxos;
+        ignoredAddresses += shard->ignoredAddresses;
+        cryptoConditionsUTXOs += shard->cryptoConditionsUTXOs;
+        cryptoConditionsTotals += shard->cryptoConditionsTotals;
+    }
     //fprintf(stderr, "total=%f, totalAddresses=%li, utxos=%li, ignored=%li\n", (double) total / COIN, totalAddresses, utxos, ignoredAddresses);
     
     // this is for the snapshot RPC, you can skip this by passing a 0 as the last argument.
@@ -572,36 +851,45 @@ bool CBlockTreeDB::Snapshot2(std::map <std::string, CAmount> &addressAmounts, Un
         // total of all the address's, does not count coins in CC vouts.
         ret->push_back(make_pair("total_includeCCvouts", (double) (total+cryptoConditionsTotals)/ COIN ));
         // The snapshot finished at this block height
-        ret->push_back(make_pair("ending_height", chainActive.Height()));
+        ret->push_back(make_pair("ending_height", height));
     }
     return true;
 }
 
 extern std::vector <std::pair<CAmount, CTxDestination>> vAddressSnapshot;
 
-UniValue CBlockTreeDB::Snapshot(int top)
+UniValue CIndexDB::Snapshot(int top)
 {
-    int topN = 0;
     std::vector <std::pair<CAmount, std::string>> vaddr;
     //std::vector <std::vector <std::pair<CAmount, CScript>>> tokenids;
     std::map <std::string, CAmount> addressAmounts;
     UniValue result(UniValue::VOBJ);
     UniValue addressesSorted(UniValue::VARR);
     result.push_back(Pair("start_time", (int) time(NULL)));
-    if ( (vAddressSnapshot.size() > 0 && top < 0) || (Snapshot2(addressAmounts,&result) && top >= 0) )
+    if ( top < 0 )
+    {
+        // the daily snapshot is maintained by ConnectTip
+        LOCK(cs_main);
+        for ( auto address : vAddressSnapshot )
+            vaddr.push_back(make_pair(address.first, CBitcoinAddress(address.second).ToString()));
+    }
+    if ( (vaddr.size() > 0 && top < 0) || (top >= 0 && Snapshot2(addressAmounts,&result)) )
     {
         if ( top > -1 )
         {
+            vaddr.reserve(addressAmounts.size());
             for (std::pair<std::string, CAmount> element : addressAmounts)
                 vaddr.push_back( make_pair(element.second, element.first) );
-            std::sort(vaddr.rbegin(), vaddr.rend());
-        }
-        else 
-        {
-            for ( auto address : vAddressSnapshot )
-                vaddr.push_back(make_pair(address.first, CBitcoinAddress(address.second).ToString()));
-            top = vAddressSnapshot.size();
+            addressAmounts.clear();
+            // only the requested top N need to be ordered
+            if ( top > 0 && top < (int)vaddr.size() )
+            {
+                std::partial_sort(vaddr.begin(), vaddr.begin() + top, vaddr.end(), std::greater<std::pair<CAmount, std::string> >());
+                vaddr.resize(top);
+            }
+            else std::sort(vaddr.rbegin(), vaddr.rend());
         }
+        else top = vaddr.size();
         int topN = 0;
         for (std::vector<std::pair<CAmount, std::string>>::iterator it = vaddr.begin(); it!=vaddr.end(); ++it)
         {
@@ -623,13 +911,16 @@ UniValue CBlockTreeDB::Snapshot(int top)
     return(result);
 }
 
-bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
+bool CIndexDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex, const CTimestampBlockIndexKey &blockhashIndex,
+                                   const CTimestampBlockIndexValue &logicalts, const uint256 &hashBestBlock) {
     CDBBatch batch(*this);
     batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
+    batch.Write(make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
+    batch.Write(DB_BEST_BLOCK, hashBestBlock);
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes) {
+bool CIndexDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
@@ -664,13 +955,7 @@ bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned i
     return true;
 }
 
-bool CBlockTreeDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts) {
-    CDBBatch batch(*this);
-    batch.Write(make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) const {
+bool CIndexDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) const {
 
     CTimestampBlockIndexValue(lts);
     if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
@@ -694,7 +979,7 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) const {
 
 void komodo_index2pubkey33(uint8_t *pubkey33,CBlockIndex *pindex,int32_t height);
 
-bool CBlockTreeDB::blockOnchainActive(const uint256 &hash) {
+bool CIndexDB::blockOnchainActive(const uint256 &hash) {
     BlockMap::const_iterator it = mapBlockIndex.find(hash);
     CBlockIndex* pblockindex = it != mapBlockIndex.end() ? it->second : NULL;
 
@@ -705,70 +990,163 @@ bool CBlockTreeDB::blockOnchainActive(const uint256 &hash) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts()
+/**
+ * Splits the block index records written by older versions, which carry the
+ * Equihash solution inline, into the fields loaded at startup and the
+ * solution. Runs once; afterwards there are no DB_BLOCK_INDEX records left.
+ */
+bool CBlockTreeDB::UpgradeBlockIndex()
 {
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
-
     pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
 
-    // Load mapBlockIndex
+    size_t nUpgraded = 0;
     while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
+        CDBBatch batch(*this);
+        for (int n = 0; n < 10000 && pcursor->Valid(); n++, pcursor->Next()) {
+            boost::this_thread::interruption_point();
+            std::pair<char, uint256> key;
+            if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX)
+                break;
+            CDiskBlockIndex diskindex;
+            if (!pcursor->GetValue(diskindex))
+                return error("%s: failed to read value", __func__);
+            if (nUpgraded++ == 0) {
+                LogPrintf("%s: moving the Equihash solutions out of the block index records\n", __func__);
+                uiInterface.InitMessage(_("Upgrading block index..."));
+            }
+            batch.Write(make_pair(DB_BLOCK_HEADER_INDEX, key.second), CDiskBlockIndexNoSolution(diskindex));
+            if (diskindex.HasSolution())
+                batch.Write(make_pair(DB_BLOCK_SOLUTION, key.second), diskindex.GetSolution());
+            batch.Erase(key);
+        }
+        if (!WriteBatch(batch, true))
+            return error("%s: failed to write the upgraded records", __func__);
         std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
+        if (pcursor->Valid() && (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX))
+            break;
+    }
+    if (nUpgraded > 0)
+        LogPrintf("%s: upgraded %u block index records\n", __func__, nUpgraded);
+    return true;
+}
+
+/** Deserializes records [nBegin, nEnd) into the block index entries made for them. */
+static void LoadBlockIndexRange(std::vector<CDataStream> *pvValues, const std::vector<CBlockIndex*> *pvIndex,
+                                std::vector<uint256> *pvPrev, size_t nBegin, size_t nEnd, std::atomic<bool> *pfFailed)
+{
+    try {
+        for (size_t i = nBegin; i < nEnd; i++) {
             CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->SetHeight(diskindex.GetHeight());
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->hashSproutAnchor     = diskindex.hashSproutAnchor;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->hashFinalSaplingRoot   = diskindex.hashFinalSaplingRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                // the Equihash solution will be loaded lazily from the dbindex entry
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nCachedBranchId = diskindex.nCachedBranchId;
-                pindexNew->nTx            = diskindex.nTx;
-                pindexNew->nSproutValue   = diskindex.nSproutValue;
-                pindexNew->nSaplingValue  = diskindex.nSaplingValue;
-                pindexNew->segid          = diskindex.segid;
-                pindexNew->nNotaryPay     = diskindex.nNotaryPay;
-
-                if ( 0 ) // POW will be checked before any block is connected
-                {
-                    // Consistency checks
-                    CBlockHeader header;
-                    {
-                        LOCK(cs_main);
-                        try {
-                            header = pindexNew->GetBlockHeader();
-                        } catch (const runtime_error&) {
-                            return error("LoadBlockIndex(): failed to read index entry: diskindex hash = %s",
-                                diskindex.GetBlockHash().ToString());
-                        }
-                    }
-                    if (header.GetHash() != pindexNew->GetBlockHash())
-                        return error("LoadBlockIndex(): block header inconsistency detected: on-disk = %s, in-memory = %s",
-                                    diskindex.ToString(),  pindexNew->ToString());
-
-                    uint8_t pubkey33[33];
-                    komodo_index2pubkey33(pubkey33,pindexNew,pindexNew->GetHeight());
-                    if (!CheckProofOfWork(header,pubkey33,pindexNew->GetHeight(),Params().GetConsensus()))
-                        return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
-                }
-                pcursor->Next();
-            } else {
+            CDiskBlockIndexNoSolution record(diskindex);
+            (*pvValues)[i] >> record;
+
+            // Construct block index object
+            CBlockIndex* pindexNew = (*pvIndex)[i];
+            (*pvPrev)[i]              = diskindex.hashPrev;
+            pindexNew->SetHeight(diskindex.GetHeight());
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->hashSproutAnchor     = diskindex.hashSproutAnchor;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->hashFinalSaplingRoot   = diskindex.hashFinalSaplingRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            // the Equihash solution will be loaded lazily from its own record
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nCachedBranchId = diskindex.nCachedBranchId;
+            pindexNew->nTx            = diskindex.nTx;
+            pindexNew->nSproutValue   = diskindex.nSproutValue;
+            pindexNew->nSaplingValue  = diskindex.nSaplingValue;
+            pindexNew->segid          = diskindex.segid;
+            pindexNew->nNotaryPay     = diskindex.nNotaryPay;
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+        *pfFailed = true;
+    }
+}
+
+/** Below this many records per thread, starting more threads costs more than it saves. */
+static const size_t MIN_BLOCK_INDEX_RECORDS_PER_THREAD = 20000;
+
+bool CBlockTreeDB::LoadBlockIndexGuts()
+{
+    if (!UpgradeBlockIndex())
+        return false;
+
+    // Read the raw records; the key holds the block hash, so no header has to be hashed
+    std::vector<uint256> vHashes;
+    std::vector<CDataStream> vValues;
+    {
+        boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+        pcursor->Seek(make_pair(DB_BLOCK_HEADER_INDEX, uint256()));
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            std::pair<char, uint256> key;
+            if (!pcursor->GetKey(key) || key.first != DB_BLOCK_HEADER_INDEX)
+                break;
+            vValues.push_back(CDataStream(SER_DISK, CLIENT_VERSION));
+            if (!pcursor->GetValueDataStream(vValues.back()))
                 return error("LoadBlockIndex() : failed to read value");
+            vHashes.push_back(key.second);
+            pcursor->Next();
+        }
+    }
+
+    // Create the entries, then fill them in in parallel; each thread only touches its own entries
+    ReserveBlockIndex(vHashes.size());
+    std::vector<CBlockIndex*> vIndex(vHashes.size());
+    for (size_t i = 0; i < vHashes.size(); i++)
+        vIndex[i] = InsertBlockIndex(vHashes[i]);
+
+    std::vector<uint256> vPrev(vHashes.size());
+    int nThreads = std::max(1, std::min(GetNumCores(), (int)(vHashes.size() / MIN_BLOCK_INDEX_RECORDS_PER_THREAD)));
+    std::atomic<bool> fFailed(false);
+    boost::thread_group workers;
+    for (int i = 0; i < nThreads; i++) {
+        size_t nBegin = vHashes.size() * i / nThreads, nEnd = vHashes.size() * (i+1) / nThreads;
+        workers.create_thread(boost::bind(&LoadBlockIndexRange, &vValues, &vIndex, &vPrev, nBegin, nEnd, &fFailed));
+    }
+    try {
+        workers.join_all();
+    } catch (const boost::thread_interrupted&) {
+        workers.interrupt_all();
+        workers.join_all();
+        throw;
+    }
+    if (fFailed)
+        return error("LoadBlockIndex() : failed to read value");
+
+    // Link the entries to their parents
+    for (size_t i = 0; i < vHashes.size(); i++) {
+        CBlockIndex* pindexNew = vIndex[i];
+        pindexNew->pprev = InsertBlockIndex(vPrev[i]);
+
+        if ( 0 ) // POW will be checked before any block is connected
+        {
+            // Consistency checks
+            CBlockHeader header;
+            {
+                LOCK(cs_main);
+                try {
+                    header = pindexNew->GetBlockHeader();
+                } catch (const runtime_error&) {
+                    return error("LoadBlockIndex(): failed to read index entry: diskindex hash = %s",
+                        vHashes[i].ToString());
+                }
             }
-        } else {
-            break;
+            if (header.GetHash() != pindexNew->GetBlockHash())
+                return error("LoadBlockIndex(): block header inconsistency detected: on-disk = %s, in-memory = %s",
+                            vHashes[i].ToString(),  pindexNew->ToString());
+
+            uint8_t pubkey33[33];
+            komodo_index2pubkey33(pubkey33,pindexNew,pindexNew->GetHeight());
+            if (!CheckProofOfWork(header,pubkey33,pindexNew->GetHeight(),Params().GetConsensus()))
+                return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
         }
     }
 
@@ -776,11 +1154,11 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
 }
 
 // custom util to read all unspents, normal and cc (used in marmara)
-bool CBlockTreeDB::ReadAllUnspentIndex(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+bool CIndexDB::ReadAllUnspentIndex(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    pcursor->SeekToFirst();
+    pcursor->Seek(DB_ADDRESSUNSPENTINDEX);
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
@@ -802,7 +1180,7 @@ bool CBlockTreeDB::ReadAllUnspentIndex(std::vector<std::pair<CAddressUnspentKey,
                 }
             }
             else {
-                //break;
+                break;
             }
         }
         catch (const std::exception& e) {
@@ -39,12 +39,15 @@ struct CAddressUnspentValue;
 struct CAddressIndexKey;
 struct CAddressIndexIteratorKey;
 struct CAddressIndexIteratorHeightKey;
+struct CAddressBalanceValue;
 struct CTimestampIndexKey;
 struct CTimestampIndexIteratorKey;
 struct CTimestampBlockIndexKey;
 struct CTimestampBlockIndexValue;
 struct CSpentIndexKey;
 struct CSpentIndexValue;
+struct CTokenIndexKey;
+struct CTokenIndexValue;
 class uint256;
 class CDiskBlockIndex;
 
@@ -91,6 +94,7 @@ public:
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
+    bool UpgradeBlockIndex();
 public:
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<CBlockIndex*>& blockinfo);
     bool EraseBatchSync(const std::vector<const CBlockIndex*>& blockinfo);
@@ -98,26 +102,57 @@ public:
     bool ReadLastBlockFile(int &nFile) const;
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool &fReindex) const;
-    bool ReadDiskBlockIndex(const uint256 &blockhash, CDiskBlockIndex &dbindex) const;
+    bool ReadBlockSolution(const uint256 &blockhash, std::vector<unsigned char> &vSolution) const;
+    bool ReadTokenIndex(const CTokenIndexKey &key, CTokenIndexValue &value) const;
+    bool UpdateTokenIndex(const std::vector<std::pair<CTokenIndexKey, CTokenIndexValue> >&vect);
+    bool WriteFlag(const std::string &name, bool fValue);
+    bool ReadFlag(const std::string &name, bool &fValue) const;
+    bool LoadBlockIndexGuts();
+};
+
+/**
+ * Access to one of the optional index databases (indexes/<name>/). Each index
+ * lives in its own database with its own cache and best block, so it can be
+ * written by the background indexer and caught up on its own.
+ */
+class CIndexDB : public CDBWrapper
+{
+public:
+    CIndexDB(const std::string &name, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool compression = true, int maxOpenFiles = 1000);
+private:
+    CIndexDB(const CIndexDB&);
+    void operator=(const CIndexDB&);
+
+    std::string strName;
+public:
+    const std::string &GetName() const { return strName; }
+    bool ReadBestBlock(uint256 &hash) const;
+    bool WriteBestBlock(const uint256 &hash);
+    bool WriteFlag(const std::string &name, bool fValue);
+    bool ReadFlag(const std::string &name, bool &fValue) const;
+    bool Wipe();
+    bool HaveLegacyEntries(CBlockTreeDB &blocktree);
+    bool MigrateFrom(CBlockTreeDB &blocktree, bool fErase);
+
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) const;
-    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list, const uint256 &hashBestBlock);
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) const;
-    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
-    bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
+    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect, const uint256 &hashBestBlock);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
-    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
-    bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect,
+                                 const CAddressUnspentKey *pAfterKey = NULL, size_t nMaxResults = 0);
+    bool UpdateAddressIndexes(const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                              const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentIndex,
+                              bool fErase, bool fBalanceIndex, const uint256 &hashBestBlock);
+    bool ReadAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value) const;
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                          int start = 0, int end = 0);
-    bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
+                          int start = 0, int end = 0,
+                          const CAddressIndexKey *pAfterKey = NULL, size_t nMaxResults = 0);
+    bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex, const CTimestampBlockIndexKey &blockhashIndex,
+                             const CTimestampBlockIndexValue &logicalts, const uint256 &hashBestBlock);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
-    bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
     bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS) const;
-    bool WriteFlag(const std::string &name, bool fValue);
-    bool ReadFlag(const std::string &name, bool &fValue) const;
-    bool LoadBlockIndexGuts();
     bool blockOnchainActive(const uint256 &hash);
     UniValue Snapshot(int top);
     bool Snapshot2(std::map <std::string, CAmount> &addressAmounts, UniValue *ret);
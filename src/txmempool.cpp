@@ -71,13 +71,17 @@ CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
 }
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) :
-    nTransactionsUpdated(0)
+    nTransactionsUpdated(0), minReasonableRelayFee(_minRelayFee)
 {
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
     // of transactions in the pool
     nCheckFrequency = 0;
 
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = false;
+    rollingMinimumFeeRate = 0;
+
     minerPolicyEstimator = new CBlockPolicyEstimator(_minRelayFee);
 }
 
@@ -119,6 +123,8 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     // all the appropriate checks.
     LOCK(cs);
     mapTx.insert(entry);
+    if (nJournalDepth > 0)
+        vJournal.push_back(CJournalOp(true, entry));
     const CTransaction& tx = mapTx.find(hash)->GetTx();
     mapRecentlyAddedTx[tx.GetHash()] = &tx;
     nRecentlyAddedSequence += 1;
@@ -138,6 +144,7 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
         mapSaplingNullifiers[spendDescription.nullifier] = &tx;
     }
     nTransactionsUpdated++;
+    addCCIndex(tx);
     totalTxSize += entry.GetTxSize();
     cachedInnerUsage += entry.DynamicMemoryUsage();
     minerPolicyEstimator->processTransaction(entry, fCurrentEstimate);
@@ -334,6 +341,48 @@ bool CTxMemPool::removeSpentIndex(const uint256 txhash)
     return true;
 }
 
+void CTxMemPool::addCCIndex(const CTransaction &tx)
+{
+    LOCK(cs);
+    std::vector<CMempoolCCKey> keys;
+    GetMempoolCCKeys(tx, keys);
+    if (keys.empty())
+        return;
+
+    uint256 txhash = tx.GetHash();
+    for (std::vector<CMempoolCCKey>::const_iterator it = keys.begin(); it != keys.end(); it++)
+        setCCIndex.insert(std::make_pair(*it, txhash));
+    mapCCInserted.insert(std::make_pair(txhash, keys));
+}
+
+void CTxMemPool::removeCCIndex(const uint256 &txhash)
+{
+    LOCK(cs);
+    ccIndexInserted::iterator it = mapCCInserted.find(txhash);
+
+    if (it != mapCCInserted.end()) {
+        for (std::vector<CMempoolCCKey>::const_iterator mit = it->second.begin(); mit != it->second.end(); mit++)
+            setCCIndex.erase(std::make_pair(*mit, txhash));
+        mapCCInserted.erase(it);
+    }
+}
+
+void CTxMemPool::getCCIndex(uint8_t evalcode, uint8_t funcid, const uint256 &reftxid, std::vector<uint256> &txids)
+{
+    LOCK(cs);
+    ccIndexSet::const_iterator it = setCCIndex.lower_bound(std::make_pair(CMempoolCCKey(evalcode, funcid, funcid != 0 ? reftxid : uint256()), uint256()));
+    for (; it != setCCIndex.end() && it->first.evalcode == evalcode; it++) {
+        if (funcid != 0 && it->first.funcid != funcid)
+            break;
+        if (!reftxid.IsNull() && it->first.reftxid != reftxid) {
+            if (funcid != 0)
+                break;
+            continue;
+        }
+        txids.push_back(it->second);
+    }
+}
+
 void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& removed, bool fRecursive)
 {
     // Remove transaction from memory pool
@@ -380,6 +429,8 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
                 mapSaplingNullifiers.erase(spendDescription.nullifier);
             }
             removed.push_back(tx);
+            if (nJournalDepth > 0)
+                vJournal.push_back(CJournalOp(false, *mapTx.find(hash)));
             totalTxSize -= mapTx.find(hash)->GetTxSize();
             cachedInnerUsage -= mapTx.find(hash)->DynamicMemoryUsage();
             mapTx.erase(hash);
@@ -387,6 +438,7 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
             minerPolicyEstimator->removeTx(hash);
             removeAddressIndex(hash);
             removeSpentIndex(hash);
+            removeCCIndex(hash);
         }
     }
 }
@@ -558,6 +610,8 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
     }
     // After the txs in the new block have been removed from the mempool, update policy estimates
     minerPolicyEstimator->processBlock(nBlockHeight, entries, fCurrentEstimate);
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = true;
 }
 
 /**
@@ -585,13 +639,179 @@ void CTxMemPool::removeWithoutBranchId(uint32_t nMemPoolBranchId)
 void CTxMemPool::clear()
 {
     LOCK(cs);
+    if (nJournalDepth > 0) {
+        for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++)
+            vJournal.push_back(CJournalOp(false, *it));
+    }
     mapTx.clear();
     mapNextTx.clear();
+    setCCIndex.clear();
+    mapCCInserted.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = false;
+    rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
 }
 
+int CTxMemPool::Expire(int64_t time)
+{
+    LOCK(cs);
+    list<CTransaction> transactionsToRemove;
+    typedef indexed_transaction_set::nth_index<2>::type::iterator byentrytime_iterator;
+    for (byentrytime_iterator it = mapTx.get<2>().begin(); it != mapTx.get<2>().end() && it->GetTime() < time; it++)
+        transactionsToRemove.push_back(it->GetTx());
+    int nRemoved = 0;
+    for (const CTransaction& tx : transactionsToRemove) {
+        list<CTransaction> removed;
+        remove(tx, removed, true);
+        nRemoved += removed.size();
+    }
+    nExpiredTx += nRemoved;
+    return nRemoved;
+}
+
+/** Number of lowest fee rate entries TrimToSize scores against their descendants per eviction */
+static const int TRIM_CANDIDATES = 100;
+
+void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRemaining)
+{
+    LOCK(cs);
+    unsigned int nTxnRemoved = 0;
+    CFeeRate maxFeeRateRemoved(0);
+    while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
+        // A low fee rate parent paid for by a child is worth as much as the package,
+        // so score each of the cheapest entries by max(own rate, package rate).
+        uint256 hashEvict;
+        CFeeRate rateEvict;
+        int nCandidates = 0;
+        typedef indexed_transaction_set::nth_index<1>::type::reverse_iterator byfee_iterator;
+        for (byfee_iterator it = mapTx.get<1>().rbegin(); it != mapTx.get<1>().rend() && nCandidates < TRIM_CANDIDATES; it++, nCandidates++) {
+            CAmount nPackageFee = 0;
+            size_t nPackageSize = 0;
+            std::set<uint256> setPackage;
+            std::vector<uint256> vQueue(1, it->GetTx().GetHash());
+            while (!vQueue.empty()) {
+                uint256 hash = vQueue.back();
+                vQueue.pop_back();
+                if (!setPackage.insert(hash).second)
+                    continue;
+                indexed_transaction_set::const_iterator entry = mapTx.find(hash);
+                nPackageFee += entry->GetFee();
+                nPackageSize += entry->GetTxSize();
+                std::map<uint256, std::pair<double, CAmount> >::const_iterator delta = mapDeltas.find(hash);
+                if (delta != mapDeltas.end())
+                    nPackageFee += delta->second.second;
+                for (std::map<COutPoint, CInPoint>::const_iterator spend = mapNextTx.lower_bound(COutPoint(hash, 0));
+                     spend != mapNextTx.end() && spend->first.hash == hash; spend++)
+                    vQueue.push_back(spend->second.ptx->GetHash());
+            }
+            CFeeRate rate = std::max(it->GetFeeRate(), CFeeRate(nPackageFee, nPackageSize));
+            if (hashEvict.IsNull() || rate < rateEvict) {
+                hashEvict = it->GetTx().GetHash();
+                rateEvict = rate;
+            }
+        }
+
+        // Anything entering the pool from now on has to beat what was just evicted
+        CFeeRate removed(rateEvict.GetFeePerK() + minReasonableRelayFee.GetFeePerK());
+        if (removed.GetFeePerK() > rollingMinimumFeeRate) {
+            rollingMinimumFeeRate = removed.GetFeePerK();
+            blockSinceLastRollingFeeBump = false;
+        }
+        lastRollingFeeUpdate = GetTime();
+        maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
+
+        CTransaction tx = mapTx.find(hashEvict)->GetTx();
+        list<CTransaction> removedTxs;
+        remove(tx, removedTxs, true);
+        nTxnRemoved += removedTxs.size();
+        if (pvNoSpendsRemaining) {
+            BOOST_FOREACH(const CTransaction& removedTx, removedTxs) {
+                BOOST_FOREACH(const CTxIn& txin, removedTx.vin) {
+                    if (mapTx.count(txin.prevout.hash))
+                        continue;
+                    std::map<COutPoint, CInPoint>::const_iterator spend = mapNextTx.lower_bound(COutPoint(txin.prevout.hash, 0));
+                    if (spend == mapNextTx.end() || spend->first.hash != txin.prevout.hash)
+                        pvNoSpendsRemaining->push_back(txin.prevout.hash);
+                }
+            }
+        }
+    }
+    nEvictedTx += nTxnRemoved;
+
+    if (maxFeeRateRemoved > CFeeRate(0))
+        LogPrint("mempool", "Removed %u txn, rolling minimum fee bumped to %s\n", nTxnRemoved, maxFeeRateRemoved.ToString());
+}
+
+CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const
+{
+    LOCK(cs);
+    if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0)
+        return CFeeRate(rollingMinimumFeeRate);
+
+    int64_t time = GetTime();
+    if (time > lastRollingFeeUpdate + 10) {
+        // Decay faster while the pool is far from full
+        double halflife = ROLLING_FEE_HALFLIFE;
+        size_t usage = DynamicMemoryUsage();
+        if (usage < sizelimit / 4)
+            halflife /= 4;
+        else if (usage < sizelimit / 2)
+            halflife /= 2;
+
+        rollingMinimumFeeRate = rollingMinimumFeeRate / pow(2.0, (time - lastRollingFeeUpdate) / halflife);
+        lastRollingFeeUpdate = time;
+
+        if (rollingMinimumFeeRate < minReasonableRelayFee.GetFeePerK() / 2) {
+            rollingMinimumFeeRate = 0;
+            return CFeeRate(0);
+        }
+    }
+    return std::max(CFeeRate(rollingMinimumFeeRate), minReasonableRelayFee);
+}
+
+size_t CTxMemPool::StartJournal()
+{
+    LOCK(cs);
+    nJournalDepth++;
+    return vJournal.size();
+}
+
+void CTxMemPool::CommitJournal()
+{
+    LOCK(cs);
+    assert(nJournalDepth > 0);
+    if (--nJournalDepth == 0)
+        vJournal.clear();
+}
+
+void CTxMemPool::RollbackJournal(size_t checkpoint)
+{
+    LOCK(cs);
+    assert(nJournalDepth > 0 && checkpoint <= vJournal.size());
+    // replay the journal backwards with journaling off, then drop the undone part
+    int nDepth = nJournalDepth;
+    nJournalDepth = 0;
+    for (size_t i = vJournal.size(); i > checkpoint; i--)
+    {
+        const CJournalOp& op = vJournal[i - 1];
+        const uint256 hash = op.entry.GetTx().GetHash();
+        if (op.fAdded) {
+            std::list<CTransaction> removed;
+            remove(op.entry.GetTx(), removed, false);
+        } else if (mapTx.count(hash) == 0) {
+            // mempool address and spent indexes of restored txs are not rebuilt, as before
+            addUnchecked(hash, op.entry, false);
+        }
+    }
+    vJournal.erase(vJournal.begin() + checkpoint, vJournal.end());
+    nJournalDepth = nDepth - 1;
+    if (nJournalDepth == 0)
+        vJournal.clear();
+}
+
 void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 {
     if (nCheckFrequency == 0)
@@ -910,6 +1130,9 @@ bool CCoinsViewMemPool::HaveCoins(const uint256 &txid) const {
 
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
-    // Estimate the overhead of mapTx to be 6 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 6 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + cachedInnerUsage;
+    // Estimate the overhead of mapTx to be 9 pointers (3 per index) + an allocation, as no exact formula for boost::multi_index_contained is implemented.
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 9 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + cachedInnerUsage +
+        memusage::DynamicUsage(mapRecentlyAddedTx) + memusage::DynamicUsage(mapSproutNullifiers) + memusage::DynamicUsage(mapSaplingNullifiers) +
+        memusage::DynamicUsage(mapAddress) + memusage::DynamicUsage(mapAddressInserted) + memusage::DynamicUsage(mapSpent) + memusage::DynamicUsage(mapSpentInserted) +
+        memusage::DynamicUsage(setCCIndex) + memusage::DynamicUsage(mapCCInserted);
 }
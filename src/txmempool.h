@@ -112,8 +112,47 @@ public:
     }
 };
 
+class CompareTxMemPoolEntryByEntryTime
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b)
+    {
+        return a.GetTime() < b.GetTime();
+    }
+};
+
 class CBlockPolicyEstimator;
 
+/**
+ * Key of the mempool cc index: the eval code and funcid of a transaction's
+ * opreturn, and the txid it references (the tokenid for token oprets, else
+ * the 32 bytes that follow the funcid, null if there are none).
+ */
+struct CMempoolCCKey
+{
+    uint8_t evalcode;
+    uint8_t funcid;
+    uint256 reftxid;
+
+    CMempoolCCKey(uint8_t evalcodeIn, uint8_t funcidIn, const uint256& reftxidIn) : evalcode(evalcodeIn), funcid(funcidIn), reftxid(reftxidIn) {}
+
+    bool operator<(const CMempoolCCKey& b) const
+    {
+        if (evalcode != b.evalcode)
+            return evalcode < b.evalcode;
+        if (funcid != b.funcid)
+            return funcid < b.funcid;
+        return reftxid < b.reftxid;
+    }
+};
+
+/**
+ * The keys a transaction is indexed under in the mempool cc index: one for the
+ * opreturn of its last vout and, for token oprets, one for the cc blob they
+ * carry. Defined with the cc utilities, as it decodes cc oprets.
+ */
+void GetMempoolCCKeys(const CTransaction& tx, std::vector<CMempoolCCKey>& keys);
+
 /** An inpoint - a combination of a transaction and an index n into its vin */
 class CInPoint
 {
@@ -148,6 +187,13 @@ private:
     uint64_t totalTxSize = 0; //! sum of all mempool tx' byte sizes
     uint64_t cachedInnerUsage; //! sum of dynamic memory usage of all the map elements (NOT the maps themselves)
 
+    CFeeRate minReasonableRelayFee; //! fee rate the rolling minimum fee is bumped by, and decays to
+    mutable int64_t lastRollingFeeUpdate;
+    mutable bool blockSinceLastRollingFeeBump;
+    mutable double rollingMinimumFeeRate; //! fee rate per kB needed to get into a full pool, decays exponentially
+    uint64_t nEvictedTx = 0; //! transactions evicted by TrimToSize
+    uint64_t nExpiredTx = 0; //! transactions removed by Expire
+
     std::map<uint256, const CTransaction*> mapRecentlyAddedTx;
     uint64_t nRecentlyAddedSequence = 0;
     uint64_t nNotifiedSequence = 0;
@@ -156,8 +202,19 @@ private:
     std::map<uint256, const CTransaction*> mapSaplingNullifiers;
 
     void checkNullifiers(ShieldedType type) const;
+
+    //! mempool mutations recorded while a checkpoint is open (see StartJournal)
+    struct CJournalOp
+    {
+        bool fAdded;
+        CTxMemPoolEntry entry;
+        CJournalOp(bool fAddedIn, const CTxMemPoolEntry& entryIn) : fAdded(fAddedIn), entry(entryIn) {}
+    };
+    std::vector<CJournalOp> vJournal;
+    int nJournalDepth = 0;
     
 public:
+    static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
     typedef boost::multi_index_container<
         CTxMemPoolEntry,
         boost::multi_index::indexed_by<
@@ -167,6 +224,11 @@ public:
             boost::multi_index::ordered_non_unique<
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByFee
+            >,
+            // sorted by entry time
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByEntryTime
             >
         >
     > indexed_transaction_set;
@@ -187,6 +249,15 @@ private:
     typedef std::map<uint256, std::vector<CSpentIndexKey> > mapSpentIndexInserted;
     mapSpentIndexInserted mapSpentInserted;
 
+    typedef std::set<std::pair<CMempoolCCKey, uint256> > ccIndexSet;
+    ccIndexSet setCCIndex;
+
+    typedef std::map<uint256, std::vector<CMempoolCCKey> > ccIndexInserted;
+    ccIndexInserted mapCCInserted;
+
+    void addCCIndex(const CTransaction &tx);
+    void removeCCIndex(const uint256 &txhash);
+
 public:
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
@@ -212,6 +283,12 @@ public:
     void addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
     bool getSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
     bool removeSpentIndex(const uint256 txhash);
+
+    /**
+     * Txids of the pool transactions indexed under evalcode and funcid, or under
+     * any funcid if it is 0, restricted to those referencing reftxid unless it is null.
+     */
+    void getCCIndex(uint8_t evalcode, uint8_t funcid, const uint256 &reftxid, std::vector<uint256> &txids);
     void remove(const CTransaction &tx, std::list<CTransaction>& removed, bool fRecursive = false);
     void removeWithAnchor(const uint256 &invalidRoot, ShieldedType type);
     void removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight, int flags);
@@ -221,6 +298,36 @@ public:
                         std::list<CTransaction>& conflicts, bool fCurrentEstimate = true);
     void removeWithoutBranchId(uint32_t nMemPoolBranchId);
     void clear();
+
+    /** Remove the transactions that entered the pool before time, with their descendants. Returns the number removed. */
+    int Expire(int64_t time);
+    /**
+     * Evict transactions until the dynamic memory usage of the pool is at most
+     * sizelimit. The victim is the transaction whose fee rate, or the fee rate of
+     * it together with its in-pool descendants if that is higher, is the lowest;
+     * its descendants go with it. The txids of evicted inputs no longer spent by
+     * anything in the pool are returned in pvNoSpendsRemaining, so the caller can
+     * drop them from the coins cache.
+     */
+    void TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRemaining = NULL);
+    /**
+     * The fee rate a transaction needs to enter a pool limited to sizelimit bytes.
+     * Raised past the fee rate of every package evicted by TrimToSize and halved
+     * every ROLLING_FEE_HALFLIFE seconds once blocks are found again.
+     */
+    CFeeRate GetMinFee(size_t sizelimit) const;
+
+    /**
+     * Open a mempool checkpoint: from now on every transaction added to or
+     * removed from the pool is journaled, so the cost of undoing is
+     * proportional to the changes made, not to the size of the pool.
+     * Checkpoints nest; the returned value identifies this one.
+     */
+    size_t StartJournal();
+    /** Close the innermost checkpoint keeping the changes made since it was opened */
+    void CommitJournal();
+    /** Close the innermost checkpoint undoing the changes made since it was opened */
+    void RollbackJournal(size_t checkpoint);
     void queryHashes(std::vector<uint256>& vtxid);
     void pruneSpent(const uint256& hash, CCoins &coins);
     unsigned int GetTransactionsUpdated() const;
@@ -253,6 +360,18 @@ public:
         return totalTxSize;
     }
 
+    uint64_t GetEvictedCount()
+    {
+        LOCK(cs);
+        return nEvictedTx;
+    }
+
+    uint64_t GetExpiredCount()
+    {
+        LOCK(cs);
+        return nExpiredTx;
+    }
+
     bool exists(uint256 hash) const
     {
         LOCK(cs);
@@ -5,8 +5,119 @@
 
 #include "validationinterface.h"
 
+#include "sync.h"
+#include "util.h"
+
+#include <deque>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
 static CMainSignals g_signals;
 
+/** Ordered queue of notifications and the thread delivering them */
+static CWaitableCriticalSection cs_validationQueue;
+static CConditionVariable condValidationQueue;
+static std::deque<boost::function<void ()> > validationQueue;
+//! Number of notifications queued and delivered so far, to tell when a sync point has been passed
+static uint64_t nValidationQueued = 0, nValidationDelivered = 0;
+static bool fValidationQueueRunning = false, fValidationQueueStop = false;
+static boost::thread threadValidationQueue;
+
+static void DeliverValidationNotification(const boost::function<void ()>& func)
+{
+    try {
+        func();
+    } catch (const std::exception& e) {
+        PrintExceptionContinue(&e, "ThreadValidationQueue()");
+    } catch (...) {
+        PrintExceptionContinue(NULL, "ThreadValidationQueue()");
+    }
+}
+
+static void ThreadValidationQueue()
+{
+    RenameThread("zcash-valnotify");
+    while (true) {
+        boost::function<void ()> func;
+        {
+            boost::unique_lock<boost::mutex> lock(cs_validationQueue);
+            while (validationQueue.empty() && !fValidationQueueStop)
+                condValidationQueue.wait(lock);
+            if (validationQueue.empty())
+                return; // stopping, and everything has been delivered
+            // Move it out rather than copy, the closures hold blocks and trees
+            func.swap(validationQueue.front());
+            validationQueue.pop_front();
+        }
+        DeliverValidationNotification(func);
+        {
+            boost::unique_lock<boost::mutex> lock(cs_validationQueue);
+            nValidationDelivered++;
+        }
+        condValidationQueue.notify_all();
+    }
+}
+
+void StartValidationInterfaceQueue()
+{
+    boost::unique_lock<boost::mutex> lock(cs_validationQueue);
+    if (fValidationQueueRunning)
+        return;
+    fValidationQueueStop = false;
+    fValidationQueueRunning = true;
+    threadValidationQueue = boost::thread(&ThreadValidationQueue);
+}
+
+void StopValidationInterfaceQueue()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs_validationQueue);
+        if (!fValidationQueueRunning)
+            return;
+        fValidationQueueStop = true;
+    }
+    condValidationQueue.notify_all();
+    threadValidationQueue.join();
+    boost::unique_lock<boost::mutex> lock(cs_validationQueue);
+    fValidationQueueRunning = false;
+}
+
+void QueueValidationNotification(const boost::function<void ()>& func)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs_validationQueue);
+        if (fValidationQueueRunning && !fValidationQueueStop) {
+            validationQueue.push_back(func);
+            nValidationQueued++;
+            condValidationQueue.notify_all();
+            return;
+        }
+    }
+    func();
+}
+
+void SyncWithValidationInterfaceQueue()
+{
+    boost::unique_lock<boost::mutex> lock(cs_validationQueue);
+    uint64_t nTarget = nValidationQueued;
+    while (fValidationQueueRunning && nValidationDelivered < nTarget)
+        condValidationQueue.wait(lock);
+}
+
+void LimitValidationInterfaceQueue()
+{
+    boost::unique_lock<boost::mutex> lock(cs_validationQueue);
+    while (fValidationQueueRunning && validationQueue.size() > MAX_VALIDATION_QUEUE_DEPTH)
+        condValidationQueue.wait(lock);
+}
+
+size_t ValidationInterfaceQueueDepth()
+{
+    boost::unique_lock<boost::mutex> lock(cs_validationQueue);
+    return validationQueue.size();
+}
+
 CMainSignals& GetMainSignals()
 {
     return g_signals;
@@ -14,7 +125,7 @@ CMainSignals& GetMainSignals()
 
 void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
-    g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
+    g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2, _3));
     g_signals.EraseTransaction.connect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
     g_signals.UpdatedTransaction.connect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
     g_signals.RescanWallet.connect(boost::bind(&CValidationInterface::RescanWallet, pwalletIn));
@@ -33,7 +144,7 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
     g_signals.UpdatedTransaction.disconnect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
     g_signals.EraseTransaction.disconnect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
-    g_signals.SyncTransaction.disconnect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
+    g_signals.SyncTransaction.disconnect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2, _3));
     g_signals.RescanWallet.disconnect(boost::bind(&CValidationInterface::RescanWallet, pwalletIn));
     g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
 }
@@ -51,8 +162,8 @@ void UnregisterAllValidationInterfaces() {
     g_signals.UpdatedBlockTip.disconnect_all_slots();
 }
 
-void SyncWithWallets(const CTransaction &tx, const CBlock *pblock) {
-    g_signals.SyncTransaction(tx, pblock);
+void SyncWithWallets(const CTransaction &tx, const CBlock *pblock, const CBlockIndex *pindex) {
+    g_signals.SyncTransaction(tx, pblock, pindex);
 }
 
 void EraseFromWallets(const uint256 &hash) {
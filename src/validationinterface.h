@@ -6,6 +6,7 @@
 #ifndef BITCOIN_VALIDATIONINTERFACE_H
 #define BITCOIN_VALIDATIONINTERFACE_H
 
+#include <boost/function.hpp>
 #include <boost/signals2/signal.hpp>
 
 #include "zcash/IncrementalMerkleTree.hpp"
@@ -26,20 +27,50 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn);
 void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
-/** Push an updated transaction to all registered wallets */
-void SyncWithWallets(const CTransaction& tx, const CBlock* pblock = NULL);
+/** Push an updated transaction to all registered wallets, with the block (and its index entry) it was confirmed in */
+void SyncWithWallets(const CTransaction& tx, const CBlock* pblock = NULL, const CBlockIndex* pindex = NULL);
 /** Erase a transaction from all registered wallets */
 void EraseFromWallets(const uint256 &hash);
 /** Rescan all registered wallets */
 void RescanWallets();
 
+/**
+ * Notifications about the active chain (SyncTransaction and ChainTip from
+ * connecting and disconnecting blocks, UpdatedBlockTip, SetBestChain and
+ * UpdatedTransaction) are delivered in order by a background thread, so slow
+ * subscribers don't hold up block validation. The thread holds no locks, so
+ * each notification carries the chain data it refers to (block index entry,
+ * block, commitment trees) and subscribers take cs_main themselves if they
+ * need more. Before StartValidationInterfaceQueue and after
+ * StopValidationInterfaceQueue they are delivered synchronously.
+ * BlockChecked, Inventory and Broadcast are always synchronous.
+ */
+static const size_t MAX_VALIDATION_QUEUE_DEPTH = 32;
+
+/** Start the thread delivering queued notifications */
+void StartValidationInterfaceQueue();
+/** Deliver everything still queued, stop the thread and go back to synchronous delivery */
+void StopValidationInterfaceQueue();
+/** Run func after all earlier queued notifications, or right away when the queue isn't running */
+void QueueValidationNotification(const boost::function<void ()>& func);
+/**
+ * Wait until every notification queued so far has been delivered, e.g. so an
+ * RPC call sees the wallet up to date with the chain. Must not be called with
+ * cs_main or any lock taken by the subscribers held.
+ */
+void SyncWithValidationInterfaceQueue();
+/** Wait while more than MAX_VALIDATION_QUEUE_DEPTH notifications are queued. Same requirements as SyncWithValidationInterfaceQueue. */
+void LimitValidationInterfaceQueue();
+/** Number of notifications waiting to be delivered */
+size_t ValidationInterfaceQueueDepth();
+
 class CValidationInterface {
 protected:
     virtual void UpdatedBlockTip(const CBlockIndex *pindex) {}
-    virtual void SyncTransaction(const CTransaction &tx, const CBlock *pblock) {}
+    virtual void SyncTransaction(const CTransaction &tx, const CBlock *pblock, const CBlockIndex *pindex) {}
     virtual void EraseFromWallet(const uint256 &hash) {}
     virtual void RescanWallet() {}
-    virtual void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, SproutMerkleTree sproutTree, SaplingMerkleTree saplingTree, bool added) {}
+    virtual void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, const SproutMerkleTree& sproutTree, const SaplingMerkleTree& saplingTree, bool added) {}
     virtual void SetBestChain(const CBlockLocator &locator) {}
     virtual void UpdatedTransaction(const uint256 &hash) {}
     virtual void Inventory(const uint256 &hash) {}
@@ -53,16 +84,16 @@ protected:
 struct CMainSignals {
     /** Notifies listeners of updated block chain tip */
     boost::signals2::signal<void (const CBlockIndex *)> UpdatedBlockTip;
-    /** Notifies listeners of updated transaction data (transaction, and optionally the block it is found in. */
-    boost::signals2::signal<void (const CTransaction &, const CBlock *)> SyncTransaction;
+    /** Notifies listeners of updated transaction data (transaction, and optionally the block it is found in and its index entry). */
+    boost::signals2::signal<void (const CTransaction &, const CBlock *, const CBlockIndex *)> SyncTransaction;
     /** Notifies listeners of an erased transaction. */
     boost::signals2::signal<void (const uint256 &)> EraseTransaction;
     /** Notifies listeners of the need to rescan the wallet. */
     boost::signals2::signal<void ()> RescanWallet;
     /** Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible). */
     boost::signals2::signal<void (const uint256 &)> UpdatedTransaction;
-    /** Notifies listeners of a change to the tip of the active block chain. */
-    boost::signals2::signal<void (const CBlockIndex *, const CBlock *, SproutMerkleTree, SaplingMerkleTree, bool)> ChainTip;
+    /** Notifies listeners of a change to the tip of the active block chain, with the commitment trees before a connected block or after a disconnected one. */
+    boost::signals2::signal<void (const CBlockIndex *, const CBlock *, const SproutMerkleTree&, const SaplingMerkleTree&, bool)> ChainTip;
     /** Notifies listeners of a new active block chain. */
     boost::signals2::signal<void (const CBlockLocator &)> SetBestChain;
     /** Notifies listeners about an inventory item being seen on the network. */
@@ -988,8 +988,9 @@ uint256 zeroid;
 UniValue NSPV_getinfo_req(int32_t reqht);
 UniValue NSPV_login(char *wifstr);
 UniValue NSPV_logout();
-UniValue NSPV_addresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,int32_t filter);
-UniValue NSPV_addressutxos(char *coinaddr,int32_t CCflag,int32_t skipcount,int32_t filter);
+UniValue NSPV_addresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,int32_t filter,struct NSPV_cursor *cursor);
+UniValue NSPV_addressutxos(char *coinaddr,int32_t CCflag,int32_t skipcount,int32_t filter,struct NSPV_cursor *cursor);
+int32_t NSPV_parsecursor(struct NSPV_cursor *ptr,std::string hexstr);
 UniValue NSPV_mempooltxids(char *coinaddr,int32_t CCflag,uint8_t funcid,uint256 txid,int32_t vout);
 UniValue NSPV_broadcast(char *hex);
 UniValue NSPV_spend(char *srcaddr,char *destaddr,int64_t satoshis);
@@ -1297,26 +1298,32 @@ UniValue nspv_login(const UniValue& params, bool fHelp, const CPubKey& mypk)
 
 UniValue nspv_listunspent(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
-    int32_t skipcount = 0,CCflag = 0;
-    if ( fHelp || params.size() > 3 )
-        throw runtime_error("nspv_listunspent [address [isCC [skipcount]]]\n");
+    int32_t skipcount = 0,CCflag = 0; struct NSPV_cursor cursor,*cursorp = 0;
+    if ( fHelp || params.size() > 4 )
+        throw runtime_error("nspv_listunspent [address [isCC [skipcount [continuation]]]]\n");
     if ( KOMODO_NSPV_FULLNODE )
         throw runtime_error("-nSPV=1 must be set to use nspv\n");
     if ( params.size() == 0 )
     {
         if ( NSPV_address.size() != 0 )
-            return(NSPV_addressutxos((char *)NSPV_address.c_str(),0,0,0));
-        else throw runtime_error("nspv_listunspent [address [isCC [skipcount]]]\n");
+            return(NSPV_addressutxos((char *)NSPV_address.c_str(),0,0,0,0));
+        else throw runtime_error("nspv_listunspent [address [isCC [skipcount [continuation]]]]\n");
     }
     if ( params.size() >= 1 )
     {
         if ( params.size() >= 2 )
             CCflag = atol((char *)params[1].get_str().c_str());
-        if ( params.size() == 3 )
+        if ( params.size() >= 3 )
             skipcount = atol((char *)params[2].get_str().c_str());
-        return(NSPV_addressutxos((char *)params[0].get_str().c_str(),CCflag,skipcount,0));
+        if ( params.size() == 4 ) // "" requests the first page
+        {
+            if ( NSPV_parsecursor(&cursor,params[3].get_str()) < 0 && params[3].get_str().size() != 0 )
+                throw runtime_error("invalid continuation\n");
+            cursorp = &cursor;
+        }
+        return(NSPV_addressutxos((char *)params[0].get_str().c_str(),CCflag,skipcount,0,cursorp));
     }
-    else throw runtime_error("nspv_listunspent [address [isCC [skipcount]]]\n");
+    else throw runtime_error("nspv_listunspent [address [isCC [skipcount [continuation]]]]\n");
 }
 
 UniValue nspv_mempool(const UniValue& params, bool fHelp, const CPubKey& mypk)
@@ -1342,27 +1349,33 @@ UniValue nspv_mempool(const UniValue& params, bool fHelp, const CPubKey& mypk)
 
 UniValue nspv_listtransactions(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
-    int32_t skipcount = 0,CCflag = 0;
-    if ( fHelp || params.size() > 3 )
-        throw runtime_error("nspv_listtransactions [address [isCC [skipcount]]]\n");
+    int32_t skipcount = 0,CCflag = 0; struct NSPV_cursor cursor,*cursorp = 0;
+    if ( fHelp || params.size() > 4 )
+        throw runtime_error("nspv_listtransactions [address [isCC [skipcount [continuation]]]]\n");
     if ( KOMODO_NSPV_FULLNODE )
         throw runtime_error("-nSPV=1 must be set to use nspv\n");
     if ( params.size() == 0 )
     {
         if ( NSPV_address.size() != 0 )
-            return(NSPV_addresstxids((char *)NSPV_address.c_str(),0,0,0));
-        else throw runtime_error("nspv_listtransactions [address [isCC [skipcount]]]\n");
+            return(NSPV_addresstxids((char *)NSPV_address.c_str(),0,0,0,0));
+        else throw runtime_error("nspv_listtransactions [address [isCC [skipcount [continuation]]]]\n");
     }
     if ( params.size() >= 1 )
     {
         if ( params.size() >= 2 )
             CCflag = atol((char *)params[1].get_str().c_str());
-        if ( params.size() == 3 )
+        if ( params.size() >= 3 )
             skipcount = atol((char *)params[2].get_str().c_str());
+        if ( params.size() == 4 ) // "" requests the first page
+        {
+            if ( NSPV_parsecursor(&cursor,params[3].get_str()) < 0 && params[3].get_str().size() != 0 )
+                throw runtime_error("invalid continuation\n");
+            cursorp = &cursor;
+        }
         //fprintf(stderr,"call txids cc.%d skip.%d\n",CCflag,skipcount);
-        return(NSPV_addresstxids((char *)params[0].get_str().c_str(),CCflag,skipcount,0));
+        return(NSPV_addresstxids((char *)params[0].get_str().c_str(),CCflag,skipcount,0,cursorp));
     }
-    else throw runtime_error("nspv_listtransactions [address [isCC [skipcount]]]\n");
+    else throw runtime_error("nspv_listtransactions [address [isCC [skipcount [continuation]]]]\n");
 }
 
 UniValue nspv_spentinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
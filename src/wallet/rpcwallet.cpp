@@ -3387,6 +3387,20 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp, const CPubKey& mypk)
 #endif
         } else if (benchmarktype == "verifyequihash") {
             sample_times.push_back(benchmark_verify_equihash());
+        } else if (benchmarktype == "sha256d64") {
+            // Number of 64-byte blobs hashed per sample
+            int nBlocks = 10000;
+            if (params.size() >= 3) {
+                nBlocks = params[2].get_int();
+            }
+            sample_times.push_back(benchmark_sha256d64(nBlocks));
+        } else if (benchmarktype == "merkleroot") {
+            // Number of transactions in the simulated block
+            int nLeaves = 10000;
+            if (params.size() >= 3) {
+                nLeaves = params[2].get_int();
+            }
+            sample_times.push_back(benchmark_merkle_root(nLeaves));
         } else if (benchmarktype == "validatelargetx") {
             // Number of inputs in the spending transaction that we will simulate
             int nInputs = 11130;
@@ -578,11 +578,14 @@ bool CWallet::ChangeWalletPassphrase(const SecureString& strOldWalletPassphrase,
 
 void CWallet::ChainTip(const CBlockIndex *pindex,
                        const CBlock *pblock,
-                       SproutMerkleTree sproutTree,
-                       SaplingMerkleTree saplingTree,
+                       const SproutMerkleTree& sproutTreeIn,
+                       const SaplingMerkleTree& saplingTreeIn,
                        bool added)
 {
     if (added) {
+        // IncrementNoteWitnesses appends the block's commitments to the trees
+        SproutMerkleTree sproutTree(sproutTreeIn);
+        SaplingMerkleTree saplingTree(saplingTreeIn);
         IncrementNoteWitnesses(pindex, pblock, sproutTree, saplingTree);
     } else {
         DecrementNoteWitnesses(pindex);
@@ -1585,7 +1588,11 @@ void CWallet::UpdateSaplingNullifierNoteMapForBlock(const CBlock *pblock) {
     }
 }
 
-bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb)
+/**
+ * pindexBlock is the index entry of the block wtxIn was confirmed in. Without it
+ * the block time is looked up in mapBlockIndex, which needs cs_main.
+ */
+bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb, const CBlockIndex* pindexBlock)
 {
     uint256 hash = wtxIn.GetHash();
 
@@ -1604,6 +1611,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         CWalletTx& wtx = (*ret.first).second;
         wtx.BindWallet(this);
         UpdateNullifierNoteMapWithTx(wtx);
+        RemoveStakeableSpends(wtx);
         bool fInsertedNew = ret.second;
         if (fInsertedNew)
         {
@@ -1613,7 +1621,13 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
             wtx.nTimeSmart = wtx.nTimeReceived;
             if (!wtxIn.hashBlock.IsNull())
             {
-                if (mapBlockIndex.count(wtxIn.hashBlock))
+                if (pindexBlock == NULL)
+                {
+                    BlockMap::const_iterator mi = mapBlockIndex.find(wtxIn.hashBlock);
+                    if (mi != mapBlockIndex.end())
+                        pindexBlock = mi->second;
+                }
+                if (pindexBlock != NULL)
                 {
                     int64_t latestNow = wtx.nTimeReceived;
                     int64_t latestEntry = 0;
@@ -1647,7 +1661,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
                         }
                     }
 
-                    int64_t blocktime = mapBlockIndex[wtxIn.hashBlock]->GetBlockTime();
+                    int64_t blocktime = pindexBlock->GetBlockTime();
                     wtx.nTimeSmart = std::max(latestEntry, std::min(blocktime, latestNow));
                 }
                 else
@@ -1750,9 +1764,10 @@ bool CWallet::UpdatedNoteData(const CWalletTx& wtxIn, CWalletTx& wtx)
 /**
  * Add a transaction to the wallet, or update it.
  * pblock is optional, but should be provided if the transaction is known to be in a block.
+ * pindex is the index entry of pblock; callers not holding cs_main must pass it.
  * If fUpdate is true, existing transactions will be updated.
  */
-bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate)
+bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate, const CBlockIndex* pindex)
 {
     {
         AssertLockHeld(cs_wallet);
@@ -1790,7 +1805,8 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pbl
                     {
                         if (fIsFromWhiteList) break;
                         uint256 hashBlock; CTransaction prevTx; CTxDestination dest;
-                        if (GetTransaction(txin.prevout.hash, prevTx, hashBlock, true) && ExtractDestination(prevTx.vout[txin.prevout.n].scriptPubKey,dest))
+                        // not GetTransaction, which takes cs_main while cs_wallet is held
+                        if (myGetTransaction(txin.prevout.hash, prevTx, hashBlock) && ExtractDestination(prevTx.vout[txin.prevout.n].scriptPubKey,dest))
                         {
                             BOOST_FOREACH(const std::string& strWhiteListAddress, mapMultiArgs["-whitelistaddress"])
                             {
@@ -1831,19 +1847,38 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pbl
             // this is safe, as in case of a crash, we rescan the necessary blocks on startup through our SetBestChain-mechanism
             CWalletDB walletdb(strWalletFile, "r+", false);
 
-            return AddToWallet(wtx, false, &walletdb);
+            return AddToWallet(wtx, false, &walletdb, pindex);
         }
     }
     return false;
 }
 
-void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
+void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock, const CBlockIndex* pindex)
 {
-    LOCK(cs_wallet);
-    if (!AddToWalletIfInvolvingMe(tx, pblock, true))
-        return; // Not one of ours
+    // Queued notifications arrive without cs_main. It is only needed to find a
+    // missing pindex and for the spent checks of confirmed stakeable outputs,
+    // and must be taken before cs_wallet.
+    if (pblock != NULL && pindex == NULL)
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(pblock->GetHash());
+        if (mi != mapBlockIndex.end())
+            pindex = mi->second;
+    }
+    {
+        LOCK(cs_wallet);
+        if (!AddToWalletIfInvolvingMe(tx, pblock, true, pindex))
+            return; // Not one of ours
 
-    MarkAffectedTransactionsDirty(tx);
+        MarkAffectedTransactionsDirty(tx);
+        if (pblock == NULL)
+        {
+            AddStakeableOutputs(tx, NULL);
+            return;
+        }
+    }
+    LOCK2(cs_main, cs_wallet);
+    AddStakeableOutputs(tx, pindex);
 }
 
 void CWallet::MarkAffectedTransactionsDirty(const CTransaction& tx)
@@ -1881,7 +1916,10 @@ void CWallet::EraseFromWallet(const uint256 &hash)
     {
         LOCK(cs_wallet);
         if (mapWallet.erase(hash))
+        {
             CWalletDB(strWalletFile).EraseTx(hash);
+            MarkStakeableDirty();
+        }
     }
     return;
 }
@@ -2890,7 +2928,7 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
             ReadBlockFromDisk(block, pindex,1);
             BOOST_FOREACH(CTransaction& tx, block.vtx)
             {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate)) {
+                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate, pindex)) {
                     myTxHashes.push_back(tx.GetHash());
                     ret++;
                 }
@@ -2929,6 +2967,7 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
         }
 
         ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+        MarkStakeableDirty();
     }
     return ret;
 }
@@ -3459,6 +3498,132 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
     }
 }
 
+void CWallet::MarkStakeableDirty()
+{
+    LOCK(cs_stakeable);
+    fStakeableDirty = true;
+    nStakeableGeneration++;
+}
+
+void CWallet::RemoveStakeableSpends(const CTransaction& tx)
+{
+    if (tx.IsCoinBase())
+        return;
+    LOCK(cs_stakeable);
+    bool fChanged = false;
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    {
+        if (mapStakeable.erase(txin.prevout) != 0)
+            fChanged = true;
+    }
+    if (fChanged)
+        nStakeableGeneration++;
+}
+
+void CWallet::AddStakeableOutputs(const CTransaction& tx, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_wallet);
+    uint256 hash = tx.GetHash();
+    if (pindex == NULL)
+    {
+        // a confirmed tx of ours going back to 0-confirmed means a reorg is in
+        // progress, so the outputs it spent may be ours to stake again
+        LOCK(cs_stakeable);
+        for (int i = 0; i < tx.vout.size(); i++)
+        {
+            if (mapStakeable.count(COutPoint(hash, i)) != 0)
+            {
+                fStakeableDirty = true;
+                nStakeableGeneration++;
+                break;
+            }
+        }
+        return;
+    }
+    // the block may have been disconnected again before the notification was delivered
+    AssertLockHeld(cs_main);
+    if (!chainActive.Contains(pindex))
+        return;
+
+    int32_t nSpendHeight = pindex->GetHeight();
+    if (tx.IsCoinBase())
+    {
+        // same rules as CMerkleTx::GetBlocksToMaturity()
+        if ( ASSETCHAINS_SYMBOL[0] == 0 )
+            COINBASE_MATURITY = _COINBASE_MATURITY;
+        nSpendHeight = std::max(nSpendHeight, (int32_t)(pindex->GetHeight() + COINBASE_MATURITY - 1));
+        nSpendHeight = std::max(nSpendHeight, (int32_t)tx.UnlockTime(0));
+    }
+
+    LOCK(cs_stakeable);
+    bool fChanged = false;
+    for (int i = 0; i < tx.vout.size(); i++)
+    {
+        const CTxOut& txout = tx.vout[i];
+        if (txout.nValue <= 0 || (IsMine(txout) & ISMINE_SPENDABLE) == ISMINE_NO)
+            continue;
+        if (IsSpent(hash, i) || IsLockedCoin(hash, i))
+            continue;
+        CStakeableOutput& out = mapStakeable[COutPoint(hash, i)];
+        out.txid = hash;
+        out.vout = i;
+        out.nValue = txout.nValue;
+        out.scriptPubKey = txout.scriptPubKey;
+        out.nHeight = pindex->GetHeight();
+        out.nSpendHeight = nSpendHeight;
+        out.nBlockTime = pindex->nTime;
+        fChanged = true;
+    }
+    if (fChanged)
+        nStakeableGeneration++;
+}
+
+void CWallet::RebuildStakeableOutputs()
+{
+    vector<COutput> vecOutputs;
+    std::map<COutPoint, CStakeableOutput> mapNew;
+
+    LOCK2(cs_main, cs_wallet);
+    AvailableCoins(vecOutputs, false, NULL, true);
+    BOOST_FOREACH(const COutput& coin, vecOutputs)
+    {
+        if (coin.nDepth < 1 || !coin.fSpendable)
+            continue;
+        BlockMap::const_iterator mi = mapBlockIndex.find(coin.tx->hashBlock);
+        if (mi == mapBlockIndex.end() || mi->second == NULL)
+            continue;
+        CStakeableOutput& out = mapNew[COutPoint(coin.tx->GetHash(), coin.i)];
+        out.txid = coin.tx->GetHash();
+        out.vout = coin.i;
+        out.nValue = coin.tx->vout[coin.i].nValue;
+        out.scriptPubKey = coin.tx->vout[coin.i].scriptPubKey;
+        out.nHeight = mi->second->GetHeight();
+        // AvailableCoins already skipped immature coinbases
+        out.nSpendHeight = out.nHeight;
+        out.nBlockTime = mi->second->nTime;
+    }
+
+    LOCK(cs_stakeable);
+    mapStakeable.swap(mapNew);
+    fStakeableDirty = false;
+    nStakeableGeneration++;
+}
+
+bool CWallet::GetStakeableOutputs(vector<CStakeableOutput>& vOutputs, uint64_t& nGeneration) const
+{
+    LOCK(cs_stakeable);
+    if (fStakeableDirty)
+        return false;
+    if (nGeneration == nStakeableGeneration)
+        return true;
+    vOutputs.clear();
+    vOutputs.reserve(mapStakeable.size());
+    for (std::map<COutPoint, CStakeableOutput>::const_iterator it = mapStakeable.begin(); it != mapStakeable.end(); ++it)
+        vOutputs.push_back(it->second);
+    nGeneration = nStakeableGeneration;
+    return true;
+}
+
 static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > >vValue, const CAmount& nTotalLower, const CAmount& nTargetValue,vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
 {
     vector<char> vfIncluded;
@@ -4275,6 +4440,7 @@ DBErrors CWallet::ZapWalletTx(std::vector<CWalletTx>& vWtx)
     if (nZapWalletTxRet != DB_LOAD_OK)
         return nZapWalletTxRet;
 
+    MarkStakeableDirty();
     return DB_LOAD_OK;
 }
 
@@ -4687,18 +4853,21 @@ void CWallet::LockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    MarkStakeableDirty();
 }
 
 void CWallet::UnlockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    MarkStakeableDirty();
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.clear();
+    MarkStakeableDirty();
 }
 
 bool CWallet::IsLockedCoin(uint256 hash, unsigned int n) const
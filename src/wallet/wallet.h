@@ -629,6 +629,25 @@ public:
 };
 
 
+/** A confirmed, spendable transparent wallet output cached for the PoS staker. */
+class CStakeableOutput
+{
+public:
+    uint256 txid;
+    int32_t vout;
+    CAmount nValue;
+    CScript scriptPubKey;
+    int32_t nHeight;        //! height of the block that confirmed the output
+    int32_t nSpendHeight;   //! lowest tip height at which the output is mature
+    uint32_t nBlockTime;    //! time of the block that confirmed the output
+
+    CStakeableOutput() : vout(0), nValue(0), nHeight(0), nSpendHeight(0), nBlockTime(0) {}
+
+    int GetDepth(int nTipHeight) const { return nTipHeight - nHeight + 1; }
+    bool IsMature(int nTipHeight) const { return nTipHeight >= nSpendHeight; }
+};
+
+
 
 
 /** Private key that includes an expiration date in case it never gets used. */
@@ -865,6 +884,23 @@ protected:
     /* the hd chain data model (chain counters) */
     CHDChain hdChain;
 
+    /**
+     * Spendable transparent outputs that can be used for PoS staking, keyed by
+     * outpoint and kept up to date as transactions are synced into the wallet.
+     * The staker reads it under cs_stakeable only, so it does not contend for
+     * cs_main or cs_wallet. Anything that cannot be applied incrementally
+     * (reorgs, rescans, erased transactions, coin locks) sets
+     * fStakeableDirty and the next reader rebuilds it from AvailableCoins.
+     */
+    mutable CCriticalSection cs_stakeable;
+    std::map<COutPoint, CStakeableOutput> mapStakeable;
+    uint64_t nStakeableGeneration;
+    bool fStakeableDirty;
+
+    void AddStakeableOutputs(const CTransaction& tx, const CBlockIndex* pindex);
+    void RemoveStakeableSpends(const CTransaction& tx);
+    void MarkStakeableDirty();
+
 public:
     /*
      * Main wallet lock.
@@ -919,6 +955,8 @@ public:
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
         nWitnessCacheSize = 0;
+        nStakeableGeneration = 1;
+        fStakeableDirty = true;
     }
 
     /**
@@ -1006,6 +1044,14 @@ public:
     void UnlockAllCoins();
     void ListLockedCoins(std::vector<COutPoint>& vOutpts);
 
+    /**
+     * Copy the cached stakeable outputs into vOutputs. If nGeneration already
+     * matches the view nothing is copied. Returns false if the view is dirty
+     * and RebuildStakeableOutputs() has to be called first.
+     */
+    bool GetStakeableOutputs(std::vector<CStakeableOutput>& vOutputs, uint64_t& nGeneration) const;
+    void RebuildStakeableOutputs();
+
     bool IsLockedNote(const JSOutPoint& outpt) const;
     void LockNote(const JSOutPoint& output);
     void UnlockNote(const JSOutPoint& output);
@@ -1135,11 +1181,11 @@ public:
     void UpdateNullifierNoteMapWithTx(const CWalletTx& wtx);
     void UpdateSaplingNullifierNoteMapWithTx(CWalletTx& wtx);
     void UpdateSaplingNullifierNoteMapForBlock(const CBlock* pblock);
-    bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb);
+    bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb, const CBlockIndex* pindexBlock = NULL);
     void EraseFromWallet(const uint256 &hash);
-    void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock, const CBlockIndex* pindex);
     void RescanWallet();
-    bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
+    bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate, const CBlockIndex* pindex = NULL);
     void WitnessNoteCommitment(
          std::vector<uint256> commitments,
          std::vector<boost::optional<SproutWitness>>& witnesses,
@@ -1210,7 +1256,7 @@ public:
     CAmount GetCredit(const CTransaction& tx, int32_t voutNum, const isminefilter& filter) const;
     CAmount GetCredit(const CTransaction& tx, const isminefilter& filter) const;
     CAmount GetChange(const CTransaction& tx) const;
-    void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, SproutMerkleTree sproutTree, SaplingMerkleTree saplingTree, bool added);
+    void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, const SproutMerkleTree& sproutTree, const SaplingMerkleTree& saplingTree, bool added);
     /** Saves witness caches and best block locator to disk. */
     void SetBestChain(const CBlockLocator& loc);
     std::set<std::pair<libzcash::PaymentAddress, uint256>> GetNullifiersForAddresses(const std::set<libzcash::PaymentAddress> & addresses);
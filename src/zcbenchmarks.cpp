@@ -11,6 +11,7 @@
 #include "primitives/transaction.h"
 #include "base58.h"
 #include "crypto/equihash.h"
+#include "crypto/sha256.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "consensus/upgrades.h"
@@ -18,6 +19,7 @@
 #include "main.h"
 #include "miner.h"
 #include "pow.h"
+#include "random.h"
 #include "rpc/server.h"
 #include "script/sign.h"
 #include "sodium.h"
@@ -225,6 +227,30 @@ double benchmark_verify_equihash()
     return timer_stop(tv_start);
 }
 
+double benchmark_sha256d64(size_t nBlocks)
+{
+    // Double-SHA256 of nBlocks independent 64-byte blobs, as hashed for
+    // each level of a merkle tree, using the back-ends SHA256AutoDetect chose.
+    std::vector<unsigned char> in(nBlocks * 64), out(nBlocks * 32);
+    GetRandBytes(in.data(), in.size());
+    struct timeval tv_start;
+    timer_start(tv_start);
+    SHA256D64(out.data(), in.data(), nBlocks);
+    return timer_stop(tv_start);
+}
+
+double benchmark_merkle_root(size_t nLeaves)
+{
+    std::vector<uint256> leaves(nLeaves), tree;
+    for (size_t i = 0; i < nLeaves; i++)
+        leaves[i] = GetRandHash();
+    bool fMutated;
+    struct timeval tv_start;
+    timer_start(tv_start);
+    BuildMerkleTree(&fMutated, leaves, tree);
+    return timer_stop(tv_start);
+}
+
 double benchmark_large_tx(size_t nInputs)
 {
     // Create priv/pub key